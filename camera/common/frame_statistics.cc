@@ -0,0 +1,245 @@
+/*
+ * Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "common/frame_statistics.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+
+#include "cros-camera/common.h"
+
+namespace cros {
+
+namespace {
+
+// Rows are accumulated in chunks of at most this many samples, so that the
+// 32-bit vector lanes summing the squares cannot overflow.
+constexpr uint32_t kMaxChunkSize = 4096;
+
+struct Accumulator {
+  uint64_t sum = 0;
+  uint64_t sum_of_squares = 0;
+  uint8_t max = 0;
+};
+
+// Accumulates |count| samples at |row|, |step| bytes apart.
+void AccumulateSamples(const uint8_t* row,
+                       uint32_t count,
+                       uint32_t step,
+                       Accumulator* acc) {
+  uint64_t sum = 0;
+  uint64_t sum_of_squares = 0;
+  uint8_t max = acc->max;
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t value = row[i * step];
+    sum += value;
+    sum_of_squares += value * value;
+    max = std::max(max, static_cast<uint8_t>(value));
+  }
+  acc->sum += sum;
+  acc->sum_of_squares += sum_of_squares;
+  acc->max = max;
+}
+
+// Accumulates |count| samples at |row|, |kStep| bytes apart, with SIMD
+// instructions. The samples that do not fill a vector are accumulated one by
+// one.
+template <uint32_t kStep>
+void AccumulateRow(const uint8_t* row, uint32_t count, Accumulator* acc) {
+  static_assert(kStep == 1 || kStep == 2, "Only steps of 1 or 2 are SIMD");
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  // A vector holds 16 bytes, i.e. 16 samples or 8 samples and the odd bytes
+  // between them.
+  constexpr uint32_t kSamplesPerVector = 16 / kStep;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask =
+      kStep == 1 ? _mm_set1_epi8(-1) : _mm_set1_epi16(0x00ff);
+  __m128i max = zero;
+  // The loads may not read past the last sample.
+  while (count - i >= kSamplesPerVector + kStep - 1) {
+    const uint32_t end =
+        i + std::min((count - i - (kStep - 1)) / kSamplesPerVector *
+                         kSamplesPerVector,
+                     kMaxChunkSize);
+    __m128i sum = zero;             // 2 x u64.
+    __m128i sum_of_squares = zero;  // 4 x u32.
+    for (; i < end; i += kSamplesPerVector) {
+      const __m128i v = _mm_and_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i * kStep)),
+          mask);
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+      if (kStep == 1) {
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+        sum_of_squares =
+            _mm_add_epi32(sum_of_squares, _mm_madd_epi16(lo, lo));
+        sum_of_squares =
+            _mm_add_epi32(sum_of_squares, _mm_madd_epi16(hi, hi));
+      } else {
+        // The samples already fill the low bytes of 16-bit lanes.
+        sum_of_squares = _mm_add_epi32(sum_of_squares, _mm_madd_epi16(v, v));
+      }
+      max = _mm_max_epu8(max, v);
+    }
+    alignas(16) uint64_t sums[2];
+    alignas(16) uint32_t squares[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(squares), sum_of_squares);
+    acc->sum += sums[0] + sums[1];
+    acc->sum_of_squares += static_cast<uint64_t>(squares[0]) + squares[1] +
+                           squares[2] + squares[3];
+  }
+  alignas(16) uint8_t maxes[16];
+  _mm_store_si128(reinterpret_cast<__m128i*>(maxes), max);
+  acc->max = std::max(acc->max, *std::max_element(maxes, maxes + 16));
+#elif defined(__ARM_NEON)
+  // vld2q_u8() deinterleaves 32 bytes, so a vector always holds 16 samples.
+  constexpr uint32_t kSamplesPerVector = 16;
+  uint8x16_t max = vdupq_n_u8(0);
+  // The loads may not read past the last sample.
+  while (count - i >= kSamplesPerVector + kStep - 1) {
+    const uint32_t end =
+        i + std::min((count - i - (kStep - 1)) / kSamplesPerVector *
+                         kSamplesPerVector,
+                     kMaxChunkSize);
+    uint32x4_t sum = vdupq_n_u32(0);
+    uint32x4_t sum_of_squares = vdupq_n_u32(0);
+    for (; i < end; i += kSamplesPerVector) {
+      const uint8x16_t v =
+          kStep == 1 ? vld1q_u8(row + i) : vld2q_u8(row + i * kStep).val[0];
+      sum = vpadalq_u16(sum, vpaddlq_u8(v));
+      sum_of_squares = vpadalq_u16(sum_of_squares,
+                                   vmull_u8(vget_low_u8(v), vget_low_u8(v)));
+      sum_of_squares = vpadalq_u16(
+          sum_of_squares, vmull_u8(vget_high_u8(v), vget_high_u8(v)));
+      max = vmaxq_u8(max, v);
+    }
+    uint32_t sums[4];
+    uint32_t squares[4];
+    vst1q_u32(sums, sum);
+    vst1q_u32(squares, sum_of_squares);
+    acc->sum += static_cast<uint64_t>(sums[0]) + sums[1] + sums[2] + sums[3];
+    acc->sum_of_squares += static_cast<uint64_t>(squares[0]) + squares[1] +
+                           squares[2] + squares[3];
+  }
+  uint8_t maxes[16];
+  vst1q_u8(maxes, max);
+  acc->max = std::max(acc->max, *std::max_element(maxes, maxes + 16));
+#endif
+  AccumulateSamples(row + i * kStep, count - i, kStep, acc);
+}
+
+using Histograms = std::array<std::array<uint32_t, 256>, 4>;
+
+// Adds the |count| samples at |row|, |step| bytes apart, to |histograms|.
+// Consecutive samples go to different histograms, so that the increments of
+// repeated values do not depend on each other.
+void AccumulateHistograms(const uint8_t* row,
+                          uint32_t count,
+                          uint32_t step,
+                          Histograms* histograms) {
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    ++(*histograms)[0][row[i * step]];
+    ++(*histograms)[1][row[(i + 1) * step]];
+    ++(*histograms)[2][row[(i + 2) * step]];
+    ++(*histograms)[3][row[(i + 3) * step]];
+  }
+  for (; i < count; ++i) {
+    ++(*histograms)[0][row[i * step]];
+  }
+}
+
+}  // namespace
+
+double PlaneStatistics::mean() const {
+  if (num_samples == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(sum) / num_samples;
+}
+
+double PlaneStatistics::variance() const {
+  if (num_samples == 0) {
+    return 0.0;
+  }
+  const double sum_of_deviations =
+      static_cast<double>(sum_of_squares) - static_cast<double>(sum) * mean();
+  return std::max(sum_of_deviations / num_samples, 0.0);
+}
+
+std::optional<PlaneStatistics> ComputePlaneStatistics(
+    const uint8_t* data,
+    uint32_t stride,
+    uint32_t width,
+    uint32_t height,
+    const PlaneStatisticsOptions& options) {
+  const Rect<uint32_t> roi = options.roi.is_valid()
+                                 ? options.roi
+                                 : Rect<uint32_t>(0, 0, width, height);
+  if (data == nullptr || options.subsample == 0 || !roi.is_valid() ||
+      roi.left >= width || roi.width > width - roi.left ||
+      roi.top >= height || roi.height > height - roi.top) {
+    LOGF(ERROR) << "Invalid region " << roi.ToString() << " with subsample "
+                << options.subsample << " for a " << width << "x" << height
+                << " plane";
+    return std::nullopt;
+  }
+
+  const uint32_t step = options.subsample;
+  const uint32_t samples_per_row = (roi.width + step - 1) / step;
+  const uint32_t num_rows = (roi.height + step - 1) / step;
+  const uint8_t* first_row =
+      data + static_cast<size_t>(stride) * roi.top + roi.left;
+  const size_t row_step = static_cast<size_t>(stride) * step;
+
+  PlaneStatistics stats;
+  stats.num_samples = samples_per_row * num_rows;
+  if (options.compute_histogram) {
+    Histograms histograms = {};
+    for (uint32_t y = 0; y < num_rows; ++y) {
+      AccumulateHistograms(first_row + row_step * y, samples_per_row, step,
+                           &histograms);
+    }
+    // The other statistics are derived from the histogram.
+    std::array<uint32_t, 256>& histogram = stats.histogram.emplace();
+    for (uint32_t value = 0; value < histogram.size(); ++value) {
+      histogram[value] = histograms[0][value] + histograms[1][value] +
+                         histograms[2][value] + histograms[3][value];
+      stats.sum += static_cast<uint64_t>(histogram[value]) * value;
+      stats.sum_of_squares +=
+          static_cast<uint64_t>(histogram[value]) * value * value;
+      if (histogram[value] > 0) {
+        stats.max = value;
+      }
+    }
+    return stats;
+  }
+
+  Accumulator acc;
+  for (uint32_t y = 0; y < num_rows; ++y) {
+    const uint8_t* row = first_row + row_step * y;
+    if (step == 1) {
+      AccumulateRow<1>(row, samples_per_row, &acc);
+    } else if (step == 2) {
+      AccumulateRow<2>(row, samples_per_row, &acc);
+    } else {
+      AccumulateSamples(row, samples_per_row, step, &acc);
+    }
+  }
+  stats.sum = acc.sum;
+  stats.sum_of_squares = acc.sum_of_squares;
+  stats.max = acc.max;
+  return stats;
+}
+
+}  // namespace cros
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CAMERA_COMMON_FRAME_STATISTICS_H_
+#define CAMERA_COMMON_FRAME_STATISTICS_H_
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include "cros-camera/common_types.h"
+
+namespace cros {
+
+// Statistics of the samples of an 8-bit image plane, e.g. the Y plane of a
+// NV12 frame.
+struct PlaneStatistics {
+  // Number of samples the statistics are computed from.
+  uint32_t num_samples = 0;
+  uint64_t sum = 0;
+  uint64_t sum_of_squares = 0;
+  uint8_t max = 0;
+
+  // Number of samples of each value. Only computed when requested with
+  // PlaneStatisticsOptions::compute_histogram.
+  std::optional<std::array<uint32_t, 256>> histogram;
+
+  double mean() const;
+  // The population variance of the samples.
+  double variance() const;
+};
+
+struct PlaneStatisticsOptions {
+  // The region of the plane to sample. The whole plane is sampled if |roi| is
+  // empty.
+  Rect<uint32_t> roi;
+
+  // Only every |subsample|-th row and column of |roi| are sampled.
+  uint32_t subsample = 1;
+
+  bool compute_histogram = false;
+};
+
+// Computes the statistics of the |width|x|height| plane at |data| in a single
+// pass over the plane. The rows are processed with SIMD instructions when no
+// histogram is computed and |options.subsample| is 1 or 2. Returns
+// std::nullopt if |options| does not select any sample inside the plane.
+std::optional<PlaneStatistics> ComputePlaneStatistics(
+    const uint8_t* data,
+    uint32_t stride,
+    uint32_t width,
+    uint32_t height,
+    const PlaneStatisticsOptions& options = {});
+
+}  // namespace cros
+
+#endif  // CAMERA_COMMON_FRAME_STATISTICS_H_
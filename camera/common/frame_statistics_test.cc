@@ -0,0 +1,228 @@
+/*
+ * Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "common/frame_statistics.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/timer/elapsed_timer.h>
+#include <gtest/gtest.h>
+
+namespace cros {
+
+namespace {
+
+// A plane whose rows are padded, to check that the padding is not sampled.
+struct TestPlane {
+  TestPlane(uint32_t width, uint32_t height, uint32_t seed)
+      : width(width), height(height), stride(width + 13) {
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    data.resize(static_cast<size_t>(stride) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+      for (uint32_t x = 0; x < stride; ++x) {
+        data[y * stride + x] = x < width ? distribution(generator) : 255;
+      }
+    }
+  }
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  std::vector<uint8_t> data;
+};
+
+// Computes the statistics sample by sample.
+PlaneStatistics ComputeReference(const TestPlane& plane,
+                                 const Rect<uint32_t>& roi,
+                                 uint32_t subsample) {
+  PlaneStatistics stats;
+  stats.histogram.emplace();
+  stats.histogram->fill(0);
+  for (uint32_t y = roi.top; y < roi.top + roi.height; y += subsample) {
+    for (uint32_t x = roi.left; x < roi.left + roi.width; x += subsample) {
+      const uint8_t value = plane.data[y * plane.stride + x];
+      ++stats.num_samples;
+      stats.sum += value;
+      stats.sum_of_squares += value * value;
+      stats.max = std::max(stats.max, value);
+      ++(*stats.histogram)[value];
+    }
+  }
+  return stats;
+}
+
+void ExpectEqual(const PlaneStatistics& actual,
+                 const PlaneStatistics& expected) {
+  EXPECT_EQ(actual.num_samples, expected.num_samples);
+  EXPECT_EQ(actual.sum, expected.sum);
+  EXPECT_EQ(actual.sum_of_squares, expected.sum_of_squares);
+  EXPECT_EQ(actual.max, expected.max);
+}
+
+// The two-pass computation PrivacyShutterDetectorImpl used to do.
+void ComputeTwoPass(const TestPlane& plane, double* mean, double* variance) {
+  double sum = 0;
+  for (uint32_t y = 0; y < plane.height; y++) {
+    for (uint32_t x = 0; x < plane.width; x++) {
+      sum += plane.data[plane.stride * y + x];
+    }
+  }
+  *mean = sum / plane.width / plane.height;
+  double var = 0;
+  for (uint32_t y = 0; y < plane.height; y++) {
+    for (uint32_t x = 0; x < plane.width; x++) {
+      var += pow(plane.data[plane.stride * y + x] - *mean, 2);
+    }
+  }
+  *variance = var / plane.width / plane.height;
+}
+
+}  // namespace
+
+TEST(FrameStatisticsTest, WholePlane) {
+  // Widths around the vector size, and one over the chunk size.
+  for (uint32_t width : {1, 15, 16, 17, 31, 640, 4096 + 37}) {
+    TestPlane plane(width, 7, width);
+    std::optional<PlaneStatistics> stats = ComputePlaneStatistics(
+        plane.data.data(), plane.stride, plane.width, plane.height);
+    ASSERT_TRUE(stats.has_value()) << "width " << width;
+    EXPECT_FALSE(stats->histogram.has_value());
+    ExpectEqual(*stats, ComputeReference(
+                            plane, Rect<uint32_t>(0, 0, width, plane.height),
+                            /*subsample=*/1));
+  }
+}
+
+TEST(FrameStatisticsTest, MeanAndVariance) {
+  TestPlane plane(320, 240, 1);
+  std::optional<PlaneStatistics> stats = ComputePlaneStatistics(
+      plane.data.data(), plane.stride, plane.width, plane.height);
+  ASSERT_TRUE(stats.has_value());
+  double mean, variance;
+  ComputeTwoPass(plane, &mean, &variance);
+  EXPECT_NEAR(stats->mean(), mean, 1e-9);
+  EXPECT_NEAR(stats->variance(), variance, 1e-6);
+}
+
+TEST(FrameStatisticsTest, SaturatedPlane) {
+  // The sum of squares of a 4K plane overflows 32 bits many times over.
+  const uint32_t width = 3840;
+  const uint32_t height = 2160;
+  std::vector<uint8_t> data(width * height, 255);
+  std::optional<PlaneStatistics> stats =
+      ComputePlaneStatistics(data.data(), width, width, height);
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->sum, 255ull * width * height);
+  EXPECT_EQ(stats->sum_of_squares, 255ull * 255 * width * height);
+  EXPECT_EQ(stats->max, 255);
+  EXPECT_EQ(stats->mean(), 255.0);
+  EXPECT_EQ(stats->variance(), 0.0);
+}
+
+TEST(FrameStatisticsTest, RegionOfInterestAndSubsampling) {
+  TestPlane plane(200, 100, 2);
+  const Rect<uint32_t> roi(33, 10, 101, 51);
+  for (uint32_t subsample : {1, 2, 3}) {
+    for (bool compute_histogram : {false, true}) {
+      PlaneStatisticsOptions options = {
+          .roi = roi,
+          .subsample = subsample,
+          .compute_histogram = compute_histogram,
+      };
+      std::optional<PlaneStatistics> stats =
+          ComputePlaneStatistics(plane.data.data(), plane.stride, plane.width,
+                                 plane.height, options);
+      ASSERT_TRUE(stats.has_value());
+      PlaneStatistics expected = ComputeReference(plane, roi, subsample);
+      ExpectEqual(*stats, expected);
+      EXPECT_EQ(stats->histogram.has_value(), compute_histogram);
+      if (compute_histogram) {
+        EXPECT_EQ(*stats->histogram, *expected.histogram);
+      }
+    }
+  }
+}
+
+TEST(FrameStatisticsTest, SubsampledPlaneWithoutPadding) {
+  // Subsampled rows are read with vectors too, which may not read past the
+  // last sample of the plane.
+  for (uint32_t width : {15, 16, 17, 32, 33, 34, 8192 + 18}) {
+    TestPlane padded(width, 3, width);
+    std::vector<uint8_t> data;
+    for (uint32_t y = 0; y < padded.height; ++y) {
+      data.insert(data.end(), padded.data.begin() + y * padded.stride,
+                  padded.data.begin() + y * padded.stride + width);
+    }
+    data.shrink_to_fit();
+    std::optional<PlaneStatistics> stats = ComputePlaneStatistics(
+        data.data(), width, width, padded.height, {.subsample = 2});
+    ASSERT_TRUE(stats.has_value()) << "width " << width;
+    ExpectEqual(*stats,
+                ComputeReference(padded,
+                                 Rect<uint32_t>(0, 0, width, padded.height),
+                                 /*subsample=*/2));
+  }
+}
+
+TEST(FrameStatisticsTest, InvalidOptions) {
+  TestPlane plane(64, 48, 3);
+  PlaneStatisticsOptions outside = {.roi = Rect<uint32_t>(60, 0, 8, 8)};
+  EXPECT_FALSE(ComputePlaneStatistics(plane.data.data(), plane.stride,
+                                      plane.width, plane.height, outside)
+                   .has_value());
+  PlaneStatisticsOptions no_subsample = {.subsample = 0};
+  EXPECT_FALSE(ComputePlaneStatistics(plane.data.data(), plane.stride,
+                                      plane.width, plane.height, no_subsample)
+                   .has_value());
+  EXPECT_FALSE(ComputePlaneStatistics(plane.data.data(), plane.stride, 0,
+                                      plane.height)
+                   .has_value());
+}
+
+// Logs the time to compute the statistics of 1080p and 4K Y planes, compared
+// with the two-pass computation PrivacyShutterDetectorImpl used to do.
+// Run with --gtest_also_run_disabled_tests.
+TEST(FrameStatisticsTest, DISABLED_Benchmark) {
+  constexpr int kIterations = 20;
+  for (auto [width, height] : {std::pair<uint32_t, uint32_t>(1920, 1080),
+                               std::pair<uint32_t, uint32_t>(3840, 2160)}) {
+    TestPlane plane(width, height, 4);
+    auto run = [&](const char* name, auto&& compute) {
+      base::ElapsedTimer timer;
+      for (int i = 0; i < kIterations; ++i) {
+        compute();
+      }
+      LOG(INFO) << width << "x" << height << " " << name << ": "
+                << timer.Elapsed().InMicroseconds() / kIterations
+                << " us per frame";
+    };
+    double mean, variance;
+    run("two passes", [&] { ComputeTwoPass(plane, &mean, &variance); });
+    run("single pass", [&] {
+      ComputePlaneStatistics(plane.data.data(), plane.stride, width, height);
+    });
+    run("single pass, subsample 2", [&] {
+      ComputePlaneStatistics(plane.data.data(), plane.stride, width, height,
+                             {.subsample = 2});
+    });
+    run("histogram", [&] {
+      ComputePlaneStatistics(plane.data.data(), plane.stride, width, height,
+                             {.compute_histogram = true});
+    });
+  }
+}
+
+}  // namespace cros
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -7,7 +7,9 @@
 #include "common/privacy_shutter_detector_impl.h"
 
 #include <memory>
+#include <optional>
 
+#include "common/frame_statistics.h"
 #include "cros-camera/camera_buffer_manager.h"
 #include "cros-camera/common.h"
 
@@ -53,34 +55,26 @@ bool PrivacyShutterDetectorImpl::DetectPrivacyShutterFromHandle(
 
 bool PrivacyShutterDetectorImpl::DetectPrivacyShutterFromHandleInternal(
     uint8_t* yData, uint32_t yStride, int width, int height) {
-  double ySum = 0;
-  for (uint32_t y = 0; y < height; y++) {
-    for (uint32_t x = 0; x < width; x++) {
-      auto offset = yStride * y + x;
-      ySum += yData[offset];
-      if (kMaxThreshold < yData[offset]) {
-        LOGF(INFO) << "The image has a bright spot: "
-                   << static_cast<int>(yData[offset]);
-        return false;
-      }
-    }
+  std::optional<PlaneStatistics> stats =
+      ComputePlaneStatistics(yData, yStride, width, height);
+  if (!stats) {
+    return false;
   }
 
-  double yMean = ySum / width / height;
-  if (yMean > kMeanThreshold) {
-    LOGF(INFO) << "The image is overall bright: " << yMean;
+  if (stats->max > kMaxThreshold) {
+    LOGF(INFO) << "The image has a bright spot: "
+               << static_cast<int>(stats->max);
     return false;
   }
 
-  int64_t yVar = 0;
-  for (uint32_t y = 0; y < height; y++) {
-    for (uint32_t x = 0; x < width; x++) {
-      auto offset = yStride * y + x;
-      yVar += pow(yData[offset] - yMean, 2);
-    }
+  double yMean = stats->mean();
+  if (yMean > kMeanThreshold) {
+    LOGF(INFO) << "The image is overall bright: " << yMean;
+    return false;
   }
 
-  yVar /= width * height;
+  // Truncated like the variance used to be accumulated in an integer.
+  int64_t yVar = static_cast<int64_t>(stats->variance());
   if (yVar > kVarThreshold) {
     LOGF(INFO) << "Variance is over threshold: " << yVar;
     return false;
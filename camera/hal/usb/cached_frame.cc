@@ -7,9 +7,11 @@
 
 #include <errno.h>
 
+#include <functional>
 #include <limits>
 #include <string>
 
+#include <base/bind.h>
 #include <base/check_op.h>
 #include <base/timer/elapsed_timer.h>
 #include <hardware/camera3.h>
@@ -30,6 +32,9 @@ static const int kRationalPrecision = 10000;
 // And it should not be larger than 64K.
 static const int kApp1MaxDataSize = 65532;
 
+// Number of threads, besides the capture thread, converting the output frames.
+static const size_t kNumConverterWorkers = 2;
+
 static bool SetExifTags(const android::CameraMetadata& static_metadata,
                         const android::CameraMetadata& request_metadata,
                         const FrameBuffer& in_frame,
@@ -37,35 +42,6 @@ static bool SetExifTags(const android::CameraMetadata& static_metadata,
 
 static bool InsertJpegBlob(FrameBuffer& out_frame, uint32_t jpeg_data_size);
 
-static Size CalculateCropSize(const Size& in_size, const Size& out_size) {
-  // Crop the input image to the same ratio as the output image.
-  // We want to compare w1/h1 and w2/h2. To avoid floating point precision loss
-  // we compare w1*h2 and w2*h1 instead, with w1 and h1 being the width and
-  // height of the input; w2 and h2 those of the output.
-  uint32_t in_aspect_ratio = in_size.width * out_size.height;
-  uint32_t out_aspect_ratio = out_size.width * in_size.height;
-
-  // Same Ratio.
-  Size crop_size(0u, 0u);
-  if (in_aspect_ratio == out_aspect_ratio) {
-    crop_size.width = in_size.width;
-    crop_size.height = in_size.height;
-  } else if (in_aspect_ratio > out_aspect_ratio) {
-    // Need to crop width.
-    crop_size.width = out_aspect_ratio / out_size.height;
-    crop_size.height = in_size.height;
-  } else {
-    // Need to crop height.
-    crop_size.width = in_size.width;
-    crop_size.height = in_aspect_ratio / out_size.width;
-  }
-  // Make sure crop size is even.
-  crop_size.width = (crop_size.width + 1) & (~1);
-  crop_size.height = (crop_size.height + 1) & (~1);
-
-  return crop_size;
-}
-
 static bool ValidateThumbnailSize(
     const android::CameraMetadata& static_metadata, int width, int height) {
   auto entry = static_metadata.find(ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES);
@@ -81,6 +57,7 @@ static bool ValidateThumbnailSize(
 
 CachedFrame::CachedFrame(const android::CameraMetadata& static_metadata)
     : image_processor_(new ImageProcessor()),
+      frame_converter_(new ParallelFrameConverter(kNumConverterWorkers)),
       camera_metrics_(CameraMetrics::New()),
       jda_available_(false),
       jda_resolution_cap_(std::numeric_limits<int>::max(),
@@ -161,7 +138,9 @@ int CachedFrame::Convert(
   //             Crop + Rotate          Scale           Convert
   //      NV12 ----------------> I420 --------> I420' ----------> NV12
   //
-  // 3. Convert the temp NV12 frame into each output frame.
+  // 3. Convert the temp NV12 frame into each output frame. The output frames
+  //    other than JPEG are converted concurrently by ParallelFrameConverter.
+  //    A single large output frame is instead split by planes and rows.
   //
   //   3a. Output size is the same as input size:
   //
@@ -250,73 +229,17 @@ int CachedFrame::Convert(
 
   // Convert |nv12_frame| into the output frames. At this time, this
   // function will always return 0 and record the per-output-frame conversion
-  // status in |out_frame_status|.
-  out_frame_status.resize(out_frames.size());
-  for (size_t i = 0; i < out_frames.size(); i++) {
-    if (i == nv12_frame_index) {
-      out_frame_status[i] = 0;
-      continue;
-    }
-    out_frame_status[i] = ConvertFromNV12(static_metadata, request_metadata,
-                                          *nv12_frame, *out_frames[i]);
-  }
+  // status in |out_frame_status|. JPEG frames are compressed on this thread,
+  // while the other frames are converted concurrently.
+  frame_converter_->Convert(
+      *nv12_frame, out_frames, nv12_frame_index,
+      base::BindRepeating(&CachedFrame::CompressNV12, base::Unretained(this),
+                          std::cref(static_metadata),
+                          std::cref(request_metadata)),
+      out_frame_status);
   return 0;
 }
 
-int CachedFrame::ConvertFromNV12(
-    const android::CameraMetadata& static_metadata,
-    const android::CameraMetadata& request_metadata,
-    FrameBuffer& in_frame,
-    FrameBuffer& out_frame) {
-  const Size in_size(in_frame.GetWidth(), in_frame.GetHeight());
-  const Size out_size(out_frame.GetWidth(), out_frame.GetHeight());
-  const Size crop_size = CalculateCropSize(in_size, out_size);
-
-  FrameBuffer* src_frame = &in_frame;
-  if (!(in_size == out_size)) {
-    // Crop to the same aspect ratio of output size. Also converts format to
-    // I420 since libyuv doesn't support NV12 scaling.
-    if (!SharedFrameBuffer::Reallocate(crop_size.width, crop_size.height,
-                                       V4L2_PIX_FMT_YUV420,
-                                       &temp_i420_frame_)) {
-      return -EINVAL;
-    }
-    int ret = image_processor_->Crop(in_frame, *temp_i420_frame_);
-    if (ret)
-      return ret;
-    // Scale to the output size.
-    if (!SharedFrameBuffer::Reallocate(
-            out_frame.GetWidth(), out_frame.GetHeight(), V4L2_PIX_FMT_YUV420,
-            &temp_i420_frame2_)) {
-      return -EINVAL;
-    }
-    ret = image_processor_->Scale(*temp_i420_frame_, *temp_i420_frame2_);
-    if (ret)
-      return ret;
-    src_frame = temp_i420_frame2_.get();
-  }
-
-  // Output JPEG.
-  if (out_frame.GetFourcc() == V4L2_PIX_FMT_JPEG) {
-    if (src_frame->GetFourcc() != V4L2_PIX_FMT_NV12 &&
-        src_frame->GetFourcc() != V4L2_PIX_FMT_NV12M) {
-      if (!GrallocFrameBuffer::Reallocate(
-              out_frame.GetWidth(), out_frame.GetHeight(), V4L2_PIX_FMT_NV12,
-              &temp_nv12_frame2_)) {
-        return -EINVAL;
-      }
-      int ret = image_processor_->ConvertFormat(*src_frame, *temp_nv12_frame2_);
-      if (ret)
-        return ret;
-      src_frame = temp_nv12_frame2_.get();
-    }
-    return CompressNV12(static_metadata, request_metadata, *src_frame,
-                        out_frame);
-  }
-  // Output other formats.
-  return image_processor_->ConvertFormat(*src_frame, out_frame);
-}
-
 int CachedFrame::DecodeToNV12(FrameBuffer& in_frame, FrameBuffer& out_frame) {
   // Try HW decoding.
   base::ElapsedTimer hw_timer;
@@ -17,6 +17,7 @@
 #include "cros-camera/jpeg_compressor.h"
 #include "cros-camera/jpeg_decode_accelerator.h"
 #include "hal/usb/image_processor.h"
+#include "hal/usb/parallel_frame_converter.h"
 
 namespace cros {
 
@@ -43,11 +44,6 @@ class CachedFrame {
               std::vector<human_sensing::CrosFace>* faces);
 
  private:
-  int ConvertFromNV12(const android::CameraMetadata& static_metadata,
-                      const android::CameraMetadata& request_metadata,
-                      FrameBuffer& in_frame,
-                      FrameBuffer& out_frame);
-
   int DecodeToNV12(FrameBuffer& in_frame, FrameBuffer& out_frame);
 
   int DecodeByJDA(FrameBuffer& in_frame, FrameBuffer& out_frame);
@@ -76,11 +72,13 @@ class CachedFrame {
   std::unique_ptr<SharedFrameBuffer> temp_i420_frame_;
   std::unique_ptr<SharedFrameBuffer> temp_i420_frame2_;
   std::unique_ptr<GrallocFrameBuffer> temp_nv12_frame_;
-  std::unique_ptr<GrallocFrameBuffer> temp_nv12_frame2_;
 
   // ImageProcessor instance.
   std::unique_ptr<ImageProcessor> image_processor_;
 
+  // Converts the NV12 frame into the output frames on several threads.
+  std::unique_ptr<ParallelFrameConverter> frame_converter_;
+
   // JPEG decoder accelerator (JDA) instance
   std::unique_ptr<JpegDecodeAccelerator> jda_;
 
@@ -58,6 +58,31 @@ namespace cros {
  *                                 -> NM12 / YV12 (video encoder)
  */
 
+namespace {
+
+bool IsNV12(uint32_t fourcc) {
+  return fourcc == V4L2_PIX_FMT_NV12 || fourcc == V4L2_PIX_FMT_NV12M;
+}
+
+bool IsYU12(uint32_t fourcc) {
+  return fourcc == V4L2_PIX_FMT_YUV420 || fourcc == V4L2_PIX_FMT_YUV420M;
+}
+
+bool IsYV12(uint32_t fourcc) {
+  return fourcc == V4L2_PIX_FMT_YVU420 || fourcc == V4L2_PIX_FMT_YVU420M;
+}
+
+// Returns the address of |row| of |plane| in |frame|. The chroma planes of the
+// YUV 4:2:0 formats have half as many rows as the frame.
+uint8_t* GetRow(const FrameBuffer& frame, size_t plane, uint32_t row) {
+  if (plane != FrameBuffer::YPLANE) {
+    row /= 2;
+  }
+  return frame.GetData(plane) + frame.GetStride(plane) * row;
+}
+
+}  // namespace
+
 size_t ImageProcessor::GetConvertedSize(FrameBuffer& frame) {
   if (frame.Map()) {
     LOGF(ERROR) << "Failed to map frame";
@@ -471,6 +496,122 @@ int ImageProcessor::Scale(FrameBuffer& in_frame, FrameBuffer& out_frame) {
   return ret;
 }
 
+// static
+int ImageProcessor::ScalePlane(FrameBuffer& in_frame,
+                               FrameBuffer& out_frame,
+                               size_t plane) {
+  if (in_frame.Map() || out_frame.Map()) {
+    LOGF(ERROR) << "Failed to map frame";
+    return -EINVAL;
+  }
+  if (!IsYU12(in_frame.GetFourcc()) || plane > FrameBuffer::VPLANE) {
+    LOGF(ERROR) << "Plane " << plane << " of pixel format "
+                << FormatToString(in_frame.GetFourcc()) << " is unsupported.";
+    return -EINVAL;
+  }
+
+  // The chroma planes are sized the same way as in libyuv::I420Scale(), so
+  // that scaling the three planes gives the same image as Scale().
+  auto plane_size = [plane](uint32_t size) {
+    return static_cast<int>(plane == FrameBuffer::YPLANE ? size
+                                                         : (size + 1) / 2);
+  };
+  libyuv::ScalePlane(
+      in_frame.GetData(plane), in_frame.GetStride(plane),
+      plane_size(in_frame.GetWidth()), plane_size(in_frame.GetHeight()),
+      out_frame.GetData(plane), out_frame.GetStride(plane),
+      plane_size(out_frame.GetWidth()), plane_size(out_frame.GetHeight()),
+      libyuv::FilterMode::kFilterNone);
+  return 0;
+}
+
+// static
+bool ImageProcessor::CanConvertFormatRows(const FrameBuffer& in_frame,
+                                          const FrameBuffer& out_frame) {
+  if (in_frame.GetWidth() != out_frame.GetWidth() ||
+      in_frame.GetHeight() != out_frame.GetHeight()) {
+    return false;
+  }
+  const uint32_t out_fourcc = out_frame.GetFourcc();
+  return (IsNV12(in_frame.GetFourcc()) || IsYU12(in_frame.GetFourcc())) &&
+         (IsNV12(out_fourcc) || IsYU12(out_fourcc) || IsYV12(out_fourcc) ||
+          out_fourcc == V4L2_PIX_FMT_RGBX32);
+}
+
+// static
+int ImageProcessor::ConvertFormatRows(FrameBuffer& in_frame,
+                                      FrameBuffer& out_frame,
+                                      uint32_t first_row,
+                                      uint32_t num_rows) {
+  if (!CanConvertFormatRows(in_frame, out_frame) || first_row % 2 ||
+      num_rows % 2 || first_row + num_rows > in_frame.GetHeight()) {
+    LOGF(ERROR) << "Cannot convert rows " << first_row << "-"
+                << first_row + num_rows << " from "
+                << FormatToString(in_frame.GetFourcc()) << " to "
+                << FormatToString(out_frame.GetFourcc());
+    return -EINVAL;
+  }
+  if (in_frame.Map() || out_frame.Map()) {
+    LOGF(ERROR) << "Failed to map frame";
+    return -EINVAL;
+  }
+
+  const int width = out_frame.GetWidth();
+  const int height = num_rows;
+  const uint32_t out_fourcc = out_frame.GetFourcc();
+  uint8_t* out_y = GetRow(out_frame, FrameBuffer::YPLANE, first_row);
+  const int out_stride_y = out_frame.GetStride(FrameBuffer::YPLANE);
+  int res;
+  if (IsNV12(in_frame.GetFourcc())) {
+    const uint8_t* in_y = GetRow(in_frame, FrameBuffer::YPLANE, first_row);
+    const uint8_t* in_uv = GetRow(in_frame, FrameBuffer::UPLANE, first_row);
+    const int in_stride_y = in_frame.GetStride(FrameBuffer::YPLANE);
+    const int in_stride_uv = in_frame.GetStride(FrameBuffer::UPLANE);
+    if (IsNV12(out_fourcc)) {
+      res = libyuv::NV12Copy(
+          in_y, in_stride_y, in_uv, in_stride_uv, out_y, out_stride_y,
+          GetRow(out_frame, FrameBuffer::UPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::UPLANE), width, height);
+    } else if (out_fourcc == V4L2_PIX_FMT_RGBX32) {
+      res = libyuv::NV12ToABGR(in_y, in_stride_y, in_uv, in_stride_uv, out_y,
+                               out_stride_y, width, height);
+    } else {
+      res = libyuv::NV12ToI420(
+          in_y, in_stride_y, in_uv, in_stride_uv, out_y, out_stride_y,
+          GetRow(out_frame, FrameBuffer::UPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::UPLANE),
+          GetRow(out_frame, FrameBuffer::VPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::VPLANE), width, height);
+    }
+  } else {
+    const uint8_t* in_y = GetRow(in_frame, FrameBuffer::YPLANE, first_row);
+    const uint8_t* in_u = GetRow(in_frame, FrameBuffer::UPLANE, first_row);
+    const uint8_t* in_v = GetRow(in_frame, FrameBuffer::VPLANE, first_row);
+    const int in_stride_y = in_frame.GetStride(FrameBuffer::YPLANE);
+    const int in_stride_u = in_frame.GetStride(FrameBuffer::UPLANE);
+    const int in_stride_v = in_frame.GetStride(FrameBuffer::VPLANE);
+    if (IsNV12(out_fourcc)) {
+      res = libyuv::I420ToNV12(
+          in_y, in_stride_y, in_u, in_stride_u, in_v, in_stride_v, out_y,
+          out_stride_y, GetRow(out_frame, FrameBuffer::UPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::UPLANE), width, height);
+    } else if (out_fourcc == V4L2_PIX_FMT_RGBX32) {
+      res = libyuv::I420ToABGR(in_y, in_stride_y, in_u, in_stride_u, in_v,
+                               in_stride_v, out_y, out_stride_y, width,
+                               height);
+    } else {
+      res = libyuv::I420Copy(
+          in_y, in_stride_y, in_u, in_stride_u, in_v, in_stride_v, out_y,
+          out_stride_y, GetRow(out_frame, FrameBuffer::UPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::UPLANE),
+          GetRow(out_frame, FrameBuffer::VPLANE, first_row),
+          out_frame.GetStride(FrameBuffer::VPLANE), width, height);
+    }
+  }
+  LOGF_IF(ERROR, res) << "Converting rows failed: " << res;
+  return res ? -EINVAL : 0;
+}
+
 int ImageProcessor::ProcessForInsetPortraitMode(FrameBuffer& in_frame,
                                                 FrameBuffer& out_frame,
                                                 int rotate_degree) {
@@ -42,6 +42,26 @@ class ImageProcessor {
   // |data_size| of |out_frame|.
   int Scale(FrameBuffer& in_frame, FrameBuffer& out_frame);
 
+  // Like Scale(), but only scales |plane| of the frames. Different planes of
+  // the same frames may be scaled concurrently.
+  static int ScalePlane(FrameBuffer& in_frame,
+                        FrameBuffer& out_frame,
+                        size_t plane);
+
+  // Returns true if ConvertFormatRows() can convert |in_frame| into
+  // |out_frame|: both have the same size, |in_frame| is NV12 or YU12, and
+  // |out_frame| is NV12, YU12, YV12 or RGBX32.
+  static bool CanConvertFormatRows(const FrameBuffer& in_frame,
+                                   const FrameBuffer& out_frame);
+
+  // Like ConvertFormat(), but only converts the |num_rows| rows starting at
+  // |first_row|. Both have to be even. No temporary buffer is used, so
+  // different rows of the same frames may be converted concurrently.
+  static int ConvertFormatRows(FrameBuffer& in_frame,
+                               FrameBuffer& out_frame,
+                               uint32_t first_row,
+                               uint32_t num_rows);
+
   // Crop and rotate image size according to |in_frame| and |out_frame|. Only
   // support V4L2_PIX_FMT_YUV420 output format. Caller should fill |data|,
   // |width|, |height|, and |buffer_size| of |out_frame|. The function will fill
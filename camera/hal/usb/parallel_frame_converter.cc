@@ -0,0 +1,305 @@
+/* Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "hal/usb/parallel_frame_converter.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/location.h>
+
+#include "cros-camera/common.h"
+#include "cros-camera/future.h"
+#include "hal/usb/common_types.h"
+
+namespace cros {
+
+namespace {
+
+// Output frames with at least this many pixels are split across the threads
+// when they are the only frame to convert.
+constexpr uint32_t kMinSplitPixels = 1280 * 720;
+
+Size CalculateCropSize(const Size& in_size, const Size& out_size) {
+  // Crop the input image to the same ratio as the output image.
+  // We want to compare w1/h1 and w2/h2. To avoid floating point precision loss
+  // we compare w1*h2 and w2*h1 instead, with w1 and h1 being the width and
+  // height of the input; w2 and h2 those of the output.
+  uint32_t in_aspect_ratio = in_size.width * out_size.height;
+  uint32_t out_aspect_ratio = out_size.width * in_size.height;
+
+  // Same Ratio.
+  Size crop_size(0u, 0u);
+  if (in_aspect_ratio == out_aspect_ratio) {
+    crop_size.width = in_size.width;
+    crop_size.height = in_size.height;
+  } else if (in_aspect_ratio > out_aspect_ratio) {
+    // Need to crop width.
+    crop_size.width = out_aspect_ratio / out_size.height;
+    crop_size.height = in_size.height;
+  } else {
+    // Need to crop height.
+    crop_size.width = in_size.width;
+    crop_size.height = in_aspect_ratio / out_size.width;
+  }
+  // Make sure crop size is even.
+  crop_size.width = (crop_size.width + 1) & (~1);
+  crop_size.height = (crop_size.height + 1) & (~1);
+
+  return crop_size;
+}
+
+bool IsJpeg(const FrameBuffer& frame) {
+  return frame.GetFourcc() == V4L2_PIX_FMT_JPEG;
+}
+
+// Scales the planes of |in_frame| that belong to |lane| into |out_frame|.
+int ScalePlanesOfLane(FrameBuffer* in_frame,
+                      FrameBuffer* out_frame,
+                      size_t num_lanes,
+                      size_t lane) {
+  for (size_t plane = lane; plane <= FrameBuffer::VPLANE; plane += num_lanes) {
+    int ret = ImageProcessor::ScalePlane(*in_frame, *out_frame, plane);
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
+
+// Converts the band of rows of |in_frame| that belongs to |lane| into
+// |out_frame|. Every band but the last has |band_rows| rows.
+int ConvertRowsOfLane(FrameBuffer* in_frame,
+                      FrameBuffer* out_frame,
+                      uint32_t band_rows,
+                      size_t lane) {
+  const uint32_t height = out_frame->GetHeight();
+  const uint32_t first_row = std::min<uint32_t>(band_rows * lane, height);
+  const uint32_t num_rows = std::min(band_rows, height - first_row);
+  if (num_rows == 0)
+    return 0;
+  return ImageProcessor::ConvertFormatRows(*in_frame, *out_frame, first_row,
+                                           num_rows);
+}
+
+}  // namespace
+
+ParallelFrameConverter::ParallelFrameConverter(size_t num_workers) {
+  lanes_.push_back(std::make_unique<Lane>());
+  for (size_t i = 0; i < num_workers; ++i) {
+    auto worker =
+        std::make_unique<CameraThread>("ParallelFrameConverterThread");
+    if (!worker->Start()) {
+      LOGF(ERROR) << "Failed to start worker thread " << i;
+      break;
+    }
+    workers_.push_back(std::move(worker));
+    lanes_.push_back(std::make_unique<Lane>());
+  }
+}
+
+ParallelFrameConverter::~ParallelFrameConverter() {
+  for (auto& worker : workers_) {
+    worker->Stop();
+  }
+}
+
+void ParallelFrameConverter::Convert(
+    FrameBuffer& in_frame,
+    const std::vector<std::unique_ptr<FrameBuffer>>& out_frames,
+    size_t skip_index,
+    const CompressJpegCallback& compress_jpeg,
+    std::vector<int>& out_frame_status) {
+  out_frame_status.assign(out_frames.size(), 0);
+
+  std::vector<size_t> jpeg_indices;
+  std::vector<size_t> other_indices;
+  for (size_t i = 0; i < out_frames.size(); ++i) {
+    if (i == skip_index)
+      continue;
+    if (IsJpeg(*out_frames[i])) {
+      jpeg_indices.push_back(i);
+    } else {
+      other_indices.push_back(i);
+    }
+  }
+
+  // A single large output frame is split across all the lanes.
+  if (!workers_.empty() && jpeg_indices.empty() &&
+      other_indices.size() == 1) {
+    FrameBuffer& out_frame = *out_frames[other_indices[0]];
+    if (out_frame.GetWidth() * out_frame.GetHeight() >= kMinSplitPixels) {
+      out_frame_status[other_indices[0]] = ConvertSplit(in_frame, out_frame);
+      return;
+    }
+  }
+
+  // Otherwise, the non-JPEG output frames are spread over the lanes. The
+  // calling thread only takes some of them if it has no JPEG to compress.
+  std::vector<std::vector<size_t>> lane_indices(lanes_.size());
+  lane_indices[0] = jpeg_indices;
+  const size_t first_lane =
+      jpeg_indices.empty() || workers_.empty() ? 0 : 1;
+  for (size_t i = 0; i < other_indices.size(); ++i) {
+    size_t lane = first_lane + i % (lanes_.size() - first_lane);
+    lane_indices[lane].push_back(other_indices[i]);
+  }
+  RunOnAllLanes(base::BindRepeating(
+      &ParallelFrameConverter::ConvertFramesOnLane, base::Unretained(this),
+      &in_frame, &out_frames, &lane_indices, compress_jpeg,
+      &out_frame_status));
+}
+
+int ParallelFrameConverter::ConvertOnLane(
+    Lane& lane,
+    FrameBuffer& in_frame,
+    FrameBuffer& out_frame,
+    const CompressJpegCallback& compress_jpeg) {
+  const Size in_size(in_frame.GetWidth(), in_frame.GetHeight());
+  const Size out_size(out_frame.GetWidth(), out_frame.GetHeight());
+  const Size crop_size = CalculateCropSize(in_size, out_size);
+
+  FrameBuffer* src_frame = &in_frame;
+  if (!(in_size == out_size)) {
+    // Crop to the same aspect ratio of output size. Also converts format to
+    // I420 since libyuv doesn't support NV12 scaling.
+    if (!SharedFrameBuffer::Reallocate(crop_size.width, crop_size.height,
+                                       V4L2_PIX_FMT_YUV420,
+                                       &lane.temp_i420_frame)) {
+      return -EINVAL;
+    }
+    int ret = lane.image_processor.Crop(in_frame, *lane.temp_i420_frame);
+    if (ret)
+      return ret;
+    // Scale to the output size.
+    if (!SharedFrameBuffer::Reallocate(
+            out_frame.GetWidth(), out_frame.GetHeight(), V4L2_PIX_FMT_YUV420,
+            &lane.temp_i420_frame2)) {
+      return -EINVAL;
+    }
+    ret = lane.image_processor.Scale(*lane.temp_i420_frame,
+                                     *lane.temp_i420_frame2);
+    if (ret)
+      return ret;
+    src_frame = lane.temp_i420_frame2.get();
+  }
+
+  // Output JPEG.
+  if (IsJpeg(out_frame)) {
+    if (src_frame->GetFourcc() != V4L2_PIX_FMT_NV12 &&
+        src_frame->GetFourcc() != V4L2_PIX_FMT_NV12M) {
+      if (!GrallocFrameBuffer::Reallocate(
+              out_frame.GetWidth(), out_frame.GetHeight(), V4L2_PIX_FMT_NV12,
+              &lane.temp_nv12_frame)) {
+        return -EINVAL;
+      }
+      int ret = lane.image_processor.ConvertFormat(*src_frame,
+                                                   *lane.temp_nv12_frame);
+      if (ret)
+        return ret;
+      src_frame = lane.temp_nv12_frame.get();
+    }
+    return compress_jpeg.Run(*src_frame, out_frame);
+  }
+  // Output other formats.
+  return lane.image_processor.ConvertFormat(*src_frame, out_frame);
+}
+
+int ParallelFrameConverter::ConvertFramesOnLane(
+    FrameBuffer* in_frame,
+    const std::vector<std::unique_ptr<FrameBuffer>>* out_frames,
+    const std::vector<std::vector<size_t>>* lane_indices,
+    const CompressJpegCallback& compress_jpeg,
+    std::vector<int>* out_frame_status,
+    size_t lane) {
+  for (size_t i : (*lane_indices)[lane]) {
+    (*out_frame_status)[i] = ConvertOnLane(*lanes_[lane], *in_frame,
+                                           *(*out_frames)[i], compress_jpeg);
+  }
+  return 0;
+}
+
+int ParallelFrameConverter::ConvertSplit(FrameBuffer& in_frame,
+                                         FrameBuffer& out_frame) {
+  Lane& lane = *lanes_[0];
+  // Map the frames once here rather than concurrently on every lane.
+  if (in_frame.Map() || out_frame.Map()) {
+    LOGF(ERROR) << "Failed to map frame";
+    return -EINVAL;
+  }
+
+  FrameBuffer* src_frame = &in_frame;
+  const Size in_size(in_frame.GetWidth(), in_frame.GetHeight());
+  const Size out_size(out_frame.GetWidth(), out_frame.GetHeight());
+  if (!(in_size == out_size)) {
+    const Size crop_size = CalculateCropSize(in_size, out_size);
+    if (!SharedFrameBuffer::Reallocate(crop_size.width, crop_size.height,
+                                       V4L2_PIX_FMT_YUV420,
+                                       &lane.temp_i420_frame) ||
+        !SharedFrameBuffer::Reallocate(out_size.width, out_size.height,
+                                       V4L2_PIX_FMT_YUV420,
+                                       &lane.temp_i420_frame2)) {
+      return -EINVAL;
+    }
+    int ret = lane.image_processor.Crop(in_frame, *lane.temp_i420_frame);
+    if (ret)
+      return ret;
+    if (lane.temp_i420_frame2->Map()) {
+      LOGF(ERROR) << "Failed to map frame";
+      return -EINVAL;
+    }
+    // libyuv::I420Scale() scales the three planes independently, so scaling
+    // them on different lanes gives the same image.
+    ret = RunOnAllLanes(base::BindRepeating(
+        &ScalePlanesOfLane, lane.temp_i420_frame.get(),
+        lane.temp_i420_frame2.get(), lanes_.size()));
+    if (ret)
+      return ret;
+    src_frame = lane.temp_i420_frame2.get();
+  }
+
+  if (!ImageProcessor::CanConvertFormatRows(*src_frame, out_frame)) {
+    return lane.image_processor.ConvertFormat(*src_frame, out_frame);
+  }
+  // Bands of an even number of rows, so that every band starts at a chroma
+  // row.
+  const uint32_t band_rows =
+      ((out_size.height + lanes_.size() - 1) / lanes_.size() + 1) & ~1u;
+  return RunOnAllLanes(base::BindRepeating(&ConvertRowsOfLane, src_frame,
+                                           &out_frame, band_rows));
+}
+
+int ParallelFrameConverter::RunOnAllLanes(
+    const base::RepeatingCallback<int(size_t lane)>& task) {
+  std::vector<int> results(lanes_.size(), 0);
+  std::vector<scoped_refptr<Future<void>>> futures;
+  for (size_t lane = 1; lane < lanes_.size(); ++lane) {
+    auto future = Future<void>::Create(nullptr);
+    workers_[lane - 1]->task_runner()->PostTask(
+        FROM_HERE, base::BindOnce(
+                       [](const base::RepeatingCallback<int(size_t)>& task,
+                          size_t lane, int* result,
+                          scoped_refptr<Future<void>> future) {
+                         *result = task.Run(lane);
+                         future->Set();
+                       },
+                       task, lane, &results[lane], future));
+    futures.push_back(std::move(future));
+  }
+  results[0] = task.Run(0);
+  for (auto& future : futures) {
+    future->Wait(-1);
+  }
+
+  for (int result : results) {
+    if (result)
+      return result;
+  }
+  return 0;
+}
+
+}  // namespace cros
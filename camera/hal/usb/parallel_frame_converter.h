@@ -0,0 +1,93 @@
+/* Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CAMERA_HAL_USB_PARALLEL_FRAME_CONVERTER_H_
+#define CAMERA_HAL_USB_PARALLEL_FRAME_CONVERTER_H_
+
+#include <memory>
+#include <vector>
+
+#include <base/callback.h>
+
+#include "cros-camera/camera_thread.h"
+#include "hal/usb/frame_buffer.h"
+#include "hal/usb/image_processor.h"
+
+namespace cros {
+
+// ParallelFrameConverter converts a NV12 frame into the output frames of a
+// capture request. Independent output frames are converted concurrently on a
+// few worker threads. When there is only one large output frame, its scaling
+// is split by planes and its format conversion is split by rows across the
+// threads instead.
+//
+// JPEG output frames are always compressed on the calling thread, since the
+// JPEG compressor is not thread-safe.
+class ParallelFrameConverter {
+ public:
+  // Compresses a NV12 frame of the output size into a JPEG output frame.
+  using CompressJpegCallback =
+      base::RepeatingCallback<int(FrameBuffer& nv12_frame,
+                                  FrameBuffer& out_frame)>;
+
+  // Creates a converter with |num_workers| worker threads. With 0 worker, all
+  // the conversions run on the calling thread.
+  explicit ParallelFrameConverter(size_t num_workers);
+  ParallelFrameConverter(const ParallelFrameConverter&) = delete;
+  ParallelFrameConverter& operator=(const ParallelFrameConverter&) = delete;
+  ~ParallelFrameConverter();
+
+  // Converts |in_frame| into each of |out_frames| except the one at
+  // |skip_index|, cropping and scaling it to the output size. The conversion
+  // status of each output frame is recorded in |out_frame_status|, which is
+  // resized to the size of |out_frames|. Blocks until all the output frames
+  // are converted.
+  void Convert(FrameBuffer& in_frame,
+               const std::vector<std::unique_ptr<FrameBuffer>>& out_frames,
+               size_t skip_index,
+               const CompressJpegCallback& compress_jpeg,
+               std::vector<int>& out_frame_status);
+
+ private:
+  // The processor and temporary buffers used by one thread. Lane 0 belongs to
+  // the calling thread and lane i > 0 to |workers_[i - 1]|.
+  struct Lane {
+    ImageProcessor image_processor;
+    std::unique_ptr<SharedFrameBuffer> temp_i420_frame;
+    std::unique_ptr<SharedFrameBuffer> temp_i420_frame2;
+    std::unique_ptr<GrallocFrameBuffer> temp_nv12_frame;
+  };
+
+  // Converts |in_frame| into |out_frame| on |lane|.
+  int ConvertOnLane(Lane& lane,
+                    FrameBuffer& in_frame,
+                    FrameBuffer& out_frame,
+                    const CompressJpegCallback& compress_jpeg);
+
+  // Converts |in_frame| into the |out_frames| at the indices assigned to
+  // |lane| in |lane_indices|, and records their status in |out_frame_status|.
+  // Always returns 0.
+  int ConvertFramesOnLane(
+      FrameBuffer* in_frame,
+      const std::vector<std::unique_ptr<FrameBuffer>>* out_frames,
+      const std::vector<std::vector<size_t>>* lane_indices,
+      const CompressJpegCallback& compress_jpeg,
+      std::vector<int>* out_frame_status,
+      size_t lane);
+
+  // Converts |in_frame| into the single |out_frame| using all the lanes.
+  int ConvertSplit(FrameBuffer& in_frame, FrameBuffer& out_frame);
+
+  // Runs |task| with the index of every lane on the thread of that lane, and
+  // returns the first error it returned.
+  int RunOnAllLanes(const base::RepeatingCallback<int(size_t lane)>& task);
+
+  std::vector<std::unique_ptr<CameraThread>> workers_;
+  std::vector<std::unique_ptr<Lane>> lanes_;
+};
+
+}  // namespace cros
+
+#endif  // CAMERA_HAL_USB_PARALLEL_FRAME_CONVERTER_H_
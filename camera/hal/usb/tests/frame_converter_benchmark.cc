@@ -0,0 +1,219 @@
+/* Copyright 2022 The ChromiumOS Authors
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+// Measures the time ParallelFrameConverter takes to convert a frame into the
+// output frames of typical stream configurations, with and without worker
+// threads, and checks that both produce the same images. Needs a device with
+// gralloc buffers.
+
+#include <errno.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/timer/elapsed_timer.h>
+#include <gtest/gtest.h>
+
+#include "hal/usb/frame_buffer.h"
+#include "hal/usb/parallel_frame_converter.h"
+
+namespace cros {
+
+namespace tests {
+
+namespace {
+
+constexpr size_t kNumWorkers = 2;
+constexpr int kIterations = 30;
+
+struct FrameConfig {
+  uint32_t width;
+  uint32_t height;
+  uint32_t fourcc;
+};
+
+struct StreamConfig {
+  std::string name;
+  FrameConfig input;
+  std::vector<FrameConfig> outputs;
+};
+
+std::vector<StreamConfig> GetStreamConfigs() {
+  return {
+      {"Preview + video + still",
+       {1920, 1080, V4L2_PIX_FMT_NV12},
+       {{1280, 720, V4L2_PIX_FMT_NV12},
+        {1920, 1080, V4L2_PIX_FMT_YUV420},
+        {1280, 960, V4L2_PIX_FMT_NV12}}},
+      {"Preview + app stream",
+       {1920, 1080, V4L2_PIX_FMT_NV12},
+       {{1280, 720, V4L2_PIX_FMT_RGBX32}, {640, 480, V4L2_PIX_FMT_YUV420}}},
+      {"Single scaled stream",
+       {2592, 1944, V4L2_PIX_FMT_NV12},
+       {{1920, 1080, V4L2_PIX_FMT_YUV420}}},
+      {"Single RGB stream",
+       {1920, 1080, V4L2_PIX_FMT_NV12},
+       {{1920, 1080, V4L2_PIX_FMT_RGBX32}}},
+  };
+}
+
+// Returns the number of bytes per row and the number of rows of |plane|.
+std::pair<size_t, size_t> GetPlaneSize(const FrameBuffer& frame,
+                                       size_t plane) {
+  const size_t width = frame.GetWidth();
+  const size_t height = frame.GetHeight();
+  if (frame.GetFourcc() == V4L2_PIX_FMT_RGBX32) {
+    return {width * 4, height};
+  }
+  if (plane == FrameBuffer::YPLANE) {
+    return {width, height};
+  }
+  if (frame.GetFourcc() == V4L2_PIX_FMT_NV12) {
+    return {width, height / 2};
+  }
+  return {width / 2, height / 2};
+}
+
+std::unique_ptr<FrameBuffer> CreateFrame(const FrameConfig& config) {
+  auto frame = std::make_unique<GrallocFrameBuffer>(
+      config.width, config.height, config.fourcc);
+  if (frame->Map()) {
+    return nullptr;
+  }
+  return frame;
+}
+
+void FillFrame(FrameBuffer& frame) {
+  for (size_t plane = 0; plane < frame.GetNumPlanes(); ++plane) {
+    const auto [row_bytes, rows] = GetPlaneSize(frame, plane);
+    for (size_t y = 0; y < rows; ++y) {
+      uint8_t* row = frame.GetData(plane) + frame.GetStride(plane) * y;
+      for (size_t x = 0; x < row_bytes; ++x) {
+        row[x] = static_cast<uint8_t>(x * 7 + y * 13 + plane * 64);
+      }
+    }
+  }
+}
+
+bool FramesEqual(const FrameBuffer& a, const FrameBuffer& b) {
+  for (size_t plane = 0; plane < a.GetNumPlanes(); ++plane) {
+    const auto [row_bytes, rows] = GetPlaneSize(a, plane);
+    for (size_t y = 0; y < rows; ++y) {
+      if (memcmp(a.GetData(plane) + a.GetStride(plane) * y,
+                 b.GetData(plane) + b.GetStride(plane) * y, row_bytes)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int CompressJpeg(FrameBuffer& nv12_frame, FrameBuffer& out_frame) {
+  ADD_FAILURE() << "No JPEG output is configured";
+  return -EINVAL;
+}
+
+}  // namespace
+
+class FrameConverterBenchmark : public ::testing::Test {
+ protected:
+  // Converts |input| into |outputs| |iterations| times with |converter|, and
+  // returns the average time per frame in microseconds.
+  int64_t ConvertFrames(
+      ParallelFrameConverter& converter,
+      FrameBuffer& input,
+      const std::vector<std::unique_ptr<FrameBuffer>>& outputs,
+      int iterations) {
+    std::vector<int> status;
+    base::ElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+      converter.Convert(input, outputs, outputs.size(),
+                        base::BindRepeating(&CompressJpeg), status);
+      for (size_t j = 0; j < status.size(); ++j) {
+        EXPECT_EQ(status[j], 0) << "Output frame " << j;
+      }
+    }
+    return timer.Elapsed().InMicroseconds() / iterations;
+  }
+
+  std::vector<std::unique_ptr<FrameBuffer>> CreateOutputs(
+      const StreamConfig& config) {
+    std::vector<std::unique_ptr<FrameBuffer>> outputs;
+    for (const FrameConfig& output : config.outputs) {
+      outputs.push_back(CreateFrame(output));
+      EXPECT_NE(outputs.back(), nullptr);
+    }
+    return outputs;
+  }
+};
+
+TEST_F(FrameConverterBenchmark, ParallelMatchesSerial) {
+  ParallelFrameConverter serial_converter(0);
+  ParallelFrameConverter parallel_converter(kNumWorkers);
+  for (const StreamConfig& config : GetStreamConfigs()) {
+    SCOPED_TRACE(config.name);
+    std::unique_ptr<FrameBuffer> input = CreateFrame(config.input);
+    ASSERT_NE(input, nullptr);
+    FillFrame(*input);
+    std::vector<std::unique_ptr<FrameBuffer>> serial_outputs =
+        CreateOutputs(config);
+    std::vector<std::unique_ptr<FrameBuffer>> parallel_outputs =
+        CreateOutputs(config);
+    if (HasFailure()) {
+      return;
+    }
+
+    ConvertFrames(serial_converter, *input, serial_outputs, 1);
+    ConvertFrames(parallel_converter, *input, parallel_outputs, 1);
+    for (size_t i = 0; i < serial_outputs.size(); ++i) {
+      EXPECT_TRUE(FramesEqual(*serial_outputs[i], *parallel_outputs[i]))
+          << "Output frame " << i;
+    }
+  }
+}
+
+// Logs the average frame time of each stream configuration.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(FrameConverterBenchmark, DISABLED_FrameTime) {
+  ParallelFrameConverter serial_converter(0);
+  ParallelFrameConverter parallel_converter(kNumWorkers);
+  for (const StreamConfig& config : GetStreamConfigs()) {
+    SCOPED_TRACE(config.name);
+    std::unique_ptr<FrameBuffer> input = CreateFrame(config.input);
+    ASSERT_NE(input, nullptr);
+    FillFrame(*input);
+    std::vector<std::unique_ptr<FrameBuffer>> outputs = CreateOutputs(config);
+    if (HasFailure()) {
+      return;
+    }
+
+    // Warm up the temporary buffers of both converters.
+    ConvertFrames(serial_converter, *input, outputs, 1);
+    ConvertFrames(parallel_converter, *input, outputs, 1);
+    const int64_t serial_us =
+        ConvertFrames(serial_converter, *input, outputs, kIterations);
+    const int64_t parallel_us =
+        ConvertFrames(parallel_converter, *input, outputs, kIterations);
+    LOG(INFO) << config.name << ": " << serial_us << " us per frame serially, "
+              << parallel_us << " us per frame with " << kNumWorkers
+              << " workers";
+  }
+}
+
+}  // namespace tests
+
+}  // namespace cros
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
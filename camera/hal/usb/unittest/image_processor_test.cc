@@ -6,6 +6,7 @@
 
 #include "hal/usb/image_processor.h"
 
+#include <string.h>
 #include <sys/mman.h>
 
 #include <base/at_exit.h>
@@ -37,6 +38,64 @@ TEST_F(ImageProcessorTest, GetConvertedSize) {
   EXPECT_EQ(image_processor->GetConvertedSize(*frame.get()), 1280 * 720 * 1.5);
 }
 
+namespace {
+
+std::unique_ptr<SharedFrameBuffer> CreateI420Frame(uint32_t width,
+                                                   uint32_t height) {
+  std::unique_ptr<SharedFrameBuffer> frame;
+  if (!SharedFrameBuffer::Reallocate(width, height, V4L2_PIX_FMT_YUV420,
+                                     &frame)) {
+    return nullptr;
+  }
+  uint8_t* data = frame->GetData();
+  for (size_t i = 0; i < frame->GetDataSize(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 7 + i / width);
+  }
+  return frame;
+}
+
+bool FramesEqual(const FrameBuffer& a, const FrameBuffer& b) {
+  return a.GetDataSize() == b.GetDataSize() &&
+         memcmp(a.GetData(), b.GetData(), a.GetDataSize()) == 0;
+}
+
+}  // namespace
+
+TEST_F(ImageProcessorTest, ScalePlaneMatchesScale) {
+  std::unique_ptr<SharedFrameBuffer> in_frame = CreateI420Frame(640, 480);
+  std::unique_ptr<SharedFrameBuffer> expected = CreateI420Frame(322, 182);
+  std::unique_ptr<SharedFrameBuffer> actual = CreateI420Frame(322, 182);
+  ASSERT_TRUE(in_frame && expected && actual);
+
+  ImageProcessor image_processor;
+  ASSERT_EQ(image_processor.Scale(*in_frame, *expected), 0);
+  for (size_t plane = FrameBuffer::YPLANE; plane <= FrameBuffer::VPLANE;
+       ++plane) {
+    ASSERT_EQ(ImageProcessor::ScalePlane(*in_frame, *actual, plane), 0);
+  }
+  EXPECT_TRUE(FramesEqual(*expected, *actual));
+}
+
+TEST_F(ImageProcessorTest, ConvertFormatRowsMatchesConvertFormat) {
+  std::unique_ptr<SharedFrameBuffer> in_frame = CreateI420Frame(320, 240);
+  std::unique_ptr<SharedFrameBuffer> expected = CreateI420Frame(320, 240);
+  std::unique_ptr<SharedFrameBuffer> actual = CreateI420Frame(320, 240);
+  ASSERT_TRUE(in_frame && expected && actual);
+  memset(actual->GetData(), 0, actual->GetDataSize());
+
+  ImageProcessor image_processor;
+  ASSERT_EQ(image_processor.ConvertFormat(*in_frame, *expected), 0);
+  ASSERT_TRUE(ImageProcessor::CanConvertFormatRows(*in_frame, *actual));
+  ASSERT_EQ(ImageProcessor::ConvertFormatRows(*in_frame, *actual, 0, 100), 0);
+  ASSERT_EQ(ImageProcessor::ConvertFormatRows(*in_frame, *actual, 100, 140),
+            0);
+  EXPECT_TRUE(FramesEqual(*expected, *actual));
+
+  // Bands have to start and end on even rows.
+  EXPECT_NE(ImageProcessor::ConvertFormatRows(*in_frame, *actual, 1, 2), 0);
+  EXPECT_NE(ImageProcessor::ConvertFormatRows(*in_frame, *actual, 0, 241), 0);
+}
+
 }  // namespace tests
 
 }  // namespace cros
@@ -4,6 +4,8 @@
 
 #include "chaps/object_pool_impl.h"
 
+#include <algorithm>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <string>
@@ -30,6 +32,15 @@ using Result = chaps::ObjectPool::Result;
 
 namespace chaps {
 
+namespace {
+
+// Attributes indexed by ObjectPoolImpl. These are the ones applications
+// typically search on, e.g. to find the key matching a certificate.
+const CK_ATTRIBUTE_TYPE kIndexedAttributes[] = {CKA_CLASS, CKA_ID, CKA_LABEL,
+                                                CKA_KEY_TYPE};
+
+}  // namespace
+
 ObjectPoolImpl::ObjectPoolImpl(ChapsFactory* factory,
                                HandleGenerator* handle_generator,
                                SlotPolicy* slot_policy,
@@ -122,6 +133,7 @@ Result ObjectPoolImpl::AddObject(Object* object, bool from_external_source) {
   }
   object->set_handle(handle_generator_->CreateHandle());
   objects_.insert(object);
+  IndexObject(object);
   handle_object_map_[object->handle()] = shared_ptr<const Object>(object);
   return Result::Success;
 }
@@ -137,6 +149,8 @@ Result ObjectPoolImpl::Delete(const Object* object) {
     if (!store_->DeleteObjectBlob(object->store_id()))
       return Result::Failure;
   }
+  if (unindexed_objects_.erase(object) == 0)
+    UnindexObject(object);
   handle_object_map_.erase(object->handle());
   objects_.erase(object);
   return Result::Success;
@@ -144,6 +158,8 @@ Result ObjectPoolImpl::Delete(const Object* object) {
 
 Result ObjectPoolImpl::DeleteAll() {
   objects_.clear();
+  attribute_indexes_.clear();
+  unindexed_objects_.clear();
   handle_object_map_.clear();
   if (store_.get())
     return store_->DeleteAllObjectBlobs() ? Result::Success : Result::Failure;
@@ -160,9 +176,24 @@ Result ObjectPoolImpl::Find(const Object* search_template,
         search_template->GetObjectClass() == CKO_PRIVATE_KEY)) &&
       !is_private_loaded_)
     return Result::WaitForPrivateObjects;
-  for (ObjectSet::iterator it = objects_.begin(); it != objects_.end(); ++it) {
-    if (Matches(search_template, *it))
-      matching_objects->push_back(*it);
+  const ObjectSet* candidates = GetIndexedCandidates(search_template);
+  if (!candidates) {
+    for (ObjectSet::iterator it = objects_.begin(); it != objects_.end();
+         ++it) {
+      if (Matches(search_template, *it))
+        matching_objects->push_back(*it);
+    }
+    return Result::Success;
+  }
+  // Merge in the objects that may have changed since they were indexed. Both
+  // sets are ordered, so results come back in the same order as a full scan.
+  vector<const Object*> merged;
+  std::set_union(candidates->begin(), candidates->end(),
+                 unindexed_objects_.begin(), unindexed_objects_.end(),
+                 std::back_inserter(merged));
+  for (const Object* object : merged) {
+    if (Matches(search_template, object))
+      matching_objects->push_back(object);
   }
   return Result::Success;
 }
@@ -177,12 +208,19 @@ Result ObjectPoolImpl::FindByHandle(int handle, const Object** object) {
 }
 
 Object* ObjectPoolImpl::GetModifiableObject(const Object* object) {
+  if (objects_.find(object) != objects_.end() &&
+      unindexed_objects_.insert(object).second)
+    UnindexObject(object);
   return const_cast<Object*>(object);
 }
 
 Result ObjectPoolImpl::Flush(const Object* object) {
   if (objects_.find(object) == objects_.end())
     return Result::Failure;
+  // The in-memory object is up to date regardless of whether the store update
+  // below succeeds.
+  if (unindexed_objects_.erase(object))
+    IndexObject(object);
   if (store_.get()) {
     ObjectBlob serialized;
     if (!Serialize(object, &serialized))
@@ -277,6 +315,7 @@ bool ObjectPoolImpl::LoadBlobs(const map<int, ObjectBlob>& object_blobs) {
       object->set_handle(handle_generator_->CreateHandle());
       object->set_store_id(it->first);
       objects_.insert(object.get());
+      IndexObject(object.get());
       handle_object_map_[object->handle()] = object;
     } else {
       LOG(WARNING) << "Object not parsable: " << it->first;
@@ -301,4 +340,45 @@ bool ObjectPoolImpl::LoadPrivateObjects() {
   return LoadBlobs(object_blobs);
 }
 
+void ObjectPoolImpl::IndexObject(const Object* object) {
+  for (CK_ATTRIBUTE_TYPE type : kIndexedAttributes) {
+    if (object->IsAttributePresent(type))
+      attribute_indexes_[type][object->GetAttributeString(type)].insert(object);
+  }
+}
+
+void ObjectPoolImpl::UnindexObject(const Object* object) {
+  for (CK_ATTRIBUTE_TYPE type : kIndexedAttributes) {
+    if (!object->IsAttributePresent(type))
+      continue;
+    AttributeValueIndex& index = attribute_indexes_[type];
+    AttributeValueIndex::iterator it =
+        index.find(object->GetAttributeString(type));
+    if (it == index.end())
+      continue;
+    it->second.erase(object);
+    if (it->second.empty())
+      index.erase(it);
+  }
+}
+
+const ObjectSet* ObjectPoolImpl::GetIndexedCandidates(
+    const Object* search_template) {
+  const ObjectSet* best = NULL;
+  for (CK_ATTRIBUTE_TYPE type : kIndexedAttributes) {
+    if (!search_template->IsAttributePresent(type))
+      continue;
+    const AttributeValueIndex& index = attribute_indexes_[type];
+    AttributeValueIndex::const_iterator it =
+        index.find(search_template->GetAttributeString(type));
+    // No indexed object holds this value, so only objects that changed since
+    // they were indexed can match.
+    if (it == index.end())
+      return &unindexed_objects_;
+    if (!best || it->second.size() < best->size())
+      best = &it->second;
+  }
+  return best;
+}
+
 }  // namespace chaps
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include "chaps/object_store.h"
+#include "pkcs11/cryptoki.h"
 
 namespace chaps {
 
@@ -25,6 +26,9 @@ class SlotPolicy;
 // Value: Object shared pointer.
 typedef std::map<int, std::shared_ptr<const Object>> HandleObjectMap;
 typedef std::set<const Object*> ObjectSet;
+// Key: Attribute value.
+// Value: The objects holding that value.
+typedef std::map<std::string, ObjectSet> AttributeValueIndex;
 
 class ObjectPoolImpl : public ObjectPool {
  public:
@@ -68,9 +72,22 @@ class ObjectPoolImpl : public ObjectPool {
   bool LoadBlobs(const std::map<int, ObjectBlob>& object_blobs);
   bool LoadPublicObjects();
   bool LoadPrivateObjects();
+  // Adds |object| to, or removes it from, |attribute_indexes_| using its
+  // current attribute values.
+  void IndexObject(const Object* object);
+  void UnindexObject(const Object* object);
+  // Returns the index entry of the attribute in |search_template| which
+  // narrows the search the most, or NULL if no indexed attribute is present.
+  const ObjectSet* GetIndexedCandidates(const Object* search_template);
 
   // Allows us to quickly check whether an object exists in the pool.
   ObjectSet objects_;
+  // Indexes of the attributes most commonly used in search templates, keyed by
+  // attribute type. Objects handed out by GetModifiableObject() may change at
+  // any time, so they are moved to |unindexed_objects_| until they are
+  // flushed and Find() always considers them.
+  std::map<CK_ATTRIBUTE_TYPE, AttributeValueIndex> attribute_indexes_;
+  ObjectSet unindexed_objects_;
   HandleObjectMap handle_object_map_;
   ChapsFactory* factory_;
   HandleGenerator* handle_generator_;
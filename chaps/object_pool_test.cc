@@ -10,6 +10,9 @@
 #include <utility>
 #include <vector>
 
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/time/time.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -376,4 +379,111 @@ TEST_F(TestObjectPool, NullSlotPolicyMeansAcceptEverything) {
   ASSERT_EQ(1, v.size());
 }
 
+// Test that Find() results stay correct as indexed attributes change.
+TEST_F(TestObjectPool, IndexedFind) {
+  PreparePools();
+  Object* cert = CreateObjectMockWithClass(CKO_CERTIFICATE);
+  cert->SetAttributeInt(CKA_CLASS, CKO_CERTIFICATE);
+  cert->SetAttributeString(CKA_ID, "id1");
+  Object* key = CreateObjectMockWithClass(CKO_PRIVATE_KEY);
+  key->SetAttributeInt(CKA_CLASS, CKO_PRIVATE_KEY);
+  key->SetAttributeString(CKA_ID, "id1");
+  key->SetAttributeInt(CKA_KEY_TYPE, CKK_RSA);
+  EXPECT_EQ(Result::Success, pool2_->Insert(cert));
+  EXPECT_EQ(Result::Success, pool2_->Insert(key));
+
+  std::unique_ptr<Object> by_id(CreateObjectMock());
+  by_id->SetAttributeString(CKA_ID, "id1");
+  std::unique_ptr<Object> by_new_id(CreateObjectMock());
+  by_new_id->SetAttributeString(CKA_ID, "id2");
+  std::unique_ptr<Object> key_by_id(CreateObjectMock());
+  key_by_id->SetAttributeInt(CKA_CLASS, CKO_PRIVATE_KEY);
+  key_by_id->SetAttributeString(CKA_ID, "id1");
+  std::unique_ptr<Object> by_label(CreateObjectMock());
+  by_label->SetAttributeString(CKA_LABEL, "label");
+
+  vector<const Object*> v;
+  EXPECT_EQ(Result::Success, pool2_->Find(by_id.get(), &v));
+  EXPECT_EQ(2, v.size());
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(key_by_id.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(key, v[0]);
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_label.get(), &v));
+  EXPECT_EQ(0, v.size());
+
+  // A modified object is found by its new values even before it is flushed.
+  Object* modifiable = pool2_->GetModifiableObject(cert);
+  modifiable->SetAttributeString(CKA_ID, "id2");
+  modifiable->SetAttributeString(CKA_LABEL, "label");
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_new_id.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(cert, v[0]);
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_id.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(key, v[0]);
+
+  EXPECT_EQ(Result::Success, pool2_->Flush(modifiable));
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_label.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(cert, v[0]);
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_id.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(key, v[0]);
+
+  // Deleted objects are no longer found.
+  EXPECT_EQ(Result::Success, pool2_->Delete(key));
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(by_id.get(), &v));
+  EXPECT_EQ(0, v.size());
+  std::unique_ptr<Object> find_all(CreateObjectMock());
+  v.clear();
+  EXPECT_EQ(Result::Success, pool2_->Find(find_all.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(cert, v[0]);
+}
+
+// Reports the latency of indexed and unindexed searches over a large token.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(TestObjectPool, DISABLED_FindBenchmark) {
+  PreparePools();
+  const int kNumObjects = 10000;
+  const int kIterations = 100;
+  for (int i = 0; i < kNumObjects; ++i) {
+    Object* object = CreateObjectMock();
+    object->SetAttributeInt(CKA_CLASS,
+                            i % 2 ? CKO_CERTIFICATE : CKO_PUBLIC_KEY);
+    object->SetAttributeString(CKA_ID, base::NumberToString(i / 2));
+    object->SetAttributeString(CKA_VALUE, base::NumberToString(i));
+    ASSERT_EQ(Result::Success, pool2_->Insert(object));
+  }
+
+  // CKA_VALUE isn't indexed, so this search scans every object.
+  std::unique_ptr<Object> by_value(CreateObjectMock());
+  by_value->SetAttributeString(CKA_VALUE, "1234");
+  std::unique_ptr<Object> by_class_and_id(CreateObjectMock());
+  by_class_and_id->SetAttributeInt(CKA_CLASS, CKO_CERTIFICATE);
+  by_class_and_id->SetAttributeString(CKA_ID, "617");
+
+  for (const Object* search_template :
+       {by_value.get(), by_class_and_id.get()}) {
+    const base::TimeTicks start = base::TimeTicks::Now();
+    for (int i = 0; i < kIterations; ++i) {
+      vector<const Object*> v;
+      ASSERT_EQ(Result::Success, pool2_->Find(search_template, &v));
+      ASSERT_EQ(1, v.size());
+    }
+    const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+    LOG(INFO) << (search_template == by_value.get() ? "Unindexed" : "Indexed")
+              << " find over " << kNumObjects
+              << " objects: " << elapsed.InMicrosecondsF() / kIterations
+              << " us";
+  }
+}
+
 }  // namespace chaps
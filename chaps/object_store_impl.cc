@@ -19,6 +19,7 @@
 #include <base/strings/stringprintf.h>
 #include <brillo/secure_blob.h>
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 
 #include "chaps/chaps_metrics.h"
 #include "chaps/chaps_utility.h"
@@ -96,7 +97,9 @@ const char ObjectStoreImpl::kObfuscationKey[] = {
     '\x13', '\x92', '\xc0', '\x84', '\x2a', '\xea', '\xf6', '\xfb'};
 const int ObjectStoreImpl::kBlobVersion = 1;
 
-ObjectStoreImpl::ObjectStoreImpl() {}
+ObjectStoreImpl::ObjectStoreImpl()
+    : obfuscation_key_(std::begin(kObfuscationKey), std::end(kObfuscationKey)) {
+}
 
 ObjectStoreImpl::~ObjectStoreImpl() {
   // TODO(https://crbug.com/844537): Remove or decrease log level when root
@@ -207,12 +210,33 @@ bool ObjectStoreImpl::InsertObjectBlob(const ObjectBlob& blob, int* handle) {
     LOG(ERROR) << "The store encryption key has not been initialized.";
     return false;
   }
-  if (!GetNextID(handle)) {
-    LOG(ERROR) << "Failed to generate blob identifier.";
+  // The ID tracker is updated in the same write as the blob so a failed
+  // insert doesn't consume an id.
+  int next_id = 0;
+  if (!ReadInt(kIDTrackerKey, &next_id)) {
+    LOG(ERROR) << "Failed to read ID tracker.";
+    return false;
+  }
+  if (next_id == std::numeric_limits<int>::max()) {
+    LOG(ERROR) << "Object ID overflow.";
     return false;
   }
-  blob_type_map_[*handle] = blob.is_private ? kPrivate : kPublic;
-  return UpdateObjectBlob(*handle, blob);
+  ObjectBlob encrypted_blob;
+  if (!Encrypt(blob, &encrypted_blob)) {
+    LOG(ERROR) << "Failed to encrypt object blob.";
+    return false;
+  }
+  const BlobType type = blob.is_private ? kPrivate : kPublic;
+  leveldb::WriteBatch batch;
+  batch.Put(CreateBlobKey(type, next_id), encrypted_blob.blob);
+  batch.Put(kIDTrackerKey, base::NumberToString(next_id + 1));
+  if (!Write(&batch)) {
+    LOG(ERROR) << "Failed to write object blob.";
+    return false;
+  }
+  blob_type_map_[next_id] = type;
+  *handle = next_id;
+  return true;
 }
 
 bool ObjectStoreImpl::DeleteObjectBlob(int handle) {
@@ -228,26 +252,20 @@ bool ObjectStoreImpl::DeleteObjectBlob(int handle) {
 }
 
 bool ObjectStoreImpl::DeleteAllObjectBlobs() {
-  vector<string> blobs_to_delete;
+  leveldb::WriteBatch batch;
   std::unique_ptr<leveldb::Iterator> it(
       db_->NewIterator(leveldb::ReadOptions()));
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
     BlobType type;
     int id = 0;
     if (ParseBlobKey(it->key().ToString(), &type, &id) && type != kInternal)
-      blobs_to_delete.push_back(it->key().ToString());
-  }
-  bool deleted_all = true;
-  for (size_t i = 0; i < blobs_to_delete.size(); ++i) {
-    leveldb::WriteOptions options;
-    options.sync = true;
-    leveldb::Status status = db_->Delete(options, blobs_to_delete[i]);
-    if (!status.ok()) {
-      LOG(ERROR) << "Failed to delete blob: " << status.ToString();
-      deleted_all = false;
-    }
+      batch.Delete(it->key());
+  }
+  if (!Write(&batch)) {
+    LOG(ERROR) << "Failed to delete blobs.";
+    return false;
   }
-  return deleted_all;
+  return true;
 }
 
 bool ObjectStoreImpl::UpdateObjectBlob(int handle, const ObjectBlob& blob) {
@@ -281,9 +299,11 @@ bool ObjectStoreImpl::LoadPrivateObjectBlobs(map<int, ObjectBlob>* blobs) {
 
 bool ObjectStoreImpl::LoadObjectBlobs(BlobType type,
                                       map<int, ObjectBlob>* blobs) {
+  const string prefix = GetBlobKeyPrefix(type) + kBlobKeySeparator;
   std::unique_ptr<leveldb::Iterator> it(
       db_->NewIterator(leveldb::ReadOptions()));
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+       it->Next()) {
     BlobType it_type;
     int id = 0;
     if (ParseBlobKey(it->key().ToString(), &it_type, &id) && type == it_type) {
@@ -309,9 +329,7 @@ bool ObjectStoreImpl::Encrypt(const ObjectBlob& plain_text,
     return false;
   }
   cipher_text->is_private = plain_text.is_private;
-  SecureBlob obfuscation_key(std::begin(kObfuscationKey),
-                             std::end(kObfuscationKey));
-  SecureBlob& key = plain_text.is_private ? key_ : obfuscation_key;
+  const SecureBlob& key = plain_text.is_private ? key_ : obfuscation_key_;
   string cipher_text_no_hmac;
   if (!RunCipher(true, key, string(), plain_text.blob, &cipher_text_no_hmac))
     return false;
@@ -328,9 +346,7 @@ bool ObjectStoreImpl::Decrypt(const ObjectBlob& cipher_text,
     return false;
   }
   plain_text->is_private = cipher_text.is_private;
-  SecureBlob obfuscation_key(std::begin(kObfuscationKey),
-                             std::end(kObfuscationKey));
-  SecureBlob& key = cipher_text.is_private ? key_ : obfuscation_key;
+  const SecureBlob& key = cipher_text.is_private ? key_ : obfuscation_key_;
   string cipher_text_no_hmac;
   if (!VerifyAndStripHMAC(cipher_text.blob, key, &cipher_text_no_hmac))
     return false;
@@ -368,22 +384,23 @@ bool ObjectStoreImpl::VerifyAndStripHMAC(const string& input,
   return true;
 }
 
-string ObjectStoreImpl::CreateBlobKey(BlobType type, int blob_id) {
-  const char* prefix = NULL;
+string ObjectStoreImpl::GetBlobKeyPrefix(BlobType type) {
   switch (type) {
     case kInternal:
-      prefix = kInternalBlobKeyPrefix;
-      break;
+      return kInternalBlobKeyPrefix;
     case kPublic:
-      prefix = kPublicBlobKeyPrefix;
-      break;
+      return kPublicBlobKeyPrefix;
     case kPrivate:
-      prefix = kPrivateBlobKeyPrefix;
-      break;
+      return kPrivateBlobKeyPrefix;
     default:
       LOG(FATAL) << "Invalid enum value.";
   }
-  return base::StringPrintf("%s%s%d", prefix, kBlobKeySeparator, blob_id);
+  return string();
+}
+
+string ObjectStoreImpl::CreateBlobKey(BlobType type, int blob_id) {
+  return base::StringPrintf("%s%s%d", GetBlobKeyPrefix(type).c_str(),
+                            kBlobKeySeparator, blob_id);
 }
 
 bool ObjectStoreImpl::ParseBlobKey(const string& key,
@@ -414,22 +431,6 @@ bool ObjectStoreImpl::ParseBlobKey(const string& key,
   return true;
 }
 
-bool ObjectStoreImpl::GetNextID(int* next_id) {
-  if (!ReadInt(kIDTrackerKey, next_id)) {
-    LOG(ERROR) << "Failed to read ID tracker.";
-    return false;
-  }
-  if (*next_id == std::numeric_limits<int>::max()) {
-    LOG(ERROR) << "Object ID overflow.";
-    return false;
-  }
-  if (!WriteInt(kIDTrackerKey, *next_id + 1)) {
-    LOG(ERROR) << "Failed to write ID tracker.";
-    return false;
-  }
-  return true;
-}
-
 bool ObjectStoreImpl::ReadBlob(const string& key, string* value) {
   leveldb::Status status = db_->Get(leveldb::ReadOptions(), key, value);
   if (!status.ok()) {
@@ -466,6 +467,17 @@ bool ObjectStoreImpl::WriteInt(const string& key, int value) {
   return WriteBlob(key, base::NumberToString(value));
 }
 
+bool ObjectStoreImpl::Write(leveldb::WriteBatch* batch) {
+  leveldb::WriteOptions options;
+  options.sync = true;
+  leveldb::Status status = db_->Write(options, batch);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to write batch to database: " << status.ToString();
+    return false;
+  }
+  return true;
+}
+
 ObjectStoreImpl::BlobType ObjectStoreImpl::GetBlobType(int blob_id) {
   map<int, BlobType>::iterator it = blob_type_map_.find(blob_id);
   if (it == blob_type_map_.end())
@@ -16,6 +16,7 @@
 #include <gtest/gtest_prod.h>
 #include <leveldb/db.h>
 #include <leveldb/env.h>
+#include <leveldb/write_batch.h>
 
 #include "chaps/chaps_metrics.h"
 
@@ -47,7 +48,8 @@ class ObjectStoreImpl : public ObjectStore {
  private:
   enum BlobType { kInternal, kPrivate, kPublic };
 
-  // Loads all object of a given type.
+  // Loads all object of a given type. Only the key range holding blobs of
+  // that type is visited.
   bool LoadObjectBlobs(BlobType type, std::map<int, ObjectBlob>* blobs);
 
   // Encrypts an object blob with a random IV and appends an HMAC.
@@ -65,6 +67,9 @@ class ObjectStoreImpl : public ObjectStore {
                           const brillo::SecureBlob& key,
                           std::string* stripped);
 
+  // Returns the prefix shared by the database keys of all blobs of |type|.
+  std::string GetBlobKeyPrefix(BlobType type);
+
   // Creates and returns a unique database key for a blob.
   std::string CreateBlobKey(BlobType type, int blob_id);
 
@@ -73,9 +78,6 @@ class ObjectStoreImpl : public ObjectStore {
   // success.
   bool ParseBlobKey(const std::string& key, BlobType* type, int* blob_id);
 
-  // Computes and returns the next (unused) blob id;
-  bool GetNextID(int* next_id);
-
   // Reads a blob from the database. Returns true on success.
   bool ReadBlob(const std::string& key, std::string* value);
 
@@ -88,6 +90,10 @@ class ObjectStoreImpl : public ObjectStore {
   // Writes an integer to the database. Returns true on success.
   bool WriteInt(const std::string& key, int value);
 
+  // Atomically applies all updates in |batch| with a single synced write.
+  // Returns true on success.
+  bool Write(leveldb::WriteBatch* batch);
+
   // Returns the blob type for the specified blob. If 'blob_id' is unknown,
   // kInternal is returned.
   BlobType GetBlobType(int blob_id);
@@ -116,6 +122,8 @@ class ObjectStoreImpl : public ObjectStore {
   static const int kBlobVersion;
 
   brillo::SecureBlob key_;
+  // |kObfuscationKey| as a SecureBlob, for public blobs.
+  const brillo::SecureBlob obfuscation_key_;
   std::unique_ptr<leveldb::Env> env_;
   std::unique_ptr<leveldb::DB> db_;
   std::map<int, BlobType> blob_type_map_;
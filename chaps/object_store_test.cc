@@ -8,6 +8,8 @@
 #include <string>
 
 #include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/time/time.h>
 #include <gtest/gtest.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
@@ -267,6 +269,37 @@ TEST(TestObjectStore, DeleteAll) {
   EXPECT_EQ("internal", internal);
 }
 
+// Reports the cost of importing objects and of loading them back. Run with
+// --gtest_also_run_disabled_tests.
+TEST(TestObjectStore, DISABLED_ImportLoadBenchmark) {
+  const int kNumObjects = 500;
+  ObjectStoreImpl store;
+  base::ScopedTempDir tmp_dir;
+  ASSERT_TRUE(tmp_dir.CreateUniqueTempDir());
+  ::testing::NiceMock<MetricsLibraryMock> mock_metrics_library;
+  ChapsMetrics chaps_metrics;
+  chaps_metrics.set_metrics_library_for_testing(&mock_metrics_library);
+  ASSERT_TRUE(store.Init(tmp_dir.GetPath(), &chaps_metrics));
+  ASSERT_TRUE(store.SetEncryptionKey(SecureBlob(32, 0xAA)));
+  // Roughly the size of a serialized certificate object.
+  const ObjectBlob blob = {string(2048, 'A'), true};
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kNumObjects; ++i) {
+    int handle;
+    ASSERT_TRUE(store.InsertObjectBlob(blob, &handle));
+  }
+  LOG(INFO) << "Inserts: "
+            << (base::TimeTicks::Now() - start).InMillisecondsF() << " ms";
+
+  start = base::TimeTicks::Now();
+  map<int, ObjectBlob> objects;
+  ASSERT_TRUE(store.LoadPrivateObjectBlobs(&objects));
+  ASSERT_EQ(kNumObjects, objects.size());
+  LOG(INFO) << "Load of " << objects.size() << " private objects: "
+            << (base::TimeTicks::Now() - start).InMillisecondsF() << " ms";
+}
+
 }  // namespace chaps
 
 int main(int argc, char** argv) {
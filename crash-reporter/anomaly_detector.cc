@@ -10,6 +10,8 @@
 #include <utility>
 
 #include <anomaly_detector/proto_bindings/anomaly_detector.pb.h>
+#include <base/check.h>
+#include <base/check_op.h>
 #include <base/logging.h>
 #include <base/rand_util.h>
 #include <base/strings/strcat.h>
@@ -62,6 +64,43 @@ std::ostream& operator<<(std::ostream& out, const CrashReport& cr) {
   return out;
 }
 
+PatternSet::PatternSet(const std::vector<std::string>& patterns)
+    : set_(RE2::DefaultOptions, RE2::UNANCHORED) {
+  CHECK_LE(patterns.size(), 64u);
+  for (const std::string& pattern : patterns) {
+    std::string error;
+    CHECK_NE(set_.Add(pattern, &error), -1)
+        << "Invalid pattern " << pattern << ": " << error;
+    patterns_.push_back(std::make_unique<RE2>(pattern));
+  }
+  CHECK(set_.Compile());
+}
+
+PatternSet::~PatternSet() = default;
+
+uint64_t PatternSet::Match(const std::string& line) const {
+  std::vector<int> matches;
+  RE2::Set::ErrorInfo error_info = {RE2::Set::kNoError};
+  if (!set_fails_for_testing_ && set_.Match(line, &matches, &error_info)) {
+    uint64_t result = 0;
+    for (int index : matches)
+      result |= uint64_t{1} << index;
+    return result;
+  }
+  if (!set_fails_for_testing_ && error_info.kind == RE2::Set::kNoError)
+    return 0;
+
+  // Matching failed, e.g. because the DFA ran out of memory. Callers act on
+  // the result without checking the line again, so fall back to matching the
+  // patterns one at a time.
+  uint64_t result = 0;
+  for (size_t i = 0; i < patterns_.size(); ++i) {
+    if (RE2::PartialMatch(line, *patterns_[i]))
+      result |= uint64_t{1} << i;
+  }
+  return result;
+}
+
 Parser::~Parser() {}
 
 // We expect only a handful of different anomalies per boot session, so the
@@ -119,7 +158,7 @@ MaybeCrashReport ServiceParser::ParseLogEntry(const std::string& line) {
   return CrashReport(std::move(text), {std::move(flag)});
 }
 
-std::string GetField(const std::string& line, std::string pattern) {
+std::string GetField(const std::string& line, const RE2& pattern) {
   std::string field_value;
   RE2::PartialMatch(line, pattern, &field_value);
   // This will return the empty string if there wasn't a match.
@@ -141,6 +180,11 @@ bool IsCrosSelinuxViolation(const std::vector<std::string>& contents) {
 }
 
 constexpr LazyRE2 granted = {"avc:[ ]*granted"};
+constexpr LazyRE2 scontext_field = {R"(scontext=(\S*))"};
+constexpr LazyRE2 tcontext_field = {R"(tcontext=(\S*))"};
+constexpr LazyRE2 permission_field = {R"(\{ (\S*) \})"};
+constexpr LazyRE2 comm_field = {R"'(comm="([^"]*)")'"};
+constexpr LazyRE2 name_field = {R"'(name="([^"]*)")'"};
 
 SELinuxParser::SELinuxParser(bool testonly_send_all)
     : testonly_send_all_(testonly_send_all) {}
@@ -170,11 +214,11 @@ MaybeCrashReport SELinuxParser::ParseLogEntry(const std::string& line) {
   if (RE2::PartialMatch(line, *granted))
     signature += "granted-";
 
-  std::string scontext = GetField(line, R"(scontext=(\S*))");
-  std::string tcontext = GetField(line, R"(tcontext=(\S*))");
-  std::string permission = GetField(line, R"(\{ (\S*) \})");
-  std::string comm = GetField(line, R"'(comm="([^"]*)")'");
-  std::string name = GetField(line, R"'(name="([^"]*)")'");
+  std::string scontext = GetField(line, *scontext_field);
+  std::string tcontext = GetField(line, *tcontext_field);
+  std::string permission = GetField(line, *permission_field);
+  std::string comm = GetField(line, *comm_field);
+  std::string name = GetField(line, *name_field);
 
   // Ignore ARC++, and other non-CrOS, errors. They are extremely common and
   // largely not used anyway, providing a lot of noise.
@@ -232,14 +276,15 @@ std::string DetermineFlag(const std::string& info) {
   return "--kernel_warning";
 }
 
-constexpr LazyRE2 start_ath10k_dump = {R"(ath10k_.*firmware crashed!)"};
+constexpr char start_ath10k_dump_pattern[] = R"(ath10k_.*firmware crashed!)";
 constexpr LazyRE2 end_ath10k_dump = {R"(ath10k_.*htt-ver)"};
 constexpr LazyRE2 tag_ath10k_dump = {R"(ath10k_)"};
 
 // Older wifi chips have lmac dump only and newer wifi chips have lmac followed
 // by umac dumps. The KernelParser should parse the dumps accordingly.
 // The following regexp identify the beginning of the iwlwifi dump.
-constexpr LazyRE2 start_iwlwifi_dump = {R"(iwlwifi.*Loaded firmware version:)"};
+constexpr char start_iwlwifi_dump_pattern[] =
+    R"(iwlwifi.*Loaded firmware version:)";
 
 // The following regexp separates the umac and lmac.
 constexpr LazyRE2 start_iwlwifi_dump_umac = {R"(Start IWL Error Log Dump(.+))"};
@@ -260,17 +305,41 @@ constexpr char crash_report_rlimit[] =
 constexpr LazyRE2 header = {
     R"(^\[\s*\S+\] WARNING:(?: CPU: \d+ PID: \d+)? at (.+))"};
 
-constexpr LazyRE2 smmu_fault = {R"(Unhandled context fault: fsr=0x)"};
+constexpr char smmu_fault_pattern[] = R"(Unhandled context fault: fsr=0x)";
 
+constexpr char kernel_lc_suspend_warning_pattern[] =
+    R"((intel_pmc_core.+CPU did not enter SLP_S0!!!))";
 static constexpr LazyRE2 kernel_lc_suspend_warning = {
-    R"((intel_pmc_core.+CPU did not enter SLP_S0!!!))"};
+    kernel_lc_suspend_warning_pattern};
+
+// The patterns KernelParser looks for on every line, in the order they are
+// added to KernelParser::triggers_. Most kernel lines match none of them, so
+// a single PatternSet pass replaces running each expression separately.
+enum KernelTrigger {
+  kCutHere,
+  kEndTrace,
+  kLcSuspendWarning,
+  kStartAth10kDump,
+  kStartIwlwifiDump,
+  kSmmuFault,
+  kCrashReporterRlimit,
+};
 
 KernelParser::KernelParser(bool testonly_send_all)
-    : testonly_send_all_(testonly_send_all) {}
+    : testonly_send_all_(testonly_send_all),
+      triggers_({RE2::QuoteMeta(cut_here), RE2::QuoteMeta(end_trace),
+                 kernel_lc_suspend_warning_pattern, start_ath10k_dump_pattern,
+                 start_iwlwifi_dump_pattern, smmu_fault_pattern,
+                 RE2::QuoteMeta(crash_report_rlimit)}) {}
 
 MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
+  const uint64_t triggers = triggers_.Match(line);
+  auto triggered = [triggers](KernelTrigger trigger) {
+    return (triggers & (uint64_t{1} << trigger)) != 0;
+  };
+
   if (last_line_ == LineType::None) {
-    if (line.find(cut_here) != std::string::npos)
+    if (triggered(kCutHere))
       last_line_ = LineType::Start;
   } else if (last_line_ == LineType::Start || last_line_ == LineType::Header) {
     std::string info;
@@ -300,7 +369,7 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
       last_line_ = LineType::None;
     }
   } else if (last_line_ == LineType::Body) {
-    if (line.find(end_trace) != std::string::npos) {
+    if (triggered(kEndTrace)) {
       last_line_ = LineType::None;
       std::string text_tmp;
       text_tmp.swap(text_);
@@ -323,7 +392,8 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
   // so they are not caught by the kernel warning matching code above. Look for
   // them here, and make sure they are sampled identically to kernel_warning.
   std::string sig;
-  if (RE2::PartialMatch(line, *kernel_lc_suspend_warning, &sig)) {
+  if (triggered(kLcSuspendWarning) &&
+      RE2::PartialMatch(line, *kernel_lc_suspend_warning, &sig)) {
     uint32_t hash = StringHash(sig.c_str());
     if (WasAlreadySeen(hash)) {
       return std::nullopt;
@@ -341,7 +411,7 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
   }
 
   if (ath10k_last_line_ == Ath10kLineType::None) {
-    if (RE2::PartialMatch(line, *start_ath10k_dump)) {
+    if (triggered(kStartAth10kDump)) {
       ath10k_last_line_ = Ath10kLineType::Start;
       ath10k_text_ += line + "\n";
     }
@@ -372,7 +442,7 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
   }
 
   if (iwlwifi_last_line_ == IwlwifiLineType::None) {
-    if (RE2::PartialMatch(line, *start_iwlwifi_dump)) {
+    if (triggered(kStartIwlwifiDump)) {
       iwlwifi_last_line_ = IwlwifiLineType::Start;
       iwlwifi_text_ += line + "\n";
     }
@@ -421,13 +491,13 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
     }
   }
 
-  if (RE2::PartialMatch(line, *smmu_fault)) {
+  if (triggered(kSmmuFault)) {
     std::string smmu_text_tmp = line + "\n";
     return CrashReport(std::move(smmu_text_tmp),
                        {std::move("--kernel_smmu_fault")});
   }
 
-  if (line.find(crash_report_rlimit) != std::string::npos) {
+  if (triggered(kCrashReporterRlimit)) {
     LOG(INFO) << "crash_reporter crashed!";
     // Rate limit reporting crash_reporter failures to prevent crash loops.
     if (crash_reporter_last_crashed_.is_null() ||
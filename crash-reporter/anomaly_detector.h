@@ -20,6 +20,8 @@
 #include <base/time/time.h>
 #include <dbus/bus.h>
 #include <metrics/metrics_library.h>
+#include <re2/re2.h>
+#include <re2/set.h>
 
 #include <memory>
 #include <optional>
@@ -45,6 +47,31 @@ using MaybeCrashReport = std::optional<CrashReport>;
 
 constexpr size_t HASH_BITMAP_SIZE(1 << 15);
 
+// PatternSet matches a log line against several regular expressions in a
+// single pass. Parsers use it as a prefilter, so that their individual
+// expressions (with captures) only run on the few lines that can match.
+class PatternSet {
+ public:
+  // At most 64 |patterns| are supported.
+  explicit PatternSet(const std::vector<std::string>& patterns);
+  PatternSet(const PatternSet&) = delete;
+  PatternSet& operator=(const PatternSet&) = delete;
+  ~PatternSet();
+
+  // Returns a bitmask with bit i set if |patterns[i]| matches somewhere in
+  // |line|, i.e. if RE2::PartialMatch() would succeed.
+  uint64_t Match(const std::string& line) const;
+
+  // Makes every RE2::Set match fail, as when the DFA runs out of memory.
+  void FailSetMatchesForTesting() { set_fails_for_testing_ = true; }
+
+ private:
+  RE2::Set set_;
+  // The same patterns, matched one at a time if |set_| fails.
+  std::vector<std::unique_ptr<RE2>> patterns_;
+  bool set_fails_for_testing_ = false;
+};
+
 class Parser {
  public:
   virtual ~Parser() = 0;
@@ -93,6 +120,8 @@ class KernelParser : public Parser {
   explicit KernelParser(bool testonly_send_all);
   MaybeCrashReport ParseLogEntry(const std::string& line) override;
 
+  void FailTriggerSetForTesting() { triggers_.FailSetMatchesForTesting(); }
+
  private:
   // Iwlwifi is the name of Intel WiFi driver that we want to parse its error
   // dumps.
@@ -116,6 +145,9 @@ class KernelParser : public Parser {
   };
   const bool testonly_send_all_;
 
+  // The patterns checked on every line, see KernelTrigger.
+  PatternSet triggers_;
+
   LineType last_line_ = LineType::None;
   IwlwifiLineType iwlwifi_last_line_ = IwlwifiLineType::None;
   std::string iwlwifi_text_;
@@ -5,10 +5,14 @@
 #include "crash-reporter/anomaly_detector.h"
 
 #include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <base/files/file_path.h>
+#include <base/logging.h>
 #include <base/strings/stringprintf.h>
+#include <base/time/time.h>
 #include <chromeos/dbus/service_constants.h>
 #include <dbus/message.h>
 #include <dbus/mock_bus.h>
@@ -18,6 +22,7 @@
 #include <metrics/metrics_library_mock.h>
 
 #include "crash-reporter/anomaly_detector_test_utils.h"
+#include "crash-reporter/test_util.h"
 #include "crash-reporter/util.h"
 
 namespace {
@@ -32,6 +37,7 @@ using ::anomaly::CryptohomeParser;
 using ::anomaly::KernelParser;
 using ::anomaly::ParserRun;
 using ::anomaly::ParserTest;
+using ::anomaly::PatternSet;
 using ::anomaly::SELinuxParser;
 using ::anomaly::ServiceParser;
 using ::anomaly::ShillParser;
@@ -391,6 +397,15 @@ TEST(AnomalyDetectorTest, KernelWarning) {
   ParserTest("TEST_WARNING", {simple_run, second}, &parser);
 }
 
+// A failing RE2::Set must neither miss warnings nor report ordinary lines.
+TEST(AnomalyDetectorTest, KernelWarningTriggerSetFails) {
+  KernelParser parser(true);
+  parser.FailTriggerSetForTesting();
+  ParserTest("TEST_WARNING", {simple_run}, &parser);
+  ParserRun smmu_fault = {.expected_size = 1};
+  ParserTest("TEST_SMMU_FAULT", {smmu_fault}, &parser);
+}
+
 TEST(AnomalyDetectorTest, KernelWarningNoDuplicate) {
   ParserRun identical_warning{.expected_size = 0};
   KernelParser parser(true);
@@ -699,3 +714,47 @@ TEST(AnomalyDetectorTest, CellularFailureBlocked) {
   ShillParser parser(/*testonly_send_all=*/true);
   ParserTest("TEST_CELLULAR_FAILURE_BLOCKED", {modem_failure}, &parser);
 }
+
+TEST(AnomalyDetectorTest, PatternSetMatch) {
+  PatternSet patterns({"cut here", R"(ath10k_.*firmware crashed!)", "^\\[",
+                       "end trace"});
+  EXPECT_EQ(0u, patterns.Match("nothing to see"));
+  EXPECT_EQ(0b0001u, patterns.Match("-----[ cut here ]-----"));
+  EXPECT_EQ(0b0110u, patterns.Match("[ 1.0] ath10k_pci: firmware crashed!"));
+  EXPECT_EQ(0b1101u, patterns.Match("[ 1.0] cut here, end trace"));
+}
+
+TEST(AnomalyDetectorTest, PatternSetMatchFallback) {
+  PatternSet patterns({"cut here", R"(ath10k_.*firmware crashed!)", "^\\[",
+                       "end trace"});
+  patterns.FailSetMatchesForTesting();
+  EXPECT_EQ(0u, patterns.Match("nothing to see"));
+  EXPECT_EQ(0b0001u, patterns.Match("-----[ cut here ]-----"));
+  EXPECT_EQ(0b0110u, patterns.Match("[ 1.0] ath10k_pci: firmware crashed!"));
+  EXPECT_EQ(0b1101u, patterns.Match("[ 1.0] cut here, end trace"));
+}
+
+// Reports how many kernel log lines per second KernelParser processes, using
+// the kernel test logs repeated many times. Most lines don't match anything,
+// as on a real system. Run with --gtest_also_run_disabled_tests.
+TEST(AnomalyDetectorTest, DISABLED_KernelParserBenchmark) {
+  const int kRepetitions = 2000;
+  std::vector<std::string> log_msgs;
+  for (const char* file :
+       {"TEST_WARNING", "TEST_WARNING_OLD", "TEST_WIFI_WARNING",
+        "TEST_ATH10K_PCI", "TEST_IWLWIFI_LMAC_UMAC", "TEST_SMMU_FAULT",
+        "TEST_SUSPEND_WARNING_LOWERCASE"}) {
+    std::vector<std::string> msgs = anomaly::GetTestLogMessages(
+        test_util::GetTestDataPath(file, /*use_testdata=*/true));
+    log_msgs.insert(log_msgs.end(), msgs.begin(), msgs.end());
+  }
+
+  KernelParser parser(/*testonly_send_all=*/true);
+  size_t reports = 0;
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kRepetitions; ++i)
+    reports += anomaly::ParseLogMessages(&parser, log_msgs).size();
+  const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  LOG(INFO) << kRepetitions * log_msgs.size() / elapsed.InSecondsF()
+            << " lines/s, " << reports << " reports";
+}
@@ -40,7 +40,6 @@
 #include <base/strings/stringprintf.h>
 #include <base/threading/thread_task_runner_handle.h>
 #include <brillo/key_value_store.h>
-#include <brillo/process/process.h>
 #include <brillo/syslog_logging.h>
 #include <brillo/userdb_utils.h>
 #include <debugd/dbus-constants.h>
@@ -49,6 +48,7 @@
 #include <zlib.h>
 
 #include "crash-reporter/constants.h"
+#include "crash-reporter/log_command_runner.h"
 #include "crash-reporter/paths.h"
 #include "crash-reporter/util.h"
 
@@ -58,7 +58,12 @@ const char kCollectChromeFile[] =
     "/mnt/stateful_partition/etc/collect_chrome_crashes";
 const char kDefaultLogConfig[] = "/etc/crash_reporter_logs.conf";
 const char kDefaultUserName[] = "chronos";
-const char kShellPath[] = "/bin/sh";
+// Log commands still running after this long are killed.
+constexpr base::TimeDelta kLogCommandTimeout = base::Seconds(30);
+// Output of a log command is reused by crash_reporter processes that run the
+// same command within this long, e.g. for a service crashing in a loop.
+constexpr base::TimeDelta kLogCacheLifetime = base::Seconds(10);
+const char kLogCommandTimeHistogram[] = "Crash.Collector.LogCommandTime";
 const char kCollectorNameKey[] = "collector";
 const char kDaemonStoreKey[] = "using_daemon_store";
 const char kEarlyCrashKey[] = "is_early_boot";
@@ -1377,39 +1382,40 @@ bool CrashCollector::GetMultipleLogContents(
     return false;
   }
 
-  std::string collated_log_contents;
-  for (auto exec_name : exec_names) {
+  std::vector<std::string> found_exec_names;
+  std::vector<std::string> commands;
+  for (const auto& exec_name : exec_names) {
     std::string command;
     if (!store.GetString(exec_name, &command)) {
       LOG(WARNING) << "exec name '" << exec_name << "' not found in log file";
       continue;
     }
+    found_exec_names.push_back(exec_name);
+    commands.push_back(command);
+  }
 
-    FilePath raw_output_file;
-    if (!base::CreateTemporaryFile(&raw_output_file)) {
-      PLOG(WARNING) << "Failed to create temporary file for raw log output.";
-      continue;
-    }
-
-    brillo::ProcessImpl diag_process;
-    diag_process.AddArg(kShellPath);
-    diag_process.AddStringOption("-c", command);
-    diag_process.RedirectOutput(raw_output_file.value());
-
-    const int result = diag_process.Run();
+  LogCommandRunner runner(paths::GetAt(paths::kSystemRunStateDirectory,
+                                       paths::kLogCacheDirectory),
+                          max_log_size_, kLogCommandTimeout,
+                          kLogCacheLifetime);
+  const std::vector<LogCommandResult> results = runner.Run(commands);
 
-    std::string log_contents;
-    const bool fully_read = base::ReadFileToStringWithMaxSize(
-        raw_output_file, &log_contents, max_log_size_);
-    base::DeleteFile(raw_output_file);
+  std::string collated_log_contents;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const LogCommandResult& result = results[i];
+    if (result.cached) {
+      LOG(INFO) << "Reused recent output of log command for "
+                << found_exec_names[i];
+    } else {
+      LOG(INFO) << "Log command for " << found_exec_names[i] << " took "
+                << result.duration.InMilliseconds() << " ms";
+      metrics_lib_->SendToUMA(kLogCommandTimeHistogram,
+                              result.duration.InMilliseconds(), 1,
+                              kLogCommandTimeout.InMilliseconds(), 50);
+    }
 
-    if (!fully_read) {
-      if (log_contents.empty()) {
-        LOG(WARNING) << "Failed to read raw log contents.";
-        continue;
-      }
-      // If ReadFileToStringWithMaxSize returned false and log_contents is
-      // non-empty, this means the log is larger than max_log_size_.
+    std::string log_contents = result.output;
+    if (result.truncated) {
       LOG(WARNING) << "Log is larger than " << max_log_size_
                    << " bytes. Truncating.";
       log_contents.append("\n<TRUNCATED>\n");
@@ -1418,9 +1424,17 @@ bool CrashCollector::GetMultipleLogContents(
     // If the registered command failed, we include any (partial) output it
     // might have produced to improve crash reports.  But make a note of the
     // failure.
-    if (result != 0) {
-      const std::string warning = StringPrintf(
-          "\nLog command \"%s\" exited with %i\n", command.c_str(), result);
+    std::string warning;
+    if (result.timed_out) {
+      warning = StringPrintf("\nLog command \"%s\" timed out after %" PRId64
+                             " seconds\n",
+                             commands[i].c_str(),
+                             kLogCommandTimeout.InSeconds());
+    } else if (!result.truncated && result.exit_code != 0) {
+      warning = StringPrintf("\nLog command \"%s\" exited with %i\n",
+                             commands[i].c_str(), result.exit_code);
+    }
+    if (!warning.empty()) {
       log_contents.append(warning);
       LOG(WARNING) << warning;
     }
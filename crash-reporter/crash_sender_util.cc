@@ -33,6 +33,7 @@
 #include <brillo/files/file_util.h>
 #include <brillo/files/safe_fd.h>
 #include <brillo/http/http_proxy.h>
+#include <brillo/http/http_request.h>
 #include <brillo/http/http_transport.h>
 #include <brillo/http/http_utils.h>
 #include <brillo/mime_utils.h>
@@ -43,6 +44,7 @@
 #include "crash-reporter/constants.h"
 #include "crash-reporter/crash_sender.pb.h"
 #include "crash-reporter/crash_sender_paths.h"
+#include "crash-reporter/gzip_input_stream.h"
 #include "crash-reporter/paths.h"
 #include "crash-reporter/util.h"
 
@@ -824,26 +826,21 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
   std::string report_id;
 
   auto stream_data = form_data->ExtractDataStream();
-  uint64_t uncompressed_size = stream_data->GetSize();
-  // Compress the data before sending it to the server. We compress the entire
-  // request body and then specify the Content-Encoding as gzip to achieve this.
-  std::vector<unsigned char> compressed_form_data =
-      util::GzipStream(std::move(stream_data));
-
-  // Record the send attempt even if it fails. We may still have used up network
-  // bandwidth even if we lose the connection at the end.
+  const uint64_t uncompressed_size = stream_data->GetSize();
   const base::FilePath timestamps_dir = paths::Get(paths::kTimestampsDirectory);
-  int size = static_cast<int>(compressed_form_data.size());
-  if (size == 0) {
-    // Compression failed; we'll end up using the uncompressed stream below.
-    size = static_cast<int>(uncompressed_size);
-  }
-  RecordSendAttempt(timestamps_dir, size);
 
   if (IsMock()) {
-    CHECK(!crash_during_testing_) << "crashing as requested";
     // Integration Tests-specific behavior
     if (IsIntegrationTest()) {
+      // Nothing is uploaded, so record the send attempt with the size the
+      // compressed report would have had.
+      int size =
+          static_cast<int>(util::GzipStream(std::move(stream_data)).size());
+      if (size == 0)
+        size = static_cast<int>(uncompressed_size);
+      RecordSendAttempt(timestamps_dir, size);
+
+      CHECK(!crash_during_testing_) << "crashing as requested";
       if (!IsMockSuccessful()) {
         LOG(INFO) << "Mocking unsuccessful send";
         return CrashRemoveReason::kRetryUploading;
@@ -852,6 +849,7 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
       LOG(INFO) << "Mocking successful send";
       return CrashRemoveReason::kFinishedUploading;
     }
+    CHECK(!crash_during_testing_) << "crashing as requested";
   } else {
     // Determine the proxy server if it's not given from the options.
     if (proxy_servers_.empty()) {
@@ -862,16 +860,26 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
   }
 
   std::shared_ptr<brillo::http::Transport> transport = GetTransport();
+  const std::string url =
+      allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl;
+
+  // Compress the data while it's being sent to the server, so that large
+  // reports are never held in memory. We compress the entire request body and
+  // then specify the Content-Encoding as gzip to achieve this. The compressed
+  // size isn't known up front, so the body is sent chunked.
+  uint64_t compressed_size = 0;
+  brillo::StreamPtr compressed_stream =
+      GzipInputStream::Create(std::move(stream_data), &compressed_size);
 
   brillo::ErrorPtr upload_error;
   std::unique_ptr<brillo::http::Response> response;
-  if (!compressed_form_data.empty()) {
-    response = brillo::http::PostBinaryAndBlock(
-        allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl,
-        compressed_form_data.data(), compressed_form_data.size(),
-        form_data->GetContentType(),
-        {{brillo::http::request_header::kContentEncoding, "gzip"}}, transport,
-        &upload_error);
+  if (compressed_stream) {
+    brillo::http::Request request(url, brillo::http::request_type::kPost,
+                                  transport);
+    request.SetContentType(form_data->GetContentType());
+    request.AddHeader(brillo::http::request_header::kContentEncoding, "gzip");
+    if (request.AddRequestBody(std::move(compressed_stream), &upload_error))
+      response = request.GetResponseAndBlock(&upload_error);
   } else {
     LOG(ERROR) << "Failed compressing crash data for upload, perform the "
                << "upload uncompressed";
@@ -884,10 +892,14 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
       return CrashRemoveReason::kRetryUploading;
     }
     response = brillo::http::PostFormDataAndBlock(
-        allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl,
-        std::move(form_data), {} /* headers */, transport, &upload_error);
+        url, std::move(form_data), {} /* headers */, transport, &upload_error);
+    compressed_size = uncompressed_size;
   }
 
+  // Record the send attempt even if it fails. We may still have used up network
+  // bandwidth even if we lose the connection at the end.
+  RecordSendAttempt(timestamps_dir, static_cast<int>(compressed_size));
+
   if (!response) {
     LOG(ERROR) << "Crash sending failed with error: "
                << upload_error->GetMessage();
@@ -0,0 +1,185 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/gzip_input_stream.h"
+
+#include <string.h>
+
+#include <memory>
+#include <utility>
+
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <brillo/errors/error.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace util {
+
+namespace {
+
+constexpr size_t kInputBufferSize = 64 * 1024;
+
+constexpr char kErrorDomain[] = "zlib";
+constexpr char kDeflateFailed[] = "deflate_failed";
+
+// Using a window size of 31 sets us to gzip mode (16) + default window size
+// (15).
+constexpr int kDefaultWindowSize = 15;
+constexpr int kWindowSizeGzipAdd = 16;
+constexpr int kDefaultMemLevel = 8;
+
+}  // namespace
+
+// static
+brillo::StreamPtr GzipInputStream::Create(brillo::StreamPtr source,
+                                          uint64_t* compressed_size) {
+  std::unique_ptr<GzipInputStream> stream(
+      new GzipInputStream(std::move(source), compressed_size));
+  z_stream* deflate_stream = &stream->deflate_stream_;
+  int result = deflateInit2(deflate_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                            kDefaultWindowSize + kWindowSizeGzipAdd,
+                            kDefaultMemLevel, Z_DEFAULT_STRATEGY);
+  if (result != Z_OK) {
+    LOG(ERROR) << "Error initializing zlib: error code " << result
+               << ", error msg: "
+               << (deflate_stream->msg == nullptr ? "None"
+                                                  : deflate_stream->msg);
+    return nullptr;
+  }
+  return stream;
+}
+
+GzipInputStream::GzipInputStream(brillo::StreamPtr source,
+                                 uint64_t* compressed_size)
+    : source_(std::move(source)),
+      compressed_size_(compressed_size),
+      input_(kInputBufferSize) {
+  memset(&deflate_stream_, 0, sizeof(deflate_stream_));
+  deflate_stream_.zalloc = Z_NULL;
+  deflate_stream_.zfree = Z_NULL;
+  if (compressed_size_)
+    *compressed_size_ = 0;
+}
+
+GzipInputStream::~GzipInputStream() {
+  // Safe to call even if deflateInit2() failed or the stream is closed.
+  deflateEnd(&deflate_stream_);
+}
+
+bool GzipInputStream::SetSizeBlocking(uint64_t /* size */,
+                                      brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::Seek(int64_t /* offset */,
+                           Whence /* whence */,
+                           uint64_t* /* new_position */,
+                           brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::ReadNonBlocking(void* buffer,
+                                      size_t size_to_read,
+                                      size_t* size_read,
+                                      bool* end_of_stream,
+                                      brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  deflate_stream_.next_out = static_cast<unsigned char*>(buffer);
+  deflate_stream_.avail_out = size_to_read;
+  while (deflate_stream_.avail_out > 0 && !finished_) {
+    if (deflate_stream_.avail_in == 0 && !source_finished_) {
+      size_t input_size = 0;
+      if (!source_->ReadNonBlocking(input_.data(), input_.size(), &input_size,
+                                    &source_finished_, error)) {
+        return false;
+      }
+      // Return what we have until more input is available.
+      if (input_size == 0 && !source_finished_)
+        break;
+      deflate_stream_.next_in = input_.data();
+      deflate_stream_.avail_in = input_size;
+    }
+
+    // We must request a flush once all input has been read, else deflate()
+    // may hold on to some compressed data.
+    const int result =
+        deflate(&deflate_stream_, source_finished_ ? Z_FINISH : Z_NO_FLUSH);
+    if (result == Z_STREAM_END) {
+      finished_ = true;
+    } else if (result != Z_OK && result != Z_BUF_ERROR) {
+      // Z_BUF_ERROR only means that no progress was possible; see
+      // https://zlib.net/zlib_how.html
+      brillo::Error::AddTo(error, FROM_HERE, kErrorDomain, kDeflateFailed,
+                           base::StringPrintf("deflate() returned %d", result));
+      return false;
+    }
+  }
+
+  *size_read = size_to_read - deflate_stream_.avail_out;
+  if (compressed_size_)
+    *compressed_size_ = deflate_stream_.total_out;
+  if (end_of_stream)
+    *end_of_stream = finished_ && *size_read == 0;
+  return true;
+}
+
+bool GzipInputStream::WriteNonBlocking(const void* /* buffer */,
+                                       size_t /* size_to_write */,
+                                       size_t* /* size_written */,
+                                       brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::CloseBlocking(brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return true;
+  bool success = source_->CloseBlocking(error);
+  source_.reset();
+  deflateEnd(&deflate_stream_);
+  return success;
+}
+
+bool GzipInputStream::WaitForDataRead(base::OnceClosure callback,
+                                      brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!source_finished_)
+    return source_->WaitForDataRead(std::move(callback), error);
+
+  brillo::MessageLoop::current()->PostTask(FROM_HERE, std::move(callback));
+  return true;
+}
+
+bool GzipInputStream::WaitForDataReadBlocking(base::TimeDelta timeout,
+                                              brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!source_finished_)
+    return source_->WaitForDataReadBlocking(timeout, error);
+
+  return true;
+}
+
+bool GzipInputStream::WaitForDataWrite(base::OnceClosure /* callback */,
+                                       brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::WaitForDataWriteBlocking(base::TimeDelta /* timeout */,
+                                               brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+void GzipInputStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    source_->CancelPendingAsyncOperations();
+  brillo::Stream::CancelPendingAsyncOperations();
+}
+
+}  // namespace util
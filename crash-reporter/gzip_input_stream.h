@@ -0,0 +1,100 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CRASH_REPORTER_GZIP_INPUT_STREAM_H_
+#define CRASH_REPORTER_GZIP_INPUT_STREAM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <brillo/streams/stream.h>
+#include <zlib.h>
+
+namespace util {
+
+// GzipInputStream is a read-only stream that returns the gzip-compressed
+// contents of a source stream. Data is compressed as it is read, so only one
+// buffer of input is held in memory at a time. This lets a crash report be
+// compressed while it is being uploaded instead of compressing the whole
+// report in memory first.
+//
+// The compressed size isn't known in advance, so CanGetSize() is false and
+// HTTP requests using this stream as their body are sent chunked.
+class GzipInputStream : public brillo::Stream {
+ public:
+  // Returns a stream of the gzip-compressed contents of |source|, or nullptr
+  // if zlib couldn't be initialized. If |compressed_size| is not null, it's
+  // set to the number of compressed bytes read so far; it must outlive the
+  // returned stream.
+  static brillo::StreamPtr Create(brillo::StreamPtr source,
+                                  uint64_t* compressed_size);
+
+  GzipInputStream(const GzipInputStream&) = delete;
+  GzipInputStream& operator=(const GzipInputStream&) = delete;
+
+  ~GzipInputStream() override;
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override { return source_ != nullptr; }
+  bool CanRead() const override { return true; }
+  bool CanWrite() const override { return false; }
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t size, brillo::ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override { return 0; }
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override { return deflate_stream_.total_out; }
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            brillo::ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       brillo::ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        brillo::ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(brillo::ErrorPtr* /* error */) override { return true; }
+  bool CloseBlocking(brillo::ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForDataRead(base::OnceClosure callback,
+                       brillo::ErrorPtr* error) override;
+  bool WaitForDataReadBlocking(base::TimeDelta timeout,
+                               brillo::ErrorPtr* error) override;
+  bool WaitForDataWrite(base::OnceClosure callback,
+                        brillo::ErrorPtr* error) override;
+  bool WaitForDataWriteBlocking(base::TimeDelta timeout,
+                                brillo::ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  GzipInputStream(brillo::StreamPtr source, uint64_t* compressed_size);
+
+  brillo::StreamPtr source_;
+  uint64_t* compressed_size_;
+  z_stream deflate_stream_;
+  // Data read from |source_| that zlib hasn't consumed yet.
+  std::vector<unsigned char> input_;
+  bool source_finished_ = false;
+  bool finished_ = false;
+};
+
+}  // namespace util
+
+#endif  // CRASH_REPORTER_GZIP_INPUT_STREAM_H_
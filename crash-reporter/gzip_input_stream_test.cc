@@ -0,0 +1,195 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/gzip_input_stream.h"
+
+#include <sys/resource.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/files/file.h>
+#include <base/files/file_path.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/rand_util.h>
+#include <base/time/time.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "crash-reporter/util.h"
+
+namespace util {
+namespace {
+
+// Reads |stream| until the end, |chunk_size| bytes at a time.
+std::string ReadAll(brillo::Stream* stream, size_t chunk_size) {
+  std::string result;
+  std::vector<char> buffer(chunk_size);
+  size_t size_read = 0;
+  do {
+    EXPECT_TRUE(
+        stream->ReadBlocking(buffer.data(), chunk_size, &size_read, nullptr));
+    result.append(buffer.data(), size_read);
+  } while (size_read > 0);
+  return result;
+}
+
+std::string Gunzip(const std::string& compressed) {
+  z_stream inflate_stream = {};
+  // 16 + 15 selects gzip decoding with the default window size.
+  EXPECT_EQ(Z_OK, inflateInit2(&inflate_stream, 16 + 15));
+  inflate_stream.next_in =
+      reinterpret_cast<unsigned char*>(const_cast<char*>(compressed.data()));
+  inflate_stream.avail_in = compressed.size();
+
+  std::string result;
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    char out[4096];
+    inflate_stream.next_out = reinterpret_cast<unsigned char*>(out);
+    inflate_stream.avail_out = sizeof(out);
+    ret = inflate(&inflate_stream, Z_NO_FLUSH);
+    result.append(out, sizeof(out) - inflate_stream.avail_out);
+  }
+  EXPECT_EQ(Z_STREAM_END, ret);
+  inflateEnd(&inflate_stream);
+  return result;
+}
+
+// Returns the peak resident set size of this process in KiB.
+long GetPeakRssKiB() {  // NOLINT(runtime/int)
+  struct rusage usage;
+  CHECK_EQ(0, getrusage(RUSAGE_SELF, &usage));
+  return usage.ru_maxrss;
+}
+
+}  // namespace
+
+TEST(GzipInputStreamTest, Compresses) {
+  // Mix compressible and random data.
+  std::string content;
+  for (int i = 0; i < 100; ++i) {
+    content += "crash report line " + std::to_string(i) + "\n";
+    content += base::RandBytesAsString(1000);
+  }
+  uint64_t compressed_size = 12345;
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(content.data(), content.size(),
+                                       nullptr),
+      &compressed_size);
+  ASSERT_TRUE(stream);
+  EXPECT_EQ(0u, compressed_size);
+  EXPECT_FALSE(stream->CanGetSize());
+  EXPECT_FALSE(stream->CanWrite());
+  EXPECT_FALSE(stream->CanSeek());
+
+  const std::string compressed = ReadAll(stream.get(), 4096);
+  EXPECT_EQ(compressed.size(), compressed_size);
+  EXPECT_EQ(compressed.size(), stream->GetPosition());
+  EXPECT_EQ(content, Gunzip(compressed));
+}
+
+TEST(GzipInputStreamTest, SmallReads) {
+  const std::string content(100000, 'a');
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(content.data(), content.size(),
+                                       nullptr),
+      nullptr);
+  ASSERT_TRUE(stream);
+  EXPECT_EQ(content, Gunzip(ReadAll(stream.get(), 1)));
+}
+
+TEST(GzipInputStreamTest, Empty) {
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(nullptr, 0, nullptr), nullptr);
+  ASSERT_TRUE(stream);
+  const std::string compressed = ReadAll(stream.get(), 4096);
+  // Even empty input has a gzip header and trailer.
+  EXPECT_FALSE(compressed.empty());
+  EXPECT_EQ("", Gunzip(compressed));
+}
+
+TEST(GzipInputStreamTest, MatchesGzipStream) {
+  const std::string content = base::RandBytesAsString(50000) + "abc";
+  std::vector<unsigned char> expected =
+      GzipStream(brillo::MemoryStream::OpenCopyOf(content.data(),
+                                                  content.size(), nullptr));
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(content.data(), content.size(),
+                                       nullptr),
+      nullptr);
+  ASSERT_TRUE(stream);
+  EXPECT_EQ(std::string(expected.begin(), expected.end()),
+            ReadAll(stream.get(), 4096));
+}
+
+TEST(GzipInputStreamTest, Closed) {
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf("abc", 3, nullptr), nullptr);
+  ASSERT_TRUE(stream);
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_FALSE(stream->IsOpen());
+  char buffer[16];
+  size_t size_read = 0;
+  EXPECT_FALSE(
+      stream->ReadBlocking(buffer, sizeof(buffer), &size_read, nullptr));
+}
+
+// Compares compressing a 50 MB report in memory before upload (GzipStream)
+// with compressing it while it's read in the chunks curl asks for, and reports
+// the growth of the peak RSS and the time to completion for each. The
+// streaming case runs first so that it isn't hidden by the other's peak.
+// Run with --gtest_also_run_disabled_tests.
+TEST(GzipInputStreamTest, DISABLED_Benchmark) {
+  constexpr size_t kReportSize = 50 * 1024 * 1024;
+  constexpr size_t kCurlChunkSize = 16 * 1024;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath report = temp_dir.GetPath().Append("report");
+  {
+    // Attachments such as ARC bugreports are mostly incompressible.
+    const std::string chunk = base::RandBytesAsString(1024 * 1024);
+    base::File file(report, base::File::FLAG_CREATE | base::File::FLAG_WRITE);
+    for (size_t i = 0; i < kReportSize / chunk.size(); ++i)
+      ASSERT_EQ(static_cast<int>(chunk.size()),
+                file.WriteAtCurrentPos(chunk.data(), chunk.size()));
+  }
+  auto open_report = [&report]() {
+    return brillo::FileStream::Open(
+        report, brillo::Stream::AccessMode::READ,
+        brillo::FileStream::Disposition::OPEN_EXISTING, nullptr);
+  };
+
+  long peak_rss = GetPeakRssKiB();  // NOLINT(runtime/int)
+  base::TimeTicks start = base::TimeTicks::Now();
+  uint64_t compressed_size = 0;
+  brillo::StreamPtr stream =
+      GzipInputStream::Create(open_report(), &compressed_size);
+  ASSERT_TRUE(stream);
+  std::vector<char> buffer(kCurlChunkSize);
+  size_t size_read = 0;
+  do {
+    ASSERT_TRUE(stream->ReadBlocking(buffer.data(), buffer.size(), &size_read,
+                                     nullptr));
+  } while (size_read > 0);
+  LOG(INFO) << "Streaming: " << compressed_size << " bytes in "
+            << (base::TimeTicks::Now() - start).InMilliseconds()
+            << " ms, peak RSS grew by " << GetPeakRssKiB() - peak_rss
+            << " KiB";
+
+  peak_rss = GetPeakRssKiB();
+  start = base::TimeTicks::Now();
+  std::vector<unsigned char> compressed = GzipStream(open_report());
+  ASSERT_FALSE(compressed.empty());
+  LOG(INFO) << "In memory: " << compressed.size() << " bytes in "
+            << (base::TimeTicks::Now() - start).InMilliseconds()
+            << " ms, peak RSS grew by " << GetPeakRssKiB() - peak_rss
+            << " KiB";
+}
+
+}  // namespace util
@@ -0,0 +1,300 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/log_command_runner.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/hash/sha1.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_split.h>
+#include <base/strings/stringprintf.h>
+#include <brillo/process/process.h>
+
+namespace {
+
+constexpr char kShellPath[] = "/bin/sh";
+constexpr size_t kReadSize = 4096;
+// Longest possible header of a cache file.
+constexpr size_t kMaxCacheHeaderSize = 32;
+// How often to check for commands that closed their output but haven't exited
+// yet.
+constexpr base::TimeDelta kReapInterval = base::Milliseconds(10);
+
+struct RunningCommand {
+  std::unique_ptr<brillo::ProcessImpl> process;
+  // Read end of the command's stdout and stderr; reset once the command
+  // closed them or was killed.
+  base::ScopedFD output_fd;
+  base::TimeTicks start;
+  bool exited = false;
+  LogCommandResult* result;
+};
+
+bool StartCommand(const std::string& command, RunningCommand* running) {
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+    PLOG(WARNING) << "Failed to create pipe for log command";
+    return false;
+  }
+  base::ScopedFD read_fd(pipe_fds[0]);
+  base::ScopedFD write_fd(pipe_fds[1]);
+
+  auto process = std::make_unique<brillo::ProcessImpl>();
+  process->AddArg(kShellPath);
+  process->AddStringOption("-c", command);
+  process->RedirectInput("/dev/null");
+  process->BindFd(write_fd.get(), STDOUT_FILENO);
+  process->BindFd(write_fd.get(), STDERR_FILENO);
+  // Start a new process group so that the command and everything it starts
+  // can be killed together. Unlike a pre-exec callback, this still allows
+  // posix_spawn().
+  process->SetPgid(0);
+  running->start = base::TimeTicks::Now();
+  if (!process->Start()) {
+    LOG(WARNING) << "Failed to start log command";
+    return false;
+  }
+  // Only the command holds the write end now, so EOF is seen once it and its
+  // children are done writing.
+  write_fd.reset();
+  if (HANDLE_EINTR(fcntl(read_fd.get(), F_SETFL, O_NONBLOCK)) != 0)
+    PLOG(WARNING) << "Failed to make log command output non-blocking";
+
+  running->process = std::move(process);
+  running->output_fd = std::move(read_fd);
+  return true;
+}
+
+// Collects the exit status of |running| if it has exited. Waits for it if
+// |block| is true.
+void Reap(RunningCommand* running, bool block) {
+  int status = 0;
+  const pid_t pid = running->process->pid();
+  const pid_t result = HANDLE_EINTR(waitpid(pid, &status, block ? 0 : WNOHANG));
+  if (result == 0)
+    return;
+  if (result < 0)
+    PLOG(WARNING) << "Failed to wait for log command " << pid;
+  else if (WIFEXITED(status))
+    running->result->exit_code = WEXITSTATUS(status);
+  // The pid may be reused now, so make sure ProcessImpl doesn't kill it.
+  running->process->Release();
+  running->exited = true;
+  running->result->duration = base::TimeTicks::Now() - running->start;
+}
+
+void Kill(RunningCommand* running) {
+  kill(-running->process->pid(), SIGKILL);
+  running->output_fd.reset();
+}
+
+// Reads the available output of |running|, killing it if there is more than
+// |max_output_size| bytes.
+void ReadOutput(RunningCommand* running, size_t max_output_size) {
+  std::string& output = running->result->output;
+  char buffer[kReadSize];
+  while (running->output_fd.is_valid()) {
+    const ssize_t size =
+        HANDLE_EINTR(read(running->output_fd.get(), buffer, sizeof(buffer)));
+    if (size < 0 && errno == EAGAIN)
+      return;
+    if (size <= 0) {
+      if (size < 0)
+        PLOG(WARNING) << "Failed to read log command output";
+      running->output_fd.reset();
+      return;
+    }
+    const size_t space = max_output_size - output.size();
+    output.append(buffer, std::min(static_cast<size_t>(size), space));
+    if (static_cast<size_t>(size) > space) {
+      running->result->truncated = true;
+      Kill(running);
+    }
+  }
+}
+
+// Waits until all |commands| have exited, killing the ones still running at
+// |deadline|.
+void WaitForCommands(std::vector<RunningCommand>* commands,
+                     base::TimeTicks deadline,
+                     size_t max_output_size) {
+  while (true) {
+    const base::TimeTicks now = base::TimeTicks::Now();
+    std::vector<struct pollfd> poll_fds;
+    std::vector<RunningCommand*> polled;
+    bool reaping = false;
+    for (RunningCommand& running : *commands) {
+      if (!running.exited && !running.output_fd.is_valid())
+        Reap(&running, false);
+      if (running.exited)
+        continue;
+      if (now >= deadline) {
+        running.result->timed_out = true;
+        Kill(&running);
+        Reap(&running, true);
+        continue;
+      }
+      if (running.output_fd.is_valid()) {
+        poll_fds.push_back({running.output_fd.get(), POLLIN, 0});
+        polled.push_back(&running);
+      } else {
+        reaping = true;
+      }
+    }
+    if (poll_fds.empty() && !reaping)
+      return;
+
+    base::TimeDelta timeout = deadline - now;
+    if (reaping)
+      timeout = std::min(timeout, kReapInterval);
+    const int ready = HANDLE_EINTR(poll(poll_fds.data(), poll_fds.size(),
+                                        timeout.InMillisecondsRoundedUp()));
+    if (ready < 0) {
+      PLOG(WARNING) << "Failed to poll log command output";
+      continue;
+    }
+    for (size_t i = 0; i < poll_fds.size(); ++i) {
+      if (poll_fds[i].revents)
+        ReadOutput(polled[i], max_output_size);
+    }
+  }
+}
+
+}  // namespace
+
+LogCommandRunner::LogCommandRunner(const base::FilePath& cache_directory,
+                                   size_t max_output_size,
+                                   base::TimeDelta timeout,
+                                   base::TimeDelta cache_lifetime)
+    : cache_directory_(cache_directory),
+      max_output_size_(max_output_size),
+      timeout_(timeout),
+      cache_lifetime_(cache_lifetime) {}
+
+std::vector<LogCommandResult> LogCommandRunner::Run(
+    const std::vector<std::string>& commands) {
+  std::vector<LogCommandResult> results(commands.size());
+  // Index of the first occurrence of each command in |commands|.
+  std::map<std::string, size_t> first_indices;
+  std::vector<RunningCommand> running;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    if (!first_indices.emplace(commands[i], i).second)
+      continue;
+    if (ReadFromCache(commands[i], &results[i]))
+      continue;
+    RunningCommand command;
+    command.result = &results[i];
+    if (StartCommand(commands[i], &command))
+      running.push_back(std::move(command));
+  }
+
+  WaitForCommands(&running, base::TimeTicks::Now() + timeout_,
+                  max_output_size_);
+
+  for (size_t i = 0; i < commands.size(); ++i) {
+    const size_t first_index = first_indices[commands[i]];
+    if (first_index != i) {
+      results[i] = results[first_index];
+    } else if (!results[i].cached && !results[i].timed_out &&
+               results[i].duration.is_positive()) {
+      WriteToCache(commands[i], results[i]);
+    }
+  }
+  return results;
+}
+
+base::FilePath LogCommandRunner::GetCachePath(
+    const std::string& command) const {
+  // Results depend on the output size limit too.
+  const std::string hash = base::SHA1HashString(
+      base::StringPrintf("%zu:", max_output_size_) + command);
+  return cache_directory_.Append(base::HexEncode(hash.data(), hash.size()));
+}
+
+bool LogCommandRunner::ReadFromCache(const std::string& command,
+                                     LogCommandResult* result) {
+  if (cache_directory_.empty() || !cache_lifetime_.is_positive())
+    return false;
+
+  base::ScopedFD fd(HANDLE_EINTR(open(GetCachePath(command).value().c_str(),
+                                      O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+  if (!fd.is_valid())
+    return false;
+  struct stat st;
+  if (fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_uid != geteuid() ||
+      static_cast<size_t>(st.st_size) >
+          max_output_size_ + kMaxCacheHeaderSize) {
+    return false;
+  }
+  const base::TimeDelta age =
+      base::Time::Now() - base::Time::FromTimeSpec(st.st_mtim);
+  if (age.is_negative() || age > cache_lifetime_)
+    return false;
+
+  std::string contents(st.st_size, '\0');
+  if (!base::ReadFromFD(fd.get(), contents.data(), contents.size()))
+    return false;
+  // The header is "<exit code> <truncated>\n".
+  const size_t header_end = contents.find('\n');
+  if (header_end == std::string::npos)
+    return false;
+  const std::vector<base::StringPiece> header =
+      base::SplitStringPiece(base::StringPiece(contents).substr(0, header_end),
+                             " ", base::KEEP_WHITESPACE, base::SPLIT_WANT_ALL);
+  int truncated = 0;
+  if (header.size() != 2 ||
+      !base::StringToInt(header[0], &result->exit_code) ||
+      !base::StringToInt(header[1], &truncated)) {
+    return false;
+  }
+  result->output = contents.substr(header_end + 1);
+  result->truncated = truncated != 0;
+  result->cached = true;
+  return true;
+}
+
+void LogCommandRunner::WriteToCache(const std::string& command,
+                                    const LogCommandResult& result) {
+  if (cache_directory_.empty() || !cache_lifetime_.is_positive())
+    return;
+
+  // The cache holds unsanitized logs, so only we may read it.
+  if (!base::CreateDirectory(cache_directory_) ||
+      !base::SetPosixFilePermissions(cache_directory_, 0700)) {
+    PLOG(WARNING) << "Failed to create log cache " << cache_directory_.value();
+    return;
+  }
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_directory_, &temp_path)) {
+    PLOG(WARNING) << "Failed to create log cache file";
+    return;
+  }
+  // Write the whole file before moving it in place so that concurrent
+  // readers never see a partial result.
+  const std::string contents =
+      base::StringPrintf("%d %d\n", result.exit_code, result.truncated) +
+      result.output;
+  if (!base::WriteFile(temp_path, contents) ||
+      !base::ReplaceFile(temp_path, GetCachePath(command), nullptr)) {
+    PLOG(WARNING) << "Failed to write log cache file";
+    base::DeleteFile(temp_path);
+  }
+}
@@ -0,0 +1,72 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CRASH_REPORTER_LOG_COMMAND_RUNNER_H_
+#define CRASH_REPORTER_LOG_COMMAND_RUNNER_H_
+
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/time/time.h>
+
+// Result of running one log command.
+struct LogCommandResult {
+  // Combined stdout and stderr of the command, at most the runner's maximum
+  // output size.
+  std::string output;
+  // Exit code of the command, or -1 if it was killed.
+  int exit_code = -1;
+  // Whether the command produced more output than was kept. The command is
+  // killed once it does.
+  bool truncated = false;
+  // Whether the command was killed for running too long.
+  bool timed_out = false;
+  // Whether the result was reused from a recent run of the same command,
+  // possibly by another crash_reporter process.
+  bool cached = false;
+  // How long the command ran for; zero if |cached|.
+  base::TimeDelta duration;
+};
+
+// LogCommandRunner runs the shell commands from crash_reporter_logs.conf.
+//
+// All commands are started at once and their output is read concurrently,
+// so collecting several logs for a crash takes as long as the slowest
+// command rather than the sum of all of them. Each command is killed (with its
+// whole process group) if it runs longer than the timeout or writes more than
+// the maximum output size.
+//
+// When a service crashes in a loop, each crash runs a new crash_reporter that
+// would collect the same logs again. To avoid that, results of commands that
+// ran to completion are cached in |cache_directory| and reused by any runner
+// that runs the identical command within |cache_lifetime|. The cache
+// directory should be on a tmpfs since it holds unsanitized logs.
+class LogCommandRunner {
+ public:
+  LogCommandRunner(const base::FilePath& cache_directory,
+                   size_t max_output_size,
+                   base::TimeDelta timeout,
+                   base::TimeDelta cache_lifetime);
+  LogCommandRunner(const LogCommandRunner&) = delete;
+  LogCommandRunner& operator=(const LogCommandRunner&) = delete;
+
+  // Runs |commands| with /bin/sh -c and returns their results in the same
+  // order. Duplicate commands are only run once.
+  std::vector<LogCommandResult> Run(const std::vector<std::string>& commands);
+
+ private:
+  // Returns the cache file for |command|.
+  base::FilePath GetCachePath(const std::string& command) const;
+  // Reads a result for |command| cached less than |cache_lifetime_| ago.
+  bool ReadFromCache(const std::string& command, LogCommandResult* result);
+  void WriteToCache(const std::string& command, const LogCommandResult& result);
+
+  const base::FilePath cache_directory_;
+  const size_t max_output_size_;
+  const base::TimeDelta timeout_;
+  const base::TimeDelta cache_lifetime_;
+};
+
+#endif  // CRASH_REPORTER_LOG_COMMAND_RUNNER_H_
@@ -0,0 +1,228 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/log_command_runner.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <base/files/file_enumerator.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr size_t kMaxOutputSize = 1024;
+constexpr base::TimeDelta kTimeout = base::Seconds(10);
+constexpr base::TimeDelta kCacheLifetime = base::Seconds(60);
+
+class LogCommandRunnerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    cache_dir_ = temp_dir_.GetPath().Append("cache");
+  }
+
+  // Returns the number of lines in |path|.
+  int CountLines(const base::FilePath& path) {
+    std::string contents;
+    if (!base::ReadFileToString(path, &contents))
+      return 0;
+    return std::count(contents.begin(), contents.end(), '\n');
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath cache_dir_;
+};
+
+}  // namespace
+
+TEST_F(LogCommandRunnerTest, RunsCommands) {
+  LogCommandRunner runner(base::FilePath(), kMaxOutputSize, kTimeout,
+                          base::TimeDelta());
+  std::vector<LogCommandResult> results =
+      runner.Run({"echo out; echo err >&2", "echo partial; exit 3", "true"});
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ("out\nerr\n", results[0].output);
+  EXPECT_EQ(0, results[0].exit_code);
+  EXPECT_EQ("partial\n", results[1].output);
+  EXPECT_EQ(3, results[1].exit_code);
+  EXPECT_EQ("", results[2].output);
+  EXPECT_EQ(0, results[2].exit_code);
+  for (const LogCommandResult& result : results) {
+    EXPECT_FALSE(result.truncated);
+    EXPECT_FALSE(result.timed_out);
+    EXPECT_FALSE(result.cached);
+  }
+}
+
+TEST_F(LogCommandRunnerTest, RunsInParallel) {
+  LogCommandRunner runner(base::FilePath(), kMaxOutputSize, kTimeout,
+                          base::TimeDelta());
+  const base::TimeTicks start = base::TimeTicks::Now();
+  std::vector<LogCommandResult> results = runner.Run(
+      {"sleep 1; echo a", "sleep 1; echo b", "sleep 1; echo c",
+       "sleep 1; echo d"});
+  EXPECT_LT(base::TimeTicks::Now() - start, base::Seconds(3));
+  ASSERT_EQ(4u, results.size());
+  EXPECT_EQ("a\n", results[0].output);
+  EXPECT_EQ("d\n", results[3].output);
+  EXPECT_GE(results[0].duration, base::Seconds(1));
+}
+
+TEST_F(LogCommandRunnerTest, TimesOut) {
+  LogCommandRunner runner(base::FilePath(), kMaxOutputSize,
+                          base::Milliseconds(500), base::TimeDelta());
+  const base::TimeTicks start = base::TimeTicks::Now();
+  // The background sleep keeps the output open after the shell is killed,
+  // unless the whole process group is.
+  std::vector<LogCommandResult> results =
+      runner.Run({"echo started; sleep 30 & sleep 30", "echo done"});
+  EXPECT_LT(base::TimeTicks::Now() - start, base::Seconds(5));
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("started\n", results[0].output);
+  EXPECT_TRUE(results[0].timed_out);
+  EXPECT_EQ(-1, results[0].exit_code);
+  EXPECT_EQ("done\n", results[1].output);
+  EXPECT_FALSE(results[1].timed_out);
+}
+
+TEST_F(LogCommandRunnerTest, TruncatesOutput) {
+  LogCommandRunner runner(base::FilePath(), 10, kTimeout, base::TimeDelta());
+  const base::TimeTicks start = base::TimeTicks::Now();
+  // Would never finish if not killed.
+  std::vector<LogCommandResult> results = runner.Run({"yes"});
+  EXPECT_LT(base::TimeTicks::Now() - start, base::Seconds(5));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("y\ny\ny\ny\ny\n", results[0].output);
+  EXPECT_TRUE(results[0].truncated);
+  EXPECT_FALSE(results[0].timed_out);
+}
+
+TEST_F(LogCommandRunnerTest, OutputOfMaximumSizeIsNotTruncated) {
+  LogCommandRunner runner(base::FilePath(), 4, kTimeout, base::TimeDelta());
+  std::vector<LogCommandResult> results = runner.Run({"echo abc"});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("abc\n", results[0].output);
+  EXPECT_FALSE(results[0].truncated);
+}
+
+TEST_F(LogCommandRunnerTest, RunsDuplicatesOnce) {
+  const base::FilePath counter = temp_dir_.GetPath().Append("counter");
+  const std::string command = "echo run >> " + counter.value() + "; echo x";
+  LogCommandRunner runner(base::FilePath(), kMaxOutputSize, kTimeout,
+                          base::TimeDelta());
+  std::vector<LogCommandResult> results =
+      runner.Run({command, "echo y", command});
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ("x\n", results[0].output);
+  EXPECT_EQ("y\n", results[1].output);
+  EXPECT_EQ("x\n", results[2].output);
+  EXPECT_EQ(1, CountLines(counter));
+}
+
+TEST_F(LogCommandRunnerTest, ReusesRecentResults) {
+  const base::FilePath counter = temp_dir_.GetPath().Append("counter");
+  const std::string command =
+      "echo run >> " + counter.value() + "; echo x; exit 2";
+  {
+    LogCommandRunner runner(cache_dir_, kMaxOutputSize, kTimeout,
+                            kCacheLifetime);
+    std::vector<LogCommandResult> results = runner.Run({command});
+    ASSERT_EQ(1u, results.size());
+    EXPECT_FALSE(results[0].cached);
+  }
+  // Only root may read the cached logs.
+  int mode = 0;
+  ASSERT_TRUE(base::GetPosixFilePermissions(cache_dir_, &mode));
+  EXPECT_EQ(0700, mode);
+
+  LogCommandRunner runner(cache_dir_, kMaxOutputSize, kTimeout,
+                          kCacheLifetime);
+  std::vector<LogCommandResult> results = runner.Run({command});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0].cached);
+  EXPECT_EQ("x\n", results[0].output);
+  EXPECT_EQ(2, results[0].exit_code);
+  EXPECT_EQ(1, CountLines(counter));
+}
+
+TEST_F(LogCommandRunnerTest, DoesNotReuseExpiredResults) {
+  const base::FilePath counter = temp_dir_.GetPath().Append("counter");
+  const std::string command = "echo run >> " + counter.value();
+  LogCommandRunner runner(cache_dir_, kMaxOutputSize, kTimeout,
+                          kCacheLifetime);
+  runner.Run({command});
+
+  const base::Time old_time =
+      base::Time::Now() - kCacheLifetime - base::Seconds(1);
+  base::FileEnumerator files(cache_dir_, false, base::FileEnumerator::FILES);
+  for (base::FilePath path = files.Next(); !path.empty(); path = files.Next())
+    ASSERT_TRUE(base::TouchFile(path, old_time, old_time));
+
+  std::vector<LogCommandResult> results = runner.Run({command});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_FALSE(results[0].cached);
+  EXPECT_EQ(2, CountLines(counter));
+}
+
+TEST_F(LogCommandRunnerTest, DoesNotReuseResultsForOtherSizes) {
+  const std::string command = "echo abcdef";
+  LogCommandRunner runner(cache_dir_, 4, kTimeout, kCacheLifetime);
+  std::vector<LogCommandResult> results = runner.Run({command});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0].truncated);
+
+  LogCommandRunner larger_runner(cache_dir_, kMaxOutputSize, kTimeout,
+                                 kCacheLifetime);
+  results = larger_runner.Run({command});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_FALSE(results[0].cached);
+  EXPECT_EQ("abcdef\n", results[0].output);
+}
+
+TEST_F(LogCommandRunnerTest, DoesNotCacheTimedOutCommands) {
+  LogCommandRunner runner(cache_dir_, kMaxOutputSize, base::Milliseconds(100),
+                          kCacheLifetime);
+  std::vector<LogCommandResult> results = runner.Run({"sleep 30"});
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0].timed_out);
+  EXPECT_TRUE(base::IsDirectoryEmpty(cache_dir_) ||
+              !base::PathExists(cache_dir_));
+}
+
+// Compares running the commands of a typical crash_reporter_logs.conf entry
+// one after the other with running them together, and with reusing the
+// results of a previous run.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(LogCommandRunnerTest, DISABLED_Benchmark) {
+  const std::vector<std::string> commands = {
+      "sleep 0.2; dmesg | tail -n 100", "sleep 0.3; ps aux",
+      "sleep 0.2; cat /proc/meminfo", "sleep 0.4; ls -lR /etc | tail -n 100",
+      "sleep 0.1; uptime"};
+  LogCommandRunner runner(cache_dir_, 512 * 1024, kTimeout, kCacheLifetime);
+  LogCommandRunner uncached_runner(base::FilePath(), 512 * 1024, kTimeout,
+                                   base::TimeDelta());
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (const std::string& command : commands)
+    uncached_runner.Run({command});
+  LOG(INFO) << "Serial: " << (base::TimeTicks::Now() - start).InMilliseconds()
+            << " ms";
+
+  start = base::TimeTicks::Now();
+  runner.Run(commands);
+  LOG(INFO) << "Parallel: "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << " ms";
+
+  start = base::TimeTicks::Now();
+  runner.Run(commands);
+  LOG(INFO) << "Cached: " << (base::TimeTicks::Now() - start).InMilliseconds()
+            << " ms";
+}
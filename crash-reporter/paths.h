@@ -88,6 +88,11 @@ constexpr char kCrashTestInProgress[] = "crash-test-in-progress";
 // repo)
 constexpr char kMockConsent[] = "mock-consent";
 
+// Base name of the directory holding recent output of the log commands from
+// crash_reporter_logs.conf, shared by crash_reporter processes. Directory will
+// be in kSystemRunStateDirectory.
+constexpr char kLogCacheDirectory[] = "log-cache";
+
 // Base name of file whose existence indicates that the anomaly detector is
 // ready for anomalies.
 constexpr char kAnomalyDetectorReady[] = "anomaly-detector-ready";
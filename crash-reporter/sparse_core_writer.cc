@@ -0,0 +1,299 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/sparse_core_writer.h"
+
+#include <elf.h>
+#include <link.h>
+#include <string.h>
+#include <sys/procfs.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <sys/reg.h>
+#endif
+
+#include <algorithm>
+#include <utility>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+namespace {
+
+constexpr size_t kBufferSize = 1024 * 1024;
+constexpr uint64_t kPageSize = 4096;
+constexpr char kCoreNoteName[] = "CORE";
+
+#if defined(__x86_64__)
+constexpr int kElfMachine = EM_X86_64;
+constexpr int kStackPointerRegister = RSP;
+#elif defined(__i386__)
+constexpr int kElfMachine = EM_386;
+constexpr int kStackPointerRegister = UESP;
+#elif defined(__aarch64__)
+constexpr int kElfMachine = EM_AARCH64;
+// elf_gregset_t holds x0-x30, sp, pc and pstate.
+constexpr int kStackPointerRegister = 31;
+#elif defined(__arm__)
+constexpr int kElfMachine = EM_ARM;
+// elf_gregset_t holds r0-r15 (r13 is sp), cpsr and orig_r0.
+constexpr int kStackPointerRegister = 13;
+#else
+#error "Unsupported architecture"
+#endif
+
+#if __WORDSIZE == 64
+constexpr int kElfClass = ELFCLASS64;
+#else
+constexpr int kElfClass = ELFCLASS32;
+#endif
+
+// Note names and descriptors are padded to 4 bytes in core dumps.
+uint64_t NoteAlign(uint64_t size) {
+  return (size + 3) & ~uint64_t{3};
+}
+
+}  // namespace
+
+SparseCoreWriter::SparseCoreWriter(int input_fd, int output_fd)
+    : input_fd_(input_fd), output_fd_(output_fd), buffer_(kBufferSize) {}
+
+bool SparseCoreWriter::Run() {
+  std::vector<Segment> segments;
+  if (!ReadHeaders(&segments) || !Write(head_.data(), head_.size()))
+    return false;
+
+  for (const Segment& segment : segments) {
+    // Copy the padding before the segment. ReadHeaders() checked that the
+    // segments are sorted and don't overlap.
+    if (!Transfer(segment.offset - offset_, true))
+      return false;
+    uint64_t position = 0;
+    for (const Range& range : GetKeptRanges(segment)) {
+      if (!Transfer(range.first - position, false) ||
+          !Transfer(range.second - range.first, true)) {
+        return false;
+      }
+      position = range.second;
+    }
+    if (!Transfer(segment.size - position, false))
+      return false;
+  }
+  // Copy anything after the last segment, or the whole core if it can't be
+  // filtered.
+  if (!Transfer(kToEof, true))
+    return false;
+
+  // Extend the file over a trailing hole.
+  if (HANDLE_EINTR(ftruncate(output_fd_, offset_)) != 0) {
+    PLOG(ERROR) << "Failed to set core file size";
+    return false;
+  }
+  return true;
+}
+
+bool SparseCoreWriter::ReadHeaders(std::vector<Segment>* segments) {
+  if (!ReadHead(sizeof(ElfW(Ehdr))))
+    return false;
+  if (head_.size() < sizeof(ElfW(Ehdr)))
+    return true;
+
+  ElfW(Ehdr) ehdr;
+  memcpy(&ehdr, head_.data(), sizeof(ehdr));
+  if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr.e_ident[EI_CLASS] != kElfClass || ehdr.e_type != ET_CORE ||
+      ehdr.e_machine != kElfMachine ||
+      ehdr.e_phentsize != sizeof(ElfW(Phdr)) || ehdr.e_phnum == 0 ||
+      ehdr.e_phnum == PN_XNUM || ehdr.e_phoff < sizeof(ehdr) ||
+      ehdr.e_phoff > kMaxHeadSize) {
+    LOG(INFO) << "Not filtering unexpected core file";
+    return true;
+  }
+
+  uint64_t head_size =
+      ehdr.e_phoff + uint64_t{ehdr.e_phnum} * sizeof(ElfW(Phdr));
+  if (!ReadHead(head_size))
+    return false;
+  if (head_.size() < head_size)
+    return true;
+
+  std::vector<ElfW(Phdr)> notes;
+  std::vector<Segment> loads;
+  for (int i = 0; i < ehdr.e_phnum; ++i) {
+    ElfW(Phdr) phdr;
+    memcpy(&phdr, head_.data() + ehdr.e_phoff + i * sizeof(phdr),
+           sizeof(phdr));
+    if (phdr.p_filesz == 0)
+      continue;
+    if (phdr.p_offset > kToEof - phdr.p_filesz)
+      return true;
+    if (phdr.p_type == PT_NOTE) {
+      notes.push_back(phdr);
+      head_size = std::max<uint64_t>(head_size, phdr.p_offset + phdr.p_filesz);
+    } else if (phdr.p_type == PT_LOAD) {
+      loads.push_back({phdr.p_offset, phdr.p_vaddr, phdr.p_filesz});
+    }
+  }
+  if (head_size > kMaxHeadSize) {
+    LOG(WARNING) << "Not filtering core file with " << head_size
+                 << " bytes of notes";
+    return true;
+  }
+
+  std::sort(loads.begin(), loads.end(),
+            [](const Segment& a, const Segment& b) {
+              return a.offset < b.offset;
+            });
+  uint64_t end = head_size;
+  for (const Segment& segment : loads) {
+    if (segment.offset < end) {
+      LOG(WARNING) << "Not filtering core file with overlapping segments";
+      return true;
+    }
+    end = segment.offset + segment.size;
+  }
+
+  if (!ReadHead(head_size))
+    return false;
+  if (head_.size() < head_size)
+    return true;
+  for (const ElfW(Phdr)& note : notes)
+    ParseNotes(note.p_offset, note.p_filesz);
+
+  // Without the stack pointers there is no telling which parts core2md
+  // needs.
+  if (stack_pointers_.empty()) {
+    LOG(WARNING) << "Not filtering core file without thread registers";
+    return true;
+  }
+  *segments = std::move(loads);
+  return true;
+}
+
+bool SparseCoreWriter::ReadHead(uint64_t size) {
+  while (head_.size() < size) {
+    const size_t old_size = head_.size();
+    head_.resize(size);
+    const ssize_t bytes =
+        HANDLE_EINTR(read(input_fd_, &head_[old_size], size - old_size));
+    head_.resize(old_size + std::max<ssize_t>(bytes, 0));
+    if (bytes < 0) {
+      PLOG(ERROR) << "Failed to read core";
+      return false;
+    }
+    if (bytes == 0)
+      break;
+    bytes_read_ += bytes;
+  }
+  return true;
+}
+
+void SparseCoreWriter::ParseNotes(uint64_t offset, uint64_t size) {
+  const char* note = head_.data() + offset;
+  const char* const end = note + size;
+  while (static_cast<size_t>(end - note) >= sizeof(ElfW(Nhdr))) {
+    ElfW(Nhdr) nhdr;
+    memcpy(&nhdr, note, sizeof(nhdr));
+    const char* name = note + sizeof(nhdr);
+    const uint64_t name_size = NoteAlign(nhdr.n_namesz);
+    const uint64_t desc_size = NoteAlign(nhdr.n_descsz);
+    if (name_size + desc_size > static_cast<size_t>(end - name))
+      break;
+    const char* desc = name + name_size;
+    note = desc + desc_size;
+
+    if (nhdr.n_namesz != sizeof(kCoreNoteName) ||
+        memcmp(name, kCoreNoteName, sizeof(kCoreNoteName)) != 0) {
+      continue;
+    }
+    if (nhdr.n_type == NT_PRSTATUS &&
+        nhdr.n_descsz >= sizeof(struct elf_prstatus)) {
+      struct elf_prstatus status;
+      memcpy(&status, desc, sizeof(status));
+      stack_pointers_.push_back(status.pr_reg[kStackPointerRegister]);
+    } else if (nhdr.n_type == NT_AUXV) {
+      for (uint64_t i = 0; i + sizeof(ElfW(auxv_t)) <= nhdr.n_descsz;
+           i += sizeof(ElfW(auxv_t))) {
+        ElfW(auxv_t) auxv;
+        memcpy(&auxv, desc + i, sizeof(auxv));
+        if (auxv.a_type == AT_SYSINFO_EHDR)
+          vdso_address_ = auxv.a_un.a_val;
+      }
+    }
+  }
+}
+
+std::vector<SparseCoreWriter::Range> SparseCoreWriter::GetKeptRanges(
+    const Segment& segment) const {
+  // core2md reads the vDSO's ELF image to identify it.
+  if (segment.size <= kMaxKeptSegmentSize ||
+      (vdso_address_ >= segment.vaddr &&
+       vdso_address_ - segment.vaddr < segment.size)) {
+    return {{0, segment.size}};
+  }
+
+  std::vector<Range> ranges;
+  for (uint64_t stack_pointer : stack_pointers_) {
+    if (stack_pointer < segment.vaddr ||
+        stack_pointer - segment.vaddr >= segment.size) {
+      continue;
+    }
+    // Stacks grow down, so keep what is above the stack pointer, plus the
+    // page below it for the red zone.
+    uint64_t begin = (stack_pointer - segment.vaddr) & ~(kPageSize - 1);
+    begin -= std::min(begin, kPageSize);
+    ranges.emplace_back(begin, std::min(begin + kKeptStackSize, segment.size));
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  // Merge the stacks of threads that share a segment.
+  std::vector<Range> merged;
+  for (const Range& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second)
+      merged.back().second = std::max(merged.back().second, range.second);
+    else
+      merged.push_back(range);
+  }
+  return merged;
+}
+
+bool SparseCoreWriter::Write(const char* data, uint64_t size) {
+  while (size > 0) {
+    // Write at an explicit offset so that skipped bytes become holes.
+    const ssize_t bytes = HANDLE_EINTR(pwrite(output_fd_, data, size, offset_));
+    if (bytes <= 0) {
+      PLOG(ERROR) << "Failed to write core";
+      return false;
+    }
+    data += bytes;
+    size -= bytes;
+    offset_ += bytes;
+    bytes_written_ += bytes;
+  }
+  return true;
+}
+
+bool SparseCoreWriter::Transfer(uint64_t size, bool keep) {
+  while (size > 0) {
+    const ssize_t bytes = HANDLE_EINTR(read(
+        input_fd_, buffer_.data(), std::min<uint64_t>(size, buffer_.size())));
+    if (bytes < 0) {
+      PLOG(ERROR) << "Failed to read core";
+      return false;
+    }
+    // A truncated core is written as far as it goes, like a plain copy.
+    if (bytes == 0)
+      return true;
+    bytes_read_ += bytes;
+    if (keep) {
+      if (!Write(buffer_.data(), bytes))
+        return false;
+    } else {
+      offset_ += bytes;
+    }
+    if (size != kToEof)
+      size -= bytes;
+  }
+  return true;
+}
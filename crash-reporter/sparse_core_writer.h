@@ -0,0 +1,93 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CRASH_REPORTER_SPARSE_CORE_WRITER_H_
+#define CRASH_REPORTER_SPARSE_CORE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// SparseCoreWriter copies an ELF core dump from the kernel's core pipe into a
+// file, writing only the parts core2md turns into a minidump.
+//
+// The core is parsed as it streams in: the ELF and program headers and all
+// notes (thread registers, auxv, file mappings) are kept, as are small
+// segments (mostly the mapped DSO headers and their data, which core2md uses
+// to build the module list), the vDSO and the top of every thread's stack.
+// The remaining contents of large segments, such as the heap, are read from
+// the pipe and dropped, leaving holes in the file. The file still has the
+// offsets and size of the full core, so core2md reads it unchanged, but
+// multi-GB cores only cost a few MB of disk writes.
+//
+// Input that is not a core dump for this architecture, or that is laid out in
+// a way the writer doesn't expect, is copied unchanged.
+class SparseCoreWriter {
+ public:
+  // Segments of at most this many bytes are always kept.
+  static constexpr uint64_t kMaxKeptSegmentSize = 1024 * 1024;
+  // Number of bytes kept above each thread's stack pointer. core2md captures
+  // at most 32 KiB of stack per thread; the rest is headroom for unwinding
+  // through large frames.
+  static constexpr uint64_t kKeptStackSize = 128 * 1024;
+  // Limit on the size of the headers and notes, which are held in memory.
+  static constexpr uint64_t kMaxHeadSize = 64 * 1024 * 1024;
+
+  // Reads the core from |input_fd| until EOF and writes it to |output_fd|,
+  // which must be an empty regular file. Neither descriptor is closed.
+  SparseCoreWriter(int input_fd, int output_fd);
+  SparseCoreWriter(const SparseCoreWriter&) = delete;
+  SparseCoreWriter& operator=(const SparseCoreWriter&) = delete;
+
+  // Copies the core. Returns false if reading or writing failed, in which
+  // case the output is incomplete.
+  bool Run();
+
+  // Number of bytes read from the input and written to the output.
+  uint64_t bytes_read() const { return bytes_read_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+
+ private:
+  struct Segment {
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t size;
+  };
+  using Range = std::pair<uint64_t, uint64_t>;
+
+  static constexpr uint64_t kToEof = UINT64_MAX;
+
+  // Reads the headers and notes into |head_| and returns the segments to
+  // filter in offset order. |segments| is left empty if the input can't be
+  // filtered. Returns false on read errors.
+  bool ReadHeaders(std::vector<Segment>* segments);
+  // Reads from the input until |head_| is |size| bytes long or EOF.
+  bool ReadHead(uint64_t size);
+  // Parses the notes in |head_| at [|offset|, |offset| + |size|).
+  void ParseNotes(uint64_t offset, uint64_t size);
+  // Returns the ranges of |segment| to keep, relative to its start.
+  std::vector<Range> GetKeptRanges(const Segment& segment) const;
+
+  // Writes |size| bytes of |data| at the current output offset.
+  bool Write(const char* data, uint64_t size);
+  // Reads the next |size| bytes of the input, or everything up to EOF if
+  // |size| is kToEof, and writes them if |keep| is true. Bytes that are not
+  // kept leave a hole in the output.
+  bool Transfer(uint64_t size, bool keep);
+
+  const int input_fd_;
+  const int output_fd_;
+  // Offset of the next byte written to the output.
+  uint64_t offset_ = 0;
+  uint64_t bytes_read_ = 0;
+  uint64_t bytes_written_ = 0;
+  // The headers and notes at the start of the core.
+  std::string head_;
+  std::vector<char> buffer_;
+  std::vector<uint64_t> stack_pointers_;
+  uint64_t vdso_address_ = 0;
+};
+
+#endif  // CRASH_REPORTER_SPARSE_CORE_WRITER_H_
@@ -0,0 +1,337 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/sparse_core_writer.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+#if defined(__x86_64__)
+constexpr int kElfMachine = EM_X86_64;
+#elif defined(__i386__)
+constexpr int kElfMachine = EM_386;
+#elif defined(__aarch64__)
+constexpr int kElfMachine = EM_AARCH64;
+#elif defined(__arm__)
+constexpr int kElfMachine = EM_ARM;
+#endif
+
+constexpr uint64_t kPageSize = 4096;
+constexpr uint64_t kMiB = 1024 * 1024;
+
+constexpr uint64_t kLibraryAddress = 0x10000000;
+constexpr uint64_t kVdsoAddress = 0x18000000;
+constexpr uint64_t kHeapAddress = 0x20000000;
+constexpr uint64_t kStackAddress = 0x70000000;
+constexpr uint64_t kStackSize = 8 * kMiB;
+constexpr uint64_t kStackPointer = kStackAddress + kStackSize / 2 + 0x100;
+
+struct TestSegment {
+  uint64_t vaddr;
+  uint64_t size;
+  char fill;
+  uint64_t offset;
+};
+
+// A synthetic core dump of a single-threaded process with a small library
+// mapping, a vDSO that is larger than usual, a heap of |heap_size| bytes and
+// an 8 MiB stack. The segments are filled with a different byte each.
+class TestCore {
+ public:
+  TestCore(uint64_t heap_size, bool with_registers) {
+    segments_ = {
+        {kLibraryAddress, 64 * 1024, 'l', 0},
+        {kVdsoAddress, 2 * kMiB, 'v', 0},
+        {kHeapAddress, heap_size, 'h', 0},
+        {kStackAddress, kStackSize, 's', 0},
+    };
+
+    std::string notes;
+    if (with_registers) {
+      struct elf_prstatus status = {};
+      // Set every register so the stack pointer is right on any architecture.
+      std::fill(std::begin(status.pr_reg), std::end(status.pr_reg),
+                kStackPointer);
+      AddNote(NT_PRSTATUS, &status, sizeof(status), &notes);
+    }
+    ElfW(auxv_t) auxv[2] = {};
+    auxv[0].a_type = AT_SYSINFO_EHDR;
+    auxv[0].a_un.a_val = kVdsoAddress;
+    auxv[1].a_type = AT_NULL;
+    AddNote(NT_AUXV, auxv, sizeof(auxv), &notes);
+
+    const size_t phnum = segments_.size() + 1;
+    const size_t notes_offset = sizeof(ElfW(Ehdr)) + phnum * sizeof(ElfW(Phdr));
+    uint64_t offset = (notes_offset + notes.size() + kPageSize - 1) &
+                      ~(kPageSize - 1);
+
+    ElfW(Ehdr) ehdr = {};
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_CORE;
+    ehdr.e_machine = kElfMachine;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_phoff = sizeof(ehdr);
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_phentsize = sizeof(ElfW(Phdr));
+    ehdr.e_phnum = phnum;
+    head_.append(reinterpret_cast<const char*>(&ehdr), sizeof(ehdr));
+
+    ElfW(Phdr) phdr = {};
+    phdr.p_type = PT_NOTE;
+    phdr.p_offset = notes_offset;
+    phdr.p_filesz = notes.size();
+    head_.append(reinterpret_cast<const char*>(&phdr), sizeof(phdr));
+    for (TestSegment& segment : segments_) {
+      segment.offset = offset;
+      phdr = {};
+      phdr.p_type = PT_LOAD;
+      phdr.p_offset = segment.offset;
+      phdr.p_vaddr = segment.vaddr;
+      phdr.p_filesz = segment.size;
+      phdr.p_memsz = segment.size;
+      phdr.p_align = kPageSize;
+      head_.append(reinterpret_cast<const char*>(&phdr), sizeof(phdr));
+      offset += segment.size;
+    }
+    head_ += notes;
+    size_ = offset;
+  }
+
+  const std::vector<TestSegment>& segments() const { return segments_; }
+  uint64_t size() const { return size_; }
+
+  // Returns the core dump as a string.
+  std::string GetContents() const {
+    std::string contents = head_;
+    for (const TestSegment& segment : segments_) {
+      contents.resize(segment.offset, '\0');
+      contents.append(segment.size, segment.fill);
+    }
+    return contents;
+  }
+
+  // Writes the core dump to |fd|, like the kernel does to the core pipe.
+  void WriteTo(int fd) const {
+    ASSERT_TRUE(base::WriteFileDescriptor(fd, head_));
+    uint64_t offset = head_.size();
+    const std::string zeros(kPageSize, '\0');
+    for (const TestSegment& segment : segments_) {
+      ASSERT_TRUE(base::WriteFileDescriptor(
+          fd, base::StringPiece(zeros.data(), segment.offset - offset)));
+      const std::string chunk(kMiB, segment.fill);
+      for (uint64_t written = 0; written < segment.size;) {
+        const uint64_t size = std::min(segment.size - written, kMiB);
+        ASSERT_TRUE(base::WriteFileDescriptor(
+            fd, base::StringPiece(chunk.data(), size)));
+        written += size;
+      }
+      offset = segment.offset + segment.size;
+    }
+  }
+
+ private:
+  static void AddNote(uint32_t type,
+                      const void* desc,
+                      size_t desc_size,
+                      std::string* notes) {
+    constexpr char kName[] = "CORE";
+    ElfW(Nhdr) nhdr = {sizeof(kName), static_cast<uint32_t>(desc_size), type};
+    notes->append(reinterpret_cast<const char*>(&nhdr), sizeof(nhdr));
+    notes->append(kName, sizeof(kName));
+    notes->resize((notes->size() + 3) & ~3, '\0');
+    notes->append(static_cast<const char*>(desc), desc_size);
+    notes->resize((notes->size() + 3) & ~3, '\0');
+  }
+
+  std::string head_;
+  std::vector<TestSegment> segments_;
+  uint64_t size_;
+};
+
+struct WriterStats {
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+};
+
+class SparseCoreWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    core_path_ = temp_dir_.GetPath().Append("core");
+  }
+
+  // Runs a SparseCoreWriter with |write_input| writing to the input pipe on
+  // another thread.
+  template <typename Writer>
+  bool RunWriter(Writer write_input, WriterStats* stats) {
+    int pipe_fds[2];
+    CHECK_EQ(0, pipe(pipe_fds));
+    base::ScopedFD read_fd(pipe_fds[0]);
+    std::thread writer_thread([&write_input, write_fd = pipe_fds[1]]() {
+      write_input(write_fd);
+      close(write_fd);
+    });
+
+    base::ScopedFD core_fd(
+        open(core_path_.value().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600));
+    CHECK(core_fd.is_valid());
+    SparseCoreWriter writer(read_fd.get(), core_fd.get());
+    const bool result = writer.Run();
+    // Drain the pipe so the writer thread can't block if Run() failed.
+    char buffer[4096];
+    while (read(read_fd.get(), buffer, sizeof(buffer)) > 0) {
+    }
+    writer_thread.join();
+    stats->bytes_read = writer.bytes_read();
+    stats->bytes_written = writer.bytes_written();
+    return result;
+  }
+
+  std::string ReadCore() {
+    std::string contents;
+    CHECK(base::ReadFileToString(core_path_, &contents));
+    return contents;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath core_path_;
+};
+
+}  // namespace
+
+TEST_F(SparseCoreWriterTest, NotACore) {
+  const std::string kData = "this is not a core file";
+  WriterStats stats;
+  ASSERT_TRUE(RunWriter(
+      [&kData](int fd) { ASSERT_TRUE(base::WriteFileDescriptor(fd, kData)); },
+      &stats));
+  EXPECT_EQ(kData, ReadCore());
+  EXPECT_EQ(kData.size(), stats.bytes_read);
+  EXPECT_EQ(kData.size(), stats.bytes_written);
+}
+
+TEST_F(SparseCoreWriterTest, Empty) {
+  WriterStats stats;
+  ASSERT_TRUE(RunWriter([](int) {}, &stats));
+  EXPECT_EQ("", ReadCore());
+}
+
+TEST_F(SparseCoreWriterTest, DropsHeapAndOldStack) {
+  const TestCore core(16 * kMiB, true);
+  WriterStats stats;
+  ASSERT_TRUE(RunWriter([&core](int fd) { core.WriteTo(fd); }, &stats));
+  EXPECT_EQ(core.size(), stats.bytes_read);
+  EXPECT_LT(stats.bytes_written, 3 * kMiB);
+
+  const std::string expected = core.GetContents();
+  const std::string actual = ReadCore();
+  ASSERT_EQ(expected.size(), actual.size());
+  // Headers, notes, the library and the vDSO are kept.
+  const TestSegment& heap = core.segments()[2];
+  ASSERT_EQ('h', heap.fill);
+  EXPECT_EQ(expected.substr(0, heap.offset), actual.substr(0, heap.offset));
+  // The heap is a hole.
+  EXPECT_EQ(std::string(heap.size, '\0'),
+            actual.substr(heap.offset, heap.size));
+  // Only the top of the stack is kept, from the page below the stack pointer.
+  const TestSegment& stack = core.segments()[3];
+  ASSERT_EQ('s', stack.fill);
+  const uint64_t kept_begin =
+      stack.offset +
+      ((kStackPointer - kStackAddress) & ~(kPageSize - 1)) - kPageSize;
+  const uint64_t kept_end = kept_begin + SparseCoreWriter::kKeptStackSize;
+  EXPECT_EQ(std::string(kept_begin - stack.offset, '\0'),
+            actual.substr(stack.offset, kept_begin - stack.offset));
+  EXPECT_EQ(expected.substr(kept_begin, kept_end - kept_begin),
+            actual.substr(kept_begin, kept_end - kept_begin));
+  EXPECT_EQ(std::string(core.size() - kept_end, '\0'),
+            actual.substr(kept_end));
+}
+
+TEST_F(SparseCoreWriterTest, CopiesCoreWithoutRegisters) {
+  const TestCore core(4 * kMiB, false);
+  WriterStats stats;
+  ASSERT_TRUE(RunWriter([&core](int fd) { core.WriteTo(fd); }, &stats));
+  EXPECT_EQ(core.size(), stats.bytes_written);
+  EXPECT_EQ(core.GetContents(), ReadCore());
+}
+
+TEST_F(SparseCoreWriterTest, TruncatedCore) {
+  const TestCore core(4 * kMiB, true);
+  const std::string contents = core.GetContents();
+  const uint64_t truncated_size = core.segments()[2].offset + kMiB;
+  WriterStats stats;
+  ASSERT_TRUE(RunWriter(
+      [&contents, truncated_size](int fd) {
+        ASSERT_TRUE(base::WriteFileDescriptor(
+            fd, base::StringPiece(contents.data(), truncated_size)));
+      },
+      &stats));
+  EXPECT_EQ(truncated_size, stats.bytes_read);
+  EXPECT_EQ(truncated_size, ReadCore().size());
+}
+
+TEST_F(SparseCoreWriterTest, FailsIfOutputIsNotWritable) {
+  const TestCore core(4 * kMiB, true);
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  base::ScopedFD read_fd(pipe_fds[0]);
+  std::thread writer_thread([&core, write_fd = pipe_fds[1]]() {
+    core.WriteTo(write_fd);
+    close(write_fd);
+  });
+  ASSERT_TRUE(base::WriteFile(core_path_, ""));
+  base::ScopedFD core_fd(open(core_path_.value().c_str(), O_RDONLY));
+  ASSERT_TRUE(core_fd.is_valid());
+  EXPECT_FALSE(SparseCoreWriter(read_fd.get(), core_fd.get()).Run());
+  char buffer[4096];
+  while (read(read_fd.get(), buffer, sizeof(buffer)) > 0) {
+  }
+  writer_thread.join();
+}
+
+// Reports the bytes written, disk usage and wall time for synthetic cores of
+// increasing size, compared to copying the whole core (as done for cores
+// without thread registers). Run with --gtest_also_run_disabled_tests.
+TEST_F(SparseCoreWriterTest, DISABLED_Benchmark) {
+  for (uint64_t heap_size : {64 * kMiB, 256 * kMiB, 1024 * kMiB}) {
+    for (bool sparse : {false, true}) {
+      const TestCore core(heap_size, sparse);
+      WriterStats stats;
+      const base::TimeTicks start = base::TimeTicks::Now();
+      ASSERT_TRUE(RunWriter([&core](int fd) { core.WriteTo(fd); }, &stats));
+      const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+      struct stat st;
+      ASSERT_EQ(0, stat(core_path_.value().c_str(), &st));
+      LOG(INFO) << (sparse ? "sparse" : "full") << " copy of "
+                << core.size() / kMiB << " MiB core: " << stats.bytes_written
+                << " bytes written, " << st.st_blocks * 512 / 1024
+                << " KiB on disk, " << elapsed.InMilliseconds() << " ms";
+      ASSERT_TRUE(base::DeleteFile(core_path_));
+    }
+  }
+}
@@ -29,6 +29,7 @@
 
 #include "crash-reporter/constants.h"
 #include "crash-reporter/paths.h"
+#include "crash-reporter/sparse_core_writer.h"
 #include "crash-reporter/user_collector_base.h"
 #include "crash-reporter/util.h"
 #include "crash-reporter/vm_support.h"
@@ -447,15 +448,29 @@ bool UserCollector::CopyPipeToCoreFile(int input_fd,
     return false;
   }
 
-  // We don't directly create a ScopedFD with input_fd because the
-  // destructor would close() that file descriptor. In non-test-scenarios,
-  // input_fd is stdin and we don't want to close stdin.
-  base::ScopedFD input_fd_copy(dup(input_fd));
-  if (!input_fd_copy.is_valid()) {
-    return false;
-  }
-  if (CopyFdToNewFile(std::move(input_fd_copy), core_path)) {
-    return true;
+  if (!util::IsDeveloperImage()) {
+    // The core file is deleted once it's converted, so only write the parts
+    // core2md reads. Developer images keep the whole core for debugging.
+    base::ScopedFD target_fd = GetNewFileHandle(core_path);
+    if (target_fd.is_valid()) {
+      SparseCoreWriter writer(input_fd, target_fd.get());
+      if (writer.Run()) {
+        LOG(INFO) << "Wrote " << writer.bytes_written() << " of "
+                  << writer.bytes_read() << " core bytes";
+        return true;
+      }
+    }
+  } else {
+    // We don't directly create a ScopedFD with input_fd because the
+    // destructor would close() that file descriptor. In non-test-scenarios,
+    // input_fd is stdin and we don't want to close stdin.
+    base::ScopedFD input_fd_copy(dup(input_fd));
+    if (!input_fd_copy.is_valid()) {
+      return false;
+    }
+    if (CopyFdToNewFile(std::move(input_fd_copy), core_path)) {
+      return true;
+    }
   }
 
   PLOG(ERROR) << "Could not write core file " << core_path.value();
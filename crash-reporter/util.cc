@@ -30,9 +30,9 @@
 #include <brillo/key_value_store.h>
 #include <brillo/userdb_utils.h>
 #include <re2/re2.h>
-#include <zlib.h>
 
 #include "crash-reporter/crossystem.h"
+#include "crash-reporter/gzip_input_stream.h"
 #include "crash-reporter/paths.h"
 #include "crash-reporter/vm_support.h"
 
@@ -437,62 +437,23 @@ bool GetDaemonStoreCrashDirectories(
 }
 
 std::vector<unsigned char> GzipStream(brillo::StreamPtr data) {
-  // Adapted from https://zlib.net/zlib_how.html
-  z_stream deflate_stream;
-  memset(&deflate_stream, 0, sizeof(deflate_stream));
-  deflate_stream.zalloc = Z_NULL;
-  deflate_stream.zfree = Z_NULL;
-
-  // Using a window size of 31 sets us to gzip mode (16) + default window size
-  // (15).
-  const int kDefaultWindowSize = 15;
-  const int kWindowSizeGzipAdd = 16;
-  const int kDefaultMemLevel = 8;
-  int result = deflateInit2(&deflate_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
-                            kDefaultWindowSize + kWindowSizeGzipAdd,
-                            kDefaultMemLevel, Z_DEFAULT_STRATEGY);
-  if (result != Z_OK) {
-    LOG(ERROR) << "Error initializing zlib: error code " << result
-               << ", error msg: "
-               << (deflate_stream.msg == nullptr ? "None" : deflate_stream.msg);
+  brillo::StreamPtr compressed_stream =
+      GzipInputStream::Create(std::move(data), nullptr);
+  if (!compressed_stream)
     return std::vector<unsigned char>();
-  }
 
   std::vector<unsigned char> deflated;
-  int flush = Z_NO_FLUSH;
-  /* compress until end of stream */
+  size_t read_size = 0;
   do {
-    size_t read_size = 0;
-    unsigned char in[kBufferSize];
-    if (!data->ReadBlocking(in, kBufferSize, &read_size, nullptr)) {
+    unsigned char out[kBufferSize];
+    if (!compressed_stream->ReadBlocking(out, kBufferSize, &read_size,
+                                         nullptr)) {
       // We are reading from a memory stream, so this really shouldn't happen.
-      LOG(ERROR) << "Error reading from input stream";
-      deflateEnd(&deflate_stream);
+      LOG(ERROR) << "Error compressing input stream";
       return std::vector<unsigned char>();
     }
-    if (data->GetRemainingSize() <= 0) {
-      // We must request a flush on the last chunk of data, else deflateEnd
-      // may just discard some compressed data.
-      flush = Z_FINISH;
-    }
-    deflate_stream.next_in = in;
-    deflate_stream.avail_in = read_size;
-    do {
-      unsigned char out[kBufferSize];
-      deflate_stream.avail_out = kBufferSize;
-      deflate_stream.next_out = out;
-      result = deflate(&deflate_stream, flush);
-      // Note that most return values are acceptable; don't error out if result
-      // is not Z_OK. See discussion at https://zlib.net/zlib_how.html
-      DCHECK_NE(result, Z_STREAM_ERROR);
-      DCHECK_LE(deflate_stream.avail_out, kBufferSize);
-      int amount_in_output_buffer = kBufferSize - deflate_stream.avail_out;
-      deflated.insert(deflated.end(), out, out + amount_in_output_buffer);
-    } while (deflate_stream.avail_out == 0);
-    DCHECK_EQ(deflate_stream.avail_in, 0) << "deflate did not consume all data";
-  } while (flush != Z_FINISH);
-  DCHECK_EQ(result, Z_STREAM_END) << "Stream did not complete properly";
-  deflateEnd(&deflate_stream);
+    deflated.insert(deflated.end(), out, out + read_size);
+  } while (read_size > 0);
   return deflated;
 }
 
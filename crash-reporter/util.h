@@ -123,7 +123,8 @@ bool GetDaemonStoreCrashDirectories(
     std::vector<base::FilePath>* directories);
 
 // Gzip's the |data| passed in and returns the compressed data. Returns an empty
-// vector on failure.
+// vector on failure. Use GzipInputStream to compress large data without
+// holding all of it in memory.
 std::vector<unsigned char> GzipStream(brillo::StreamPtr data);
 
 // Runs |process| and redirects |fd| to |output|. Returns the exit code, or -1
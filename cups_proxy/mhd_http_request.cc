@@ -43,6 +43,10 @@ void MHDHttpRequest::Finalize() {
   }
 }
 
+std::vector<uint8_t> MHDHttpRequest::TakeBody() {
+  return std::move(body_);
+}
+
 void MHDHttpRequest::PushToBody(base::StringPiece data) {
   body_.insert(body_.end(), data.begin(), data.end());
 }
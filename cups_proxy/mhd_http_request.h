@@ -25,6 +25,9 @@ class MHDHttpRequest {
   void PushToBody(base::StringPiece data);
   void Finalize();
 
+  // Moves the body out of the request, e.g. to pass it on without a copy.
+  std::vector<uint8_t> TakeBody();
+
   const std::string& method() const { return method_; }
   const std::string& url() const { return url_; }
   const std::string& version() const { return version_; }
@@ -74,5 +74,14 @@ TEST(PushToBody, AddContent) {
   EXPECT_EQ(request.body(), expected);
 }
 
+TEST(PushToBody, TakeBody) {
+  MHDHttpRequest request;
+  request.PushToBody("line1\n");
+
+  std::string body = "line1\n";
+  std::vector<unsigned char> expected(body.begin(), body.end());
+  EXPECT_EQ(request.TakeBody(), expected);
+}
+
 }  // namespace
 }  // namespace cups_proxy
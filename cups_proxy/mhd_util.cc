@@ -71,7 +71,7 @@ MHD_RESULT AccessHandler(void* cls,
 
   request->Finalize();
   auto* mojo_handler = static_cast<MojoHandler*>(cls);
-  IppResponse response = mojo_handler->ProxyRequestSync(*request);
+  IppResponse response = mojo_handler->ProxyRequestSync(request);
 
   ScopedMHDResponse mhd_resp(MHD_create_response_from_buffer(
       response.body.size(), response.body.data(), MHD_RESPMEM_MUST_COPY));
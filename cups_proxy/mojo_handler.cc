@@ -111,7 +111,7 @@ void MojoHandler::ProxyRequestOnThread(
     const std::string& url,
     const std::string& version,
     IppHeaders headers,
-    const IppBody& body,
+    IppBody body,
     mojom::CupsProxier::ProxyRequestCallback callback) {
   DCHECK(mojo_task_runner_->BelongsToCurrentThread());
 
@@ -122,18 +122,18 @@ void MojoHandler::ProxyRequestOnThread(
     LOG(INFO) << "Chrome Proxy is not up yet, queuing the request.";
     queued_requests_.push_back(base::BindOnce(
         &MojoHandler::ProxyRequestOnThread, base::Unretained(this), method, url,
-        version, std::move(headers), body, std::move(callback)));
+        version, std::move(headers), std::move(body), std::move(callback)));
   }
 }
 
-IppResponse MojoHandler::ProxyRequestSync(const MHDHttpRequest& request) {
+IppResponse MojoHandler::ProxyRequestSync(MHDHttpRequest* request) {
   DCHECK(!mojo_task_runner_->BelongsToCurrentThread());
 
-  const std::string& url = request.url();
-  const std::string& method = request.method();
-  const std::string& version = request.version();
-  IppHeaders headers = ConvertHeadersToMojom(request.headers());
-  const IppBody& body = request.body();
+  const std::string& url = request->url();
+  const std::string& method = request->method();
+  const std::string& version = request->version();
+  IppHeaders headers = ConvertHeadersToMojom(request->headers());
+  IppBody body = request->TakeBody();
 
   IppResponse response;
 
@@ -156,9 +156,10 @@ IppResponse MojoHandler::ProxyRequestSync(const MHDHttpRequest& request) {
   DVLOG(2) << "body = " << ShowBody(body);
 
   mojo_task_runner_->PostTask(
-      FROM_HERE, base::BindOnce(&MojoHandler::ProxyRequestOnThread,
-                                base::Unretained(this), method, url, version,
-                                std::move(headers), body, std::move(callback)));
+      FROM_HERE,
+      base::BindOnce(&MojoHandler::ProxyRequestOnThread, base::Unretained(this),
+                     method, url, version, std::move(headers), std::move(body),
+                     std::move(callback)));
   event.Wait();
 
   DVLOG(2) << "response code = " << response.http_status_code;
@@ -48,8 +48,9 @@ class MojoHandler {
   //
   // This calls method ProxyRequest@0 on the mojo interface. If called before
   // the mojo pipe is bound, the request would be queued and send after pipe is
-  // bound.
-  IppResponse ProxyRequestSync(const MHDHttpRequest& request);
+  // bound. The body is moved out of |request| rather than copied, since it
+  // holds the whole print job.
+  IppResponse ProxyRequestSync(MHDHttpRequest* request);
 
  private:
   // Setup the mojo pipe. This is always called on the mojo thread.
@@ -62,7 +63,7 @@ class MojoHandler {
                             const std::string& url,
                             const std::string& version,
                             IppHeaders headers,
-                            const IppBody& body,
+                            IppBody body,
                             mojom::CupsProxier::ProxyRequestCallback callback);
 
   base::Thread mojo_thread_;
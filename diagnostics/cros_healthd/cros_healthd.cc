@@ -31,7 +31,8 @@
 namespace diagnostics {
 
 CrosHealthd::CrosHealthd(mojo::PlatformChannelEndpoint endpoint,
-                         std::unique_ptr<brillo::UdevMonitor>&& udev_monitor)
+                         std::unique_ptr<brillo::UdevMonitor>&& udev_monitor,
+                         base::TimeDelta probe_snapshot_age)
     : DBusServiceDaemon(kCrosHealthdServiceName /* service_name */) {
   ipc_support_ = std::make_unique<mojo::core::ScopedIPCSupport>(
       base::ThreadTaskRunnerHandle::Get() /* io_thread_task_runner */,
@@ -43,7 +44,8 @@ CrosHealthd::CrosHealthd(mojo::PlatformChannelEndpoint endpoint,
       base::BindOnce(&CrosHealthd::Quit, base::Unretained(this)));
   CHECK(context_) << "Failed to initialize context.";
 
-  fetch_aggregator_ = std::make_unique<FetchAggregator>(context_.get());
+  fetch_aggregator_ =
+      std::make_unique<FetchAggregator>(context_.get(), probe_snapshot_age);
 
   bluetooth_events_ = std::make_unique<BluetoothEventsImpl>(context_.get());
 
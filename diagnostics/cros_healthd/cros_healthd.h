@@ -9,6 +9,7 @@
 #include <string>
 
 #include <base/files/scoped_file.h>
+#include <base/time/time.h>
 #include <brillo/daemons/dbus_daemon.h>
 #include <brillo/dbus/dbus_object.h>
 #include <mojo/core/embedder/scoped_ipc_support.h>
@@ -36,8 +37,11 @@ class CrosHealthd final
     : public brillo::DBusServiceDaemon,
       public ash::cros_healthd::mojom::CrosHealthdServiceFactory {
  public:
-  explicit CrosHealthd(mojo::PlatformChannelEndpoint endpoint,
-                       std::unique_ptr<brillo::UdevMonitor>&& udev_monitor);
+  // |probe_snapshot_age| - how long probed telemetry information is reused
+  //                        for by later probes.
+  CrosHealthd(mojo::PlatformChannelEndpoint endpoint,
+              std::unique_ptr<brillo::UdevMonitor>&& udev_monitor,
+              base::TimeDelta probe_snapshot_age);
   CrosHealthd(const CrosHealthd&) = delete;
   CrosHealthd& operator=(const CrosHealthd&) = delete;
   ~CrosHealthd() override;
@@ -6,10 +6,12 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <utility>
 
 #include <base/check.h>
 #include <base/logging.h>
+#include <base/time/time.h>
 #include <chromeos/mojo/service_constants.h>
 
 #include "diagnostics/cros_healthd/fetchers/process_fetcher.h"
@@ -20,6 +22,13 @@ namespace diagnostics {
 namespace mojo_ipc = ::ash::cros_healthd::mojom;
 namespace network_health_ipc = ::chromeos::network_health::mojom;
 
+namespace {
+
+// Telemetry observers are notified at most this often.
+constexpr base::TimeDelta kMinTelemetryObserverInterval = base::Seconds(1);
+
+}  // namespace
+
 CrosHealthdMojoService::CrosHealthdMojoService(
     Context* context,
     FetchAggregator* fetch_aggregator,
@@ -110,6 +119,16 @@ void CrosHealthdMojoService::ProbeMultipleProcessInfo(
       process_ids, ignore_single_process_info, std::move(callback));
 }
 
+void CrosHealthdMojoService::AddTelemetryObserver(
+    const std::vector<ProbeCategoryEnum>& categories,
+    uint32_t interval_ms,
+    mojo::PendingRemote<mojo_ipc::CrosHealthdTelemetryObserver> observer) {
+  fetch_aggregator_->AddObserver(
+      categories,
+      std::max(base::Milliseconds(interval_ms), kMinTelemetryObserverInterval),
+      std::move(observer));
+}
+
 void CrosHealthdMojoService::GetServiceStatus(
     GetServiceStatusCallback callback) {
   auto response = mojo_ipc::ServiceStatus::New();
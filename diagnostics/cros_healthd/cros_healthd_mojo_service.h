@@ -85,6 +85,12 @@ class CrosHealthdMojoService final
       const std::optional<std::vector<uint32_t>>& process_ids,
       bool ignore_single_process_info,
       ProbeMultipleProcessInfoCallback callback) override;
+  void AddTelemetryObserver(
+      const std::vector<ProbeCategoryEnum>& categories,
+      uint32_t interval_ms,
+      mojo::PendingRemote<
+          ash::cros_healthd::mojom::CrosHealthdTelemetryObserver> observer)
+      override;
 
   // ash::cros_healthd::mojom::CrosHealthdSystemService overrides:
   void GetServiceStatus(GetServiceStatusCallback callback) override;
@@ -30,4 +30,12 @@ void FakeProbeService::ProbeMultipleProcessInfo(
   NOTIMPLEMENTED();
 }
 
+void FakeProbeService::AddTelemetryObserver(
+    const std::vector<ProbeCategoryEnum>& categories,
+    uint32_t interval_ms,
+    mojo::PendingRemote<ash::cros_healthd::mojom::CrosHealthdTelemetryObserver>
+        observer) {
+  NOTIMPLEMENTED();
+}
+
 }  // namespace diagnostics
@@ -8,6 +8,8 @@
 #include <cstdint>
 #include <vector>
 
+#include <mojo/public/cpp/bindings/pending_remote.h>
+
 #include "diagnostics/mojom/public/cros_healthd.mojom.h"
 
 namespace diagnostics {
@@ -32,6 +34,12 @@ class FakeProbeService final
       const std::optional<std::vector<uint32_t>>& process_ids,
       bool ignore_single_process_info,
       ProbeMultipleProcessInfoCallback callback) override;
+  void AddTelemetryObserver(
+      const std::vector<ProbeCategoryEnum>& categories,
+      uint32_t interval_ms,
+      mojo::PendingRemote<
+          ash::cros_healthd::mojom::CrosHealthdTelemetryObserver> observer)
+      override;
 };
 
 }  // namespace diagnostics
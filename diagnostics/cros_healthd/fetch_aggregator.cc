@@ -11,6 +11,7 @@
 
 #include <base/bind.h>
 #include <base/logging.h>
+#include <mojo/public/cpp/bindings/equals_traits.h>
 
 #include "diagnostics/cros_healthd/fetchers/audio_fetcher.h"
 #include "diagnostics/cros_healthd/fetchers/audio_hardware_fetcher.h"
@@ -39,10 +40,91 @@ void OnFinish(
   std::move(callback).Run(std::move(*result));
 }
 
+// Calls |visitor| with the member of TelemetryInfo holding the information of
+// |category|.
+template <typename Visitor>
+void VisitCategoryField(mojom::ProbeCategoryEnum category, Visitor visitor) {
+  switch (category) {
+    case mojom::ProbeCategoryEnum::kUnknown:
+      // For interface backward compatibility.
+      return;
+    case mojom::ProbeCategoryEnum::kBattery:
+      return visitor(&mojom::TelemetryInfo::battery_result);
+    case mojom::ProbeCategoryEnum::kCpu:
+      return visitor(&mojom::TelemetryInfo::cpu_result);
+    case mojom::ProbeCategoryEnum::kNonRemovableBlockDevices:
+      return visitor(&mojom::TelemetryInfo::block_device_result);
+    case mojom::ProbeCategoryEnum::kTimezone:
+      return visitor(&mojom::TelemetryInfo::timezone_result);
+    case mojom::ProbeCategoryEnum::kMemory:
+      return visitor(&mojom::TelemetryInfo::memory_result);
+    case mojom::ProbeCategoryEnum::kBacklight:
+      return visitor(&mojom::TelemetryInfo::backlight_result);
+    case mojom::ProbeCategoryEnum::kFan:
+      return visitor(&mojom::TelemetryInfo::fan_result);
+    case mojom::ProbeCategoryEnum::kStatefulPartition:
+      return visitor(&mojom::TelemetryInfo::stateful_partition_result);
+    case mojom::ProbeCategoryEnum::kBluetooth:
+      return visitor(&mojom::TelemetryInfo::bluetooth_result);
+    case mojom::ProbeCategoryEnum::kSystem:
+      return visitor(&mojom::TelemetryInfo::system_result);
+    case mojom::ProbeCategoryEnum::kNetwork:
+      return visitor(&mojom::TelemetryInfo::network_result);
+    case mojom::ProbeCategoryEnum::kAudio:
+      return visitor(&mojom::TelemetryInfo::audio_result);
+    case mojom::ProbeCategoryEnum::kBootPerformance:
+      return visitor(&mojom::TelemetryInfo::boot_performance_result);
+    case mojom::ProbeCategoryEnum::kBus:
+      return visitor(&mojom::TelemetryInfo::bus_result);
+    case mojom::ProbeCategoryEnum::kTpm:
+      return visitor(&mojom::TelemetryInfo::tpm_result);
+    case mojom::ProbeCategoryEnum::kNetworkInterface:
+      return visitor(&mojom::TelemetryInfo::network_interface_result);
+    case mojom::ProbeCategoryEnum::kGraphics:
+      return visitor(&mojom::TelemetryInfo::graphics_result);
+    case mojom::ProbeCategoryEnum::kDisplay:
+      return visitor(&mojom::TelemetryInfo::display_result);
+    case mojom::ProbeCategoryEnum::kInput:
+      return visitor(&mojom::TelemetryInfo::input_result);
+    case mojom::ProbeCategoryEnum::kAudioHardware:
+      return visitor(&mojom::TelemetryInfo::audio_hardware_result);
+    case mojom::ProbeCategoryEnum::kSensor:
+      return visitor(&mojom::TelemetryInfo::sensor_result);
+  }
+}
+
+// Copies the information of |category| from |from| to |to|.
+void CopyCategory(mojom::ProbeCategoryEnum category,
+                  mojom::TelemetryInfo* to,
+                  const mojom::TelemetryInfo& from) {
+  VisitCategoryField(category,
+                     [&](auto field) { to->*field = (from.*field).Clone(); });
+}
+
+// Returns whether |a| and |b| hold the same information of |category|.
+bool CategoryEquals(mojom::ProbeCategoryEnum category,
+                    const mojom::TelemetryInfo& a,
+                    const mojom::TelemetryInfo& b) {
+  bool equals = true;
+  VisitCategoryField(category, [&](auto field) {
+    equals = mojo::Equals(a.*field, b.*field);
+  });
+  return equals;
+}
+
+// Whether snapshots of |category| may be reused by later requests.
+bool CanReuseSnapshot(mojom::ProbeCategoryEnum category) {
+  // Clients compute CPU usage from the difference of the CPU times of two
+  // probes, which would be zero for a reused snapshot.
+  return category != mojom::ProbeCategoryEnum::kCpu;
+}
+
 }  // namespace
 
-FetchAggregator::FetchAggregator(Context* context)
-    : backlight_fetcher_(context),
+FetchAggregator::FetchAggregator(Context* context,
+                                 base::TimeDelta max_snapshot_age)
+    : max_snapshot_age_(max_snapshot_age),
+      backlight_fetcher_(context),
       battery_fetcher_(context),
       bluetooth_fetcher_(context),
       boot_performance_fetcher_(context),
@@ -61,6 +143,9 @@ FetchAggregator::FetchAggregator(Context* context)
 
 FetchAggregator::~FetchAggregator() = default;
 
+FetchAggregator::Subscription::Subscription() = default;
+FetchAggregator::Subscription::~Subscription() = default;
+
 void FetchAggregator::Run(
     const std::vector<mojom::ProbeCategoryEnum>& categories_to_probe,
     mojom::CrosHealthdProbeService::ProbeTelemetryInfoCallback callback) {
@@ -79,112 +164,225 @@ void FetchAggregator::Run(
 
   for (const auto category : std::set<mojom::ProbeCategoryEnum>(
            categories_to_probe.begin(), categories_to_probe.end())) {
-    switch (category) {
-      case mojom::ProbeCategoryEnum::kUnknown: {
-        // For interface backward compatibility.
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kBattery: {
-        info->battery_result = battery_fetcher_.FetchBatteryInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kCpu: {
-        FetchCpuInfo(context_,
-                     CreateFetchCallback(&barrier, &info->cpu_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kNonRemovableBlockDevices: {
-        info->block_device_result =
-            disk_fetcher_.FetchNonRemovableBlockDevicesInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kTimezone: {
-        info->timezone_result = timezone_fetcher_.FetchTimezoneInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kMemory: {
-        memory_fetcher_.FetchMemoryInfo(
-            CreateFetchCallback(&barrier, &info->memory_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kBacklight: {
-        info->backlight_result = backlight_fetcher_.FetchBacklightInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kFan: {
-        fan_fetcher_.FetchFanInfo(
-            CreateFetchCallback(&barrier, &info->fan_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kStatefulPartition: {
-        info->stateful_partition_result =
-            stateful_partition_fetcher_.FetchStatefulPartitionInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kBluetooth: {
-        info->bluetooth_result = bluetooth_fetcher_.FetchBluetoothInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kSystem: {
-        FetchSystemInfo(context_,
-                        CreateFetchCallback(&barrier, &info->system_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kNetwork: {
-        network_fetcher_.FetchNetworkInfo(
-            CreateFetchCallback(&barrier, &info->network_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kAudio: {
-        FetchAudioInfo(context_,
-                       CreateFetchCallback(&barrier, &info->audio_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kBootPerformance: {
-        info->boot_performance_result =
-            boot_performance_fetcher_.FetchBootPerformanceInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kBus: {
-        FetchBusDevices(context_,
-                        CreateFetchCallback(&barrier, &info->bus_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kTpm: {
-        tpm_fetcher_.FetchTpmInfo(
-            CreateFetchCallback(&barrier, &info->tpm_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kNetworkInterface: {
-        network_interface_fetcher_.FetchNetworkInterfaceInfo(
-            CreateFetchCallback(&barrier, &info->network_interface_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kGraphics: {
-        info->graphics_result = graphics_fetcher_.FetchGraphicsInfo();
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kDisplay: {
-        display_fetcher_.FetchDisplayInfo(
-            CreateFetchCallback(&barrier, &info->display_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kInput: {
-        input_fetcher_.Fetch(
-            CreateFetchCallback(&barrier, &info->input_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kAudioHardware: {
-        FetchAudioHardwareInfo(
-            context_,
-            CreateFetchCallback(&barrier, &info->audio_hardware_result));
-        break;
-      }
-      case mojom::ProbeCategoryEnum::kSensor: {
-        FetchSensorInfo(context_,
-                        CreateFetchCallback(&barrier, &info->sensor_result));
-        break;
-      }
+    GetCategory(category,
+                barrier.Depend(base::BindOnce(&CopyCategory, category, info)));
+  }
+}
+
+void FetchAggregator::AddObserver(
+    const std::vector<mojom::ProbeCategoryEnum>& categories,
+    base::TimeDelta interval,
+    mojo::PendingRemote<mojom::CrosHealthdTelemetryObserver> observer) {
+  const uint64_t id = next_subscription_id_++;
+  auto subscription = std::make_unique<Subscription>();
+  subscription->categories = categories;
+  subscription->observer.Bind(std::move(observer));
+  subscription->observer.set_disconnect_handler(base::BindOnce(
+      [](FetchAggregator* aggregator, uint64_t id) {
+        aggregator->subscriptions_.erase(id);
+      },
+      base::Unretained(this), id));
+  // Unretained is safe because |this| owns the timer.
+  subscription->timer.Start(
+      FROM_HERE, interval,
+      base::BindRepeating(&FetchAggregator::ProbeSubscription,
+                          base::Unretained(this), id));
+  subscriptions_[id] = std::move(subscription);
+  ProbeSubscription(id);
+}
+
+void FetchAggregator::GetCategory(mojom::ProbeCategoryEnum category,
+                                  SnapshotCallback callback) {
+  auto snapshot = snapshots_.find(category);
+  if (snapshot != snapshots_.end() &&
+      base::TimeTicks::Now() - snapshot->second.time <= max_snapshot_age_) {
+    std::move(callback).Run(*snapshot->second.info);
+    return;
+  }
+
+  std::vector<SnapshotCallback>& waiting = pending_fetches_[category];
+  waiting.push_back(std::move(callback));
+  if (waiting.size() > 1)
+    return;
+
+  CallbackBarrier barrier{base::BindOnce(&FetchAggregator::OnFetchFinished,
+                                         weak_factory_.GetWeakPtr(),
+                                         category)};
+  FetchCategory(category, barrier.Depend(base::BindOnce(
+                              &FetchAggregator::OnCategoryFetched,
+                              weak_factory_.GetWeakPtr(), category)));
+}
+
+void FetchAggregator::OnCategoryFetched(mojom::ProbeCategoryEnum category,
+                                        mojom::TelemetryInfoPtr info) {
+  std::vector<SnapshotCallback> waiting =
+      std::move(pending_fetches_[category]);
+  pending_fetches_.erase(category);
+  for (auto& callback : waiting)
+    std::move(callback).Run(*info);
+
+  if (CanReuseSnapshot(category) && max_snapshot_age_.is_positive())
+    snapshots_[category] = {std::move(info), base::TimeTicks::Now()};
+}
+
+void FetchAggregator::OnFetchFinished(mojom::ProbeCategoryEnum category,
+                                      bool replied) {
+  if (!replied)
+    pending_fetches_.erase(category);
+}
+
+void FetchAggregator::ProbeSubscription(uint64_t id) {
+  // Probes overlapping a slow fetch wait for it rather than fetching again.
+  Run(subscriptions_[id]->categories,
+      base::BindOnce(&FetchAggregator::OnSubscriptionProbed,
+                     weak_factory_.GetWeakPtr(), id));
+}
+
+void FetchAggregator::OnSubscriptionProbed(uint64_t id,
+                                           mojom::TelemetryInfoPtr info) {
+  auto it = subscriptions_.find(id);
+  if (it == subscriptions_.end())
+    return;
+  Subscription* subscription = it->second.get();
+
+  // Only send the categories that changed.
+  auto changes = mojom::TelemetryInfo::New();
+  bool changed = false;
+  for (const auto category : std::set<mojom::ProbeCategoryEnum>(
+           subscription->categories.begin(), subscription->categories.end())) {
+    if (subscription->last_sent &&
+        CategoryEquals(category, *subscription->last_sent, *info)) {
+      continue;
+    }
+    CopyCategory(category, changes.get(), *info);
+    changed = true;
+  }
+  subscription->last_sent = std::move(info);
+  if (changed)
+    subscription->observer->OnTelemetryInfoChanged(std::move(changes));
+}
+
+void FetchAggregator::FetchCategory(
+    mojom::ProbeCategoryEnum category,
+    base::OnceCallback<void(mojom::TelemetryInfoPtr)> callback) {
+  // Use unique_ptr so the pointer |info| remains valid after std::move.
+  auto result =
+      std::make_unique<mojom::TelemetryInfoPtr>(mojom::TelemetryInfo::New());
+  mojom::TelemetryInfo* info = result->get();
+  CallbackBarrier barrier{
+      base::BindOnce(
+          [](base::OnceCallback<void(mojom::TelemetryInfoPtr)> callback,
+             std::unique_ptr<mojom::TelemetryInfoPtr> result) {
+            std::move(callback).Run(std::move(*result));
+          },
+          std::move(callback), std::move(result)),
+      /*on_error=*/base::BindOnce([]() {
+        LOG(ERROR) << "Some async fetchers didn't call the callback.";
+      })};
+
+  switch (category) {
+    case mojom::ProbeCategoryEnum::kUnknown: {
+      // For interface backward compatibility.
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kBattery: {
+      info->battery_result = battery_fetcher_.FetchBatteryInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kCpu: {
+      FetchCpuInfo(context_, CreateFetchCallback(&barrier, &info->cpu_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kNonRemovableBlockDevices: {
+      info->block_device_result =
+          disk_fetcher_.FetchNonRemovableBlockDevicesInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kTimezone: {
+      info->timezone_result = timezone_fetcher_.FetchTimezoneInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kMemory: {
+      memory_fetcher_.FetchMemoryInfo(
+          CreateFetchCallback(&barrier, &info->memory_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kBacklight: {
+      info->backlight_result = backlight_fetcher_.FetchBacklightInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kFan: {
+      fan_fetcher_.FetchFanInfo(
+          CreateFetchCallback(&barrier, &info->fan_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kStatefulPartition: {
+      info->stateful_partition_result =
+          stateful_partition_fetcher_.FetchStatefulPartitionInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kBluetooth: {
+      info->bluetooth_result = bluetooth_fetcher_.FetchBluetoothInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kSystem: {
+      FetchSystemInfo(context_,
+                      CreateFetchCallback(&barrier, &info->system_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kNetwork: {
+      network_fetcher_.FetchNetworkInfo(
+          CreateFetchCallback(&barrier, &info->network_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kAudio: {
+      FetchAudioInfo(context_,
+                     CreateFetchCallback(&barrier, &info->audio_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kBootPerformance: {
+      info->boot_performance_result =
+          boot_performance_fetcher_.FetchBootPerformanceInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kBus: {
+      FetchBusDevices(context_,
+                      CreateFetchCallback(&barrier, &info->bus_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kTpm: {
+      tpm_fetcher_.FetchTpmInfo(
+          CreateFetchCallback(&barrier, &info->tpm_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kNetworkInterface: {
+      network_interface_fetcher_.FetchNetworkInterfaceInfo(
+          CreateFetchCallback(&barrier, &info->network_interface_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kGraphics: {
+      info->graphics_result = graphics_fetcher_.FetchGraphicsInfo();
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kDisplay: {
+      display_fetcher_.FetchDisplayInfo(
+          CreateFetchCallback(&barrier, &info->display_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kInput: {
+      input_fetcher_.Fetch(CreateFetchCallback(&barrier, &info->input_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kAudioHardware: {
+      FetchAudioHardwareInfo(
+          context_,
+          CreateFetchCallback(&barrier, &info->audio_hardware_result));
+      break;
+    }
+    case mojom::ProbeCategoryEnum::kSensor: {
+      FetchSensorInfo(context_,
+                      CreateFetchCallback(&barrier, &info->sensor_result));
+      break;
     }
   }
 }
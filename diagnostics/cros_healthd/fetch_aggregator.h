@@ -5,8 +5,18 @@
 #ifndef DIAGNOSTICS_CROS_HEALTHD_FETCH_AGGREGATOR_H_
 #define DIAGNOSTICS_CROS_HEALTHD_FETCH_AGGREGATOR_H_
 
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <vector>
 
+#include <base/callback.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
+#include <base/timer/timer.h>
+#include <mojo/public/cpp/bindings/pending_remote.h>
+#include <mojo/public/cpp/bindings/remote.h>
+
 #include "diagnostics/cros_healthd/fetchers/backlight_fetcher.h"
 #include "diagnostics/cros_healthd/fetchers/battery_fetcher.h"
 #include "diagnostics/cros_healthd/fetchers/bluetooth_fetcher.h"
@@ -34,9 +44,16 @@ namespace diagnostics {
 // This class is responsible for aggregating probe data from various fetchers,
 // some of which may be asynchronous, and running the given callback when all
 // probe data has been fetched.
+//
+// Fetched categories are kept as snapshots and reused by requests made within
+// |max_snapshot_age|, so that clients polling the same categories don't each
+// re-read the system. Requests for a category that is already being fetched
+// wait for that fetch instead of starting another one.
 class FetchAggregator final {
  public:
-  explicit FetchAggregator(Context* context);
+  // Snapshots are reused for at most |max_snapshot_age|. Categories whose
+  // information is meant to be diffed between probes (kCpu) are never reused.
+  FetchAggregator(Context* context, base::TimeDelta max_snapshot_age);
   FetchAggregator(const FetchAggregator&) = delete;
   FetchAggregator& operator=(const FetchAggregator&) = delete;
   ~FetchAggregator();
@@ -48,7 +65,66 @@ class FetchAggregator final {
            ash::cros_healthd::mojom::CrosHealthdProbeService::
                ProbeTelemetryInfoCallback callback);
 
+  // Probes |categories| every |interval| and notifies |observer| of the
+  // information that changed since its previous notification.
+  void AddObserver(
+      const std::vector<ash::cros_healthd::mojom::ProbeCategoryEnum>&
+          categories,
+      base::TimeDelta interval,
+      mojo::PendingRemote<
+          ash::cros_healthd::mojom::CrosHealthdTelemetryObserver> observer);
+
  private:
+  // Called with a TelemetryInfo holding the information of one category.
+  using SnapshotCallback =
+      base::OnceCallback<void(const ash::cros_healthd::mojom::TelemetryInfo&)>;
+
+  struct Snapshot {
+    ash::cros_healthd::mojom::TelemetryInfoPtr info;
+    base::TimeTicks time;
+  };
+
+  struct Subscription {
+    Subscription();
+    ~Subscription();
+
+    std::vector<ash::cros_healthd::mojom::ProbeCategoryEnum> categories;
+    mojo::Remote<ash::cros_healthd::mojom::CrosHealthdTelemetryObserver>
+        observer;
+    base::RepeatingTimer timer;
+    // Information last sent to |observer|.
+    ash::cros_healthd::mojom::TelemetryInfoPtr last_sent;
+  };
+
+  // Gets the information of |category| from a fresh snapshot, the pending
+  // fetch of |category| or a new fetch.
+  void GetCategory(ash::cros_healthd::mojom::ProbeCategoryEnum category,
+                   SnapshotCallback callback);
+  // Fetches the information of |category| from the fetchers.
+  void FetchCategory(
+      ash::cros_healthd::mojom::ProbeCategoryEnum category,
+      base::OnceCallback<void(ash::cros_healthd::mojom::TelemetryInfoPtr)>
+          callback);
+  void OnCategoryFetched(ash::cros_healthd::mojom::ProbeCategoryEnum category,
+                         ash::cros_healthd::mojom::TelemetryInfoPtr info);
+  // Drops the requests waiting for |category| if its fetcher never replied.
+  void OnFetchFinished(ash::cros_healthd::mojom::ProbeCategoryEnum category,
+                       bool replied);
+
+  void ProbeSubscription(uint64_t id);
+  void OnSubscriptionProbed(uint64_t id,
+                            ash::cros_healthd::mojom::TelemetryInfoPtr info);
+
+  const base::TimeDelta max_snapshot_age_;
+  // Last fetched information of each category.
+  std::map<ash::cros_healthd::mojom::ProbeCategoryEnum, Snapshot> snapshots_;
+  // Requests waiting for the pending fetch of each category.
+  std::map<ash::cros_healthd::mojom::ProbeCategoryEnum,
+           std::vector<SnapshotCallback>>
+      pending_fetches_;
+  std::map<uint64_t, std::unique_ptr<Subscription>> subscriptions_;
+  uint64_t next_subscription_id_ = 0;
+
   BacklightFetcher backlight_fetcher_;
   BatteryFetcher battery_fetcher_;
   BluetoothFetcher bluetooth_fetcher_;
@@ -67,6 +143,9 @@ class FetchAggregator final {
 
   // The pointer to the Context object for accessing system utilities.
   Context* const context_;
+
+  // Must be the last member of the class.
+  base::WeakPtrFactory<FetchAggregator> weak_factory_{this};
 };
 
 }  // namespace diagnostics
@@ -0,0 +1,306 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/run_loop.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/task_environment.h>
+#include <base/time/time.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <mojo/public/cpp/bindings/pending_receiver.h>
+#include <mojo/public/cpp/bindings/pending_remote.h>
+#include <mojo/public/cpp/bindings/receiver.h>
+
+#include "diagnostics/cros_healthd/executor/mojom/executor.mojom.h"
+#include "diagnostics/cros_healthd/fetch_aggregator.h"
+#include "diagnostics/cros_healthd/fetchers/fan_fetcher.h"
+#include "diagnostics/cros_healthd/system/mock_context.h"
+#include "diagnostics/mojom/public/cros_healthd_probe.mojom.h"
+
+namespace diagnostics {
+namespace {
+
+namespace mojom = ::ash::cros_healthd::mojom;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::WithArg;
+
+constexpr base::TimeDelta kSnapshotAge = base::Seconds(5);
+constexpr base::TimeDelta kInterval = base::Seconds(1);
+constexpr uint32_t kFanSpeedRpm = 2255;
+constexpr uint32_t kOtherFanSpeedRpm = 1263;
+
+mojom::ExecutedProcessResultPtr CreateFanSpeedResult(uint32_t speed_rpm) {
+  auto result = mojom::ExecutedProcessResult::New();
+  result->return_code = EXIT_SUCCESS;
+  result->out = base::StringPrintf("Fan 0 RPM: %u\n", speed_rpm);
+  return result;
+}
+
+// Returns the fan speed in |info|, or 0 if it has no fan information.
+uint32_t GetFanSpeed(const mojom::TelemetryInfoPtr& info) {
+  if (!info->fan_result || !info->fan_result->is_fan_info() ||
+      info->fan_result->get_fan_info().empty()) {
+    return 0;
+  }
+  return info->fan_result->get_fan_info()[0]->speed_rpm;
+}
+
+class FakeTelemetryObserver : public mojom::CrosHealthdTelemetryObserver {
+ public:
+  explicit FakeTelemetryObserver(
+      mojo::PendingReceiver<mojom::CrosHealthdTelemetryObserver> receiver)
+      : receiver_{this /* impl */, std::move(receiver)} {}
+  FakeTelemetryObserver(const FakeTelemetryObserver&) = delete;
+  FakeTelemetryObserver& operator=(const FakeTelemetryObserver&) = delete;
+
+  // mojom::CrosHealthdTelemetryObserver overrides:
+  void OnTelemetryInfoChanged(mojom::TelemetryInfoPtr info) override {
+    notifications_.push_back(std::move(info));
+  }
+
+  std::vector<mojom::TelemetryInfoPtr>& notifications() {
+    return notifications_;
+  }
+
+ private:
+  mojo::Receiver<mojom::CrosHealthdTelemetryObserver> receiver_;
+  std::vector<mojom::TelemetryInfoPtr> notifications_;
+};
+
+class FetchAggregatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(base::CreateDirectory(
+        mock_context_.root_dir().Append(kRelativeCrosEcPath)));
+  }
+
+  MockExecutor* mock_executor() { return mock_context_.mock_executor(); }
+
+  // Sets the fan speed reported by the executor, and counts the calls.
+  void SetFanSpeed(uint32_t speed_rpm) {
+    EXPECT_CALL(*mock_executor(), GetFanSpeed(_))
+        .WillRepeatedly(WithArg<0>(
+            Invoke([this, speed_rpm](
+                       mojom::Executor::GetFanSpeedCallback callback) {
+              ++fan_speed_calls_;
+              std::move(callback).Run(CreateFanSpeedResult(speed_rpm));
+            })));
+  }
+
+  mojom::TelemetryInfoPtr Probe(
+      const std::vector<mojom::ProbeCategoryEnum>& categories) {
+    base::RunLoop run_loop;
+    mojom::TelemetryInfoPtr result;
+    fetch_aggregator_.Run(
+        categories,
+        base::BindOnce(
+            [](mojom::TelemetryInfoPtr* result, base::OnceClosure quit_closure,
+               mojom::TelemetryInfoPtr info) {
+              *result = std::move(info);
+              std::move(quit_closure).Run();
+            },
+            &result, run_loop.QuitClosure()));
+    run_loop.Run();
+    return result;
+  }
+
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::TimeSource::MOCK_TIME};
+  MockContext mock_context_;
+  FetchAggregator fetch_aggregator_{&mock_context_, kSnapshotAge};
+  int fan_speed_calls_ = 0;
+};
+
+// Test that a category probed again within the snapshot age isn't refetched.
+TEST_F(FetchAggregatorTest, ReusesFreshSnapshot) {
+  SetFanSpeed(kFanSpeedRpm);
+  EXPECT_EQ(GetFanSpeed(Probe({mojom::ProbeCategoryEnum::kFan})),
+            kFanSpeedRpm);
+
+  task_environment_.FastForwardBy(kSnapshotAge - base::Seconds(1));
+  SetFanSpeed(kOtherFanSpeedRpm);
+  EXPECT_EQ(GetFanSpeed(Probe({mojom::ProbeCategoryEnum::kFan})),
+            kFanSpeedRpm);
+  EXPECT_EQ(fan_speed_calls_, 1);
+}
+
+// Test that a category is refetched once its snapshot is too old.
+TEST_F(FetchAggregatorTest, RefetchesStaleSnapshot) {
+  SetFanSpeed(kFanSpeedRpm);
+  Probe({mojom::ProbeCategoryEnum::kFan});
+
+  task_environment_.FastForwardBy(kSnapshotAge + base::Seconds(1));
+  SetFanSpeed(kOtherFanSpeedRpm);
+  EXPECT_EQ(GetFanSpeed(Probe({mojom::ProbeCategoryEnum::kFan})),
+            kOtherFanSpeedRpm);
+  EXPECT_EQ(fan_speed_calls_, 2);
+}
+
+// Test that concurrent probes of a category share one fetch.
+TEST_F(FetchAggregatorTest, CoalescesConcurrentProbes) {
+  mojom::Executor::GetFanSpeedCallback fan_speed_callback;
+  EXPECT_CALL(*mock_executor(), GetFanSpeed(_))
+      .WillOnce(WithArg<0>(
+          Invoke([&](mojom::Executor::GetFanSpeedCallback callback) {
+            fan_speed_callback = std::move(callback);
+          })));
+
+  std::vector<mojom::TelemetryInfoPtr> results;
+  auto save_result = base::BindRepeating(
+      [](std::vector<mojom::TelemetryInfoPtr>* results,
+         mojom::TelemetryInfoPtr info) { results->push_back(std::move(info)); },
+      &results);
+  fetch_aggregator_.Run({mojom::ProbeCategoryEnum::kFan}, save_result);
+  fetch_aggregator_.Run(
+      {mojom::ProbeCategoryEnum::kFan, mojom::ProbeCategoryEnum::kUnknown},
+      save_result);
+  EXPECT_TRUE(results.empty());
+
+  ASSERT_TRUE(fan_speed_callback);
+  std::move(fan_speed_callback).Run(CreateFanSpeedResult(kFanSpeedRpm));
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_EQ(GetFanSpeed(results[0]), kFanSpeedRpm);
+  EXPECT_EQ(GetFanSpeed(results[1]), kFanSpeedRpm);
+}
+
+// Test that probes waiting for a fetch whose fetcher never replies are
+// dropped, and that the category can be fetched again.
+TEST_F(FetchAggregatorTest, DropsProbesOfAbandonedFetch) {
+  EXPECT_CALL(*mock_executor(), GetFanSpeed(_))
+      .WillOnce(WithArg<0>(
+          Invoke([](mojom::Executor::GetFanSpeedCallback callback) {})));
+  bool replied = false;
+  fetch_aggregator_.Run(
+      {mojom::ProbeCategoryEnum::kFan},
+      base::BindOnce(
+          [](bool* replied, mojom::TelemetryInfoPtr) { *replied = true; },
+          &replied));
+  EXPECT_FALSE(replied);
+
+  SetFanSpeed(kFanSpeedRpm);
+  EXPECT_EQ(GetFanSpeed(Probe({mojom::ProbeCategoryEnum::kFan})),
+            kFanSpeedRpm);
+}
+
+// Test that observers get the subscribed categories right away and then only
+// the changes.
+TEST_F(FetchAggregatorTest, ObserverGetsChanges) {
+  SetFanSpeed(kFanSpeedRpm);
+  mojo::PendingRemote<mojom::CrosHealthdTelemetryObserver> remote;
+  FakeTelemetryObserver observer(remote.InitWithNewPipeAndPassReceiver());
+  fetch_aggregator_.AddObserver({mojom::ProbeCategoryEnum::kFan}, kInterval,
+                                std::move(remote));
+  task_environment_.RunUntilIdle();
+  ASSERT_EQ(observer.notifications().size(), 1);
+  EXPECT_EQ(GetFanSpeed(observer.notifications()[0]), kFanSpeedRpm);
+
+  // Nothing changed.
+  task_environment_.FastForwardBy(kSnapshotAge + kInterval);
+  EXPECT_EQ(observer.notifications().size(), 1);
+
+  SetFanSpeed(kOtherFanSpeedRpm);
+  task_environment_.FastForwardBy(kSnapshotAge + kInterval);
+  ASSERT_EQ(observer.notifications().size(), 2);
+  EXPECT_EQ(GetFanSpeed(observer.notifications()[1]), kOtherFanSpeedRpm);
+}
+
+// Test that observers share the snapshots with each other and with probes.
+TEST_F(FetchAggregatorTest, ObserversShareSnapshots) {
+  SetFanSpeed(kFanSpeedRpm);
+  std::vector<std::unique_ptr<FakeTelemetryObserver>> observers;
+  for (int i = 0; i < 5; ++i) {
+    mojo::PendingRemote<mojom::CrosHealthdTelemetryObserver> remote;
+    observers.push_back(std::make_unique<FakeTelemetryObserver>(
+        remote.InitWithNewPipeAndPassReceiver()));
+    fetch_aggregator_.AddObserver({mojom::ProbeCategoryEnum::kFan}, kInterval,
+                                  std::move(remote));
+  }
+  Probe({mojom::ProbeCategoryEnum::kFan});
+  task_environment_.FastForwardBy(kSnapshotAge - kInterval);
+  EXPECT_EQ(fan_speed_calls_, 1);
+}
+
+// Test that an observer is no longer probed for once it disconnects.
+TEST_F(FetchAggregatorTest, StopsProbingForDisconnectedObserver) {
+  SetFanSpeed(kFanSpeedRpm);
+  mojo::PendingRemote<mojom::CrosHealthdTelemetryObserver> remote;
+  auto observer = std::make_unique<FakeTelemetryObserver>(
+      remote.InitWithNewPipeAndPassReceiver());
+  fetch_aggregator_.AddObserver({mojom::ProbeCategoryEnum::kFan}, kInterval,
+                                std::move(remote));
+  task_environment_.RunUntilIdle();
+  EXPECT_EQ(fan_speed_calls_, 1);
+
+  observer.reset();
+  task_environment_.RunUntilIdle();
+  task_environment_.FastForwardBy(kSnapshotAge * 3);
+  EXPECT_EQ(fan_speed_calls_, 1);
+}
+
+// Measures the latency of probes and the time spent fetching when five
+// clients poll the same categories every second, with and without snapshots.
+// The executor replies after 20 ms, like a typical ectool call.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(FetchAggregatorTest, DISABLED_Benchmark) {
+  constexpr int kPollers = 5;
+  constexpr int kRounds = 60;
+  constexpr base::TimeDelta kFetchTime = base::Milliseconds(20);
+  const std::vector<mojom::ProbeCategoryEnum> categories = {
+      mojom::ProbeCategoryEnum::kFan, mojom::ProbeCategoryEnum::kTimezone,
+      mojom::ProbeCategoryEnum::kBacklight};
+  EXPECT_CALL(*mock_executor(), GetFanSpeed(_))
+      .WillRepeatedly(WithArg<0>(
+          Invoke([this, kFetchTime](
+                     mojom::Executor::GetFanSpeedCallback callback) {
+            ++fan_speed_calls_;
+            task_environment_.GetMainThreadTaskRunner()->PostDelayedTask(
+                FROM_HERE,
+                base::BindOnce(std::move(callback),
+                               CreateFanSpeedResult(kFanSpeedRpm)),
+                kFetchTime);
+          })));
+
+  for (base::TimeDelta snapshot_age : {base::TimeDelta(), kSnapshotAge}) {
+    FetchAggregator fetch_aggregator(&mock_context_, snapshot_age);
+    fan_speed_calls_ = 0;
+    base::TimeDelta total_latency;
+    base::TimeDelta cpu_time;
+    for (int round = 0; round < kRounds; ++round) {
+      // The pollers are spread over the second.
+      for (int poller = 0; poller < kPollers; ++poller) {
+        const base::TimeTicks start = base::TimeTicks::Now();
+        const base::ThreadTicks cpu_start = base::ThreadTicks::Now();
+        base::RunLoop run_loop;
+        fetch_aggregator.Run(
+            categories, base::BindOnce(
+                            [](base::OnceClosure quit_closure,
+                               mojom::TelemetryInfoPtr) {
+                              std::move(quit_closure).Run();
+                            },
+                            run_loop.QuitClosure()));
+        run_loop.Run();
+        cpu_time += base::ThreadTicks::Now() - cpu_start;
+        total_latency += base::TimeTicks::Now() - start;
+        task_environment_.FastForwardBy(base::Seconds(1) / kPollers -
+                                        (base::TimeTicks::Now() - start));
+      }
+    }
+    LOG(INFO) << "Snapshot age " << snapshot_age << ": "
+              << fan_speed_calls_ << " fan fetches, average latency "
+              << total_latency / (kRounds * kPollers) << ", CPU time "
+              << cpu_time;
+  }
+}
+
+}  // namespace
+}  // namespace diagnostics
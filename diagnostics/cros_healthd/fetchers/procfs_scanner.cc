@@ -0,0 +1,589 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "diagnostics/cros_healthd/fetchers/procfs_scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <base/check.h>
+#include <base/files/scoped_file.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_piece.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <base/threading/simple_thread.h>
+#include <re2/re2.h>
+
+#include "diagnostics/cros_healthd/utils/error_utils.h"
+#include "diagnostics/cros_healthd/utils/file_utils.h"
+#include "diagnostics/cros_healthd/utils/procfs_utils.h"
+
+namespace diagnostics {
+
+namespace {
+
+namespace mojom = ::ash::cros_healthd::mojom;
+
+// Regex used to parse procfs's uptime file.
+constexpr char kUptimeFileRegex[] = R"(([.\d]+)\s+[.\d]+)";
+// Prefix of the line with the process's Uid in the status file.
+constexpr char kUidStatusKey[] = "Uid:";
+// Number of values of the Uid key in the status file.
+constexpr int kUidStatusValues = 4;
+// Number of values in the statm file.
+constexpr int kStatmValues = 7;
+// Initial size of the buffers files are read into. Most procfs files fit.
+constexpr size_t kReadChunkSize = 4096;
+// Fewest processes worth giving a thread of their own.
+constexpr size_t kMinProcessesPerThread = 128;
+
+struct CloseDir {
+  void operator()(DIR* dir) const { closedir(dir); }
+};
+
+// Splits a string into whitespace-separated fields without copying them.
+class FieldTokenizer {
+ public:
+  explicit FieldTokenizer(base::StringPiece input) : input_(input) {}
+  FieldTokenizer(const FieldTokenizer&) = delete;
+  FieldTokenizer& operator=(const FieldTokenizer&) = delete;
+
+  // Sets |field| to the next field. Returns false if there are none left.
+  bool Next(base::StringPiece* field) {
+    const size_t start = input_.find_first_not_of(base::kWhitespaceASCII, pos_);
+    if (start == base::StringPiece::npos) {
+      pos_ = input_.size();
+      return false;
+    }
+    size_t end = input_.find_first_of(base::kWhitespaceASCII, start);
+    if (end == base::StringPiece::npos)
+      end = input_.size();
+    *field = input_.substr(start, end - start);
+    pos_ = end;
+    return true;
+  }
+
+ private:
+  const base::StringPiece input_;
+  size_t pos_ = 0;
+};
+
+// Returns true if |str| is a non-empty string of decimal digits.
+bool IsDigits(base::StringPiece str) {
+  return !str.empty() && std::all_of(str.begin(), str.end(), [](char c) {
+    return base::IsAsciiDigit(c);
+  });
+}
+
+// Values that are the same for all processes of a scan.
+struct SystemValues {
+  // Set if any of the values below could not be determined.
+  std::optional<mojom::ProbeErrorPtr> error;
+  // Clock ticks since boot.
+  uint64_t uptime_ticks = 0;
+  uint64_t page_size_kib = 0;
+};
+
+SystemValues GetSystemValues(const base::FilePath& root_dir) {
+  SystemValues values;
+
+  std::string uptime_contents;
+  base::FilePath uptime_path = GetProcUptimePath(root_dir);
+  if (!ReadAndTrimString(uptime_path, &uptime_contents)) {
+    values.error = CreateAndLogProbeError(
+        mojom::ErrorType::kFileReadError,
+        "Failed to read " + uptime_path.value());
+    return values;
+  }
+
+  std::string system_uptime_str;
+  if (!RE2::FullMatch(uptime_contents, kUptimeFileRegex, &system_uptime_str)) {
+    values.error = CreateAndLogProbeError(
+        mojom::ErrorType::kParseError,
+        "Failed to parse uptime file: " + uptime_contents);
+    return values;
+  }
+
+  double system_uptime_seconds;
+  if (!base::StringToDouble(system_uptime_str, &system_uptime_seconds)) {
+    values.error = CreateAndLogProbeError(
+        mojom::ErrorType::kParseError,
+        "Failed to convert system uptime to double: " + system_uptime_str);
+    return values;
+  }
+
+  const auto kClockTicksPerSecond = sysconf(_SC_CLK_TCK);
+  if (kClockTicksPerSecond == -1) {
+    values.error = CreateAndLogProbeError(
+        mojom::ErrorType::kSystemUtilityError,
+        "Failed to run sysconf(_SC_CLK_TCK).");
+    return values;
+  }
+  values.uptime_ticks = static_cast<uint64_t>(
+      system_uptime_seconds * static_cast<double>(kClockTicksPerSecond));
+
+  const auto kPageSizeInBytes = sysconf(_SC_PAGESIZE);
+  if (kPageSizeInBytes == -1) {
+    values.error = CreateAndLogProbeError(
+        mojom::ErrorType::kSystemUtilityError,
+        "Failed to run sysconf(_SC_PAGESIZE).");
+    return values;
+  }
+  values.page_size_kib = kPageSizeInBytes / 1024;
+
+  return values;
+}
+
+// Converts the raw process state read from procfs to a mojom::ProcessState.
+// If the conversion is successful, returns std::nullopt and sets
+// |mojo_state_out| to the converted value. If the conversion fails,
+// |mojo_state_out| is invalid and an appropriate error is returned.
+std::optional<mojom::ProbeErrorPtr> GetProcessState(
+    base::StringPiece raw_state, mojom::ProcessState* mojo_state_out) {
+  DCHECK(mojo_state_out);
+  // See https://man7.org/linux/man-pages/man5/proc.5.html for allowable raw
+  // state values.
+  if (raw_state == "R") {
+    *mojo_state_out = mojom::ProcessState::kRunning;
+  } else if (raw_state == "S") {
+    *mojo_state_out = mojom::ProcessState::kSleeping;
+  } else if (raw_state == "D") {
+    *mojo_state_out = mojom::ProcessState::kWaiting;
+  } else if (raw_state == "Z") {
+    *mojo_state_out = mojom::ProcessState::kZombie;
+  } else if (raw_state == "T") {
+    *mojo_state_out = mojom::ProcessState::kStopped;
+  } else if (raw_state == "t") {
+    *mojo_state_out = mojom::ProcessState::kTracingStop;
+  } else if (raw_state == "X") {
+    *mojo_state_out = mojom::ProcessState::kDead;
+  } else if (raw_state == "I") {
+    *mojo_state_out = mojom::ProcessState::kIdle;
+  } else {
+    return CreateAndLogProbeError(
+        mojom::ErrorType::kParseError,
+        "Undefined process state: " + std::string(raw_state));
+  }
+
+  return std::nullopt;
+}
+
+// Converts |str| to a signed, 8-bit integer. If the conversion is successful,
+// returns std::nullopt and sets |int_out| to the converted value. If the
+// conversion fails, |int_out| is invalid and an appropriate error is returned.
+std::optional<mojom::ProbeErrorPtr> GetInt8FromString(base::StringPiece str,
+                                                      int8_t* int_out) {
+  DCHECK(int_out);
+
+  int full_size_int;
+  if (!base::StringToInt(str, &full_size_int)) {
+    return CreateAndLogProbeError(
+        mojom::ErrorType::kParseError,
+        "Failed to convert " + std::string(str) + " to int.");
+  }
+
+  if (full_size_int > std::numeric_limits<int8_t>::max()) {
+    return CreateAndLogProbeError(
+        mojom::ErrorType::kParseError,
+        "Integer too large for int8_t: " + std::to_string(full_size_int));
+  }
+
+  *int_out = static_cast<int8_t>(full_size_int);
+
+  return std::nullopt;
+}
+
+// Reads the processes of a scan. Workers of the same scan share the list of
+// processes and take the next unread one until none are left.
+class ScanWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  ScanWorker(const base::FilePath& proc_dir,
+             const SystemValues& system_values,
+             const std::vector<uint32_t>& process_ids,
+             std::atomic<size_t>* next_index,
+             std::vector<mojom::ProcessResultPtr>* results)
+      : proc_dir_(proc_dir),
+        system_values_(system_values),
+        process_ids_(process_ids),
+        next_index_(next_index),
+        results_(results) {
+    buffer_.reserve(kReadChunkSize);
+    pid_dir_path_ = proc_dir_.value() + "/";
+  }
+  ScanWorker(const ScanWorker&) = delete;
+  ScanWorker& operator=(const ScanWorker&) = delete;
+
+  // base::DelegateSimpleThread::Delegate overrides:
+  void Run() override {
+    for (size_t i = next_index_->fetch_add(1); i < process_ids_.size();
+         i = next_index_->fetch_add(1)) {
+      auto process_info = mojom::ProcessInfo::New();
+      auto error = ScanProcess(process_ids_[i], process_info.get());
+      (*results_)[i] =
+          error.has_value()
+              ? mojom::ProcessResult::NewError(std::move(error.value()))
+              : mojom::ProcessResult::NewProcessInfo(std::move(process_info));
+    }
+  }
+
+ private:
+  std::optional<mojom::ProbeErrorPtr> ScanProcess(
+      uint32_t pid, mojom::ProcessInfo* process_info) {
+    // Open the directory once so that its files are looked up relative to it
+    // instead of resolving the whole path each time. If the process is gone,
+    // the reads below fail.
+    const size_t prefix_size = proc_dir_.value().size() + 1;
+    pid_dir_path_.resize(prefix_size);
+    base::StringAppendF(&pid_dir_path_, "%u", pid);
+    pid_dir_fd_.reset(HANDLE_EINTR(
+        open(pid_dir_path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+
+    // Number of ticks after system boot that the process started.
+    uint64_t start_time_ticks;
+    auto error = ParseStat(pid, process_info, &start_time_ticks);
+    if (error.has_value())
+      return error;
+
+    if (system_values_.error.has_value())
+      return system_values_.error.value().Clone();
+    process_info->uptime_ticks = system_values_.uptime_ticks - start_time_ticks;
+
+    error = ParseStatm(pid, process_info);
+    if (error.has_value())
+      return error;
+
+    error = ParseStatus(pid, process_info);
+    if (error.has_value())
+      return error;
+
+    if (!ReadFile(pid, kProcessCmdlineFile))
+      return CreateReadError(pid, kProcessCmdlineFile);
+    // In "/proc/{PID}/cmdline", the arguments are separated by 0x00, we need
+    // to replace them by space for better output.
+    std::replace(buffer_.begin(), buffer_.end(), '\0', ' ');
+    process_info->command = std::string(
+        base::TrimWhitespaceASCII(buffer_, base::TRIM_ALL));
+
+    return std::nullopt;
+  }
+
+  // Parses relevant fields from /proc/|pid|/stat.
+  std::optional<mojom::ProbeErrorPtr> ParseStat(
+      uint32_t pid,
+      mojom::ProcessInfo* process_info,
+      uint64_t* start_time_ticks) {
+    if (!ReadFile(pid, kProcessStatFile))
+      return CreateReadError(pid, kProcessStatFile);
+    const base::StringPiece stat =
+        base::TrimWhitespaceASCII(buffer_, base::TRIM_ALL);
+
+    // The filename of the executable is displayed in parentheses and may
+    // itself contain spaces or parentheses, so split around the first '(' and
+    // the last ')'.
+    const size_t name_start = stat.find('(');
+    const size_t name_end = stat.rfind(')');
+    base::StringPiece fields[ProcPidStatIndices::kMaxValue + 1];
+    bool tokenized = name_start != base::StringPiece::npos &&
+                     name_end != base::StringPiece::npos &&
+                     name_start < name_end;
+    if (tokenized) {
+      fields[ProcPidStatIndices::kProcessID] = base::TrimWhitespaceASCII(
+          stat.substr(0, name_start), base::TRIM_ALL);
+      fields[ProcPidStatIndices::kName] =
+          stat.substr(name_start + 1, name_end - name_start - 1);
+      FieldTokenizer tokenizer(stat.substr(name_end + 1));
+      for (int i = ProcPidStatIndices::kName + 1;
+           tokenized && i <= ProcPidStatIndices::kMaxValue; ++i) {
+        tokenized = tokenizer.Next(&fields[i]);
+      }
+    }
+    if (!tokenized) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to tokenize " + GetPath(pid, kProcessStatFile).value());
+    }
+
+    auto error = GetProcessState(fields[ProcPidStatIndices::kState],
+                                 &process_info->state);
+    if (error.has_value())
+      return error;
+
+    error = GetInt8FromString(fields[ProcPidStatIndices::kPriority],
+                              &process_info->priority);
+    if (error.has_value())
+      return error;
+
+    error = GetInt8FromString(fields[ProcPidStatIndices::kNice],
+                              &process_info->nice);
+    if (error.has_value())
+      return error;
+
+    base::StringPiece start_time_str = fields[ProcPidStatIndices::kStartTime];
+    if (!base::StringToUint64(start_time_str, start_time_ticks)) {
+      return CreateAndLogProbeError(mojom::ErrorType::kParseError,
+                                    "Failed to convert starttime to uint64: " +
+                                        std::string(start_time_str));
+    }
+
+    base::StringPiece process_id_str = fields[ProcPidStatIndices::kProcessID];
+    if (!base::StringToUint(process_id_str, &process_info->process_id)) {
+      return CreateAndLogProbeError(mojom::ErrorType::kParseError,
+                                    "Failed to convert process id to uint32: " +
+                                        std::string(process_id_str));
+    }
+
+    process_info->name = std::string(fields[ProcPidStatIndices::kName]);
+
+    base::StringPiece parent_process_id_str =
+        fields[ProcPidStatIndices::kParentProcessID];
+    if (!base::StringToUint(parent_process_id_str,
+                            &process_info->parent_process_id)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to convert parent process id to uint32: " +
+              std::string(parent_process_id_str));
+    }
+
+    base::StringPiece process_group_id_str =
+        fields[ProcPidStatIndices::kProcessGroupID];
+    if (!base::StringToUint(process_group_id_str,
+                            &process_info->process_group_id)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to convert process group id to uint32: " +
+              std::string(process_group_id_str));
+    }
+
+    base::StringPiece threads_str = fields[ProcPidStatIndices::kThreads];
+    if (!base::StringToUint(threads_str, &process_info->threads)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to convert threads to uint32: " + std::string(threads_str));
+    }
+
+    return std::nullopt;
+  }
+
+  // Parses the memory usage from /proc/|pid|/statm.
+  std::optional<mojom::ProbeErrorPtr> ParseStatm(
+      uint32_t pid, mojom::ProcessInfo* process_info) {
+    if (!ReadFile(pid, kProcessStatmFile))
+      return CreateReadError(pid, kProcessStatmFile);
+    const base::StringPiece statm =
+        base::TrimWhitespaceASCII(buffer_, base::TRIM_ALL);
+
+    // Only the total and resident sizes are used, but the file must have all
+    // its values.
+    base::StringPiece values[kStatmValues];
+    FieldTokenizer tokenizer(statm);
+    bool parsed = true;
+    for (int i = 0; parsed && i < kStatmValues; ++i)
+      parsed = tokenizer.Next(&values[i]) && IsDigits(values[i]);
+    base::StringPiece extra;
+    if (!parsed || tokenizer.Next(&extra)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to parse process's statm file: " + std::string(statm));
+    }
+
+    uint32_t total_memory_pages;
+    if (!base::StringToUint(values[0], &total_memory_pages)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to convert total memory to uint32_t: " +
+              std::string(values[0]));
+    }
+
+    uint32_t resident_memory_pages;
+    if (!base::StringToUint(values[1], &resident_memory_pages)) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          "Failed to convert resident memory to uint32_t: " +
+              std::string(values[1]));
+    }
+
+    if (resident_memory_pages > total_memory_pages) {
+      return CreateAndLogProbeError(
+          mojom::ErrorType::kParseError,
+          base::StringPrintf("Process's resident memory (%u pages) higher than "
+                             "total memory (%u pages).",
+                             resident_memory_pages, total_memory_pages));
+    }
+
+    const uint64_t page_size_kib = system_values_.page_size_kib;
+    process_info->total_memory_kib =
+        static_cast<uint32_t>(total_memory_pages * page_size_kib);
+    process_info->resident_memory_kib =
+        static_cast<uint32_t>(resident_memory_pages * page_size_kib);
+    process_info->free_memory_kib = static_cast<uint32_t>(
+        (total_memory_pages - resident_memory_pages) * page_size_kib);
+
+    return std::nullopt;
+  }
+
+  // Parses the real user ID from /proc/|pid|/status.
+  std::optional<mojom::ProbeErrorPtr> ParseStatus(
+      uint32_t pid, mojom::ProcessInfo* process_info) {
+    if (!ReadFile(pid, kProcessStatusFile))
+      return CreateReadError(pid, kProcessStatusFile);
+
+    const base::StringPiece status(buffer_);
+    size_t line_start = 0;
+    while (line_start < status.size()) {
+      size_t line_end = status.find('\n', line_start);
+      if (line_end == base::StringPiece::npos)
+        line_end = status.size();
+      const base::StringPiece line = base::TrimWhitespaceASCII(
+          status.substr(line_start, line_end - line_start), base::TRIM_ALL);
+      line_start = line_end + 1;
+      if (!base::StartsWith(line, kUidStatusKey))
+        continue;
+
+      // The key is followed by the real, effective, saved set and file system
+      // UIDs.
+      base::StringPiece values[kUidStatusValues];
+      FieldTokenizer tokenizer(line.substr(strlen(kUidStatusKey)));
+      bool parsed = true;
+      for (int i = 0; parsed && i < kUidStatusValues; ++i)
+        parsed = tokenizer.Next(&values[i]) && IsDigits(values[i]);
+      base::StringPiece extra;
+      if (!parsed || tokenizer.Next(&extra))
+        continue;
+
+      if (!base::StringToUint(values[0], &process_info->user_id)) {
+        return CreateAndLogProbeError(
+            mojom::ErrorType::kParseError,
+            "Failed to convert Uid to uint: " + std::string(values[0]));
+      }
+      return std::nullopt;
+    }
+
+    return CreateAndLogProbeError(mojom::ErrorType::kParseError,
+                                  "Failed to find Uid key.");
+  }
+
+  // Reads the file |name| of the process into |buffer_|, reusing its memory.
+  bool ReadFile(uint32_t pid, const char* name) {
+    buffer_.clear();
+    if (!pid_dir_fd_.is_valid())
+      return false;
+    base::ScopedFD fd(
+        HANDLE_EINTR(openat(pid_dir_fd_.get(), name, O_RDONLY | O_CLOEXEC)));
+    if (!fd.is_valid())
+      return false;
+
+    size_t size = 0;
+    while (true) {
+      if (buffer_.size() < size + kReadChunkSize)
+        buffer_.resize(std::max(buffer_.capacity(), size + kReadChunkSize));
+      const ssize_t bytes_read = HANDLE_EINTR(
+          read(fd.get(), &buffer_[size], buffer_.size() - size));
+      if (bytes_read < 0) {
+        buffer_.clear();
+        return false;
+      }
+      if (bytes_read == 0)
+        break;
+      size += bytes_read;
+    }
+    buffer_.resize(size);
+    return true;
+  }
+
+  base::FilePath GetPath(uint32_t pid, const char* name) const {
+    return proc_dir_.Append(base::NumberToString(pid)).Append(name);
+  }
+
+  mojom::ProbeErrorPtr CreateReadError(uint32_t pid, const char* name) const {
+    return CreateAndLogProbeError(
+        mojom::ErrorType::kFileReadError,
+        "Failed to read " + GetPath(pid, name).value());
+  }
+
+  const base::FilePath& proc_dir_;
+  const SystemValues& system_values_;
+  const std::vector<uint32_t>& process_ids_;
+  std::atomic<size_t>* const next_index_;
+  std::vector<mojom::ProcessResultPtr>* const results_;
+  // Holds the contents of the file read last.
+  std::string buffer_;
+  // Path of the directory of the process being read.
+  std::string pid_dir_path_;
+  base::ScopedFD pid_dir_fd_;
+};
+
+}  // namespace
+
+ProcfsScanner::ProcfsScanner(int max_threads, const base::FilePath& root_dir)
+    : max_threads_(std::max(max_threads, 1)), root_dir_(root_dir) {}
+
+ProcfsScanner::~ProcfsScanner() = default;
+
+std::vector<uint32_t> ProcfsScanner::ListProcessIds() const {
+  std::vector<uint32_t> process_ids;
+  const base::FilePath proc_dir = root_dir_.Append("proc");
+  // Unlike base::FileEnumerator, this does not stat every entry of procfs.
+  const std::unique_ptr<DIR, CloseDir> dir(opendir(proc_dir.value().c_str()));
+  if (!dir)
+    return process_ids;
+  while (const dirent* entry = readdir(dir.get())) {
+    if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+      continue;
+    uint32_t process_id;
+    if (base::StringToUint(entry->d_name, &process_id))
+      process_ids.push_back(process_id);
+  }
+  std::sort(process_ids.begin(), process_ids.end());
+  return process_ids;
+}
+
+std::vector<mojom::ProcessResultPtr> ProcfsScanner::Scan(
+    const std::vector<uint32_t>& process_ids) const {
+  std::vector<mojom::ProcessResultPtr> results(process_ids.size());
+  if (process_ids.empty())
+    return results;
+
+  // /proc/uptime and the system configuration are read once for all
+  // processes.
+  const SystemValues system_values = GetSystemValues(root_dir_);
+  const base::FilePath proc_dir = root_dir_.Append("proc");
+  std::atomic<size_t> next_index(0);
+  const size_t num_workers =
+      std::clamp(process_ids.size() / kMinProcessesPerThread, size_t{1},
+                 static_cast<size_t>(max_threads_));
+  std::vector<std::unique_ptr<ScanWorker>> workers;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.push_back(std::make_unique<ScanWorker>(
+        proc_dir, system_values, process_ids, &next_index, &results));
+  }
+
+  // The calling thread reads too, so a single worker needs no thread.
+  std::unique_ptr<base::DelegateSimpleThreadPool> pool;
+  if (num_workers > 1) {
+    pool = std::make_unique<base::DelegateSimpleThreadPool>("ProcfsScanner",
+                                                            num_workers - 1);
+    for (size_t i = 1; i < num_workers; ++i)
+      pool->AddWork(workers[i].get());
+    pool->Start();
+  }
+  workers[0]->Run();
+  if (pool)
+    pool->JoinAll();
+
+  return results;
+}
+
+}  // namespace diagnostics
@@ -0,0 +1,50 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DIAGNOSTICS_CROS_HEALTHD_FETCHERS_PROCFS_SCANNER_H_
+#define DIAGNOSTICS_CROS_HEALTHD_FETCHERS_PROCFS_SCANNER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <base/files/file_path.h>
+
+#include "diagnostics/mojom/public/cros_healthd_probe.mojom.h"
+
+namespace diagnostics {
+
+// Reads the procfs files of many processes at once. The files of each process
+// are read into a buffer that is reused for every process, and parsed in place
+// without splitting them into strings. Large scans are spread over a few
+// threads.
+//
+// The returned ProcessInfo does not contain the I/O statistics, since
+// /proc/<pid>/io can only be read by the executor.
+class ProcfsScanner {
+ public:
+  // Scans with at most |max_threads| threads. Only override |root_dir| for
+  // testing.
+  explicit ProcfsScanner(int max_threads = 1,
+                         const base::FilePath& root_dir = base::FilePath("/"));
+  ProcfsScanner(const ProcfsScanner&) = delete;
+  ProcfsScanner& operator=(const ProcfsScanner&) = delete;
+  ~ProcfsScanner();
+
+  // Returns the IDs of all processes in procfs, in ascending order.
+  std::vector<uint32_t> ListProcessIds() const;
+
+  // Returns the information about each process in |process_ids|, or the error
+  // that occurred retrieving it. The results are in the order of
+  // |process_ids|. Blocks until all the processes are read.
+  std::vector<ash::cros_healthd::mojom::ProcessResultPtr> Scan(
+      const std::vector<uint32_t>& process_ids) const;
+
+ private:
+  const int max_threads_;
+  const base::FilePath root_dir_;
+};
+
+}  // namespace diagnostics
+
+#endif  // DIAGNOSTICS_CROS_HEALTHD_FETCHERS_PROCFS_SCANNER_H_
@@ -0,0 +1,220 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "diagnostics/cros_healthd/fetchers/procfs_scanner.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "diagnostics/common/file_test_utils.h"
+#include "diagnostics/cros_healthd/utils/procfs_utils.h"
+#include "diagnostics/mojom/public/cros_healthd_probe.mojom.h"
+
+namespace diagnostics {
+namespace {
+
+namespace mojom = ::ash::cros_healthd::mojom;
+
+// Valid fake data for /proc/uptime.
+constexpr char kFakeProcUptimeContents[] = "339214.60 2707855.71";
+// Fake data for /proc/|pid|/stat, formatted with the PID and name.
+constexpr char kFakeProcPidStatFormat[] =
+    "%u (%s) S 1 1015 1015 0 -1 4210944 1536 158 1 0 10956 17428 19 37 20 0 1 "
+    "0 358 36884480 3515\n";
+constexpr char kFakeProcPidStatmContents[] = "25648 2657 2357 151 0 18632 0\n";
+constexpr char kFakeProcPidStatusContents[] =
+    "Name:\tfake_exe\nState:\tS (sleeping)\nUid:\t20104 20104 20104 20104\n"
+    "Gid:\t20104 20104 20104 20104\n";
+constexpr char kFakeProcPidCmdlineContents[] =
+    "/usr/bin/fake_exe\0--arg=yes\0";
+
+constexpr uint32_t kFirstPid = 6001;
+constexpr uint32_t kSecondPid = 6002;
+constexpr uint32_t kExpectedUid = 20104;
+constexpr uint32_t kExpectedThreads = 1;
+constexpr char kExpectedCommand[] = "/usr/bin/fake_exe --arg=yes";
+
+class ProcfsScannerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    ASSERT_TRUE(WriteFileAndCreateParentDirs(
+        GetProcUptimePath(root_dir()), kFakeProcUptimeContents));
+  }
+
+  // Writes the procfs files of a process.
+  void WriteProcess(uint32_t pid, const std::string& name) {
+    const base::FilePath dir = GetProcProcessDirectoryPath(root_dir(), pid);
+    ASSERT_TRUE(WriteFileAndCreateParentDirs(
+        dir.Append(kProcessStatFile),
+        base::StringPrintf(kFakeProcPidStatFormat, pid, name.c_str())));
+    ASSERT_TRUE(WriteFileAndCreateParentDirs(dir.Append(kProcessStatmFile),
+                                             kFakeProcPidStatmContents));
+    ASSERT_TRUE(WriteFileAndCreateParentDirs(dir.Append(kProcessStatusFile),
+                                             kFakeProcPidStatusContents));
+    ASSERT_TRUE(WriteFileAndCreateParentDirs(
+        dir.Append(kProcessCmdlineFile),
+        std::string(kFakeProcPidCmdlineContents,
+                    sizeof(kFakeProcPidCmdlineContents) - 1)));
+  }
+
+  const base::FilePath& root_dir() const { return temp_dir_.GetPath(); }
+
+ private:
+  base::ScopedTempDir temp_dir_;
+};
+
+// Test that all the fields are read for every process.
+TEST_F(ProcfsScannerTest, ScansProcesses) {
+  WriteProcess(kFirstPid, "first_exe");
+  WriteProcess(kSecondPid, "second exe (with) spaces");
+
+  std::vector<mojom::ProcessResultPtr> results =
+      ProcfsScanner(/*max_threads=*/1, root_dir())
+          .Scan({kSecondPid, kFirstPid});
+
+  ASSERT_EQ(results.size(), 2);
+  ASSERT_TRUE(results[0]->is_process_info());
+  ASSERT_TRUE(results[1]->is_process_info());
+  const auto& second_info = results[0]->get_process_info();
+  const auto& first_info = results[1]->get_process_info();
+  EXPECT_EQ(first_info->process_id, kFirstPid);
+  EXPECT_EQ(first_info->name, "first_exe");
+  EXPECT_EQ(second_info->process_id, kSecondPid);
+  EXPECT_EQ(second_info->name, "second exe (with) spaces");
+
+  EXPECT_EQ(first_info->state, mojom::ProcessState::kSleeping);
+  EXPECT_EQ(first_info->priority, 20);
+  EXPECT_EQ(first_info->nice, 0);
+  EXPECT_EQ(first_info->parent_process_id, 1);
+  EXPECT_EQ(first_info->process_group_id, 1015);
+  EXPECT_EQ(first_info->threads, kExpectedThreads);
+  EXPECT_EQ(first_info->user_id, kExpectedUid);
+  EXPECT_EQ(first_info->command, kExpectedCommand);
+  EXPECT_EQ(first_info->uptime_ticks,
+            static_cast<uint64_t>(339214.60 * sysconf(_SC_CLK_TCK)) - 358);
+  const uint64_t page_size_kib = sysconf(_SC_PAGESIZE) / 1024;
+  EXPECT_EQ(first_info->total_memory_kib, 25648 * page_size_kib);
+  EXPECT_EQ(first_info->resident_memory_kib, 2657 * page_size_kib);
+  EXPECT_EQ(first_info->free_memory_kib, (25648 - 2657) * page_size_kib);
+}
+
+// Test that an unreadable process does not affect the others.
+TEST_F(ProcfsScannerTest, ReportsErrorsPerProcess) {
+  WriteProcess(kFirstPid, "first_exe");
+  WriteProcess(kSecondPid, "second_exe");
+  ASSERT_TRUE(base::DeleteFile(
+      GetProcProcessDirectoryPath(root_dir(), kSecondPid)
+          .Append(kProcessStatmFile)));
+
+  std::vector<mojom::ProcessResultPtr> results =
+      ProcfsScanner(/*max_threads=*/1, root_dir())
+          .Scan({kFirstPid, kSecondPid, /*gone=*/7000});
+
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_TRUE(results[0]->is_process_info());
+  ASSERT_TRUE(results[1]->is_error());
+  EXPECT_EQ(results[1]->get_error()->type, mojom::ErrorType::kFileReadError);
+  ASSERT_TRUE(results[2]->is_error());
+  EXPECT_EQ(results[2]->get_error()->type, mojom::ErrorType::kFileReadError);
+}
+
+// Test that a process without parentheses around its name is rejected.
+TEST_F(ProcfsScannerTest, MalformedStatFile) {
+  WriteProcess(kFirstPid, "first_exe");
+  ASSERT_TRUE(WriteFileAndCreateParentDirs(
+      GetProcProcessDirectoryPath(root_dir(), kFirstPid)
+          .Append(kProcessStatFile),
+      "6001 first_exe S 1 1015 1015 0 -1 4210944 1536 158 1 0 10956 17428 19 "
+      "37 20 0 1 0 358 36884480 3515"));
+
+  std::vector<mojom::ProcessResultPtr> results =
+      ProcfsScanner(/*max_threads=*/1, root_dir()).Scan({kFirstPid});
+
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_TRUE(results[0]->is_error());
+  EXPECT_EQ(results[0]->get_error()->type, mojom::ErrorType::kParseError);
+}
+
+// Test that a scan spread over several threads gives the same results.
+TEST_F(ProcfsScannerTest, ParallelScanMatchesSerialScan) {
+  std::vector<uint32_t> pids;
+  for (uint32_t pid = 1; pid <= 1000; ++pid) {
+    WriteProcess(pid, base::StringPrintf("exe_%u", pid));
+    pids.push_back(pid);
+  }
+  // Some processes fail, to check the errors end up in the right place.
+  for (uint32_t pid = 100; pid <= 1000; pid += 100) {
+    ASSERT_TRUE(base::DeleteFile(GetProcProcessDirectoryPath(root_dir(), pid)
+                                     .Append(kProcessStatusFile)));
+  }
+
+  std::vector<mojom::ProcessResultPtr> serial =
+      ProcfsScanner(/*max_threads=*/1, root_dir()).Scan(pids);
+  std::vector<mojom::ProcessResultPtr> parallel =
+      ProcfsScanner(/*max_threads=*/4, root_dir()).Scan(pids);
+
+  ASSERT_EQ(serial.size(), pids.size());
+  ASSERT_EQ(parallel.size(), pids.size());
+  for (size_t i = 0; i < pids.size(); ++i) {
+    EXPECT_EQ(serial[i]->is_error(), pids[i] % 100 == 0);
+    EXPECT_TRUE(serial[i].Equals(parallel[i])) << "PID " << pids[i];
+  }
+}
+
+// Test that only process directories are listed.
+TEST_F(ProcfsScannerTest, ListsProcessIds) {
+  WriteProcess(kSecondPid, "second_exe");
+  WriteProcess(kFirstPid, "first_exe");
+  ASSERT_TRUE(base::CreateDirectory(root_dir().Append("proc/sys")));
+  ASSERT_TRUE(WriteFileAndCreateParentDirs(root_dir().Append("proc/123"), ""));
+
+  EXPECT_EQ(ProcfsScanner(/*max_threads=*/1, root_dir()).ListProcessIds(),
+            (std::vector<uint32_t>{kFirstPid, kSecondPid}));
+}
+
+// Compares reading a fake procfs of 2000 processes one process at a time, as
+// FetchProcessInfo does, with reading them in one scan with one and with four
+// threads.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(ProcfsScannerTest, DISABLED_Benchmark) {
+  constexpr uint32_t kProcessCount = 2000;
+  std::vector<uint32_t> pids;
+  for (uint32_t pid = 1; pid <= kProcessCount; ++pid) {
+    WriteProcess(pid, base::StringPrintf("exe_%u", pid));
+    pids.push_back(pid);
+  }
+
+  ProcfsScanner serial_scanner(/*max_threads=*/1, root_dir());
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (uint32_t pid : pids)
+    serial_scanner.Scan({pid});
+  LOG(INFO) << "One scan per process: "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << " ms";
+
+  start = base::TimeTicks::Now();
+  serial_scanner.Scan(serial_scanner.ListProcessIds());
+  LOG(INFO) << "One scan, 1 thread: "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << " ms";
+
+  ProcfsScanner parallel_scanner(/*max_threads=*/4, root_dir());
+  start = base::TimeTicks::Now();
+  parallel_scanner.Scan(parallel_scanner.ListProcessIds());
+  LOG(INFO) << "One scan, 4 threads: "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << " ms";
+}
+
+}  // namespace
+}  // namespace diagnostics
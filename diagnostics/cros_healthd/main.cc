@@ -10,6 +10,7 @@
 
 #include <base/check_op.h>
 #include <base/logging.h>
+#include <base/time/time.h>
 #include <brillo/flag_helper.h>
 #include <brillo/syslog_logging.h>
 #include <brillo/udev/udev.h>
@@ -33,6 +34,9 @@ int main(int argc, char** argv) {
   brillo::InitLog(brillo::kLogToSyslog | brillo::kLogToStderrIfTty);
 
   DEFINE_uint32(verbosity, 0, "Set verbosity level. Allowed value: 0 to 3");
+  DEFINE_uint32(probe_snapshot_age_ms, 2000,
+                "How long probed telemetry is reused for by later probes. Set "
+                "to 0 to probe the system on every request.");
   brillo::FlagHelper::Init(
       argc, argv, "cros_healthd - Device telemetry and diagnostics daemon.");
 
@@ -94,7 +98,8 @@ int main(int argc, char** argv) {
 
   // Run the cros_healthd daemon.
   executor_endpoint.reset();
-  auto service = diagnostics::CrosHealthd(std::move(healthd_endpoint),
-                                          std::move(udev_monitor));
+  auto service = diagnostics::CrosHealthd(
+      std::move(healthd_endpoint), std::move(udev_monitor),
+      base::Milliseconds(FLAGS_probe_snapshot_age_ms));
   return service.Run();
 }
@@ -5,6 +5,7 @@
 #include <sysexits.h>
 #include <unistd.h>
 
+#include <cstring>
 #include <map>
 #include <utility>
 #include <vector>
@@ -33,6 +34,8 @@
 #include "fusebox/fuse_path_inodes.h"
 #include "fusebox/make_stat.h"
 #include "fusebox/proto_bindings/fusebox.pb.h"
+#include "fusebox/read_ahead_cache.h"
+#include "fusebox/shared_buffer.h"
 #include "fusebox/util.h"
 
 namespace fusebox {
@@ -390,6 +393,8 @@ class FuseBoxClient : public FileSystem {
       return;
     }
 
+    read_ahead_cache_.Invalidate(ino);
+
     TruncateRequestProto request_proto;
     request_proto.set_file_system_url(GetInodeTable().GetDevicePath(node));
     request_proto.set_length(base::strict_cast<int64_t>(attr->st_size));
@@ -490,6 +495,7 @@ class FuseBoxClient : public FileSystem {
     }
 
     if (ino) {
+      read_ahead_cache_.Invalidate(ino);
       GetInodeTable().Forget(ino);
     }
     request->ReplyOk();
@@ -809,17 +815,27 @@ class FuseBoxClient : public FileSystem {
     const std::string path = GetInodeTable().GetDevicePath(node);
     const std::string type = mtp_device_type(device);
 
+    // Close-to-open consistency: changes made by others since the last open
+    // must be visible.
+    read_ahead_cache_.Invalidate(ino);
+
+    scoped_refptr<SharedBuffer> shared_buffer = SharedBuffer::Create();
+
     Open2RequestProto request_proto;
     request_proto.set_file_system_url(path);
     request_proto.set_access_mode(CreateAccessMode(request->flags()));
+    if (shared_buffer)
+      request_proto.set_shared_memory_size(shared_buffer->size());
 
     dbus::MethodCall method(kFuseBoxServiceInterface, kOpen2Method);
     dbus::MessageWriter writer(&method);
     writer.AppendProtoAsArrayOfBytes(request_proto);
+    if (shared_buffer)
+      writer.AppendFileDescriptor(shared_buffer->fd());
 
-    auto open2_response = base::BindOnce(&FuseBoxClient::Open2Response,
-                                         weak_ptr_factory_.GetWeakPtr(),
-                                         std::move(request), ino, path, type);
+    auto open2_response = base::BindOnce(
+        &FuseBoxClient::Open2Response, weak_ptr_factory_.GetWeakPtr(),
+        std::move(request), ino, path, type, std::move(shared_buffer));
     CallFuseBoxServerMethod(&method, std::move(open2_response));
   }
 
@@ -827,6 +843,7 @@ class FuseBoxClient : public FileSystem {
                      ino_t ino,
                      std::string path,
                      std::string type,
+                     scoped_refptr<SharedBuffer> shared_buffer,
                      dbus::Response* response) {
     VLOG(1) << "open2-resp";
 
@@ -841,9 +858,21 @@ class FuseBoxClient : public FileSystem {
 
     uint64_t handle = fusebox::OpenFile();
     fusebox::SetFileData(handle, server_side_fuse_handle, path, type);
+    if (shared_buffer && response_proto.shared_memory())
+      shared_buffers_[handle] = std::move(shared_buffer);
     request->ReplyOpen(handle);
   }
 
+  // Returns a slot of the shared memory of file |handle| for a Read2 or
+  // Write2 call of |size| bytes, or an invalid slot if the data must go in
+  // the D-Bus message.
+  SharedBuffer::Slot AcquireSharedBufferSlot(uint64_t handle, size_t size) {
+    auto it = shared_buffers_.find(handle);
+    if (it == shared_buffers_.end())
+      return {};
+    return it->second->AcquireSlot(size);
+  }
+
   void Read(std::unique_ptr<BufferRequest> request,
             ino_t ino,
             size_t size,
@@ -887,18 +916,31 @@ class FuseBoxClient : public FileSystem {
       return;
     }
 
+    base::StringPiece cached;
+    if (read_ahead_cache_.Read(ino, off, size, &cached)) {
+      request->ReplyBuffer(cached.data(), cached.size());
+      return;
+    }
+
+    uint64_t read_ahead_id = 0;
+    const size_t length =
+        read_ahead_cache_.GetReadLength(ino, off, size, &read_ahead_id);
+    SharedBuffer::Slot slot = AcquireSharedBufferSlot(request->fh(), length);
+
     Read2RequestProto request_proto;
     request_proto.set_fuse_handle(data.server_side_fuse_handle);
     request_proto.set_offset(off);
-    request_proto.set_length(size);
+    request_proto.set_length(length);
+    if (slot.is_valid())
+      request_proto.set_shared_memory_offset(slot.offset());
 
     dbus::MethodCall method(kFuseBoxServiceInterface, kRead2Method);
     dbus::MessageWriter writer(&method);
     writer.AppendProtoAsArrayOfBytes(request_proto);
 
-    auto read2_response =
-        base::BindOnce(&FuseBoxClient::Read2Response,
-                       weak_ptr_factory_.GetWeakPtr(), std::move(request));
+    auto read2_response = base::BindOnce(
+        &FuseBoxClient::Read2Response, weak_ptr_factory_.GetWeakPtr(),
+        std::move(request), ino, size, length, read_ahead_id, std::move(slot));
     CallFuseBoxServerMethod(&method, std::move(read2_response));
   }
 
@@ -951,28 +993,66 @@ class FuseBoxClient : public FileSystem {
   }
 
   void Read2Response(std::unique_ptr<BufferRequest> request,
+                     ino_t ino,
+                     size_t size,
+                     size_t length,
+                     uint64_t read_ahead_id,
+                     SharedBuffer::Slot slot,
                      dbus::Response* response) {
     VLOG(1) << "read2-resp";
 
+    Read2ResponseProto response_proto;
+    base::StringPiece data;
+    int error =
+        GetRead2ResponseData(response, length, slot, &response_proto, &data);
+    if (read_ahead_id) {
+      // Cache the data read ahead, even if |request| was interrupted.
+      if (error) {
+        read_ahead_cache_.Cancel(ino, read_ahead_id);
+      } else {
+        read_ahead_cache_.Insert(ino, read_ahead_id, data);
+      }
+    }
+
     if (request->IsInterrupted())
       return;
 
-    dbus::MessageReader reader(response);
-    Read2ResponseProto response_proto;
-    if (!reader.PopArrayOfBytesAsProto(&response_proto)) {
-      request->ReplyError(EINVAL);
+    if (error) {
+      request->ReplyError(error);
       return;
     }
-    int32_t posix_error_code = response_proto.has_posix_error_code()
-                                   ? response_proto.posix_error_code()
+
+    data = data.substr(0, size);
+    request->ReplyBuffer(data.data(), data.size());
+  }
+
+  // Returns errno from the Read2 |response|, or 0 and sets |data| to the
+  // data read: in |response_proto|, or in |slot| of the shared memory.
+  // |length| is the number of bytes requested.
+  static int GetRead2ResponseData(dbus::Response* response,
+                                  size_t length,
+                                  const SharedBuffer::Slot& slot,
+                                  Read2ResponseProto* response_proto,
+                                  base::StringPiece* data) {
+    dbus::MessageReader reader(response);
+    if (!reader.PopArrayOfBytesAsProto(response_proto))
+      return EINVAL;
+    int32_t posix_error_code = response_proto->has_posix_error_code()
+                                   ? response_proto->posix_error_code()
                                    : 0;
-    if (posix_error_code != 0) {
-      request->ReplyError(posix_error_code);
-      return;
+    if (posix_error_code != 0)
+      return posix_error_code;
+
+    if (slot.is_valid() && response_proto->has_shared_memory_length()) {
+      int64_t size = response_proto->shared_memory_length();
+      if (size < 0 || size > base::saturated_cast<int64_t>(length))
+        return EINVAL;
+      *data = base::StringPiece(slot.data(), base::checked_cast<size_t>(size));
+      return 0;
     }
 
-    const std::string& data = response_proto.data();
-    request->ReplyBuffer(data.data(), data.size());
+    *data = response_proto->data();
+    return 0;
   }
 
   void ReadFileDescriptor(std::unique_ptr<BufferRequest> request,
@@ -1033,23 +1113,34 @@ class FuseBoxClient : public FileSystem {
 
     auto data = fusebox::GetFileData(request->fh());
 
+    read_ahead_cache_.Invalidate(ino);
+    SharedBuffer::Slot slot = AcquireSharedBufferSlot(request->fh(), size);
+
     Write2RequestProto request_proto;
     request_proto.set_fuse_handle(data.server_side_fuse_handle);
     request_proto.set_offset(off);
-    request_proto.mutable_data()->append(buf, size);
+    if (slot.is_valid()) {
+      memcpy(slot.data(), buf, size);
+      request_proto.set_shared_memory_offset(slot.offset());
+      request_proto.set_shared_memory_length(size);
+    } else {
+      request_proto.mutable_data()->append(buf, size);
+    }
 
     dbus::MethodCall method(kFuseBoxServiceInterface, kWrite2Method);
     dbus::MessageWriter writer(&method);
     writer.AppendProtoAsArrayOfBytes(request_proto);
 
-    auto write2_response = base::BindOnce(&FuseBoxClient::Write2Response,
-                                          weak_ptr_factory_.GetWeakPtr(),
-                                          std::move(request), size);
+    // |slot| is held until the server has read the data.
+    auto write2_response = base::BindOnce(
+        &FuseBoxClient::Write2Response, weak_ptr_factory_.GetWeakPtr(),
+        std::move(request), size, std::move(slot));
     CallFuseBoxServerMethod(&method, std::move(write2_response));
   }
 
   void Write2Response(std::unique_ptr<WriteRequest> request,
                       size_t length,
+                      SharedBuffer::Slot slot,
                       dbus::Response* response) {
     VLOG(1) << "write2-resp";
 
@@ -1109,6 +1200,7 @@ class FuseBoxClient : public FileSystem {
 
     auto data = fusebox::GetFileData(request->fh());
     fusebox::CloseFile(request->fh());
+    shared_buffers_.erase(request->fh());
 
     Close2RequestProto request_proto;
     request_proto.set_fuse_handle(data.server_side_fuse_handle);
@@ -1177,21 +1269,28 @@ class FuseBoxClient : public FileSystem {
       return;
     }
 
+    scoped_refptr<SharedBuffer> shared_buffer = SharedBuffer::Create();
+
     CreateRequestProto request_proto;
     request_proto.set_file_system_url(GetInodeTable().GetDevicePath(node));
+    if (shared_buffer)
+      request_proto.set_shared_memory_size(shared_buffer->size());
 
     dbus::MethodCall method(kFuseBoxServiceInterface, kCreateMethod);
     dbus::MessageWriter writer(&method);
     writer.AppendProtoAsArrayOfBytes(request_proto);
+    if (shared_buffer)
+      writer.AppendFileDescriptor(shared_buffer->fd());
 
-    auto create_response = base::BindOnce(&FuseBoxClient::CreateResponse,
-                                          weak_ptr_factory_.GetWeakPtr(),
-                                          std::move(request), node->ino);
+    auto create_response = base::BindOnce(
+        &FuseBoxClient::CreateResponse, weak_ptr_factory_.GetWeakPtr(),
+        std::move(request), node->ino, std::move(shared_buffer));
     CallFuseBoxServerMethod(&method, std::move(create_response));
   }
 
   void CreateResponse(std::unique_ptr<CreateRequest> request,
                       ino_t ino,
+                      scoped_refptr<SharedBuffer> shared_buffer,
                       dbus::Response* response) {
     VLOG(1) << "create-resp " << ino;
 
@@ -1231,6 +1330,8 @@ class FuseBoxClient : public FileSystem {
 
     uint64_t handle = fusebox::OpenFile();
     fusebox::SetFileData(handle, server_side_fuse_handle, "", "");
+    if (shared_buffer && response_proto.shared_memory())
+      shared_buffers_[handle] = std::move(shared_buffer);
     request->ReplyOpen(handle);
   }
 
@@ -1290,6 +1391,13 @@ class FuseBoxClient : public FileSystem {
   // Fuse user-space frontend.
   std::unique_ptr<FuseFrontend> fuse_frontend_;
 
+  // Map open file handle to the memory it shares with the server, if the
+  // server uses it.
+  std::map<uint64_t, scoped_refptr<SharedBuffer>> shared_buffers_;
+
+  // Data read ahead of sequential reads.
+  ReadAheadCache read_ahead_cache_;
+
   base::WeakPtrFactory<FuseBoxClient> weak_ptr_factory_;
 };
 
@@ -0,0 +1,102 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fusebox/read_ahead_cache.h"
+
+#include <algorithm>
+
+#include <base/check.h>
+
+namespace fusebox {
+
+ReadAheadCache::ReadAheadCache() : entries_(kMaxInodes) {}
+
+ReadAheadCache::~ReadAheadCache() = default;
+
+bool ReadAheadCache::Read(ino_t ino,
+                         off_t off,
+                         size_t size,
+                         base::StringPiece* data) {
+  DCHECK(data);
+
+  auto it = entries_.Get(ino);
+  if (it == entries_.end())
+    it = entries_.Put(ino, Entry());
+  Entry& entry = it->second;
+
+  if (off == entry.next_off) {
+    ++entry.sequential_reads;
+  } else {
+    entry.sequential_reads = 0;
+  }
+  entry.next_off = off + static_cast<off_t>(size);
+
+  const off_t end = entry.off + static_cast<off_t>(entry.data.size());
+  if (off < entry.off || off > end)
+    return false;
+  if (off + static_cast<off_t>(size) > end && !entry.eof)
+    return false;
+
+  const size_t start = static_cast<size_t>(off - entry.off);
+  *data = base::StringPiece(entry.data).substr(start, size);
+  entry.next_off = off + static_cast<off_t>(data->size());
+  return true;
+}
+
+size_t ReadAheadCache::GetReadLength(ino_t ino,
+                                     off_t off,
+                                     size_t size,
+                                     uint64_t* read_ahead_id) {
+  DCHECK(read_ahead_id);
+  *read_ahead_id = 0;
+
+  auto it = entries_.Peek(ino);
+  if (it == entries_.end())
+    return size;
+  Entry& entry = it->second;
+
+  // Reads made while a read ahead is in progress are not read ahead again:
+  // Kernel FUSE sends the reads of a sequential reader in parallel.
+  if (entry.sequential_reads < kSequentialReads || entry.read_ahead_id ||
+      size >= kReadAheadSize) {
+    return size;
+  }
+
+  entry.read_ahead_id = ++last_read_ahead_id_;
+  entry.read_ahead_off = off;
+  *read_ahead_id = entry.read_ahead_id;
+  return kReadAheadSize;
+}
+
+void ReadAheadCache::Insert(ino_t ino,
+                            uint64_t read_ahead_id,
+                            base::StringPiece data) {
+  DCHECK(read_ahead_id);
+
+  auto it = entries_.Peek(ino);
+  if (it == entries_.end() || it->second.read_ahead_id != read_ahead_id)
+    return;
+  Entry& entry = it->second;
+
+  entry.read_ahead_id = 0;
+  entry.off = entry.read_ahead_off;
+  entry.data.assign(data.data(), std::min(data.size(), kReadAheadSize));
+  // A short reply is not necessarily the end of the file, e.g. providers may
+  // return less data than asked for. Only an empty reply is.
+  entry.eof = data.empty();
+}
+
+void ReadAheadCache::Cancel(ino_t ino, uint64_t read_ahead_id) {
+  auto it = entries_.Peek(ino);
+  if (it != entries_.end() && it->second.read_ahead_id == read_ahead_id)
+    it->second.read_ahead_id = 0;
+}
+
+void ReadAheadCache::Invalidate(ino_t ino) {
+  auto it = entries_.Peek(ino);
+  if (it != entries_.end())
+    entries_.Erase(it);
+}
+
+}  // namespace fusebox
@@ -0,0 +1,95 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FUSEBOX_READ_AHEAD_CACHE_H_
+#define FUSEBOX_READ_AHEAD_CACHE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include <base/containers/lru_cache.h>
+#include <base/strings/string_piece.h>
+
+namespace fusebox {
+
+// Per-inode cache of the data read ahead of sequential reads. Kernel FUSE
+// splits reads in requests of at most 128KB, and each of them is a D-Bus call
+// to the Fusebox server, which may have to reach an MTP device or a file
+// system provider. Once the reads of an inode are sequential, a read that is
+// not cached asks the server for kReadAheadSize bytes instead, and the next
+// reads are served from the cache.
+//
+// The cached data of an inode must be invalidated when the inode is written,
+// truncated or opened again.
+class ReadAheadCache {
+ public:
+  // Size of the reads made to fill the cache.
+  static constexpr size_t kReadAheadSize = 1024 * 1024;
+
+  // Number of consecutive sequential reads after which reading ahead starts.
+  static constexpr int kSequentialReads = 2;
+
+  // Number of inodes with cached data.
+  static constexpr size_t kMaxInodes = 8;
+
+  ReadAheadCache();
+  ReadAheadCache(const ReadAheadCache&) = delete;
+  ReadAheadCache& operator=(const ReadAheadCache&) = delete;
+  ~ReadAheadCache();
+
+  // Records a read of |size| bytes at |off| of |ino|. Returns true if the
+  // data is cached and sets |data| to it: |size| bytes, or less at the end of
+  // the file. |data| is valid until the next call.
+  bool Read(ino_t ino, off_t off, size_t size, base::StringPiece* data);
+
+  // Returns the number of bytes to ask the server for, for a read of |size|
+  // bytes at |off| of |ino| that was not cached. It is kReadAheadSize if the
+  // reads of |ino| are sequential: |read_ahead_id| is then set to a non-zero
+  // value to pass to Insert() or Cancel() with the response. Otherwise, it is
+  // |size| and |read_ahead_id| is set to 0.
+  size_t GetReadLength(ino_t ino,
+                       off_t off,
+                       size_t size,
+                       uint64_t* read_ahead_id);
+
+  // Caches |data| read for |read_ahead_id|, unless |ino| was invalidated in
+  // the meantime.
+  void Insert(ino_t ino, uint64_t read_ahead_id, base::StringPiece data);
+
+  // Ends |read_ahead_id| without data, e.g. when the read failed.
+  void Cancel(ino_t ino, uint64_t read_ahead_id);
+
+  // Drops the cached data of |ino| and any read ahead in progress.
+  void Invalidate(ino_t ino);
+
+ private:
+  struct Entry {
+    // Offset right after the last read, and number of consecutive reads that
+    // started there.
+    off_t next_off = 0;
+    int sequential_reads = 0;
+
+    // Read ahead in progress, if |read_ahead_id| is not 0.
+    uint64_t read_ahead_id = 0;
+    off_t read_ahead_off = 0;
+
+    // Data of the inode at |off|. |eof| is true if it is empty because |off|
+    // is at or past the end of the file. Otherwise, reads going past the end
+    // of |data| are not cached.
+    off_t off = 0;
+    std::string data;
+    bool eof = false;
+  };
+
+  base::LRUCache<ino_t, Entry> entries_;
+
+  // Last read ahead id.
+  uint64_t last_read_ahead_id_ = 0;
+};
+
+}  // namespace fusebox
+
+#endif  // FUSEBOX_READ_AHEAD_CACHE_H_
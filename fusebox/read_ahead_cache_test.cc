@@ -0,0 +1,349 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fusebox/read_ahead_cache.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <base/logging.h>
+#include <base/threading/platform_thread.h>
+#include <base/time/time.h>
+#include <base/timer/elapsed_timer.h>
+#include <chromeos/dbus/service_constants.h>
+#include <dbus/message.h>
+#include <gtest/gtest.h>
+
+#include "fusebox/proto_bindings/fusebox.pb.h"
+#include "fusebox/shared_buffer.h"
+
+namespace fusebox {
+namespace {
+
+constexpr ino_t kIno = 42;
+
+// Size of the reads made by Kernel FUSE.
+constexpr size_t kReadSize = 128 * 1024;
+
+// Data of a file of |size| bytes.
+std::string MakeFileData(size_t size) {
+  std::string data(size, 0);
+  for (size_t i = 0; i < size; ++i)
+    data[i] = static_cast<char>(i * 7 + i / 4096);
+  return data;
+}
+
+// Makes sequential reads of kReadSize bytes from |off| that are not cached,
+// until one is read ahead. Returns its offset and sets |read_ahead_id|.
+off_t ReadUntilReadAhead(ReadAheadCache* cache,
+                         off_t off,
+                         uint64_t* read_ahead_id) {
+  for (int i = 0; i <= ReadAheadCache::kSequentialReads; ++i) {
+    base::StringPiece data;
+    EXPECT_FALSE(cache->Read(kIno, off, kReadSize, &data));
+    size_t length = cache->GetReadLength(kIno, off, kReadSize, read_ahead_id);
+    if (*read_ahead_id) {
+      EXPECT_EQ(ReadAheadCache::kReadAheadSize, length);
+      return off;
+    }
+    EXPECT_EQ(kReadSize, length);
+    off += kReadSize;
+  }
+  ADD_FAILURE() << "Sequential reads are not read ahead";
+  return off;
+}
+
+TEST(ReadAheadCacheTest, RandomReadsAreNotReadAhead) {
+  ReadAheadCache cache;
+  uint64_t read_ahead_id = 1;
+
+  for (off_t off : {5, 3, 8, 1, 9, 2}) {
+    base::StringPiece data;
+    EXPECT_FALSE(cache.Read(kIno, off * kReadSize, kReadSize, &data));
+    EXPECT_EQ(kReadSize, cache.GetReadLength(kIno, off * kReadSize, kReadSize,
+                                             &read_ahead_id));
+    EXPECT_EQ(0u, read_ahead_id);
+  }
+}
+
+TEST(ReadAheadCacheTest, SequentialReadsAreReadAhead) {
+  ReadAheadCache cache;
+  const std::string file = MakeFileData(4 * ReadAheadCache::kReadAheadSize);
+
+  // The first reads go to the server.
+  uint64_t read_ahead_id = 0;
+  const off_t off = ReadUntilReadAhead(&cache, 0, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+
+  // Reads made while the read ahead is in progress go to the server.
+  base::StringPiece data;
+  uint64_t other_read_ahead_id = 0;
+  EXPECT_FALSE(cache.Read(kIno, off + kReadSize, kReadSize, &data));
+  EXPECT_EQ(kReadSize, cache.GetReadLength(kIno, off + kReadSize, kReadSize,
+                                           &other_read_ahead_id));
+  EXPECT_EQ(0u, other_read_ahead_id);
+
+  // The next reads are served from the data read ahead.
+  cache.Insert(kIno, read_ahead_id,
+               base::StringPiece(file).substr(
+                   off, ReadAheadCache::kReadAheadSize));
+  for (size_t i = 0; i < ReadAheadCache::kReadAheadSize; i += kReadSize) {
+    ASSERT_TRUE(cache.Read(kIno, off + i, kReadSize, &data));
+    EXPECT_EQ(base::StringPiece(file).substr(off + i, kReadSize), data);
+  }
+
+  // Then the cache is read ahead again.
+  const off_t end = off + ReadAheadCache::kReadAheadSize;
+  EXPECT_FALSE(cache.Read(kIno, end, kReadSize, &data));
+  EXPECT_EQ(ReadAheadCache::kReadAheadSize,
+            cache.GetReadLength(kIno, end, kReadSize, &read_ahead_id));
+  EXPECT_NE(0u, read_ahead_id);
+}
+
+TEST(ReadAheadCacheTest, ShortReadAheadIsPartial) {
+  ReadAheadCache cache;
+  const std::string file = MakeFileData(4 * ReadAheadCache::kReadAheadSize);
+
+  uint64_t read_ahead_id = 0;
+  const off_t off = ReadUntilReadAhead(&cache, 0, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+
+  // The server returns less data than asked for, but it is not the end of the
+  // file.
+  const off_t end = off + ReadAheadCache::kReadAheadSize / 2;
+  cache.Insert(kIno, read_ahead_id,
+               base::StringPiece(file).substr(off, end - off));
+
+  // Reads within the data are served from the cache.
+  base::StringPiece data;
+  for (off_t i = off; i < end; i += kReadSize) {
+    ASSERT_TRUE(cache.Read(kIno, i, kReadSize, &data));
+    EXPECT_EQ(base::StringPiece(file).substr(i, kReadSize), data);
+  }
+
+  // The next read goes to the server, and is read ahead again.
+  EXPECT_FALSE(cache.Read(kIno, end, kReadSize, &data));
+  EXPECT_EQ(ReadAheadCache::kReadAheadSize,
+            cache.GetReadLength(kIno, end, kReadSize, &read_ahead_id));
+  EXPECT_NE(0u, read_ahead_id);
+}
+
+TEST(ReadAheadCacheTest, ReadAheadStopsAtEndOfFile) {
+  ReadAheadCache cache;
+  const std::string file = MakeFileData(ReadAheadCache::kReadAheadSize);
+  const off_t size = file.size();
+
+  uint64_t read_ahead_id = 0;
+  const off_t off = ReadUntilReadAhead(&cache, 0, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+  cache.Insert(kIno, read_ahead_id, base::StringPiece(file).substr(off));
+  base::StringPiece data;
+  for (off_t i = off; i < size; i += kReadSize)
+    ASSERT_TRUE(cache.Read(kIno, i, kReadSize, &data));
+
+  // The server returns no data at the end of the file.
+  EXPECT_FALSE(cache.Read(kIno, size, kReadSize, &data));
+  ASSERT_EQ(ReadAheadCache::kReadAheadSize,
+            cache.GetReadLength(kIno, size, kReadSize, &read_ahead_id));
+  ASSERT_NE(0u, read_ahead_id);
+  cache.Insert(kIno, read_ahead_id, base::StringPiece());
+
+  // Reads at the end of the file are then served from the cache.
+  ASSERT_TRUE(cache.Read(kIno, size, kReadSize, &data));
+  EXPECT_TRUE(data.empty());
+}
+
+TEST(ReadAheadCacheTest, InvalidateDropsData) {
+  ReadAheadCache cache;
+  const std::string file = MakeFileData(4 * ReadAheadCache::kReadAheadSize);
+
+  uint64_t read_ahead_id = 0;
+  const off_t off = ReadUntilReadAhead(&cache, 0, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+  cache.Insert(kIno, read_ahead_id, base::StringPiece(file).substr(off));
+
+  // The file is written: the cached data is dropped.
+  cache.Invalidate(kIno);
+  base::StringPiece data;
+  EXPECT_FALSE(cache.Read(kIno, off, kReadSize, &data));
+
+  // Data read ahead before the file was written is not cached.
+  ReadUntilReadAhead(&cache, off, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+  cache.Invalidate(kIno);
+  cache.Insert(kIno, read_ahead_id, base::StringPiece(file).substr(off));
+  EXPECT_FALSE(cache.Read(kIno, off, kReadSize, &data));
+}
+
+TEST(ReadAheadCacheTest, CancelAllowsReadAhead) {
+  ReadAheadCache cache;
+
+  uint64_t read_ahead_id = 0;
+  off_t off = ReadUntilReadAhead(&cache, 0, &read_ahead_id);
+  ASSERT_NE(0u, read_ahead_id);
+
+  // The read ahead failed: the next sequential read is read ahead.
+  cache.Cancel(kIno, read_ahead_id);
+  off += kReadSize;
+  base::StringPiece data;
+  EXPECT_FALSE(cache.Read(kIno, off, kReadSize, &data));
+  EXPECT_EQ(ReadAheadCache::kReadAheadSize,
+            cache.GetReadLength(kIno, off, kReadSize, &read_ahead_id));
+  EXPECT_NE(0u, read_ahead_id);
+}
+
+// Fusebox server stand-in: answers Read2 calls for a file in memory. The
+// calls go through D-Bus messages that are marshalled but not sent, and each
+// call waits for |round_trip| like a call to a remote process.
+class FakeServer {
+ public:
+  FakeServer(std::string file, base::TimeDelta round_trip)
+      : file_(std::move(file)), round_trip_(round_trip) {}
+
+  FakeServer(const FakeServer&) = delete;
+  FakeServer& operator=(const FakeServer&) = delete;
+
+  ~FakeServer() {
+    if (shared_memory_)
+      munmap(shared_memory_, shared_memory_size_);
+  }
+
+  // Maps the shared memory |buffer| like the server does on Open2.
+  void MapSharedMemory(const SharedBuffer& buffer) {
+    shared_memory_size_ = buffer.size();
+    void* data = mmap(nullptr, shared_memory_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, buffer.fd(), 0);
+    CHECK_NE(MAP_FAILED, data);
+    shared_memory_ = static_cast<char*>(data);
+  }
+
+  std::unique_ptr<dbus::Response> Read2(dbus::MethodCall* method) {
+    base::PlatformThread::Sleep(round_trip_);
+
+    dbus::MessageReader reader(method);
+    Read2RequestProto request;
+    CHECK(reader.PopArrayOfBytesAsProto(&request));
+    const base::StringPiece data = base::StringPiece(file_).substr(
+        std::min<size_t>(request.offset(), file_.size()), request.length());
+
+    Read2ResponseProto response_proto;
+    if (request.has_shared_memory_offset()) {
+      CHECK(shared_memory_);
+      memcpy(shared_memory_ + request.shared_memory_offset(), data.data(),
+             data.size());
+      response_proto.set_shared_memory_length(data.size());
+    } else {
+      response_proto.set_data(data.data(), data.size());
+    }
+
+    std::unique_ptr<dbus::Response> response = dbus::Response::CreateEmpty();
+    dbus::MessageWriter writer(response.get());
+    writer.AppendProtoAsArrayOfBytes(response_proto);
+    return response;
+  }
+
+ private:
+  const std::string file_;
+  const base::TimeDelta round_trip_;
+  char* shared_memory_ = nullptr;
+  size_t shared_memory_size_ = 0;
+};
+
+// Reads the |size| bytes of the file of |server| sequentially, the way
+// FuseBoxClient serves Kernel FUSE reads, into |out|. Uses |buffer| if not
+// null and |cache| if not null.
+void ReadSequentially(FakeServer* server,
+                      size_t size,
+                      SharedBuffer* buffer,
+                      ReadAheadCache* cache,
+                      std::string* out) {
+  out->resize(size);
+  for (size_t off = 0; off < size; off += kReadSize) {
+    base::StringPiece data;
+    if (cache && cache->Read(kIno, off, kReadSize, &data)) {
+      memcpy(out->data() + off, data.data(), data.size());
+      continue;
+    }
+
+    uint64_t read_ahead_id = 0;
+    const size_t length =
+        cache ? cache->GetReadLength(kIno, off, kReadSize, &read_ahead_id)
+              : kReadSize;
+    SharedBuffer::Slot slot;
+    if (buffer)
+      slot = buffer->AcquireSlot(length);
+
+    Read2RequestProto request_proto;
+    request_proto.set_fuse_handle(1);
+    request_proto.set_offset(off);
+    request_proto.set_length(length);
+    if (slot.is_valid())
+      request_proto.set_shared_memory_offset(slot.offset());
+    dbus::MethodCall method(kFuseBoxServiceInterface, kRead2Method);
+    dbus::MessageWriter writer(&method);
+    writer.AppendProtoAsArrayOfBytes(request_proto);
+
+    std::unique_ptr<dbus::Response> response = server->Read2(&method);
+    dbus::MessageReader reader(response.get());
+    Read2ResponseProto response_proto;
+    ASSERT_TRUE(reader.PopArrayOfBytesAsProto(&response_proto));
+    if (slot.is_valid()) {
+      data = base::StringPiece(slot.data(),
+                               response_proto.shared_memory_length());
+    } else {
+      data = response_proto.data();
+    }
+    if (read_ahead_id)
+      cache->Insert(kIno, read_ahead_id, data);
+
+    data = data.substr(0, kReadSize);
+    memcpy(out->data() + off, data.data(), data.size());
+  }
+}
+
+// Logs the throughput of sequential reads with the data in the D-Bus
+// messages, in shared memory, and in shared memory with read ahead.
+// Run with --gtest_also_run_disabled_tests.
+TEST(ReadAheadCacheTest, DISABLED_Benchmark) {
+  constexpr size_t kSize = 64 * 1024 * 1024;
+  constexpr base::TimeDelta kRoundTrip = base::Microseconds(200);
+  const std::string file = MakeFileData(kSize);
+
+  struct Config {
+    const char* name;
+    bool shared_memory;
+    bool read_ahead;
+  };
+  for (const Config& config : {Config{"D-Bus", false, false},
+                               Config{"shared memory", true, false},
+                               Config{"shared memory + read-ahead", true,
+                                      true}}) {
+    FakeServer server(file, kRoundTrip);
+    scoped_refptr<SharedBuffer> buffer;
+    if (config.shared_memory) {
+      buffer = SharedBuffer::Create();
+      ASSERT_TRUE(buffer);
+      server.MapSharedMemory(*buffer);
+    }
+    ReadAheadCache cache;
+
+    std::string out;
+    base::ElapsedTimer timer;
+    ReadSequentially(&server, kSize, buffer.get(),
+                     config.read_ahead ? &cache : nullptr, &out);
+    const base::TimeDelta elapsed = timer.Elapsed();
+    EXPECT_EQ(file, out);
+
+    LOG(INFO) << config.name << ": " << kSize / elapsed.InSecondsF() / 1e6
+              << " MB/s";
+  }
+}
+
+}  // namespace
+}  // namespace fusebox
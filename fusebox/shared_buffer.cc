@@ -0,0 +1,129 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fusebox/shared_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include <base/check.h>
+#include <base/check_op.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+namespace fusebox {
+
+SharedBuffer::Slot::Slot() = default;
+
+SharedBuffer::Slot::Slot(scoped_refptr<SharedBuffer> buffer, size_t index)
+    : buffer_(std::move(buffer)), index_(index) {}
+
+SharedBuffer::Slot::Slot(Slot&& other)
+    : buffer_(std::move(other.buffer_)), index_(other.index_) {}
+
+SharedBuffer::Slot& SharedBuffer::Slot::operator=(Slot&& other) {
+  if (this != &other) {
+    Release();
+    buffer_ = std::move(other.buffer_);
+    index_ = other.index_;
+  }
+  return *this;
+}
+
+SharedBuffer::Slot::~Slot() {
+  Release();
+}
+
+off_t SharedBuffer::Slot::offset() const {
+  DCHECK(buffer_);
+  return static_cast<off_t>(index_ * buffer_->slot_size_);
+}
+
+char* SharedBuffer::Slot::data() const {
+  DCHECK(buffer_);
+  return buffer_->data_ + offset();
+}
+
+size_t SharedBuffer::Slot::size() const {
+  DCHECK(buffer_);
+  return buffer_->slot_size_;
+}
+
+void SharedBuffer::Slot::Release() {
+  if (!buffer_)
+    return;
+
+  DCHECK(buffer_->in_use_[index_]);
+  buffer_->in_use_[index_] = false;
+  buffer_.reset();
+}
+
+// static
+scoped_refptr<SharedBuffer> SharedBuffer::Create(size_t slot_size,
+                                                 size_t slot_count) {
+  CHECK_GT(slot_size, 0);
+  CHECK_GT(slot_count, 0);
+  const size_t size = slot_size * slot_count;
+
+  base::ScopedFD fd(memfd_create("fusebox", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << "memfd_create";
+    return nullptr;
+  }
+
+  if (HANDLE_EINTR(ftruncate(fd.get(), size)) == -1) {
+    PLOG(ERROR) << "ftruncate";
+    return nullptr;
+  }
+
+  // The server can then map the memory without checking its size, and
+  // without the risk of a SIGBUS if the client shrinks it.
+  const int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+  if (fcntl(fd.get(), F_ADD_SEALS, seals) == -1) {
+    PLOG(ERROR) << "memfd seals";
+    return nullptr;
+  }
+
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+  if (data == MAP_FAILED) {
+    PLOG(ERROR) << "mmap";
+    return nullptr;
+  }
+
+  return base::WrapRefCounted(new SharedBuffer(
+      std::move(fd), static_cast<char*>(data), slot_size, slot_count));
+}
+
+SharedBuffer::SharedBuffer(base::ScopedFD fd,
+                           char* data,
+                           size_t slot_size,
+                           size_t count)
+    : fd_(std::move(fd)),
+      data_(data),
+      slot_size_(slot_size),
+      in_use_(count, false) {}
+
+SharedBuffer::~SharedBuffer() {
+  PLOG_IF(ERROR, munmap(data_, size()) == -1) << "munmap";
+}
+
+SharedBuffer::Slot SharedBuffer::AcquireSlot(size_t size) {
+  if (size > slot_size_)
+    return {};
+
+  for (size_t i = 0; i < in_use_.size(); ++i) {
+    if (!in_use_[i]) {
+      in_use_[i] = true;
+      return Slot(base::WrapRefCounted(this), i);
+    }
+  }
+
+  return {};
+}
+
+}  // namespace fusebox
@@ -0,0 +1,98 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FUSEBOX_SHARED_BUFFER_H_
+#define FUSEBOX_SHARED_BUFFER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include <base/files/scoped_file.h>
+#include <base/memory/ref_counted.h>
+
+namespace fusebox {
+
+// Memory shared with the Fusebox server: a sealed memfd, mapped here and
+// passed to the server with Open2 or Create, see "Shared memory" in
+// fusebox.proto. It is split in fixed size slots, each used by one Read2 or
+// Write2 call at a time.
+//
+// Callbacks of in-flight calls hold a reference, so the memory stays mapped
+// until they have run, even if the file was released in the meantime.
+class SharedBuffer : public base::RefCounted<SharedBuffer> {
+ public:
+  // Size of a slot: the largest read or write that uses shared memory.
+  static constexpr size_t kSlotSize = 1024 * 1024;
+
+  // Number of slots: Read2 and Write2 calls on a file that run in parallel
+  // with as many other calls fall back to passing their data in the protos.
+  static constexpr size_t kSlotCount = 4;
+
+  // A slot of a SharedBuffer, released when destroyed.
+  class Slot {
+   public:
+    Slot();
+    Slot(Slot&& other);
+    Slot& operator=(Slot&& other);
+    ~Slot();
+
+    // Returns true if the slot was acquired.
+    bool is_valid() const { return buffer_ != nullptr; }
+
+    // Offset of the slot in the shared memory.
+    off_t offset() const;
+
+    // Slot data: size() bytes.
+    char* data() const;
+    size_t size() const;
+
+   private:
+    friend class SharedBuffer;
+
+    Slot(scoped_refptr<SharedBuffer> buffer, size_t index);
+
+    void Release();
+
+    scoped_refptr<SharedBuffer> buffer_;
+    size_t index_ = 0;
+  };
+
+  // Creates a buffer of |slot_count| slots of |slot_size| bytes. Returns null
+  // on failure.
+  static scoped_refptr<SharedBuffer> Create(size_t slot_size = kSlotSize,
+                                            size_t slot_count = kSlotCount);
+
+  SharedBuffer(const SharedBuffer&) = delete;
+  SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+  // The memfd: pass it to the server.
+  int fd() const { return fd_.get(); }
+
+  // Size of the shared memory in bytes.
+  size_t size() const { return slot_size_ * in_use_.size(); }
+
+  // Returns a free slot that can hold |size| bytes, or an invalid slot if
+  // there is none.
+  Slot AcquireSlot(size_t size);
+
+ private:
+  friend class base::RefCounted<SharedBuffer>;
+
+  SharedBuffer(base::ScopedFD fd, char* data, size_t slot_size, size_t count);
+  ~SharedBuffer();
+
+  // The memfd and its mapping.
+  const base::ScopedFD fd_;
+  char* const data_;
+
+  // Slot size and slot use: true if the slot is acquired.
+  const size_t slot_size_;
+  std::vector<bool> in_use_;
+};
+
+}  // namespace fusebox
+
+#endif  // FUSEBOX_SHARED_BUFFER_H_
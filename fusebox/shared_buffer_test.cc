@@ -0,0 +1,92 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fusebox/shared_buffer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+namespace fusebox {
+
+TEST(SharedBufferTest, Slots) {
+  scoped_refptr<SharedBuffer> buffer = SharedBuffer::Create(4096, 2);
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ(8192, buffer->size());
+
+  // Slots larger than the slot size cannot be acquired.
+  EXPECT_FALSE(buffer->AcquireSlot(4097).is_valid());
+
+  // Each slot can be acquired once.
+  SharedBuffer::Slot first = buffer->AcquireSlot(4096);
+  SharedBuffer::Slot second = buffer->AcquireSlot(1);
+  ASSERT_TRUE(first.is_valid());
+  ASSERT_TRUE(second.is_valid());
+  EXPECT_EQ(4096, first.size());
+  EXPECT_NE(first.offset(), second.offset());
+  EXPECT_FALSE(buffer->AcquireSlot(1).is_valid());
+
+  // Destroying a slot releases it.
+  const off_t offset = second.offset();
+  second = SharedBuffer::Slot();
+  SharedBuffer::Slot third = buffer->AcquireSlot(1);
+  ASSERT_TRUE(third.is_valid());
+  EXPECT_EQ(offset, third.offset());
+
+  // Moving a slot does not release it.
+  SharedBuffer::Slot moved = std::move(third);
+  EXPECT_TRUE(moved.is_valid());
+  EXPECT_FALSE(buffer->AcquireSlot(1).is_valid());
+}
+
+TEST(SharedBufferTest, MemoryIsShared) {
+  scoped_refptr<SharedBuffer> buffer = SharedBuffer::Create(4096, 2);
+  ASSERT_TRUE(buffer);
+  SharedBuffer::Slot first = buffer->AcquireSlot(4096);
+  SharedBuffer::Slot second = buffer->AcquireSlot(4096);
+  ASSERT_TRUE(second.is_valid());
+
+  // What the client writes in a slot can be read from the memfd.
+  const char kClientData[] = "client data";
+  memcpy(second.data(), kClientData, sizeof(kClientData));
+  char data[sizeof(kClientData)] = {};
+  EXPECT_EQ(sizeof(data),
+            pread(buffer->fd(), data, sizeof(data), second.offset()));
+  EXPECT_STREQ(kClientData, data);
+
+  // What the server writes in the memfd can be read from the slot.
+  const char kServerData[] = "server data";
+  EXPECT_EQ(sizeof(kServerData), pwrite(buffer->fd(), kServerData,
+                                        sizeof(kServerData), first.offset()));
+  EXPECT_STREQ(kServerData, first.data());
+}
+
+TEST(SharedBufferTest, MemoryIsSealed) {
+  scoped_refptr<SharedBuffer> buffer = SharedBuffer::Create(4096, 2);
+  ASSERT_TRUE(buffer);
+
+  // The server can rely on the size of the memfd.
+  EXPECT_EQ(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL,
+            fcntl(buffer->fd(), F_GET_SEALS));
+  EXPECT_EQ(-1, ftruncate(buffer->fd(), 0));
+  EXPECT_EQ(-1, ftruncate(buffer->fd(), 3 * 4096));
+}
+
+TEST(SharedBufferTest, SlotKeepsBufferAlive) {
+  scoped_refptr<SharedBuffer> buffer = SharedBuffer::Create(4096, 2);
+  ASSERT_TRUE(buffer);
+  SharedBuffer::Slot slot = buffer->AcquireSlot(4096);
+  ASSERT_TRUE(slot.is_valid());
+
+  // The file is released before the response of the call using the slot.
+  buffer.reset();
+  memset(slot.data(), 'x', slot.size());
+  EXPECT_EQ('x', slot.data()[slot.size() - 1]);
+}
+
+}  // namespace fusebox
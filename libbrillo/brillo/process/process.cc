@@ -6,13 +6,17 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdint.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <limits>
 #include <map>
 #include <memory>
 #include <utility>
@@ -24,6 +28,7 @@
 #include <base/files/file_util.h>
 #include <base/logging.h>
 #include <base/posix/eintr_wrapper.h>
+#include <base/posix/safe_strerror.h>
 #include <base/process/process_metrics.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_util.h>
@@ -34,6 +39,16 @@
 #define setresgid(_g1, _g2, _g3) setregid(_g1, _g2)
 #endif  // !__linux__
 
+// posix_spawn_file_actions_addclosefrom_np() was added in glibc 2.34.
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+#define BRILLO_HAVE_SPAWN_CLOSEFROM 1
+#else
+#define BRILLO_HAVE_SPAWN_CLOSEFROM 0
+#endif
+
+extern char** environ;
+
 namespace brillo {
 
 namespace {
@@ -52,6 +67,20 @@ void OpenFileAndDup2Fd(const std::string& filename, int fd) {
   IGNORE_EINTR(close(output_handle));
 }
 
+// Closes the file descriptors in [first, last], ignoring errors since we're
+// just trying to close anything we can find.
+void CloseFileDescriptorRange(int first, int last) {
+#if defined(__NR_close_range)
+  if (syscall(__NR_close_range, first, last, 0) == 0)
+    return;
+#endif
+  // Fall back to closing them one by one on kernels without close_range().
+  const int max_fds = static_cast<int>(
+      std::min<size_t>(base::GetMaxFds(), std::numeric_limits<int>::max()));
+  for (int fd = first; fd <= last && fd < max_fds; ++fd)
+    IGNORE_EINTR(close(fd));
+}
+
 }  // namespace
 
 bool ReturnTrue() {
@@ -73,6 +102,7 @@ ProcessImpl::ProcessImpl()
       gid_(-1),
       pgid_(-1),
       pre_exec_(base::BindOnce(&ReturnTrue)),
+      has_pre_exec_callback_(false),
       search_path_(false),
       inherit_parent_signal_mask_(false),
       close_unused_file_descriptors_(false) {}
@@ -214,6 +244,7 @@ void ProcessImpl::SetInheritParentSignalMask(bool inherit) {
 
 void ProcessImpl::SetPreExecCallback(PreExecCallback cb) {
   pre_exec_ = std::move(cb);
+  has_pre_exec_callback_ = true;
 }
 
 void ProcessImpl::SetSearchPath(bool search_path) {
@@ -311,41 +342,172 @@ bool ProcessImpl::PopulatePipeMap() {
   return true;
 }
 
-bool ProcessImpl::IsFileDescriptorInPipeMap(int fd) const {
+std::vector<int> ProcessImpl::GetUsedFileDescriptors() const {
+  // STD file descriptors, redirect memfds for stdout and stderr, and file
+  // descriptors used by the PipeMap are handled when setting up the child.
+  std::vector<int> fds = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO,
+                          stdout_.parent_fd_, stderr_.parent_fd_};
   for (const auto& pipe : pipe_map_) {
-    if (fd == pipe.second.parent_fd_ || fd == pipe.second.child_fd_ ||
-        fd == pipe.first) {
-      return true;
-    }
+    fds.push_back(pipe.first);
+    fds.push_back(pipe.second.parent_fd_);
+    fds.push_back(pipe.second.child_fd_);
   }
-  return false;
+  fds.erase(std::remove(fds.begin(), fds.end(), -1), fds.end());
+  std::sort(fds.begin(), fds.end());
+  fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+  return fds;
+}
+
+void ProcessImpl::CloseUnusedFileDescriptors(const std::vector<int>& used_fds) {
+  // Close the gaps between the used file descriptors, which are sorted, and
+  // everything after the last one.
+  int first = 0;
+  for (int fd : used_fds) {
+    if (fd > first)
+      CloseFileDescriptorRange(first, fd - 1);
+    first = fd + 1;
+  }
+  CloseFileDescriptorRange(first, std::numeric_limits<int>::max());
+}
+
+bool ProcessImpl::CanSpawnWithoutFork() const {
+  // posix_spawn() can't run arbitrary code in the child, so it is only used
+  // when the child needs nothing beyond file descriptor, process group and
+  // signal mask setup.
+  if (has_pre_exec_callback_ || uid_ != static_cast<uid_t>(-1) ||
+      gid_ != static_cast<gid_t>(-1)) {
+    return false;
+  }
+#if !BRILLO_HAVE_SPAWN_CLOSEFROM
+  if (close_unused_file_descriptors_)
+    return false;
+#endif
+  return true;
 }
 
-void ProcessImpl::CloseUnusedFileDescriptors() {
-  size_t max_fds = base::GetMaxFds();
-  for (size_t i = 0; i < max_fds; i++) {
-    const int fd = static_cast<int>(i);
+pid_t ProcessImpl::SpawnChildProcess(char* const argv[],
+                                     const std::vector<int>& used_fds) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attributes;
+  if (posix_spawn_file_actions_init(&actions) != 0)
+    return -1;
+  if (posix_spawnattr_init(&attributes) != 0) {
+    posix_spawn_file_actions_destroy(&actions);
+    return -1;
+  }
 
-    // Ignore STD file descriptors.
-    if (fd == STDIN_FILENO || fd == STDOUT_FILENO || fd == STDERR_FILENO) {
-      continue;
+  // Remember the first error, the remaining calls are then harmless.
+  int error = 0;
+  auto check = [&error](int result) {
+    if (error == 0)
+      error = result;
+  };
+
+  // The file actions mirror the steps of ExecChildProcess().
+  if (close_unused_file_descriptors_) {
+#if BRILLO_HAVE_SPAWN_CLOSEFROM
+    int first = 0;
+    for (int fd : used_fds) {
+      for (; first < fd; ++first)
+        check(posix_spawn_file_actions_addclose(&actions, first));
+      first = fd + 1;
     }
-
-    // Ignore redirect memfds for stdout and stderr.
-    if (fd == stdout_.parent_fd_ || fd == stderr_.parent_fd_) {
+    check(posix_spawn_file_actions_addclosefrom_np(&actions, first));
+#endif  // BRILLO_HAVE_SPAWN_CLOSEFROM
+  }
+  for (const auto& i : pipe_map_) {
+    if (i.second.parent_fd_ != -1)
+      check(posix_spawn_file_actions_addclose(&actions, i.second.parent_fd_));
+    if (i.second.child_fd_ == i.first)
       continue;
-    }
-
-    // Ignore file descriptors used by the PipeMap, they will be handled
-    // by this process later on.
-    if (IsFileDescriptorInPipeMap(fd)) {
+    check(posix_spawn_file_actions_adddup2(&actions, i.second.child_fd_,
+                                           i.first));
+  }
+  for (const auto& i : pipe_map_) {
+    if (i.second.child_fd_ == i.first)
       continue;
-    }
+    check(posix_spawn_file_actions_addclose(&actions, i.second.child_fd_));
+  }
 
-    // Since we're just trying to close anything we can find,
-    // ignore any error return values of close().
-    IGNORE_EINTR(close(fd));
+  if (stdin_.type_ == FileDescriptorRedirectType::kFile &&
+      !stdin_.filename_.empty()) {
+    check(posix_spawn_file_actions_addopen(
+        &actions, STDIN_FILENO, stdin_.filename_.c_str(),
+        O_RDONLY | O_NOFOLLOW | O_NOCTTY, 0));
   }
+  const int kOutputFlags = O_CREAT | O_WRONLY | O_TRUNC | O_NOFOLLOW;
+  switch (stdout_.type_) {
+    case FileDescriptorRedirectType::kFile:
+      if (!stdout_.filename_.empty()) {
+        check(posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                               stdout_.filename_.c_str(),
+                                               kOutputFlags, 0666));
+      }
+      break;
+    case FileDescriptorRedirectType::kMemory:
+      check(posix_spawn_file_actions_adddup2(&actions, stdout_.parent_fd_,
+                                             STDOUT_FILENO));
+      check(posix_spawn_file_actions_addclose(&actions, stdout_.parent_fd_));
+      break;
+    default:
+      break;
+  }
+  switch (stderr_.type_) {
+    case FileDescriptorRedirectType::kFile:
+      if (stderr_.filename_.empty())
+        break;
+      if (stderr_.filename_ == stdout_.filename_) {
+        check(posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO,
+                                               STDERR_FILENO));
+      } else {
+        check(posix_spawn_file_actions_addopen(&actions, STDERR_FILENO,
+                                               stderr_.filename_.c_str(),
+                                               kOutputFlags, 0666));
+      }
+      break;
+    case FileDescriptorRedirectType::kMemory:
+      check(posix_spawn_file_actions_adddup2(&actions, stderr_.parent_fd_,
+                                             STDERR_FILENO));
+      check(posix_spawn_file_actions_addclose(&actions, stderr_.parent_fd_));
+      break;
+    default:
+      break;
+  }
+
+  short flags = 0;  // NOLINT(runtime/int)
+  if (pgid_ != static_cast<pid_t>(-1)) {
+    check(posix_spawnattr_setpgroup(&attributes, pgid_));
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  if (!inherit_parent_signal_mask_) {
+    sigset_t signal_mask;
+    CHECK_EQ(0, sigemptyset(&signal_mask));
+    check(posix_spawnattr_setsigmask(&attributes, &signal_mask));
+    flags |= POSIX_SPAWN_SETSIGMASK;
+  }
+  check(posix_spawnattr_setflags(&attributes, flags));
+
+  pid_t pid = -1;
+  if (error == 0) {
+    // posix_spawn() reports failures of the file actions and of exec, e.g. a
+    // missing input file or executable, as its return value.
+    error = search_path_
+                ? posix_spawnp(&pid, argv[0], &actions, &attributes, argv,
+                               environ)
+                : posix_spawn(&pid, argv[0], &actions, &attributes, argv,
+                              environ);
+  }
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (error != 0) {
+    // Retry with fork() so that errors are logged and reported through
+    // kErrorExitStatus exactly as before.
+    VLOG(1) << "posix_spawn of " << argv[0]
+            << " failed: " << base::safe_strerror(error);
+    return -1;
+  }
+  return pid;
 }
 
 bool ProcessImpl::Start() {
@@ -366,134 +528,147 @@ bool ProcessImpl::Start() {
     return false;
   }
 
-  pid_t pid = fork();
+  std::vector<int> used_fds;
+  if (close_unused_file_descriptors_)
+    used_fds = GetUsedFileDescriptors();
+
+  pid_t pid = -1;
+  if (CanSpawnWithoutFork())
+    pid = SpawnChildProcess(argv.get(), used_fds);
   if (pid < 0) {
-    PLOG(ERROR) << "Fork failed";
-    Reset(0);
-    return false;
+    pid = fork();
+    if (pid < 0) {
+      PLOG(ERROR) << "Fork failed";
+      Reset(0);
+      return false;
+    }
+    if (pid == 0) {
+      // Executing inside the child process, this doesn't return.
+      ExecChildProcess(argv.get(), used_fds);
+    }
   }
 
-  if (pid == 0) {
-    // Executing inside the child process.
-    // Close unused file descriptors.
-    if (close_unused_file_descriptors_) {
-      CloseUnusedFileDescriptors();
-    }
-    // Close parent's side of the child pipes. dup2 ours into place and
-    // then close our ends.
-    for (PipeMap::iterator i = pipe_map_.begin(); i != pipe_map_.end(); ++i) {
-      if (i->second.parent_fd_ != -1)
-        IGNORE_EINTR(close(i->second.parent_fd_));
-      // If we want to bind a fd to the same fd in the child, we don't need to
-      // close and dup2 it.
-      if (i->second.child_fd_ == i->first)
-        continue;
-      HANDLE_EINTR(dup2(i->second.child_fd_, i->first));
+  // Still executing inside the parent process with known child pid.
+  arguments_.clear();
+  UpdatePid(pid);
+  // Close our copy of child side pipes only if we created those pipes.
+  for (const auto& i : pipe_map_) {
+    if (!i.second.is_bound_) {
+      IGNORE_EINTR(close(i.second.child_fd_));
     }
-    // Defer the actual close() of the child fd until afterward; this lets the
-    // same child fd be bound to multiple fds using BindFd. Don't close the fd
-    // if it was bound to itself.
-    for (PipeMap::iterator i = pipe_map_.begin(); i != pipe_map_.end(); ++i) {
-      if (i->second.child_fd_ == i->first)
-        continue;
-      IGNORE_EINTR(close(i->second.child_fd_));
+  }
+  return true;
+}
+
+void ProcessImpl::ExecChildProcess(char* const argv[],
+                                   const std::vector<int>& used_fds) {
+  // Close unused file descriptors.
+  if (close_unused_file_descriptors_) {
+    CloseUnusedFileDescriptors(used_fds);
+  }
+  // Close parent's side of the child pipes. dup2 ours into place and
+  // then close our ends.
+  for (PipeMap::iterator i = pipe_map_.begin(); i != pipe_map_.end(); ++i) {
+    if (i->second.parent_fd_ != -1)
+      IGNORE_EINTR(close(i->second.parent_fd_));
+    // If we want to bind a fd to the same fd in the child, we don't need to
+    // close and dup2 it.
+    if (i->second.child_fd_ == i->first)
+      continue;
+    HANDLE_EINTR(dup2(i->second.child_fd_, i->first));
+  }
+  // Defer the actual close() of the child fd until afterward; this lets the
+  // same child fd be bound to multiple fds using BindFd. Don't close the fd
+  // if it was bound to itself.
+  for (PipeMap::iterator i = pipe_map_.begin(); i != pipe_map_.end(); ++i) {
+    if (i->second.child_fd_ == i->first)
+      continue;
+    IGNORE_EINTR(close(i->second.child_fd_));
+  }
+
+  if (stdin_.type_ == FileDescriptorRedirectType::kFile &&
+      !stdin_.filename_.empty()) {
+    int input_handle = HANDLE_EINTR(
+        open(stdin_.filename_.c_str(), O_RDONLY | O_NOFOLLOW | O_NOCTTY));
+    if (input_handle < 0) {
+      PLOG(ERROR) << "Could not open " << stdin_.filename_;
+      // Avoid exit() to avoid atexit handlers from parent.
+      _exit(kErrorExitStatus);
     }
 
-    if (stdin_.type_ == FileDescriptorRedirectType::kFile &&
-        !stdin_.filename_.empty()) {
-      int input_handle = HANDLE_EINTR(
-          open(stdin_.filename_.c_str(), O_RDONLY | O_NOFOLLOW | O_NOCTTY));
-      if (input_handle < 0) {
-        PLOG(ERROR) << "Could not open " << stdin_.filename_;
-        // Avoid exit() to avoid atexit handlers from parent.
+    // It's possible input_handle is already stdin. But if not, we need
+    // to dup into that file descriptor and close the original.
+    if (input_handle != STDIN_FILENO) {
+      if (HANDLE_EINTR(dup2(input_handle, STDIN_FILENO)) < 0) {
+        PLOG(ERROR) << "Could not dup fd to stdin for " << stdin_.filename_;
         _exit(kErrorExitStatus);
       }
-
-      // It's possible input_handle is already stdin. But if not, we need
-      // to dup into that file descriptor and close the original.
-      if (input_handle != STDIN_FILENO) {
-        if (HANDLE_EINTR(dup2(input_handle, STDIN_FILENO)) < 0) {
-          PLOG(ERROR) << "Could not dup fd to stdin for " << stdin_.filename_;
-          _exit(kErrorExitStatus);
-        }
-        IGNORE_EINTR(close(input_handle));
-      }
+      IGNORE_EINTR(close(input_handle));
     }
+  }
 
-    switch (stdout_.type_) {
-      case FileDescriptorRedirectType::kFile:
-        if (!stdout_.filename_.empty()) {
-          OpenFileAndDup2Fd(stdout_.filename_, STDOUT_FILENO);
-        }
-        break;
-      case FileDescriptorRedirectType::kMemory:
-        HANDLE_EINTR(dup2(stdout_.parent_fd_, STDOUT_FILENO));
-        IGNORE_EINTR(close(stdout_.parent_fd_));
-        break;
-      default:
-        VLOG(2) << "Ignoring stdout";
-    }
+  switch (stdout_.type_) {
+    case FileDescriptorRedirectType::kFile:
+      if (!stdout_.filename_.empty()) {
+        OpenFileAndDup2Fd(stdout_.filename_, STDOUT_FILENO);
+      }
+      break;
+    case FileDescriptorRedirectType::kMemory:
+      HANDLE_EINTR(dup2(stdout_.parent_fd_, STDOUT_FILENO));
+      IGNORE_EINTR(close(stdout_.parent_fd_));
+      break;
+    default:
+      VLOG(2) << "Ignoring stdout";
+  }
 
-    switch (stderr_.type_) {
-      case FileDescriptorRedirectType::kFile:
-        if (!stderr_.filename_.empty()) {
-          if (stderr_.filename_ == stdout_.filename_) {
-            HANDLE_EINTR(dup2(STDOUT_FILENO, STDERR_FILENO));
-          } else {
-            OpenFileAndDup2Fd(stderr_.filename_, STDERR_FILENO);
-          }
+  switch (stderr_.type_) {
+    case FileDescriptorRedirectType::kFile:
+      if (!stderr_.filename_.empty()) {
+        if (stderr_.filename_ == stdout_.filename_) {
+          HANDLE_EINTR(dup2(STDOUT_FILENO, STDERR_FILENO));
+        } else {
+          OpenFileAndDup2Fd(stderr_.filename_, STDERR_FILENO);
         }
-        break;
-      case FileDescriptorRedirectType::kMemory:
-        HANDLE_EINTR(dup2(stderr_.parent_fd_, STDERR_FILENO));
-        IGNORE_EINTR(close(stderr_.parent_fd_));
-        break;
-      default:
-        VLOG(2) << "Ignoring stderr";
-    }
+      }
+      break;
+    case FileDescriptorRedirectType::kMemory:
+      HANDLE_EINTR(dup2(stderr_.parent_fd_, STDERR_FILENO));
+      IGNORE_EINTR(close(stderr_.parent_fd_));
+      break;
+    default:
+      VLOG(2) << "Ignoring stderr";
+  }
 
-    if (gid_ != static_cast<gid_t>(-1) && setresgid(gid_, gid_, gid_) < 0) {
-      PLOG(ERROR) << "Unable to set GID to " << gid_;
-      _exit(kErrorExitStatus);
-    }
-    if (uid_ != static_cast<uid_t>(-1) && setresuid(uid_, uid_, uid_) < 0) {
-      PLOG(ERROR) << "Unable to set UID to " << uid_;
-      _exit(kErrorExitStatus);
-    }
-    if (pgid_ != static_cast<pid_t>(-1) && setpgid(0, pgid_) < 0) {
-      PLOG(ERROR) << "Unable to set PGID to " << pgid_;
-      _exit(kErrorExitStatus);
-    }
-    if (!std::move(pre_exec_).Run()) {
-      LOG(ERROR) << "Pre-exec callback failed";
-      _exit(kErrorExitStatus);
-    }
-    // Reset signal mask for the child process if not inheriting signal mask
-    // from the parent process.
-    if (!inherit_parent_signal_mask_) {
-      sigset_t signal_mask;
-      CHECK_EQ(0, sigemptyset(&signal_mask));
-      CHECK_EQ(0, sigprocmask(SIG_SETMASK, &signal_mask, nullptr));
-    }
-    if (search_path_) {
-      execvp(argv[0], &argv[0]);
-    } else {
-      execv(argv[0], &argv[0]);
-    }
-    PLOG(ERROR) << "Exec of " << argv[0] << " failed";
+  if (gid_ != static_cast<gid_t>(-1) && setresgid(gid_, gid_, gid_) < 0) {
+    PLOG(ERROR) << "Unable to set GID to " << gid_;
+    _exit(kErrorExitStatus);
+  }
+  if (uid_ != static_cast<uid_t>(-1) && setresuid(uid_, uid_, uid_) < 0) {
+    PLOG(ERROR) << "Unable to set UID to " << uid_;
     _exit(kErrorExitStatus);
+  }
+  if (pgid_ != static_cast<pid_t>(-1) && setpgid(0, pgid_) < 0) {
+    PLOG(ERROR) << "Unable to set PGID to " << pgid_;
+    _exit(kErrorExitStatus);
+  }
+  if (!std::move(pre_exec_).Run()) {
+    LOG(ERROR) << "Pre-exec callback failed";
+    _exit(kErrorExitStatus);
+  }
+  // Reset signal mask for the child process if not inheriting signal mask
+  // from the parent process.
+  if (!inherit_parent_signal_mask_) {
+    sigset_t signal_mask;
+    CHECK_EQ(0, sigemptyset(&signal_mask));
+    CHECK_EQ(0, sigprocmask(SIG_SETMASK, &signal_mask, nullptr));
+  }
+  if (search_path_) {
+    execvp(argv[0], &argv[0]);
   } else {
-    // Still executing inside the parent process with known child pid.
-    arguments_.clear();
-    UpdatePid(pid);
-    // Close our copy of child side pipes only if we created those pipes.
-    for (const auto& i : pipe_map_) {
-      if (!i.second.is_bound_) {
-        IGNORE_EINTR(close(i.second.child_fd_));
-      }
-    }
+    execv(argv[0], &argv[0]);
   }
-  return true;
+  PLOG(ERROR) << "Exec of " << argv[0] << " failed";
+  _exit(kErrorExitStatus);
 }
 
 int ProcessImpl::Wait() {
@@ -130,7 +130,8 @@ class BRILLO_EXPORT Process {
 
   // Set the pre-exec callback. This is called after all setup is complete but
   // before we exec() the process. The callback may return false to cause Start
-  // to return false without starting the process.
+  // to return false without starting the process. Setting a callback makes
+  // ProcessImpl start the process with fork() instead of posix_spawn().
   virtual void SetPreExecCallback(PreExecCallback cb) = 0;
 
   // Sets whether starting the process should search the system path or not.
@@ -269,8 +270,20 @@ class BRILLO_EXPORT ProcessImpl : public Process {
  private:
   FRIEND_TEST(ProcessTest, ResetPidByFile);
 
-  bool IsFileDescriptorInPipeMap(int fd) const;
-  void CloseUnusedFileDescriptors();
+  // Returns the sorted file descriptors that are set up for the child, all
+  // others are closed when close_unused_file_descriptors_ is set.
+  std::vector<int> GetUsedFileDescriptors() const;
+  void CloseUnusedFileDescriptors(const std::vector<int>& used_fds);
+
+  // Returns whether the child can be started with posix_spawn(), which avoids
+  // copying the page tables of large parents the way fork() does.
+  bool CanSpawnWithoutFork() const;
+  // Starts the child with posix_spawn(). Returns its pid, or -1 on failure, in
+  // which case the caller falls back to fork().
+  pid_t SpawnChildProcess(char* const argv[], const std::vector<int>& used_fds);
+  // Sets up and execs the child after fork(). Never returns.
+  [[noreturn]] void ExecChildProcess(char* const argv[],
+                                     const std::vector<int>& used_fds);
 
   // Pid of currently managed process or 0 if no currently managed
   // process.  pid must not be modified except by calling
@@ -286,6 +299,8 @@ class BRILLO_EXPORT ProcessImpl : public Process {
   gid_t gid_;
   pid_t pgid_;
   PreExecCallback pre_exec_;
+  // Whether SetPreExecCallback() was called, which requires fork().
+  bool has_pre_exec_callback_;
   bool search_path_;
   // Flag indicating to inherit signal mask from the parent process. It
   // is set to false by default, which means by default the child process
@@ -19,6 +19,7 @@
 #include <base/check_op.h>
 #include <base/logging.h>
 #include <brillo/brillo_export.h>
+#include <brillo/secure_arena.h>
 #include <brillo/secure_string.h>
 
 namespace brillo {
@@ -29,10 +30,12 @@ namespace brillo {
 // 1. Use page-aligned memory so that it can be locked (therefore, use mmap()
 //    instead of malloc()). Note that mlock()s are not inherited over fork(),
 //
-// 2. Always allocate memory in multiples of pages: this adds a memory overhead
-//    of ~1 page for each object. Moreover, the extra memory is not available
-//    for the allocated object to expand into: the container expects that the
-//    memory allocated to it matches the size set in reserve().
+// 2. Allocate memory in multiples of pages. Small allocations (up to
+//    SecureArena::kMaxSlotSize bytes) share pages with each other through
+//    SecureArena, which rounds them up to a power of two; larger ones are
+//    rounded up to whole pages. The extra memory is not available for the
+//    allocated object to expand into: the container expects that the memory
+//    allocated to it matches the size set in reserve().
 // TODO(sarthakkukreti): Figure out if it is possible to propagate the real
 // capacity to the container without an intrusive change to the STL.
 // [Example: allow __recommend() override in allocators for containers.]
@@ -90,7 +93,8 @@ class BRILLO_PRIVATE SecureAllocator {
     return result;
   }
 
-  // Allocation: allocates ceil(size/pagesize) for holding the data.
+  // Allocation: allocates a SecureArena slot or ceil(size/pagesize) pages for
+  // holding the data.
   pointer allocate(size_type n, pointer hint = nullptr) {
     pointer buffer = nullptr;
     // Check if n can be theoretically allocated.
@@ -109,48 +113,14 @@ class BRILLO_PRIVATE SecureAllocator {
     if (n == 0)
       return nullptr;
 
-    // Calculate the page-aligned buffer size.
-    size_type buffer_size = CalculatePageAlignedBufferSize(n);
-
-    // Memory locking granularity is per-page: mmap ceil(size/page size) pages.
-    buffer = reinterpret_cast<pointer>(
-        mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE,
-             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-    if (buffer == MAP_FAILED)
-      return nullptr;
-
-    // Lock buffer into physical memory.
-    if (mlock(buffer, buffer_size)) {
-      CHECK_NE(errno, ENOMEM) << "It is likely that SecureAllocator has "
-                                 "exceeded the RLIMIT_MEMLOCK limit";
-      return nullptr;
-    }
-
-    // Mark memory as non dumpable in a core dump.
-    if (madvise(buffer, buffer_size, MADV_DONTDUMP))
-      return nullptr;
-
-    // Mark memory as non mergeable with another page, even if the contents
-    // are the same.
-    if (madvise(buffer, buffer_size, MADV_UNMERGEABLE)) {
-      // MADV_UNMERGEABLE is only available if the kernel has been configured
-      // with CONFIG_KSM set. If the CONFIG_KSM flag has not been set, then
-      // pages are not mergeable so this madvise option is not necessary.
-      //
-      // In the case where CONFIG_KSM is not set, EINVAL is the error set.
-      // Since this error value is expected in some cases, we don't return a
-      // nullptr.
-      if (errno != EINVAL)
-        return nullptr;
+    if (UsesArena(n)) {
+      buffer = reinterpret_cast<pointer>(
+          SecureArena::GetInstance()->Allocate(n * sizeof(value_type)));
+    } else {
+      buffer = reinterpret_cast<pointer>(
+          MapSecurePages(CalculatePageAlignedBufferSize(n)));
     }
-
-    // Make this mapping available to child processes but don't copy data from
-    // the secure object's pages during fork. With MADV_DONTFORK, the
-    // vma is not mapped in the child process which leads to segmentation
-    // faults if the child process tries to access this address. For example,
-    // if the parent process creates a SecureObject, forks() and the child
-    // process tries to call the destructor at the virtual address.
-    if (madvise(buffer, buffer_size, MADV_WIPEONFORK))
+    if (!buffer)
       return nullptr;
 
     fail_on_allocation_error.ReplaceClosure(base::DoNothing());
@@ -179,12 +149,17 @@ class BRILLO_PRIVATE SecureAllocator {
     if (n == 0 || !p)
       return;
 
+    if (UsesArena(n)) {
+      clear_contents(p, SecureArena::GetSlotSize(n * sizeof(value_type)));
+      SecureArena::GetInstance()->Free(p, n * sizeof(value_type));
+      return;
+    }
+
     // Calculate the page-aligned buffer size.
     size_type buffer_size = CalculatePageAlignedBufferSize(n);
 
     clear_contents(p, buffer_size);
-    munlock(p, buffer_size);
-    munmap(p, buffer_size);
+    UnmapSecurePages(p, buffer_size);
   }
 
  protected:
@@ -213,6 +188,12 @@ class BRILLO_PRIVATE SecureAllocator {
     return result;
   }
 
+  // Returns true if |n| objects are small enough to share pages through
+  // SecureArena.
+  static bool UsesArena(size_type n) {
+    return n <= SecureArena::kMaxSlotSize / sizeof(value_type);
+  }
+
   // Calculates the page-aligned buffer size.
   size_t CalculatePageAlignedBufferSize(size_type n) {
     size_type page_size = SystemPageSize();
@@ -0,0 +1,241 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "brillo/secure_arena.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/check.h>
+#include <base/check_op.h>
+#include <base/no_destructor.h>
+
+namespace brillo {
+
+void* MapSecurePages(size_t size) {
+  // Memory locking granularity is per-page, so callers map whole pages.
+  void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED)
+    return nullptr;
+
+  // Lock the pages into physical memory.
+  if (mlock(pages, size)) {
+    CHECK_NE(errno, ENOMEM) << "It is likely that SecureAllocator has "
+                               "exceeded the RLIMIT_MEMLOCK limit";
+    munmap(pages, size);
+    return nullptr;
+  }
+
+  // Mark memory as non dumpable in a core dump.
+  if (madvise(pages, size, MADV_DONTDUMP)) {
+    UnmapSecurePages(pages, size);
+    return nullptr;
+  }
+
+  // Mark memory as non mergeable with another page, even if the contents
+  // are the same.
+  if (madvise(pages, size, MADV_UNMERGEABLE)) {
+    // MADV_UNMERGEABLE is only available if the kernel has been configured
+    // with CONFIG_KSM set. If the CONFIG_KSM flag has not been set, then
+    // pages are not mergeable so this madvise option is not necessary.
+    //
+    // In the case where CONFIG_KSM is not set, EINVAL is the error set.
+    // Since this error value is expected in some cases, we don't fail.
+    if (errno != EINVAL) {
+      UnmapSecurePages(pages, size);
+      return nullptr;
+    }
+  }
+
+  // Make this mapping available to child processes but don't copy data from
+  // the secure object's pages during fork. With MADV_DONTFORK, the
+  // vma is not mapped in the child process which leads to segmentation
+  // faults if the child process tries to access this address. For example,
+  // if the parent process creates a SecureObject, forks() and the child
+  // process tries to call the destructor at the virtual address.
+  if (madvise(pages, size, MADV_WIPEONFORK)) {
+    UnmapSecurePages(pages, size);
+    return nullptr;
+  }
+
+  return pages;
+}
+
+void UnmapSecurePages(void* pages, size_t size) {
+  munlock(pages, size);
+  munmap(pages, size);
+}
+
+// static
+SecureArena* SecureArena::GetInstance() {
+  static base::NoDestructor<SecureArena> instance;
+  [[maybe_unused]] static const bool fork_handlers_registered = [] {
+    CHECK_EQ(0, pthread_atfork(&SecureArena::PrepareFork,
+                               &SecureArena::ParentAfterFork,
+                               &SecureArena::ChildAfterFork));
+    return true;
+  }();
+  return instance.get();
+}
+
+SecureArena::SecureArena() {
+  long page_size = sysconf(_SC_PAGESIZE);  // NOLINT [runtime/int]
+  CHECK_GT(page_size, 0L);
+  page_size_ = page_size;
+  CHECK_GE(page_size_, kMaxSlotSize);
+  available_slabs_.resize(GetSizeClass(kMaxSlotSize) + 1);
+}
+
+SecureArena::~SecureArena() {
+  for (const auto& [base, slab] : slabs_)
+    UnmapSecurePages(reinterpret_cast<void*>(base), page_size_);
+}
+
+// static
+size_t SecureArena::GetSlotSize(size_t size) {
+  DCHECK_LE(size, kMaxSlotSize);
+  size_t slot_size = kMinSlotSize;
+  while (slot_size < size)
+    slot_size <<= 1;
+  return slot_size;
+}
+
+void* SecureArena::Allocate(size_t size) {
+  const size_t slot_size = GetSlotSize(size);
+  base::AutoLock lock(lock_);
+  std::vector<Slab*>& available = available_slabs_[GetSizeClass(slot_size)];
+  if (available.empty() && !AddSlab(slot_size))
+    return nullptr;
+
+  Slab* slab = available.back();
+  const uint16_t index = slab->free_slots.back();
+  slab->free_slots.pop_back();
+  if (slab->free_slots.empty())
+    available.pop_back();
+  return reinterpret_cast<void*>(slab->base + index * slot_size);
+}
+
+void SecureArena::Free(void* slot, size_t size) {
+  const size_t slot_size = GetSlotSize(size);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(slot);
+  const uintptr_t base = address & ~(page_size_ - 1);
+
+  base::AutoLock lock(lock_);
+  auto it = slabs_.find(base);
+  CHECK(it != slabs_.end()) << "Freeing memory not owned by SecureArena";
+  Slab* slab = it->second.get();
+  CHECK_EQ(slab->slot_size, slot_size);
+
+  const bool inherited = slab->generation != generation_;
+  std::vector<Slab*>& available = available_slabs_[GetSizeClass(slot_size)];
+  if (slab->free_slots.empty() && !inherited)
+    available.push_back(slab);
+  slab->free_slots.push_back((address - base) / slot_size);
+  if (slab->free_slots.size() < slab->capacity)
+    return;
+
+  // Give fully free slabs back to the system, but keep the last one with free
+  // slots of each size class so that allocating and freeing a single blob
+  // doesn't map a slab every time. Inherited slabs are never reused.
+  if (inherited) {
+    UnmapSecurePages(reinterpret_cast<void*>(base), page_size_);
+    slabs_.erase(it);
+  } else if (available.size() > 1) {
+    available.erase(std::find(available.begin(), available.end(), slab));
+    UnmapSecurePages(reinterpret_cast<void*>(base), page_size_);
+    slabs_.erase(it);
+  }
+}
+
+void SecureArena::ReleaseFreeSlabs() {
+  base::AutoLock lock(lock_);
+  for (std::vector<Slab*>& available : available_slabs_) {
+    auto free_end = std::partition(
+        available.begin(), available.end(), [](const Slab* slab) {
+          return slab->free_slots.size() < slab->capacity;
+        });
+    for (auto it = free_end; it != available.end(); ++it) {
+      UnmapSecurePages(reinterpret_cast<void*>((*it)->base), page_size_);
+      slabs_.erase((*it)->base);
+    }
+    available.erase(free_end, available.end());
+  }
+}
+
+size_t SecureArena::GetLockedBytes() {
+  base::AutoLock lock(lock_);
+  size_t locked_slabs = 0;
+  for (const auto& [base, slab] : slabs_) {
+    if (slab->generation == generation_)
+      ++locked_slabs;
+  }
+  return locked_slabs * page_size_;
+}
+
+// static
+int SecureArena::GetSizeClass(size_t slot_size) {
+  int size_class = 0;
+  while ((kMinSlotSize << size_class) < slot_size)
+    ++size_class;
+  return size_class;
+}
+
+SecureArena::Slab* SecureArena::AddSlab(size_t slot_size) {
+  void* pages = MapSecurePages(page_size_);
+  if (!pages)
+    return nullptr;
+
+  auto slab = std::make_unique<Slab>();
+  slab->base = reinterpret_cast<uintptr_t>(pages);
+  slab->slot_size = slot_size;
+  slab->capacity = page_size_ / slot_size;
+  slab->generation = generation_;
+  // Hand out slots from the start of the slab first.
+  slab->free_slots.reserve(slab->capacity);
+  for (size_t i = slab->capacity; i > 0; --i)
+    slab->free_slots.push_back(i - 1);
+
+  Slab* result = slab.get();
+  available_slabs_[GetSizeClass(slot_size)].push_back(result);
+  slabs_.emplace(result->base, std::move(slab));
+  return result;
+}
+
+// static
+void SecureArena::PrepareFork() {
+  GetInstance()->lock_.Acquire();
+}
+
+// static
+void SecureArena::ParentAfterFork() {
+  GetInstance()->lock_.Release();
+}
+
+// static
+void SecureArena::ChildAfterFork() {
+  SecureArena* arena = GetInstance();
+  // The inherited slabs stay known so their slots can still be freed, but new
+  // allocations go to fresh slabs that are locked in the child. The empty
+  // slabs kept for reuse would never be freed, so unmap them now.
+  ++arena->generation_;
+  for (std::vector<Slab*>& available : arena->available_slabs_) {
+    for (Slab* slab : available) {
+      if (slab->free_slots.size() < slab->capacity)
+        continue;
+      const uintptr_t base = slab->base;
+      UnmapSecurePages(reinterpret_cast<void*>(base), arena->page_size_);
+      arena->slabs_.erase(base);
+    }
+    available.clear();
+  }
+  arena->lock_.Release();
+}
+
+}  // namespace brillo
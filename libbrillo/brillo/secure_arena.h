@@ -0,0 +1,117 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_SECURE_ARENA_H_
+#define LIBBRILLO_BRILLO_SECURE_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <base/synchronization/lock.h>
+#include <brillo/brillo_export.h>
+
+namespace brillo {
+
+// Maps |size| bytes (a multiple of the page size) of anonymous memory that is
+// locked, excluded from core dumps, unmergeable and wiped in forked children.
+// Returns nullptr on failure. Crashes if RLIMIT_MEMLOCK is exceeded.
+BRILLO_EXPORT void* MapSecurePages(size_t size);
+
+// Unlocks and unmaps pages returned by MapSecurePages(). The caller is
+// responsible for clearing their contents first.
+BRILLO_EXPORT void UnmapSecurePages(void* pages, size_t size);
+
+// SecureArena hands out small blocks of secure memory for SecureAllocator.
+//
+// Mapping and locking whole pages for every allocation costs several syscalls
+// and a locked page per SecureBlob, which adds up when thousands of small keys
+// and passwords are created during login. Instead, pages from MapSecurePages()
+// are used as slabs that are carved into power-of-two slots, one size class
+// per slab. A slab is unmapped again once all of its slots are free, unless it
+// is the last one of its size class.
+//
+// Slots are not cleared by the arena: SecureAllocator clears them before they
+// are freed. All methods are thread-safe.
+//
+// A child process inherits the slabs of the process-wide arena wiped and no
+// longer locked. It maps new slabs for its own allocations and only takes back
+// the slots of the inherited ones, unmapping each once all of its slots are
+// free.
+class BRILLO_EXPORT SecureArena {
+ public:
+  // The smallest and largest slot sizes. Larger allocations should use
+  // MapSecurePages() directly.
+  static constexpr size_t kMinSlotSize = 16;
+  static constexpr size_t kMaxSlotSize = 1024;
+
+  // Returns the process-wide arena.
+  static SecureArena* GetInstance();
+
+  SecureArena();
+  SecureArena(const SecureArena&) = delete;
+  SecureArena& operator=(const SecureArena&) = delete;
+
+  ~SecureArena();
+
+  // Returns the size of the slot used for an allocation of |size| bytes,
+  // which must be at most kMaxSlotSize.
+  static size_t GetSlotSize(size_t size);
+
+  // Returns a slot of at least |size| bytes, or nullptr if no slab could be
+  // mapped.
+  void* Allocate(size_t size);
+
+  // Returns a slot obtained from Allocate(|size|) to the arena. A slab whose
+  // slots are all free is unmapped, unless it is the only slab of its size
+  // class with free slots.
+  void Free(void* slot, size_t size);
+
+  // Unmaps all slabs that have no allocated slots, including the ones kept
+  // for reuse. This lowers the amount of locked memory, e.g. before running
+  // close to RLIMIT_MEMLOCK.
+  void ReleaseFreeSlabs();
+
+  // Returns the number of bytes of slabs currently mapped and locked.
+  size_t GetLockedBytes();
+
+ private:
+  struct Slab {
+    uintptr_t base;
+    size_t slot_size;
+    // Indices of the free slots; the slab is full when this is empty.
+    std::vector<uint16_t> free_slots;
+    size_t capacity;
+    // The value of |generation_| when the slab was mapped.
+    int generation;
+  };
+
+  // Returns the index of the size class for |slot_size|.
+  static int GetSizeClass(size_t slot_size);
+
+  // Maps a new slab for slots of |slot_size| bytes.
+  Slab* AddSlab(size_t slot_size);
+
+  // pthread_atfork() handlers for the process-wide arena. |lock_| is held
+  // across fork() so the child doesn't inherit it locked by another thread.
+  static void PrepareFork();
+  static void ParentAfterFork();
+  static void ChildAfterFork();
+
+  base::Lock lock_;
+  size_t page_size_;
+  // All slabs, keyed by base address.
+  std::unordered_map<uintptr_t, std::unique_ptr<Slab>> slabs_;
+  // For each size class, the slabs that have free slots.
+  std::vector<std::vector<Slab*>> available_slabs_;
+  // Incremented in the child on fork(); slabs of older generations were
+  // inherited from the parent and are not reused.
+  int generation_ = 0;
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_SECURE_ARENA_H_
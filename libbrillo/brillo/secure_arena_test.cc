@@ -0,0 +1,144 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "brillo/secure_arena.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "brillo/secure_blob.h"
+
+namespace brillo {
+
+namespace {
+
+size_t PageSize() {
+  return sysconf(_SC_PAGESIZE);
+}
+
+}  // namespace
+
+TEST(SecureArenaTest, SlotSize) {
+  EXPECT_EQ(16u, SecureArena::GetSlotSize(1));
+  EXPECT_EQ(16u, SecureArena::GetSlotSize(16));
+  EXPECT_EQ(32u, SecureArena::GetSlotSize(17));
+  EXPECT_EQ(1024u, SecureArena::GetSlotSize(1000));
+  EXPECT_EQ(1024u, SecureArena::GetSlotSize(SecureArena::kMaxSlotSize));
+}
+
+TEST(SecureArenaTest, SlotsShareSlabs) {
+  SecureArena arena;
+  const size_t slots_per_slab = PageSize() / 64;
+
+  std::vector<void*> slots;
+  std::set<uintptr_t> addresses;
+  for (size_t i = 0; i < slots_per_slab; ++i) {
+    slots.push_back(arena.Allocate(50));
+    ASSERT_NE(nullptr, slots.back());
+    uintptr_t address = reinterpret_cast<uintptr_t>(slots.back());
+    EXPECT_EQ(0u, address % 64);
+    addresses.insert(address);
+  }
+  EXPECT_EQ(slots_per_slab, addresses.size());
+  EXPECT_EQ(PageSize(), arena.GetLockedBytes());
+
+  // The next slot of this size class needs a second slab, other size classes
+  // get their own.
+  void* extra = arena.Allocate(64);
+  ASSERT_NE(nullptr, extra);
+  EXPECT_EQ(2 * PageSize(), arena.GetLockedBytes());
+  void* other = arena.Allocate(16);
+  ASSERT_NE(nullptr, other);
+  EXPECT_EQ(3 * PageSize(), arena.GetLockedBytes());
+
+  // Slots are reused once freed.
+  arena.Free(slots[3], 50);
+  EXPECT_EQ(slots[3], arena.Allocate(60));
+  EXPECT_EQ(3 * PageSize(), arena.GetLockedBytes());
+
+  for (void* slot : slots)
+    arena.Free(slot, 64);
+  arena.Free(extra, 64);
+  arena.Free(other, 16);
+  // One empty slab per size class is kept for reuse.
+  EXPECT_EQ(2 * PageSize(), arena.GetLockedBytes());
+  arena.ReleaseFreeSlabs();
+  EXPECT_EQ(0u, arena.GetLockedBytes());
+}
+
+TEST(SecureArenaTest, SecureBlobUsesArena) {
+  SecureArena* arena = SecureArena::GetInstance();
+  arena->ReleaseFreeSlabs();
+  const size_t locked_bytes = arena->GetLockedBytes();
+  {
+    std::vector<SecureBlob> blobs;
+    for (int i = 0; i < 100; ++i)
+      blobs.emplace_back(32, i);
+    // 100 blobs of 32 bytes fit in a page.
+    EXPECT_LE(arena->GetLockedBytes(), locked_bytes + PageSize());
+  }
+}
+
+TEST(SecureArenaTest, Fork) {
+  SecureArena* arena = SecureArena::GetInstance();
+  SecureBlob inherited(32, 'x');
+  void* kept = arena->Allocate(64);
+  ASSERT_NE(nullptr, kept);
+  arena->Free(kept, 64);
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    // Inherited slabs are wiped and unlocked, so they are not reused.
+    if (arena->GetLockedBytes() != 0 || inherited[0] != 0)
+      _exit(1);
+    void* slot = arena->Allocate(32);
+    if (!slot || arena->GetLockedBytes() != PageSize())
+      _exit(2);
+    if (reinterpret_cast<uintptr_t>(slot) / PageSize() ==
+        reinterpret_cast<uintptr_t>(inherited.data()) / PageSize())
+      _exit(3);
+    arena->Free(slot, 32);
+    // Freeing an inherited slot works and unmaps its slab once empty.
+    inherited.clear();
+    inherited.shrink_to_fit();
+    _exit(0);
+  }
+  int status = 0;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+// Reports the cost of creating many small SecureBlobs, as done during login
+// and key derivation. Run with --gtest_also_run_disabled_tests.
+TEST(SecureArenaTest, DISABLED_SmallBlobBenchmark) {
+  const int kLiveBlobs = 1000;
+  const int kIterations = 100;
+  SecureArena* arena = SecureArena::GetInstance();
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  size_t locked_bytes = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    std::vector<SecureBlob> blobs;
+    blobs.reserve(kLiveBlobs);
+    for (int j = 0; j < kLiveBlobs; ++j)
+      blobs.emplace_back(32, j);
+    locked_bytes = arena->GetLockedBytes();
+  }
+  const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  LOG(INFO) << kIterations * kLiveBlobs / elapsed.InSecondsF()
+            << " allocations/s, " << locked_bytes / kLiveBlobs
+            << " locked bytes per live blob";
+}
+
+}  // namespace brillo
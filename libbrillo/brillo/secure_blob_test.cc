@@ -6,6 +6,7 @@
 
 #include "brillo/asan.h"
 #include "brillo/secure_allocator.h"
+#include "brillo/secure_arena.h"
 #include "brillo/secure_blob.h"
 #include <sys/resource.h>
 
@@ -270,8 +271,8 @@ TEST(SecureAllocator, ErasureOnDeallocation) {
 
   // Deallocate memory; the mock class should check for cleared data.
   e.deallocate(test_string_addr, 15);
-  // The deallocation should have traversed the complete page.
-  EXPECT_EQ(e.GetErasedCount(), 4096);
+  // The deallocation should have traversed the complete arena slot.
+  EXPECT_EQ(e.GetErasedCount(), 16);
 }
 
 TEST(SecureAllocator, MultiPageCorrectness) {
@@ -298,13 +299,13 @@ TEST(SecureAllocator, SecureVectorIsClearedOnDestruction) {
     TestSecureVector vector = {{1, 2, 3, 4}};
     EXPECT_EQ(vector.capacity(), 4);
   }
-  // The allocator operates on page size blocks, so even though the vector's
-  // capacity is 4, the actual amount of memory allocated is a page.
-  // On destruction, each vector element is destroyed through
+  // The allocator operates on arena slots of at least 16 bytes, so even
+  // though the vector's capacity is 4, the actual amount of memory allocated
+  // is 16 bytes. On destruction, each vector element is destroyed through
   // SecureAllocator::destroy, which clears the memory. Then the underlying
-  // buffer (page in this case) is deallocated through
+  // buffer (arena slot in this case) is deallocated through
   // SecureAllocator::deallocate, which clears the memory.
-  EXPECT_EQ(allocator.GetErasedCount(), 4 + 4096);
+  EXPECT_EQ(allocator.GetErasedCount(), 4 + 16);
 }
 
 TEST(SecureAllocator, IsAlwaysEqualTrait) {
@@ -331,6 +332,9 @@ class SecureAllocatorMemlockTest : public ::testing::Test {
   SecureAllocatorMemlockTest() {
     struct rlimit limit;
 
+    // Slabs kept for reuse by earlier tests count against the limit.
+    SecureArena::GetInstance()->ReleaseFreeSlabs();
+
     EXPECT_EQ(getrlimit(RLIMIT_MEMLOCK, &limit), 0);
     orig_limit_ = limit;
 
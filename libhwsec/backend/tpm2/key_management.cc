@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <absl/container/flat_hash_set.h>
@@ -37,6 +38,11 @@ namespace hwsec {
 namespace {
 
 constexpr uint32_t kDefaultTpmRsaKeyBits = 2048;
+
+// The number of handles loaded by LoadKey() to keep after their last key is
+// flushed. Unlocking with several auth factors loads the same few blobs back
+// to back.
+constexpr size_t kMaxIdleLoadedBlobs = 4;
 constexpr uint32_t kDefaultTpmPublicExponent = 0x10001;
 constexpr trunks::TPMI_ECC_CURVE kDefaultTpmCurveId = trunks::TPM_ECC_NIST_P256;
 
@@ -163,6 +169,7 @@ KeyManagementTpm2::~KeyManagementTpm2() {
       LOG(WARNING) << "Failed to flush key: " << status;
     }
   }
+  EvictIdleLoadedBlobs(0);
 }
 
 StatusOr<absl::flat_hash_set<KeyAlgoType>>
@@ -537,6 +544,43 @@ StatusOr<KeyManagementTpm2::CreateKeyResult> KeyManagementTpm2::CreateEccKey(
 StatusOr<ScopedKey> KeyManagementTpm2::LoadKey(const OperationPolicy& policy,
                                                const brillo::Blob& key_blob,
                                                AutoReload auto_reload) {
+  KeyTpm2::Type key_type = KeyTpm2::Type::kTransientKey;
+  std::optional<KeyReloadDataTpm2> reload_data;
+  if (auto_reload == AutoReload::kTrue) {
+    key_type = KeyTpm2::Type::kReloadableTransientKey;
+    reload_data = KeyReloadDataTpm2{
+        .key_blob = key_blob,
+    };
+  }
+
+  const std::string blob_digest = BlobToString(Sha256(key_blob));
+  bool cache_handle = true;
+  if (auto it = loaded_blobs_.find(blob_digest); it != loaded_blobs_.end()) {
+    // The handle goes stale if trunksd restarted since it was loaded, and the
+    // restarted trunksd may have given the same handle to another key. Only
+    // reuse it if it still holds the key loaded from |key_blob|.
+    StatusOr<trunks::TPMT_PUBLIC> public_area =
+        GetMatchingPublicArea(it->second);
+    if (public_area.ok()) {
+      ASSIGN_OR_RETURN(ScopedKey key,
+                       AddKey(policy, key_type, it->second.key_handle,
+                              std::move(public_area).value(), reload_data));
+      ++it->second.refcount;
+      key_map_.at(key.GetKey().token).blob_digest = blob_digest;
+      return key;
+    }
+    LOG(WARNING) << "Dropping stale loaded key handle: "
+                 << public_area.err_status();
+    if (it->second.refcount > 0) {
+      // The keys still using the stale handle reload it when they fail; load
+      // this one separately.
+      cache_handle = false;
+    } else {
+      // Don't flush the handle, it may belong to another key by now.
+      loaded_blobs_.erase(it);
+    }
+  }
+
   BackendTpm2::TrunksClientContext& context = backend_.GetTrunksContext();
 
   uint32_t key_handle;
@@ -547,16 +591,24 @@ StatusOr<ScopedKey> KeyManagementTpm2::LoadKey(const OperationPolicy& policy,
                       BlobToString(key_blob), delegate.get(), &key_handle)))
       .WithStatus<TPMError>("Failed to load SRK wrapped key");
 
-  KeyTpm2::Type key_type = KeyTpm2::Type::kTransientKey;
-  std::optional<KeyReloadDataTpm2> reload_data;
-  if (auto_reload == AutoReload::kTrue) {
-    key_type = KeyTpm2::Type::kReloadableTransientKey;
-    reload_data = KeyReloadDataTpm2{
-        .key_blob = key_blob,
-    };
-  }
-
-  return LoadKeyInternal(policy, key_type, key_handle, reload_data);
+  ASSIGN_OR_RETURN(
+      ScopedKey key,
+      LoadKeyInternal(policy, key_type, key_handle, std::move(reload_data)));
+
+  KeyTpm2& key_data = key_map_.at(key.GetKey().token);
+  std::string public_area;
+  if (!cache_handle ||
+      trunks::Serialize_TPMT_PUBLIC(key_data.cache.public_area,
+                                    &public_area) != trunks::TPM_RC_SUCCESS) {
+    return key;
+  }
+  loaded_blobs_[blob_digest] = LoadedBlob{
+      .key_handle = key_handle,
+      .public_area = std::move(public_area),
+      .refcount = 1,
+  };
+  key_data.blob_digest = blob_digest;
+  return key;
 }
 
 StatusOr<ScopedKey> KeyManagementTpm2::GetPersistentKey(
@@ -676,11 +728,21 @@ StatusOr<ScopedKey> KeyManagementTpm2::LoadKeyInternal(
     std::optional<KeyReloadDataTpm2> reload_data) {
   BackendTpm2::TrunksClientContext& context = backend_.GetTrunksContext();
 
-  trunks::TPMT_PUBLIC public_area;
+  trunks::TPMT_PUBLIC public_area = {};
   RETURN_IF_ERROR(MakeStatus<TPM2Error>(context.tpm_utility->GetKeyPublicArea(
                       key_handle, &public_area)))
       .WithStatus<TPMError>("Failed to Get key public area");
 
+  return AddKey(policy, key_type, key_handle, std::move(public_area),
+                std::move(reload_data));
+}
+
+StatusOr<ScopedKey> KeyManagementTpm2::AddKey(
+    const OperationPolicy& policy,
+    KeyTpm2::Type key_type,
+    uint32_t key_handle,
+    trunks::TPMT_PUBLIC public_area,
+    std::optional<KeyReloadDataTpm2> reload_data) {
   KeyToken token = current_token_++;
   key_map_.emplace(token, KeyTpm2{
                               .type = key_type,
@@ -707,6 +769,13 @@ Status KeyManagementTpm2::Flush(Key key) {
 
     case KeyTpm2::Type::kTransientKey:
     case KeyTpm2::Type::kReloadableTransientKey:
+      if (key_data.blob_digest.has_value()) {
+        // The handle may be shared, so leave unloading it to the cache.
+        const std::string blob_digest = *key_data.blob_digest;
+        key_map_.erase(key.token);
+        ReleaseLoadedBlob(blob_digest);
+        return OkStatus();
+      }
       RETURN_IF_ERROR(
           MakeStatus<TPM2Error>(context.factory.GetTpm()->FlushContextSync(
               key_data.key_handle, nullptr)))
@@ -757,10 +826,83 @@ Status KeyManagementTpm2::ReloadIfPossible(Key key) {
                       delegate.get(), &key_handle)))
       .WithStatus<TPMError>("Failed to reload SRK wrapped key");
 
+  if (key_data.blob_digest.has_value()) {
+    // Every key loaded from the same blob shared the stale handle.
+    const std::string& blob_digest = *key_data.blob_digest;
+    for (auto& [token, data] : key_map_) {
+      if (data.blob_digest == blob_digest) {
+        data.key_handle = key_handle;
+      }
+    }
+    if (auto it = loaded_blobs_.find(blob_digest); it != loaded_blobs_.end()) {
+      it->second.key_handle = key_handle;
+    }
+  }
+
   key_data.key_handle = key_handle;
   return OkStatus();
 }
 
+StatusOr<trunks::TPMT_PUBLIC> KeyManagementTpm2::GetMatchingPublicArea(
+    const LoadedBlob& loaded_blob) {
+  BackendTpm2::TrunksClientContext& context = backend_.GetTrunksContext();
+
+  trunks::TPMT_PUBLIC public_area = {};
+  RETURN_IF_ERROR(MakeStatus<TPM2Error>(context.tpm_utility->GetKeyPublicArea(
+                      loaded_blob.key_handle, &public_area)))
+      .WithStatus<TPMError>("Failed to Get key public area");
+
+  std::string serialized;
+  RETURN_IF_ERROR(MakeStatus<TPM2Error>(
+                      trunks::Serialize_TPMT_PUBLIC(public_area, &serialized)))
+      .WithStatus<TPMError>("Failed to serialize key public area");
+  if (serialized != loaded_blob.public_area) {
+    return MakeStatus<TPMError>("Handle holds another key",
+                                TPMRetryAction::kNoRetry);
+  }
+  return public_area;
+}
+
+void KeyManagementTpm2::ReleaseLoadedBlob(const std::string& blob_digest) {
+  auto it = loaded_blobs_.find(blob_digest);
+  if (it == loaded_blobs_.end()) {
+    return;
+  }
+  if (--it->second.refcount > 0) {
+    return;
+  }
+  it->second.last_used = loaded_blob_clock_++;
+  EvictIdleLoadedBlobs(kMaxIdleLoadedBlobs);
+}
+
+void KeyManagementTpm2::EvictIdleLoadedBlobs(size_t max_idle) {
+  BackendTpm2::TrunksClientContext& context = backend_.GetTrunksContext();
+  while (true) {
+    size_t idle_count = 0;
+    auto oldest = loaded_blobs_.end();
+    for (auto it = loaded_blobs_.begin(); it != loaded_blobs_.end(); ++it) {
+      if (it->second.refcount > 0) {
+        continue;
+      }
+      ++idle_count;
+      if (oldest == loaded_blobs_.end() ||
+          it->second.last_used < oldest->second.last_used) {
+        oldest = it;
+      }
+    }
+    if (idle_count <= max_idle) {
+      return;
+    }
+    if (auto status =
+            MakeStatus<TPM2Error>(context.factory.GetTpm()->FlushContextSync(
+                oldest->second.key_handle, nullptr));
+        !status.ok()) {
+      LOG(WARNING) << "Failed to flush idle key handle: " << status;
+    }
+    loaded_blobs_.erase(oldest);
+  }
+}
+
 StatusOr<ScopedKey> KeyManagementTpm2::LoadPublicKeyFromSpki(
     const brillo::Blob& public_key_spki_der,
     trunks::TPM_ALG_ID scheme,
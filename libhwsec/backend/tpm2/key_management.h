@@ -9,6 +9,7 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <string>
 #include <utility>
 
 #include <absl/container/flat_hash_map.h>
@@ -46,6 +47,9 @@ struct KeyTpm2 {
   NoDefault<trunks::TPM_HANDLE> key_handle;
   NoDefault<Cache> cache;
   std::optional<KeyReloadDataTpm2> reload_data;
+  // The digest of the key blob, if |key_handle| is shared with other keys
+  // loaded from the same blob.
+  std::optional<std::string> blob_digest;
 };
 
 class KeyManagementTpm2 : public Backend::KeyManagement,
@@ -118,9 +122,47 @@ class KeyManagementTpm2 : public Backend::KeyManagement,
       uint32_t key_handle,
       std::optional<KeyReloadDataTpm2> reload_data);
 
+  // Same as LoadKeyInternal(), but with the |public_area| of |key_handle|
+  // already read.
+  StatusOr<ScopedKey> AddKey(const OperationPolicy& policy,
+                             KeyTpm2::Type key_type,
+                             uint32_t key_handle,
+                             trunks::TPMT_PUBLIC public_area,
+                             std::optional<KeyReloadDataTpm2> reload_data);
+
+  // Drops a reference to the handle loaded from the blob with |blob_digest|.
+  void ReleaseLoadedBlob(const std::string& blob_digest);
+
+  // Flushes the least recently used unreferenced handles until at most
+  // |max_idle| of them remain loaded.
+  void EvictIdleLoadedBlobs(size_t max_idle);
+
+  // A TPM handle loaded by LoadKey(), shared by all the keys loaded from the
+  // same blob so repeated loads of a blob cost one TPM2_Load. A few handles
+  // are kept loaded after their last key is flushed; trunks' resource manager
+  // swaps them out of the TPM when it needs the room.
+  struct LoadedBlob {
+    uint32_t key_handle = 0;
+    // The serialized public area of the key, to tell whether |key_handle|
+    // still holds it.
+    std::string public_area;
+    // The number of keys in |key_map_| using |key_handle|.
+    int refcount = 0;
+    // Orders unreferenced handles for eviction.
+    uint64_t last_used = 0;
+  };
+
+  // Returns the public area of the handle of |loaded_blob|, or an error if
+  // the handle is stale or now holds another key.
+  StatusOr<trunks::TPMT_PUBLIC> GetMatchingPublicArea(
+      const LoadedBlob& loaded_blob);
+
   KeyToken current_token_ = 0;
   absl::flat_hash_map<KeyToken, KeyTpm2> key_map_;
   absl::flat_hash_map<PersistentKeyType, KeyToken> persistent_key_map_;
+  // Keyed by the SHA-256 digest of the key blob.
+  absl::flat_hash_map<std::string, LoadedBlob> loaded_blobs_;
+  uint64_t loaded_blob_clock_ = 0;
 };
 
 }  // namespace hwsec
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <memory>
+#include <string>
 #include <utility>
 
 #include <cstdint>
@@ -337,6 +338,172 @@ TEST_F(BackendKeyManagementTpm2Test, LoadAutoReloadKey) {
       .WillOnce(Return(trunks::TPM_RC_SUCCESS));
 }
 
+TEST_F(BackendKeyManagementTpm2Test, LoadKeyReusesHandle) {
+  const OperationPolicy kFakePolicy{};
+  const std::string kFakeKeyBlob = "fake_key_blob";
+  const uint32_t kFakeKeyHandle = 0x1337;
+
+  // Loading the same blob again reuses the loaded handle, even after the first
+  // key is gone.
+  EXPECT_CALL(proxy_->GetMock().tpm_utility, LoadKey(kFakeKeyBlob, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(kFakeKeyHandle),
+                      Return(trunks::TPM_RC_SUCCESS)));
+
+  EXPECT_CALL(proxy_->GetMock().tpm_utility,
+              GetKeyPublicArea(kFakeKeyHandle, _))
+      .Times(3)
+      .WillRepeatedly(Return(trunks::TPM_RC_SUCCESS));
+
+  {
+    auto result1 = middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+        kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+        Backend::KeyManagement::AutoReload::kFalse);
+    ASSERT_OK(result1);
+
+    auto result2 = middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+        kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+        Backend::KeyManagement::AutoReload::kTrue);
+    ASSERT_OK(result2);
+    EXPECT_NE(result1->GetKey().token, result2->GetKey().token);
+  }
+
+  auto result3 = middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+      kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+      Backend::KeyManagement::AutoReload::kFalse);
+  ASSERT_OK(result3);
+  EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::GetKeyHandle>(
+                  result3->GetKey()),
+              IsOkAndHolds(kFakeKeyHandle));
+
+  // The handle is flushed once, when the backend goes away.
+  EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFakeKeyHandle, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+}
+
+TEST_F(BackendKeyManagementTpm2Test, LoadKeyStaleHandle) {
+  const OperationPolicy kFakePolicy{};
+  const std::string kFakeKeyBlob = "fake_key_blob";
+  const uint32_t kFakeKeyHandle = 0x1337;
+  const uint32_t kFakeKeyHandle2 = 0x7331;
+
+  EXPECT_CALL(proxy_->GetMock().tpm_utility, LoadKey(kFakeKeyBlob, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(kFakeKeyHandle),
+                      Return(trunks::TPM_RC_SUCCESS)))
+      .WillOnce(DoAll(SetArgPointee<2>(kFakeKeyHandle2),
+                      Return(trunks::TPM_RC_SUCCESS)));
+
+  // The cached handle is no longer valid the second time, so the blob is
+  // loaded again.
+  EXPECT_CALL(proxy_->GetMock().tpm_utility,
+              GetKeyPublicArea(kFakeKeyHandle, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS))
+      .WillOnce(Return(trunks::TPM_RC_HANDLE));
+  EXPECT_CALL(proxy_->GetMock().tpm_utility,
+              GetKeyPublicArea(kFakeKeyHandle2, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+
+  EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+                  kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+                  Backend::KeyManagement::AutoReload::kFalse),
+              IsOk());
+
+  auto result = middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+      kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+      Backend::KeyManagement::AutoReload::kFalse);
+  ASSERT_OK(result);
+  EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::GetKeyHandle>(
+                  result->GetKey()),
+              IsOkAndHolds(kFakeKeyHandle2));
+
+  EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFakeKeyHandle2, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+}
+
+TEST_F(BackendKeyManagementTpm2Test, LoadKeyHandleHoldsAnotherKey) {
+  const OperationPolicy kFakePolicy{};
+  const std::string kFakeKeyBlob = "fake_key_blob";
+  const uint32_t kFakeKeyHandle = 0x1337;
+  const uint32_t kFakeKeyHandle2 = 0x7331;
+  const trunks::TPMT_PUBLIC kOtherPublic = {
+      .type = trunks::TPM_ALG_RSA,
+      .name_alg = trunks::TPM_ALG_SHA256,
+  };
+
+  EXPECT_CALL(proxy_->GetMock().tpm_utility, LoadKey(kFakeKeyBlob, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(kFakeKeyHandle),
+                      Return(trunks::TPM_RC_SUCCESS)))
+      .WillOnce(DoAll(SetArgPointee<2>(kFakeKeyHandle2),
+                      Return(trunks::TPM_RC_SUCCESS)));
+
+  // After a trunksd restart the cached handle is valid but holds another key,
+  // so the blob is loaded again and the other key is left alone.
+  EXPECT_CALL(proxy_->GetMock().tpm_utility,
+              GetKeyPublicArea(kFakeKeyHandle, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS))
+      .WillOnce(DoAll(SetArgPointee<1>(kOtherPublic),
+                      Return(trunks::TPM_RC_SUCCESS)));
+  EXPECT_CALL(proxy_->GetMock().tpm_utility,
+              GetKeyPublicArea(kFakeKeyHandle2, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+
+  EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+                  kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+                  Backend::KeyManagement::AutoReload::kFalse),
+              IsOk());
+
+  auto result = middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+      kFakePolicy, brillo::BlobFromString(kFakeKeyBlob),
+      Backend::KeyManagement::AutoReload::kFalse);
+  ASSERT_OK(result);
+  EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::GetKeyHandle>(
+                  result->GetKey()),
+              IsOkAndHolds(kFakeKeyHandle2));
+
+  EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFakeKeyHandle, _))
+      .Times(0);
+  EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFakeKeyHandle2, _))
+      .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+}
+
+TEST_F(BackendKeyManagementTpm2Test, LoadKeyEvictsIdleHandles) {
+  const OperationPolicy kFakePolicy{};
+  const uint32_t kFirstKeyHandle = 0x1000;
+  const int kNumBlobs = 5;
+
+  for (int i = 0; i < kNumBlobs; ++i) {
+    const std::string key_blob = "fake_key_blob" + std::to_string(i);
+    EXPECT_CALL(proxy_->GetMock().tpm_utility, LoadKey(key_blob, _, _))
+        .WillOnce(DoAll(SetArgPointee<2>(kFirstKeyHandle + i),
+                        Return(trunks::TPM_RC_SUCCESS)));
+    EXPECT_CALL(proxy_->GetMock().tpm_utility,
+                GetKeyPublicArea(kFirstKeyHandle + i, _))
+        .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+  }
+
+  // Only the least recently used idle handle is flushed right away, the rest
+  // when the backend goes away.
+  testing::MockFunction<void()> loads_done;
+  {
+    testing::InSequence sequence;
+    EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFirstKeyHandle, _))
+        .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+    EXPECT_CALL(loads_done, Call());
+  }
+  for (int i = 1; i < kNumBlobs; ++i) {
+    EXPECT_CALL(proxy_->GetMock().tpm, FlushContextSync(kFirstKeyHandle + i, _))
+        .WillOnce(Return(trunks::TPM_RC_SUCCESS));
+  }
+
+  for (int i = 0; i < kNumBlobs; ++i) {
+    const std::string key_blob = "fake_key_blob" + std::to_string(i);
+    EXPECT_THAT(middleware_->CallSync<&Backend::KeyManagement::LoadKey>(
+                    kFakePolicy, brillo::BlobFromString(key_blob),
+                    Backend::KeyManagement::AutoReload::kFalse),
+                IsOk());
+  }
+  loads_done.Call();
+}
+
 TEST_F(BackendKeyManagementTpm2Test, GetPersistentKey) {
   const OperationPolicy kFakePolicy{};
   const std::string kFakeKeyBlob = "fake_key_blob";
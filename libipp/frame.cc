@@ -100,10 +100,10 @@ Frame::Frame(const uint8_t* buffer, size_t size, ParsingResults* result) {
   std::vector<Log> log;
   FrameData frame_data;
   Parser parser(&frame_data, &log);
-  const bool completed1 = parser.ReadFrameFromBuffer(buffer, buffer + size);
-  const bool completed2 = parser.SaveFrameToPackage(false, &package_);
+  const bool completed =
+      parser.ParseFrameFromBuffer(buffer, buffer + size, false, &package_);
   if (result) {
-    result->whole_buffer_was_parsed = completed1 && completed2;
+    result->whole_buffer_was_parsed = completed;
     result->errors.swap(log);
   }
   uint16_t ver = frame_data.major_version_number_;
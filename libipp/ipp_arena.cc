@@ -0,0 +1,57 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ipp_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+
+namespace ipp {
+
+namespace {
+
+// The first block is small, so that parsing a small frame is cheap. The next
+// blocks are twice as large as the previous one, up to the maximum size.
+constexpr size_t kMinBlockSize = 4 * 1024;
+constexpr size_t kMaxBlockSize = 256 * 1024;
+
+}  // namespace
+
+Arena::~Arena() = default;
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(free_begin_);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(free_end_);
+  const uintptr_t aligned = (begin + alignment - 1) & ~(alignment - 1);
+  // The padding may exceed the free space, e.g. after an odd-sized dedicated
+  // block, so check it before computing what is left.
+  if (free_begin_ == nullptr || aligned > end || size > end - aligned) {
+    // Allocations larger than a block get a block of their own. The memory
+    // returned by new[] is aligned to alignof(std::max_align_t).
+    next_block_size_ =
+        std::clamp(next_block_size_ * 2, kMinBlockSize, kMaxBlockSize);
+    const size_t block_size = std::max(size, next_block_size_);
+    blocks_.push_back(std::make_unique<uint8_t[]>(block_size));
+    free_begin_ = blocks_.back().get();
+    free_end_ = free_begin_ + block_size;
+    void* ptr = free_begin_;
+    free_begin_ += size;
+    return ptr;
+  }
+  free_begin_ = reinterpret_cast<uint8_t*>(aligned) + size;
+  return reinterpret_cast<void*>(aligned);
+}
+
+std::string_view Arena::CopyString(std::string_view str) {
+  if (str.empty())
+    return std::string_view();
+  char* ptr = static_cast<char*>(Allocate(str.size(), 1));
+  std::memcpy(ptr, str.data(), str.size());
+  return std::string_view(ptr, str.size());
+}
+
+}  // namespace ipp
@@ -0,0 +1,97 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBIPP_IPP_ARENA_H_
+#define LIBIPP_IPP_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Internal structures used during parsing IPP frames. You probably do not want
+// to use it directly. See ipp.h for information how to use this library.
+
+namespace ipp {
+
+// Monotonic allocator. Memory is carved out of blocks of growing size and is
+// released all at once, when the arena is destroyed. It is used for the
+// numerous small objects created while parsing a frame.
+class Arena {
+ public:
+  Arena() = default;
+  ~Arena();
+
+  // Returns `size` bytes of memory aligned to `alignment`, which must be
+  // a power of two not greater than alignof(std::max_align_t).
+  void* Allocate(size_t size, size_t alignment);
+
+  // Creates a new object of type T in the arena. Its destructor is never
+  // called, so the object must not own memory outside the arena.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Copies `str` to the arena.
+  std::string_view CopyString(std::string_view str);
+
+ private:
+  // Copy/move/assign constructors/operators are forbidden.
+  Arena(const Arena&) = delete;
+  Arena(Arena&&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  Arena& operator=(Arena&&) = delete;
+
+  std::vector<std::unique_ptr<uint8_t[]>> blocks_;
+  // Free space in the last block.
+  uint8_t* free_begin_ = nullptr;
+  uint8_t* free_end_ = nullptr;
+  // Size of the next block.
+  size_t next_block_size_ = 0;
+};
+
+// Allocator for standard containers using an Arena. Memory released by the
+// container is reused only when the arena is destroyed.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other)  // NOLINT(runtime/explicit)
+      : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* ptr, size_t n) {}
+
+  Arena* arena() const { return arena_; }
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+// Vector allocated in an Arena.
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace ipp
+
+#endif  //  LIBIPP_IPP_ARENA_H_
@@ -0,0 +1,69 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ipp_arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+namespace ipp {
+namespace {
+
+TEST(Arena, AlignedAllocations) {
+  Arena arena;
+  uint8_t* last = nullptr;
+  for (size_t i = 0; i < 10000; ++i) {
+    const size_t alignment = size_t(1) << (i % 4);
+    uint8_t* ptr = static_cast<uint8_t*>(arena.Allocate(i % 13 + 1, alignment));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+    EXPECT_NE(ptr, last);
+    std::memset(ptr, 0xab, i % 13 + 1);
+    last = ptr;
+  }
+}
+
+TEST(Arena, LargeAllocations) {
+  Arena arena;
+  const std::string large(1024 * 1024, 'x');
+  std::string_view copy1 = arena.CopyString(large);
+  std::string_view copy2 = arena.CopyString("small");
+  std::string_view copy3 = arena.CopyString(large);
+  EXPECT_EQ(copy1, large);
+  EXPECT_EQ(copy2, "small");
+  EXPECT_EQ(copy3, large);
+  EXPECT_NE(copy1.data(), copy3.data());
+  EXPECT_TRUE(arena.CopyString("").empty());
+}
+
+TEST(Arena, AlignmentPaddingLargerThanFreeSpace) {
+  Arena arena;
+  // The first allocation gets a dedicated block with no free space left, and
+  // its end is not aligned for the next one.
+  uint8_t* odd = static_cast<uint8_t*>(arena.Allocate(5001, 1));
+  ASSERT_NE(odd, nullptr);
+  std::memset(odd, 0xab, 5001);
+  uint64_t* value = static_cast<uint64_t*>(arena.Allocate(8, 8));
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(value) % 8, 0);
+  EXPECT_TRUE(reinterpret_cast<uint8_t*>(value) >= odd + 5001 ||
+              reinterpret_cast<uint8_t*>(value) + 8 <= odd);
+  *value = 0;
+}
+
+TEST(Arena, Vector) {
+  Arena arena;
+  ArenaVector<int> values{ArenaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; ++i)
+    values.push_back(i);
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(values[i], i);
+}
+
+}  // namespace
+}  // namespace ipp
@@ -8,6 +8,7 @@
 #include <cassert>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "frame.h"  // needed for ipp::Code
@@ -421,7 +422,7 @@ bool SaveValueTyped(std::map<AttrName, void*>* values,
       ResizeAttrGetValuePtr<InternalType>(values, name, def, index, false);
   if (internal_ptr == nullptr)
     return false;
-  *internal_ptr = internal_value;
+  *internal_ptr = std::move(internal_value);
   return true;
 }
 
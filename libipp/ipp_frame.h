@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <list>
+#include <string_view>
 #include <vector>
 
 // Internal structures used during parsing & building IPP frames. You probably
@@ -22,6 +23,13 @@ struct TagNameValue {
   std::vector<uint8_t> value;
 };
 
+// The same as TagNameValue, but |name| and |value| point to the parsed buffer.
+struct TagNameValueView {
+  uint8_t tag;
+  std::string_view name;
+  std::string_view value;
+};
+
 // This represents single IPP frame, described in rfc8010.
 struct FrameData {
   // Variables save to/load from a frame's header.
@@ -3,7 +3,10 @@
 // found in the LICENSE file.
 
 #include "libipp/ipp_parser.h"
+
+#include <algorithm>
 #include <set>
+#include <string_view>
 
 #include "libipp/ipp_encoding.h"
 
@@ -75,13 +78,23 @@ std::string ToHexSeq(const uint8_t* begin, const uint8_t* end) {
   return s;
 }
 
+// Returns a view of |size| bytes at |ptr|.
+std::string_view MakeView(const uint8_t* ptr, size_t size) {
+  return std::string_view(reinterpret_cast<const char*>(ptr), size);
+}
+
+// Returns a pointer to the first byte of |buf|.
+const uint8_t* BytesOf(std::string_view buf) {
+  return reinterpret_cast<const uint8_t*>(buf.data());
+}
+
 // Decodes 1-, 2- or 4-bytes integers (two's-complement binary encoding).
 // Returns false if (data.size() != BytesCount) or (out == nullptr).
 template <size_t BytesCount>
-bool LoadInteger(const std::vector<uint8_t>& data, int* out) {
+bool LoadInteger(std::string_view data, int* out) {
   if ((data.size() != BytesCount) || (out == nullptr))
     return false;
-  const uint8_t* ptr = data.data();
+  const uint8_t* ptr = BytesOf(data);
   ParseSignedInteger<BytesCount>(&ptr, out);
   return true;
 }
@@ -89,15 +102,15 @@ bool LoadInteger(const std::vector<uint8_t>& data, int* out) {
 // Reads simple string from buf. The string is truncated if it is longer than
 // |max_length|. |truncated_chars| must not be nullptr and it is set to a count
 // of truncated characters.
-std::string LoadOctetString(const std::vector<uint8_t>& buf,
+std::string LoadOctetString(std::string_view buf,
                             size_t max_length,
                             int* truncated_chars) {
   if (max_length >= buf.size()) {
     *truncated_chars = 0;
-    return std::string(buf.data(), buf.data() + buf.size());
+    return std::string(buf);
   }
   *truncated_chars = buf.size() - max_length;
-  return std::string(buf.data(), buf.data() + max_length);
+  return std::string(buf.substr(0, max_length));
 }
 
 // Reads textWithLanguage/nameWithLanguage (see [rfc8010], section 3.9) from
@@ -105,14 +118,14 @@ std::string LoadOctetString(const std::vector<uint8_t>& buf,
 // If parsed string is longer than |max_length|, it is truncated and true is
 // returned. |truncated_chars| must not be nullptr and is set to a count of
 // truncated characters when the function returns true.
-bool LoadStringWithLanguage(const std::vector<uint8_t>& buf,
+bool LoadStringWithLanguage(std::string_view buf,
                             size_t max_length,
                             ipp::StringWithLanguage* out,
                             int* truncated_chars) {
   // The shortest possible value has 4 bytes: 2 times 2-bytes zero.
   if ((buf.size() < 4) || (out == nullptr))
     return false;
-  const uint8_t* ptr = buf.data();
+  const uint8_t* ptr = BytesOf(buf);
   size_t length;
   if (!ParseUnsignedInteger<2>(&ptr, &length))
     return false;
@@ -138,10 +151,10 @@ bool LoadStringWithLanguage(const std::vector<uint8_t>& buf,
 
 // Reads dateTime (see [rfc8010]) from buf.
 // Fails when binary representation is incorrect or (out == nullptr).
-bool LoadDateTime(const std::vector<uint8_t>& buf, ipp::DateTime* out) {
+bool LoadDateTime(std::string_view buf, ipp::DateTime* out) {
   if ((buf.size() != 11) || (out == nullptr))
     return false;
-  const uint8_t* ptr = buf.data();
+  const uint8_t* ptr = BytesOf(buf);
   return (ParseUnsignedInteger<2>(&ptr, &out->year) &&
           ParseUnsignedInteger<1>(&ptr, &out->month) &&
           ParseUnsignedInteger<1>(&ptr, &out->day) &&
@@ -156,10 +169,10 @@ bool LoadDateTime(const std::vector<uint8_t>& buf, ipp::DateTime* out) {
 
 // Reads resolution (see [rfc8010]) from buf.
 // Fails when binary representation is incorrect or (out == nullptr).
-bool LoadResolution(const std::vector<uint8_t>& buf, ipp::Resolution* out) {
+bool LoadResolution(std::string_view buf, ipp::Resolution* out) {
   if ((buf.size() != 9) || (out == nullptr))
     return false;
-  const uint8_t* ptr = buf.data();
+  const uint8_t* ptr = BytesOf(buf);
   ParseSignedInteger<4>(&ptr, &out->xres);
   ParseSignedInteger<4>(&ptr, &out->yres);
   switch (*ptr) {
@@ -177,25 +190,33 @@ bool LoadResolution(const std::vector<uint8_t>& buf, ipp::Resolution* out) {
 
 // Reads rangeOfInteger (see [rfc8010]) from buf.
 // Fails when binary representation is incorrect or (out == nullptr).
-bool LoadRangeOfInteger(const std::vector<uint8_t>& buf,
-                        ipp::RangeOfInteger* out) {
+bool LoadRangeOfInteger(std::string_view buf, ipp::RangeOfInteger* out) {
   if ((buf.size() != 8) || (out == nullptr))
     return false;
-  const uint8_t* ptr = buf.data();
+  const uint8_t* ptr = BytesOf(buf);
   ParseSignedInteger<4>(&ptr, &out->min_value);
   ParseSignedInteger<4>(&ptr, &out->max_value);
   return true;
 }
 
+// Returns true if |c| is allowed in a name (see 3.2 section of rfc8010).
+bool IsCorrectNameCharacter(uint8_t c) {
+  return (c >= 0x30 && c <= 0x39) || (c >= 0x61 && c <= 0x7a) || (c == '-') ||
+         (c == '_') || (c == '.');
+}
+
 // Reads name as specified in 3.2 section of rfc8010 and stores it in |out|.
 // Returns list of errors (no error codes are repeated). The parameter |out|
 // is always set to obtained name. The resultant name is truncated if too long
 // and incorrect characters are replaced by '_' (underscore). For empty |buf|,
-// an empty string is set in |out|. |out| must not be nullptr.
-std::vector<ErrorCode> LoadName(const std::vector<uint8_t>& buf,
-                                std::string* out) {
+// an empty string is set in |out|. |out| must not be nullptr. Correct names
+// are not copied, |out| points to |buf| then. Otherwise, the fixed name is
+// allocated in |arena|.
+std::vector<ErrorCode> LoadName(std::string_view buf,
+                                Arena* arena,
+                                std::string_view* out) {
   if (buf.empty()) {
-    *out = "";
+    *out = std::string_view();
     return {ErrorCode::kAttributeNameIsEmpty};
   }
   std::vector<ErrorCode> result;
@@ -207,19 +228,15 @@ std::vector<ErrorCode> LoadName(const std::vector<uint8_t>& buf,
     result.push_back(ErrorCode::kAttributeNameIsTooLong);
     length = kMaxLengthOfKeyword;
   }
-  out->resize(length);
-  bool has_incorrect_characters = false;
+  *out = buf.substr(0, length);
+  if (std::all_of(out->begin(), out->end(), IsCorrectNameCharacter))
+    return result;
+  char* name = static_cast<char*>(arena->Allocate(length, 1));
   for (size_t i = 0; i < length; ++i) {
-    uint8_t c = buf[i];
-    if ((c < 0x30 || c > 0x39) && (c < 0x61 || c > 0x7a) && (c != '-') &&
-        (c != '_') && (c != '.')) {
-      c = '_';
-      has_incorrect_characters = true;
-    }
-    (*out)[i] = c;
+    name[i] = IsCorrectNameCharacter(buf[i]) ? buf[i] : '_';
   }
-  if (has_incorrect_characters)
-    result.push_back(ErrorCode::kAttributeNameContainsIncorrectCharacters);
+  *out = std::string_view(name, length);
+  result.push_back(ErrorCode::kAttributeNameContainsIncorrectCharacters);
   return result;
 }
 
@@ -227,8 +244,8 @@ std::vector<ErrorCode> LoadName(const std::vector<uint8_t>& buf,
 // the path while destructor removes it from the path.
 class ContextPathGuard {
  public:
-  ContextPathGuard(std::vector<std::pair<std::string, bool>>* path,
-                   const std::string& name,
+  ContextPathGuard(std::vector<std::pair<std::string_view, bool>>* path,
+                   std::string_view name,
                    bool is_known = true)
       : path_(path) {
     if (!path_->empty() && !path_->back().second)
@@ -242,12 +259,12 @@ class ContextPathGuard {
   ContextPathGuard(ContextPathGuard&&) = delete;
   ContextPathGuard& operator=(const ContextPathGuard&) = delete;
   ContextPathGuard& operator=(ContextPathGuard&&) = delete;
-  std::vector<std::pair<std::string, bool>>* path_;
+  std::vector<std::pair<std::string_view, bool>>* path_;
 };
 
 // Builds nice string with context path.
 std::string PathAsString(
-    const std::vector<std::pair<std::string, bool>>& path) {
+    const std::vector<std::pair<std::string_view, bool>>& path) {
   std::string s;
   for (auto& e : path) {
     if (!s.empty())
@@ -340,7 +357,7 @@ void Parser::LogParserNewElement() {
 
 void Parser::LoadAttrValue(Attribute* attr,
                            size_t index,
-                           const std::vector<uint8_t>& buf,
+                           std::string_view buf,
                            uint8_t tag) {
   const AttrType tag_type = static_cast<AttrType>(tag);
 
@@ -460,9 +477,9 @@ struct RawValue {
   // original tag - verified
   uint8_t tag;
   // original data, empty when (type == collection) - not verified
-  std::vector<uint8_t> data;
-  // (not nullptr) <=> (type == collection)
-  std::unique_ptr<RawCollection> collection;
+  std::string_view data;
+  // (not nullptr) <=> (type == collection), allocated in the arena
+  RawCollection* collection = nullptr;
   // default constructor
   RawValue()
       : state(AttrState::set),
@@ -472,7 +489,7 @@ struct RawValue {
   explicit RawValue(uint8_t tag)
       : state(static_cast<AttrState>(tag)), type(AttrType::integer), tag(tag) {}
   // create as standard value
-  RawValue(AttrType type, uint8_t tag, const std::vector<uint8_t>& data)
+  RawValue(AttrType type, uint8_t tag, std::string_view data)
       : state(AttrState::set), type(type), tag(tag), data(data) {}
   // create as collection
   explicit RawValue(RawCollection* coll)
@@ -482,24 +499,91 @@ struct RawValue {
         collection(coll) {}
 };
 
-struct RawCollection;
-
 // Temporary representation of an attribute parsed from TNVs.
 struct RawAttribute {
-  // verified (non-empty, correct syntax)
-  std::string name;
+  // verified (non-empty, correct syntax), points to the parsed buffer or to
+  // the arena
+  std::string_view name;
   // parsed values (see RawValue)
-  std::vector<RawValue> values;
-  explicit RawAttribute(const std::string& name) : name(name) {}
+  ArenaVector<RawValue> values;
+  RawAttribute(std::string_view name, Arena* arena)
+      : name(name), values(ArenaAllocator<RawValue>(arena)) {}
 };
 
 // Temporary representation of a collection parsed from TNVs.
 struct RawCollection {
   // parsed attributes (may have duplicate names)
-  std::vector<RawAttribute> attributes;
+  ArenaVector<RawAttribute> attributes;
+  explicit RawCollection(Arena* arena)
+      : attributes(ArenaAllocator<RawAttribute>(arena)) {}
+};
+
+// TNVs of an attribute group that have not been parsed yet.
+struct TagNameValueRange {
+  const TagNameValueView* begin;
+  const TagNameValueView* end;
+  bool empty() const { return begin == end; }
+  const TagNameValueView& front() const { return *begin; }
+  void pop_front() { ++begin; }
 };
 
 bool Parser::SaveFrameToPackage(bool log_unknown_values, Package* package) {
+  Arena arena;
+  std::vector<TagNameValueViews> groups;
+  groups.reserve(frame_->groups_content_.size());
+  for (const std::list<TagNameValue>& tnvs : frame_->groups_content_) {
+    groups.emplace_back(ArenaAllocator<TagNameValueView>(&arena));
+    groups.back().reserve(tnvs.size());
+    for (const TagNameValue& tnv : tnvs) {
+      groups.back().push_back({tnv.tag,
+                               MakeView(tnv.name.data(), tnv.name.size()),
+                               MakeView(tnv.value.data(), tnv.value.size())});
+    }
+  }
+  if (!SaveGroupsToPackage(groups, log_unknown_values, &arena, package))
+    return false;
+  package->Data() = frame_->data_;
+  return true;
+}
+
+bool Parser::ReadFrameFromBuffer(const uint8_t* ptr,
+                                 const uint8_t* const buf_end) {
+  Arena arena;
+  std::vector<TagNameValueViews> groups;
+  const bool completed = ReadGroupsFromBuffer(&ptr, buf_end, &arena, &groups);
+  // The buffer may be released before SaveFrameToPackage() is called, the
+  // parsed data is copied to the internal buffer.
+  for (const TagNameValueViews& tnvs : groups) {
+    frame_->groups_content_.emplace_back();
+    for (const TagNameValueView& tnv : tnvs) {
+      frame_->groups_content_.back().push_back(
+          {tnv.tag, std::vector<uint8_t>(tnv.name.begin(), tnv.name.end()),
+           std::vector<uint8_t>(tnv.value.begin(), tnv.value.end())});
+    }
+  }
+  if (completed)
+    frame_->data_.assign(ptr, buf_end);
+  return completed;
+}
+
+bool Parser::ParseFrameFromBuffer(const uint8_t* ptr,
+                                  const uint8_t* const buf_end,
+                                  bool log_unknown_values,
+                                  Package* package) {
+  Arena arena;
+  std::vector<TagNameValueViews> groups;
+  const bool completed = ReadGroupsFromBuffer(&ptr, buf_end, &arena, &groups);
+  if (!SaveGroupsToPackage(groups, log_unknown_values, &arena, package))
+    return false;
+  if (completed)
+    package->Data().assign(ptr, buf_end);
+  return completed;
+}
+
+bool Parser::SaveGroupsToPackage(const std::vector<TagNameValueViews>& groups,
+                                 bool log_unknown_values,
+                                 Arena* arena,
+                                 Package* package) {
   std::set<GroupTag> processed_single_groups;
   for (size_t i = 0; i < frame_->groups_tags_.size(); ++i) {
     GroupTag gn = static_cast<GroupTag>(frame_->groups_tags_[i]);
@@ -532,18 +616,22 @@ bool Parser::SaveFrameToPackage(bool log_unknown_values, Package* package) {
         continue;
       }
     }
-    RawCollection raw_coll;
-    if (!ParseRawGroup(&(frame_->groups_content_[i]), &raw_coll))
+    TagNameValueRange tnvs = {groups[i].data(),
+                              groups[i].data() + groups[i].size()};
+    RawCollection raw_coll(arena);
+    if (!ParseRawGroup(&tnvs, arena, &raw_coll))
       return false;
     if (!DecodeCollection(&raw_coll, coll))
       return false;
   }
-  package->Data() = frame_->data_;
   return true;
 }
 
-bool Parser::ReadFrameFromBuffer(const uint8_t* ptr,
-                                 const uint8_t* const buf_end) {
+bool Parser::ReadGroupsFromBuffer(const uint8_t** ptr2,
+                                  const uint8_t* const buf_end,
+                                  Arena* arena,
+                                  std::vector<TagNameValueViews>* groups) {
+  const uint8_t*& ptr = *ptr2;
   buffer_begin_ = ptr;
   buffer_end_ = buf_end;
   bool error_in_header = true;
@@ -576,9 +664,9 @@ bool Parser::ReadFrameFromBuffer(const uint8_t* ptr,
       return false;
     }
     frame_->groups_tags_.push_back(*ptr);
-    frame_->groups_content_.resize(frame_->groups_tags_.size());
+    groups->emplace_back(ArenaAllocator<TagNameValueView>(arena));
     ++ptr;
-    if (!ReadTNVsFromBuffer(&ptr, buf_end, &(frame_->groups_content_.back())))
+    if (!ReadTNVsFromBuffer(&ptr, buf_end, &groups->back()))
       return false;
     if (ptr >= buf_end) {
       LogScannerError(
@@ -588,8 +676,6 @@ bool Parser::ReadFrameFromBuffer(const uint8_t* ptr,
     }
   }
   ++ptr;
-  frame_->data_.assign(ptr, buf_end);
-  ptr = buf_end;
   return true;
 }
 
@@ -601,10 +687,10 @@ bool Parser::ReadFrameFromBuffer(const uint8_t* ptr,
 // output is saved but parsing occurs as usual.
 bool Parser::ReadTNVsFromBuffer(const uint8_t** ptr2,
                                 const uint8_t* const buf_end,
-                                std::list<TagNameValue>* tnvs) {
+                                TagNameValueViews* tnvs) {
   const uint8_t*& ptr = *ptr2;
   while ((ptr < buf_end) && (*ptr > max_begin_attribute_group_tag)) {
-    TagNameValue tnv;
+    TagNameValueView tnv;
 
     if (buf_end - ptr < 5) {
       LogScannerError(
@@ -629,7 +715,7 @@ bool Parser::ReadTNVsFromBuffer(const uint8_t** ptr2,
           ptr);
       return false;
     }
-    tnv.name.assign(ptr, ptr + length);
+    tnv.name = MakeView(ptr, length);
     ptr += length;
     if (!ParseUnsignedInteger<2>(&ptr, &length)) {
       LogScannerError("value-length is negative", ptr);
@@ -641,10 +727,10 @@ bool Parser::ReadTNVsFromBuffer(const uint8_t** ptr2,
                       ptr);
       return false;
     }
-    tnv.value.assign(ptr, ptr + length);
+    tnv.value = MakeView(ptr, length);
     ptr += length;
     if (tnvs != nullptr)
-      tnvs->push_back(std::move(tnv));
+      tnvs->push_back(tnv);
   }
   return true;
 }
@@ -662,8 +748,9 @@ void Parser::ResetContent() {
 // have level 0. Returns false <=> critical parsing error was spotted.
 // See section 3.5.2 from rfc8010 for details.
 bool Parser::ParseRawValue(int coll_level,
-                           const TagNameValue& tnv,
-                           std::list<TagNameValue>* tnvs,
+                           const TagNameValueView& tnv,
+                           TagNameValueRange* tnvs,
+                           Arena* arena,
                            RawAttribute* attr) {
   // Is it Ouf-Of-Band value ?
   if (tnv.tag >= min_out_of_band_value_tag &&
@@ -690,10 +777,10 @@ bool Parser::ParseRawValue(int coll_level,
     if (!tnv.value.empty())
       LogParserError("Tag-name-value opening a collection has non-empty value",
                      "The field is ignored");
-    std::unique_ptr<RawCollection> coll(new RawCollection);
-    if (!ParseRawCollection(coll_level + 1, tnvs, coll.get()))
+    RawCollection* coll = arena->New<RawCollection>(arena);
+    if (!ParseRawCollection(coll_level + 1, tnvs, arena, coll))
       return false;
-    attr->values.emplace_back(coll.release());
+    attr->values.emplace_back(coll);
     return true;
   }
   // Is is a standard attribute type ?
@@ -722,7 +809,8 @@ bool Parser::ParseRawValue(int coll_level,
 // have level 1. Both |tnvs| and |coll| cannot be nullptr.
 // Returns false <=> critical parsing error was spotted.
 bool Parser::ParseRawCollection(int coll_level,
-                                std::list<TagNameValue>* tnvs,
+                                TagNameValueRange* tnvs,
+                                Arena* arena,
                                 RawCollection* coll) {
   if (coll_level > kMaxCollectionLevel) {
     LogParserError(
@@ -738,7 +826,7 @@ bool Parser::ParseRawCollection(int coll_level,
           "endCollection tag (0x37) was expected");
       return false;
     }
-    TagNameValue tnv = tnvs->front();
+    TagNameValueView tnv = tnvs->front();
     tnvs->pop_front();
     // exit if the end of the collection was reached
     if (tnv.tag == endCollection_value_tag) {
@@ -762,13 +850,13 @@ bool Parser::ParseRawCollection(int coll_level,
       LogParserError(
           "Tag-name-value opening member attribute has non-empty name",
           "The field is ignored");
-    std::string name;
-    for (ErrorCode error_code : LoadName(tnv.value, &name)) {
+    std::string_view name;
+    for (ErrorCode error_code : LoadName(tnv.value, arena, &name)) {
       LogParserError(error_code);
       if (error_code == ErrorCode::kAttributeNameIsEmpty)
         return false;
     }
-    coll->attributes.emplace_back(name);
+    coll->attributes.emplace_back(name, arena);
     RawAttribute* attr = &coll->attributes.back();
     ContextPathGuard path_update(&parser_context_, name);
     // parse tag
@@ -787,7 +875,7 @@ bool Parser::ParseRawCollection(int coll_level,
         LogParserError(
             "Tag-name-value opening member attribute has non-empty name",
             "The field is ignored");
-      if (!ParseRawValue(coll_level, tnv, tnvs, attr))
+      if (!ParseRawValue(coll_level, tnv, tnvs, arena, attr))
         return false;
     }
   }
@@ -796,24 +884,26 @@ bool Parser::ParseRawCollection(int coll_level,
 // Parses attributes group from given TNVs and saves it to |coll|. Both |tnvs|
 // and |coll| cannot be nullptr. Returns false <=> critical parsing error was
 // spotted.
-bool Parser::ParseRawGroup(std::list<TagNameValue>* tnvs, RawCollection* coll) {
+bool Parser::ParseRawGroup(TagNameValueRange* tnvs,
+                           Arena* arena,
+                           RawCollection* coll) {
   while (!tnvs->empty()) {
-    TagNameValue tnv = tnvs->front();
+    TagNameValueView tnv = tnvs->front();
     tnvs->pop_front();
     // parse name & create attribute
-    std::string name;
-    for (ErrorCode error_code : LoadName(tnv.name, &name)) {
+    std::string_view name;
+    for (ErrorCode error_code : LoadName(tnv.name, arena, &name)) {
       LogParserError(error_code);
       if (error_code == ErrorCode::kAttributeNameIsEmpty)
         return false;
     }
-    coll->attributes.emplace_back(name);
+    coll->attributes.emplace_back(name, arena);
     RawAttribute* attr = &coll->attributes.back();
     ContextPathGuard path_update(&parser_context_, name);
     // parse all values
     while (true) {
       // parse value
-      if (!ParseRawValue(0 /*collection level*/, tnv, tnvs, attr))
+      if (!ParseRawValue(0 /*collection level*/, tnv, tnvs, arena, attr))
         return false;
       // go to the next value or attribute
       if (tnvs->empty() || !tnvs->front().name.empty())
@@ -838,16 +928,12 @@ size_t RemoveIncompatibleValues(const ipp::AttrType type, RawAttribute* attr) {
     return incorrect_values;
   }
   // Not Out-Of-Band value. Filter out incorrect values.
-  std::vector<RawValue> new_values;
-  new_values.reserve(attr->values.size());
-  for (RawValue& val : attr->values) {
-    if (val.state == AttrState::set && IsConvertibleTo(val.type, type)) {
-      new_values.emplace_back(std::move(val));
-    } else {
-      ++incorrect_values;
-    }
-  }
-  attr->values = std::move(new_values);
+  auto correct_values_end = std::remove_if(
+      attr->values.begin(), attr->values.end(), [type](const RawValue& val) {
+        return val.state != AttrState::set || !IsConvertibleTo(val.type, type);
+      });
+  incorrect_values = attr->values.end() - correct_values_end;
+  attr->values.erase(correct_values_end, attr->values.end());
   return incorrect_values;
 }
 
@@ -857,7 +943,8 @@ size_t RemoveIncompatibleValues(const ipp::AttrType type, RawAttribute* attr) {
 bool Parser::DecodeCollection(RawCollection* raw_coll, Collection* coll) {
   for (RawAttribute& raw_attr : raw_coll->attributes) {
     // Tries to match the attribute to existing one by name.
-    Attribute* attr = coll->GetAttribute(raw_attr.name);
+    const std::string name(raw_attr.name);
+    Attribute* attr = coll->GetAttribute(name);
     ContextPathGuard path_update(&parser_context_, raw_attr.name,
                                  attr != nullptr);
     // Tries to detect a type.
@@ -894,7 +981,7 @@ bool Parser::DecodeCollection(RawCollection* raw_coll, Collection* coll) {
     }
     // Register UnknownAtribute if it was not found.
     if (attr == nullptr) {
-      attr = coll->AddUnknownAttribute(raw_attr.name, true, detectedType);
+      attr = coll->AddUnknownAttribute(name, true, detectedType);
       if (attr == nullptr) {
         LogParserError("Internal parser error: cannot create unknown attribute",
                        "The attribute was ignored");
@@ -916,7 +1003,7 @@ bool Parser::DecodeCollection(RawCollection* raw_coll, Collection* coll) {
     attr->Resize(raw_attr.values.size());
     for (size_t i = 0; i < attr->GetSize(); ++i)
       if (attr->GetType() == AttrType::collection) {
-        if (!DecodeCollection(raw_attr.values[i].collection.get(),
+        if (!DecodeCollection(raw_attr.values[i].collection,
                               attr->GetCollection(i)))
           return false;
       } else {
@@ -6,12 +6,13 @@
 #define LIBIPP_IPP_PARSER_H_
 
 #include <cstdint>
-#include <list>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "ipp_arena.h"
 #include "ipp_attribute.h"
 #include "ipp_base.h"
 #include "ipp_frame.h"
@@ -23,6 +24,10 @@ class Collection;
 class Package;
 struct RawAttribute;
 struct RawCollection;
+struct TagNameValueRange;
+
+// Tag-name-values of a single attribute group.
+using TagNameValueViews = ArenaVector<TagNameValueView>;
 
 enum ErrorCode {
   kAttributeNameIsEmpty,
@@ -47,6 +52,16 @@ class Parser {
   // are reported to the log.
   bool SaveFrameToPackage(bool log_unknown_values, Package* package);
 
+  // Does the same as ReadFrameFromBuffer() followed by SaveFrameToPackage(),
+  // but the parsed data is not saved to the internal buffer. Only the header
+  // of the frame is saved there. The intermediate form of parsed data points
+  // to the given buffer and is allocated from a single arena, so parsing large
+  // frames requires much less allocations.
+  bool ParseFrameFromBuffer(const uint8_t* ptr,
+                            const uint8_t* const buf_end,
+                            bool log_unknown_values,
+                            Package* package);
+
   // Resets the state of the object to initial state. It does not modify
   // objects provided in the constructor (|frame| and |log|).
   void ResetContent();
@@ -67,27 +82,46 @@ class Parser {
   void LogParserWarning(const std::string& message);
   void LogParserNewElement();
 
+  // Reads the header of the frame to the internal buffer and the attribute
+  // groups to |groups|. The tags of the groups are saved to the internal
+  // buffer. On success, |ptr| is set to the beginning of the payload.
+  bool ReadGroupsFromBuffer(const uint8_t** ptr,
+                            const uint8_t* const buf_end,
+                            Arena* arena,
+                            std::vector<TagNameValueViews>* groups);
+
   // Reads single tag_name_value from the buffer (ptr is updated) and append it
   // to the parameter. Returns false <=> error occurred.
   bool ReadTNVsFromBuffer(const uint8_t** ptr,
                           const uint8_t* const end_buf,
-                          std::list<TagNameValue>*);
+                          TagNameValueViews*);
+
+  // Interprets |groups| read by ReadGroupsFromBuffer() and store them in
+  // |package|.
+  bool SaveGroupsToPackage(const std::vector<TagNameValueViews>& groups,
+                           bool log_unknown_values,
+                           Arena* arena,
+                           Package* package);
 
   // Parser helpers.
   bool ParseRawValue(int coll_level,
-                     const TagNameValue& tnv,
-                     std::list<TagNameValue>* data_chunks,
+                     const TagNameValueView& tnv,
+                     TagNameValueRange* data_chunks,
+                     Arena* arena,
                      RawAttribute* attr);
   bool ParseRawCollection(int coll_level,
-                          std::list<TagNameValue>* data_chunks,
+                          TagNameValueRange* data_chunks,
+                          Arena* arena,
                           RawCollection* coll);
-  bool ParseRawGroup(std::list<TagNameValue>* data_chunks, RawCollection* coll);
+  bool ParseRawGroup(TagNameValueRange* data_chunks,
+                     Arena* arena,
+                     RawCollection* coll);
   bool DecodeCollection(RawCollection* raw, Collection* coll);
 
   // Helper for parsing individual values.
   void LoadAttrValue(Attribute* attr,
                      size_t index,
-                     const std::vector<uint8_t>& buf,
+                     std::string_view buf,
                      uint8_t tag);
 
   // Internal buffer.
@@ -105,7 +139,7 @@ class Parser {
   // set to true then notices about direct offspring unknown attributes are
   // added to the log with LogParserNewElement(...) method. When false, this
   // method has no effect for offspring attributes.
-  std::vector<std::pair<std::string, bool>> parser_context_;
+  std::vector<std::pair<std::string_view, bool>> parser_context_;
 };
 
 }  // namespace ipp
@@ -0,0 +1,134 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ipp_parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "frame.h"
+
+namespace ipp {
+namespace {
+
+// Builds a Get-Printer-Attributes response of a large office printer, with
+// `media_count` entries in media-col-database.
+std::vector<uint8_t> CreatePrinterAttributes(size_t media_count) {
+  Frame frame(Status::successful_ok);
+  Collection* grp;
+  EXPECT_EQ(frame.AddGroup(GroupTag::printer_attributes, &grp), Code::kOK);
+  grp->AddAttr("printer-make-and-model", ValueTag::textWithoutLanguage,
+               "Example Office Printer 9000 Series");
+  const std::vector<std::string> uris = {
+      "ipp://printer.example.com/ipp/print",
+      "ipps://printer.example.com/ipp/print"};
+  grp->AddAttr("printer-uri-supported", ValueTag::uri, uris);
+  std::vector<std::string> media;
+  for (size_t i = 0; i < media_count; ++i) {
+    media.push_back("custom_media-" + std::to_string(i) + "_210x297mm");
+  }
+  grp->AddAttr("media-supported", ValueTag::keyword, media);
+  std::vector<Collection*> media_cols(media_count);
+  EXPECT_EQ(grp->AddAttr("media-col-database", media_cols), Code::kOK);
+  for (size_t i = 0; i < media_count; ++i) {
+    Collection* media_size;
+    media_cols[i]->AddAttr("media-size", media_size);
+    media_size->AddAttr("x-dimension", static_cast<int32_t>(21000 + i));
+    media_size->AddAttr("y-dimension", static_cast<int32_t>(29700 + i));
+    media_cols[i]->AddAttr("media-source", ValueTag::keyword,
+                           i % 2 ? "main-roll" : "alternate-roll");
+    media_cols[i]->AddAttr("media-type", ValueTag::keyword,
+                           "stationery-heavyweight");
+    media_cols[i]->AddAttr("media-top-margin", 300);
+    media_cols[i]->AddAttr("media-bottom-margin", 300);
+    media_cols[i]->AddAttr("media-left-margin", 300);
+    media_cols[i]->AddAttr("media-right-margin", 300);
+  }
+  return frame.SaveToBuffer();
+}
+
+TEST(Parser, LargePrinterAttributes) {
+  const std::vector<uint8_t> buffer = CreatePrinterAttributes(100);
+  ParsingResults log;
+  Frame frame(buffer.data(), buffer.size(), &log);
+  EXPECT_TRUE(log.whole_buffer_was_parsed);
+  EXPECT_TRUE(log.errors.empty());
+  EXPECT_EQ(frame.SaveToBuffer(), buffer);
+  const Collection* grp = frame.GetGroup(GroupTag::printer_attributes);
+  ASSERT_NE(grp, nullptr);
+  const Attribute* media_cols = grp->GetAttribute("media-col-database");
+  ASSERT_NE(media_cols, nullptr);
+  ASSERT_EQ(media_cols->Size(), 100);
+  const Attribute* media_type =
+      media_cols->GetCollection(99)->GetAttribute("media-type");
+  ASSERT_NE(media_type, nullptr);
+  std::string value;
+  EXPECT_TRUE(media_type->GetValue(&value));
+  EXPECT_EQ(value, "stationery-heavyweight");
+}
+
+TEST(Parser, BrokenNamesAreFixed) {
+  // Names with incorrect characters and too long names are not views of the
+  // parsed buffer, they are fixed by the parser.
+  Frame request(Operation::Print_Job);
+  Collection* grp = request.GetGroup(GroupTag::operation_attributes);
+  grp->AddAttr("job-name", ValueTag::nameWithoutLanguage, "test");
+  std::vector<uint8_t> buffer = request.SaveToBuffer();
+  const std::string name = "job-name";
+  auto it = std::search(buffer.begin(), buffer.end(), name.begin(), name.end());
+  ASSERT_NE(it, buffer.end());
+  it[3] = '#';
+  ParsingResults log;
+  Frame frame(buffer.data(), buffer.size(), &log);
+  EXPECT_TRUE(log.whole_buffer_was_parsed);
+  EXPECT_FALSE(log.errors.empty());
+  grp = frame.GetGroup(GroupTag::operation_attributes);
+  ASSERT_NE(grp, nullptr);
+  EXPECT_EQ(grp->GetAttribute("job-name"), nullptr);
+  EXPECT_NE(grp->GetAttribute("job_name"), nullptr);
+}
+
+// Prints the time needed to parse a large Get-Printer-Attributes response. If
+// the environment variable LIBIPP_BENCHMARK_FRAMES points to a directory,
+// every file in it is parsed too, e.g. responses of real printers from the
+// fuzzer corpus.
+// Run with --gtest_also_run_disabled_tests.
+TEST(Parser, DISABLED_Benchmark) {
+  constexpr int kIterations = 20;
+  std::vector<std::pair<std::string, std::vector<uint8_t>>> frames;
+  frames.emplace_back("media-col-database x 2000",
+                      CreatePrinterAttributes(2000));
+  if (const char* dir = std::getenv("LIBIPP_BENCHMARK_FRAMES")) {
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+      std::ifstream file(entry.path(), std::ios::binary);
+      frames.emplace_back(entry.path().filename(),
+                          std::vector<uint8_t>(std::istreambuf_iterator(file),
+                                               {}));
+    }
+  }
+  for (const auto& [name, buffer] : frames) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      Frame frame(buffer.data(), buffer.size());
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << name << " (" << buffer.size()
+              << " bytes): " << elapsed.count() / kIterations
+              << " us per frame" << std::endl;
+  }
+}
+
+}  // namespace
+}  // namespace ipp
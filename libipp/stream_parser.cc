@@ -0,0 +1,104 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "stream_parser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ipp_encoding.h"
+
+namespace ipp {
+
+namespace {
+
+// The header of the frame consists of 2-bytes version-number, 2-bytes
+// operation-id (or status-code) and 4-bytes request-id.
+constexpr size_t kHeaderSize = 8;
+
+}  // namespace
+
+StreamParser::StreamParser(FrameCallback on_frame, DataCallback on_data)
+    : on_frame_(std::move(on_frame)), on_data_(std::move(on_data)) {}
+
+StreamParser::~StreamParser() = default;
+
+bool StreamParser::Push(const uint8_t* data, size_t size) {
+  if (state_ == State::kFailed)
+    return false;
+  if (state_ == State::kPayload) {
+    payload_size_ += size;
+    if (on_data_ && size > 0)
+      on_data_(data, size);
+    return true;
+  }
+
+  // Only the bytes that may belong to the attribute groups are buffered.
+  const size_t old_size = buffer_.size();
+  buffer_.insert(buffer_.end(), data,
+                 data + std::min(size, kMaxAttributesSize - old_size));
+  if (!ScanAttributes() ||
+      (attributes_end_ == 0 && buffer_.size() >= kMaxAttributesSize)) {
+    state_ = State::kFailed;
+    std::vector<uint8_t>().swap(buffer_);
+    return false;
+  }
+  if (attributes_end_ == 0)
+    return true;
+
+  ParsingResults results;
+  auto frame =
+      std::make_unique<Frame>(buffer_.data(), attributes_end_, &results);
+  std::vector<uint8_t>().swap(buffer_);
+  state_ = State::kPayload;
+  on_frame_(std::move(frame), results);
+  // The rest of `data` is the beginning of the payload.
+  const size_t used = attributes_end_ - old_size;
+  return Push(data + used, size - used);
+}
+
+bool StreamParser::ScanAttributes() {
+  if (scan_position_ == 0) {
+    if (buffer_.size() < kHeaderSize)
+      return true;
+    scan_position_ = kHeaderSize;
+  }
+  const uint8_t* const begin = buffer_.data();
+  const uint8_t* const end = begin + buffer_.size();
+  const uint8_t* ptr = begin + scan_position_;
+  while (ptr < end) {
+    if (*ptr == end_of_attributes_tag) {
+      attributes_end_ = ptr + 1 - begin;
+      return true;
+    }
+    if (*ptr <= max_begin_attribute_group_tag) {
+      ++ptr;
+    } else {
+      // The tag-name-value consists of 1-byte tag, 2-bytes name-length, name,
+      // 2-bytes value-length and value. It is skipped only when it was
+      // received completely.
+      const uint8_t* field = ptr + 1;
+      int length = 0;
+      if (end - field < 2)
+        return true;
+      if (!ParseUnsignedInteger<2>(&field, &length))
+        return false;
+      if (end - field < length + 2)
+        return true;
+      field += length;
+      if (!ParseUnsignedInteger<2>(&field, &length))
+        return false;
+      if (end - field < length)
+        return true;
+      ptr = field + length;
+    }
+    scan_position_ = ptr - begin;
+  }
+  return true;
+}
+
+}  // namespace ipp
@@ -0,0 +1,87 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBIPP_STREAM_PARSER_H_
+#define LIBIPP_STREAM_PARSER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "frame.h"
+#include "ipp_export.h"
+
+namespace ipp {
+
+// This class parses an IPP frame that is received in pieces, e.g. as the body
+// of a HTTP request. Only the header and the attribute groups of the frame
+// are buffered. They are parsed as soon as the end-of-attributes-tag is
+// received and the payload (e.g. document to print) is passed through as it
+// arrives, without being copied. This way the attributes of a large print job
+// are available long before the whole job is received.
+class IPP_EXPORT StreamParser {
+ public:
+  // Maximum size of the header and the attribute groups of the frame. The
+  // parsing fails if there is no end-of-attributes-tag in the first
+  // kMaxAttributesSize bytes of the frame.
+  static constexpr size_t kMaxAttributesSize = 8 * 1024 * 1024;
+
+  // It is called once, when the header and all attribute groups of the frame
+  // were pushed. `frame` contains them but has no payload. `results` contains
+  // the errors detected by the parser, like for the constructor
+  // Frame(buffer, size, log).
+  using FrameCallback = std::function<void(std::unique_ptr<Frame> frame,
+                                           const ParsingResults& results)>;
+  // It is called with every piece of the payload, after the FrameCallback.
+  // `data` is valid only during the call. It may be empty if the payload is
+  // not needed.
+  using DataCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+  // Constructor. The callbacks must not destroy the parser.
+  StreamParser(FrameCallback on_frame, DataCallback on_data);
+
+  // Not copyable.
+  StreamParser(const StreamParser&) = delete;
+  StreamParser& operator=(const StreamParser&) = delete;
+
+  ~StreamParser();
+
+  // Push the next `size` bytes of the frame. Returns false when the end of
+  // the attribute groups cannot be found, i.e. a tag-name-value has a
+  // negative length or the attribute groups are longer than
+  // kMaxAttributesSize. All data pushed after an error is ignored.
+  bool Push(const uint8_t* data, size_t size);
+
+  // Return true after the FrameCallback was called.
+  bool HasFrame() const { return state_ == State::kPayload; }
+  // Return true if the frame is malformed, see Push().
+  bool HasFailed() const { return state_ == State::kFailed; }
+  // Return the number of bytes of the payload passed to the DataCallback.
+  size_t PayloadSize() const { return payload_size_; }
+
+ private:
+  enum class State { kAttributes, kPayload, kFailed };
+
+  // Scans `buffer_` from `scan_position_` for the end-of-attributes-tag.
+  // Returns false if the frame is malformed. Otherwise, sets `attributes_end_`
+  // to the position right after the tag if it was found.
+  bool ScanAttributes();
+
+  FrameCallback on_frame_;
+  DataCallback on_data_;
+  State state_ = State::kAttributes;
+  // The header and the attribute groups received so far.
+  std::vector<uint8_t> buffer_;
+  // The position of the next tag to scan in `buffer_`.
+  size_t scan_position_ = 0;
+  // The size of the header and the attribute groups, 0 until it is known.
+  size_t attributes_end_ = 0;
+  size_t payload_size_ = 0;
+};
+
+}  // namespace ipp
+
+#endif  //  LIBIPP_STREAM_PARSER_H_
@@ -0,0 +1,230 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "stream_parser.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "frame.h"
+
+namespace ipp {
+namespace {
+
+// Builds a Print-Job request with the given payload.
+std::unique_ptr<Frame> CreatePrintJob(std::vector<uint8_t> payload) {
+  auto frame = std::make_unique<Frame>(Operation::Print_Job);
+  Collection* grp = frame->GetGroup(GroupTag::operation_attributes);
+  grp->AddAttr("printer-uri", ValueTag::uri,
+               "ipp://printer.example.com/ipp/print/pinetree");
+  grp->AddAttr("job-name", ValueTag::nameWithoutLanguage, "foobar");
+  EXPECT_EQ(frame->AddGroup(GroupTag::job_attributes, &grp), Code::kOK);
+  grp->AddAttr("copies", 20);
+  grp->AddAttr("sides", ValueTag::keyword, "two-sided-long-edge");
+  EXPECT_EQ(frame->SetData(std::move(payload)), Code::kOK);
+  return frame;
+}
+
+std::vector<uint8_t> CreatePayload(size_t size) {
+  std::vector<uint8_t> payload(size);
+  for (size_t i = 0; i < size; ++i) {
+    payload[i] = static_cast<uint8_t>(i * 7);
+  }
+  return payload;
+}
+
+// Collects the output of StreamParser.
+struct Receiver {
+  std::unique_ptr<Frame> frame;
+  ParsingResults results;
+  std::vector<uint8_t> payload;
+  // The size of the payload when the frame was received.
+  size_t payload_size_at_frame = 0;
+
+  StreamParser CreateParser() {
+    return StreamParser(
+        [this](std::unique_ptr<Frame> f, const ParsingResults& r) {
+          frame = std::move(f);
+          results = r;
+          payload_size_at_frame = payload.size();
+        },
+        [this](const uint8_t* data, size_t size) {
+          payload.insert(payload.end(), data, data + size);
+        });
+  }
+};
+
+// Returns the binary representation of `frame` without the payload.
+std::vector<uint8_t> SaveAttributes(const Frame& frame) {
+  std::vector<uint8_t> bytes = frame.SaveToBuffer();
+  bytes.resize(bytes.size() - frame.Data().size());
+  return bytes;
+}
+
+TEST(StreamParser, Chunks) {
+  const std::unique_ptr<Frame> request = CreatePrintJob(CreatePayload(10000));
+  const std::vector<uint8_t> bytes = request->SaveToBuffer();
+  for (size_t chunk_size : {1, 7, 64, 4096, 100000}) {
+    Receiver receiver;
+    StreamParser parser = receiver.CreateParser();
+    for (size_t i = 0; i < bytes.size(); i += chunk_size) {
+      ASSERT_TRUE(parser.Push(bytes.data() + i,
+                              std::min(chunk_size, bytes.size() - i)));
+    }
+    EXPECT_TRUE(parser.HasFrame());
+    EXPECT_FALSE(parser.HasFailed());
+    ASSERT_NE(receiver.frame, nullptr);
+    EXPECT_TRUE(receiver.results.whole_buffer_was_parsed);
+    EXPECT_TRUE(receiver.results.errors.empty());
+    EXPECT_EQ(receiver.payload_size_at_frame, 0);
+    EXPECT_TRUE(receiver.frame->Data().empty());
+    EXPECT_EQ(SaveAttributes(*receiver.frame), SaveAttributes(*request));
+    EXPECT_EQ(receiver.payload, request->Data());
+    EXPECT_EQ(parser.PayloadSize(), request->Data().size());
+  }
+}
+
+TEST(StreamParser, FrameBeforePayload) {
+  const std::unique_ptr<Frame> request = CreatePrintJob(CreatePayload(100));
+  const std::vector<uint8_t> attributes = SaveAttributes(*request);
+  Receiver receiver;
+  StreamParser parser = receiver.CreateParser();
+  EXPECT_TRUE(parser.Push(attributes.data(), attributes.size() - 1));
+  EXPECT_FALSE(parser.HasFrame());
+  EXPECT_TRUE(parser.Push(attributes.data() + attributes.size() - 1, 1));
+  EXPECT_TRUE(parser.HasFrame());
+  ASSERT_NE(receiver.frame, nullptr);
+  EXPECT_EQ(receiver.frame->OperationId(), Operation::Print_Job);
+  EXPECT_TRUE(receiver.payload.empty());
+  EXPECT_TRUE(parser.Push(request->Data().data(), request->Data().size()));
+  EXPECT_EQ(receiver.payload, request->Data());
+}
+
+TEST(StreamParser, WithoutDataCallback) {
+  const std::unique_ptr<Frame> request = CreatePrintJob(CreatePayload(100));
+  const std::vector<uint8_t> bytes = request->SaveToBuffer();
+  std::unique_ptr<Frame> frame;
+  StreamParser parser(
+      [&frame](std::unique_ptr<Frame> f, const ParsingResults&) {
+        frame = std::move(f);
+      },
+      StreamParser::DataCallback());
+  EXPECT_TRUE(parser.Push(bytes.data(), bytes.size()));
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(SaveAttributes(*frame), SaveAttributes(*request));
+  EXPECT_EQ(parser.PayloadSize(), request->Data().size());
+}
+
+TEST(StreamParser, NegativeLength) {
+  // Header, operation-attributes-tag and a tag-name-value with name-length
+  // equal 0x8000.
+  const std::vector<uint8_t> bytes = {0x01, 0x01, 0x00, 0x02, 0x00, 0x00,
+                                      0x00, 0x01, 0x01, 0x45, 0x80, 0x00};
+  Receiver receiver;
+  StreamParser parser = receiver.CreateParser();
+  EXPECT_FALSE(parser.Push(bytes.data(), bytes.size()));
+  EXPECT_TRUE(parser.HasFailed());
+  EXPECT_FALSE(parser.Push(bytes.data(), bytes.size()));
+  EXPECT_EQ(receiver.frame, nullptr);
+}
+
+TEST(StreamParser, AttributesTooLong) {
+  // Header, operation-attributes-tag and tag-name-values with 30000-bytes
+  // values, without end-of-attributes-tag.
+  std::vector<uint8_t> bytes = {0x01, 0x01, 0x00, 0x02, 0x00,
+                                0x00, 0x00, 0x01, 0x01};
+  const std::vector<uint8_t> tnv_header = {0x41, 0x00, 0x01, 'a', 0x75, 0x30};
+  Receiver receiver;
+  StreamParser parser = receiver.CreateParser();
+  ASSERT_TRUE(parser.Push(bytes.data(), bytes.size()));
+  bytes = tnv_header;
+  bytes.resize(tnv_header.size() + 30000, 'x');
+  size_t pushed = 9;
+  while (parser.Push(bytes.data(), bytes.size())) {
+    pushed += bytes.size();
+    ASSERT_LT(pushed, StreamParser::kMaxAttributesSize);
+  }
+  EXPECT_TRUE(parser.HasFailed());
+  EXPECT_EQ(receiver.frame, nullptr);
+}
+
+TEST(StreamParser, MalformedHeader) {
+  // The version number is out of range. The frame is reported with the
+  // errors, like by the constructor Frame(buffer, size, log).
+  const std::vector<uint8_t> bytes = {0x81, 0x01, 0x00, 0x02, 0x00,
+                                      0x00, 0x00, 0x01, 0x03, 'x'};
+  Receiver receiver;
+  StreamParser parser = receiver.CreateParser();
+  EXPECT_TRUE(parser.Push(bytes.data(), bytes.size()));
+  ASSERT_NE(receiver.frame, nullptr);
+  EXPECT_FALSE(receiver.results.whole_buffer_was_parsed);
+  EXPECT_FALSE(receiver.results.errors.empty());
+  EXPECT_EQ(receiver.payload, std::vector<uint8_t>({'x'}));
+}
+
+long MaxRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Compares the time to the attributes of a 200MB print job received in 64KB
+// pieces, and the peak memory used while receiving it, between buffering the
+// whole frame for Frame(buffer, size) and StreamParser. The streaming case
+// runs first, since the peak memory of a process never decreases.
+// Run with --gtest_also_run_disabled_tests.
+TEST(StreamParser, DISABLED_Benchmark) {
+  constexpr size_t kChunkSize = 64 * 1024;
+  // The payload is appended directly, so that the frame is never copied.
+  std::vector<uint8_t> bytes = CreatePrintJob({})->SaveToBuffer();
+  bytes.resize(bytes.size() + 200 * 1024 * 1024, 'x');
+  using Clock = std::chrono::steady_clock;
+  auto to_ms = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  };
+
+  long rss_before = MaxRssKb();
+  Clock::time_point start = Clock::now();
+  Clock::duration time_to_frame;
+  size_t checksum = 0;
+  StreamParser parser(
+      [&](std::unique_ptr<Frame>, const ParsingResults&) {
+        time_to_frame = Clock::now() - start;
+      },
+      [&checksum](const uint8_t* data, size_t size) {
+        checksum += data[size - 1];
+      });
+  for (size_t i = 0; i < bytes.size(); i += kChunkSize) {
+    parser.Push(bytes.data() + i, std::min(kChunkSize, bytes.size() - i));
+  }
+  std::cout << "StreamParser: " << to_ms(time_to_frame)
+            << " ms to the attributes, " << to_ms(Clock::now() - start)
+            << " ms in total, peak memory +" << (MaxRssKb() - rss_before) / 1024
+            << " MB" << std::endl;
+
+  rss_before = MaxRssKb();
+  start = Clock::now();
+  std::vector<uint8_t> buffer;
+  for (size_t i = 0; i < bytes.size(); i += kChunkSize) {
+    buffer.insert(buffer.end(), bytes.begin() + i,
+                  bytes.begin() + std::min(i + kChunkSize, bytes.size()));
+  }
+  Frame frame(buffer.data(), buffer.size());
+  std::cout << "Frame(buffer, size): " << to_ms(Clock::now() - start)
+            << " ms to the attributes, peak memory +"
+            << (MaxRssKb() - rss_before) / 1024 << " MB" << std::endl;
+  EXPECT_EQ(frame.Data().size(), parser.PayloadSize());
+}
+
+}  // namespace
+}  // namespace ipp
@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <jerror.h>
 #include <jpeglib.h>
@@ -44,6 +45,9 @@ class JpegReader final : public ImageReader {
   // Whether or not the JpegReader is in a valid state.
   bool valid_ = false;
 
+  // Row of a 1-bit image expanded to 8 bits, reused for every row.
+  std::vector<uint8_t> expanded_row_;
+
   jpeg_compress_struct cinfo_ = {0};
   jpeg_error_mgr jerr_ = {0};
 };
@@ -0,0 +1,163 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "lorgnette/image_readers/pipelined_image_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <dbus/lorgnette/dbus-constants.h>
+
+#include "lorgnette/constants.h"
+
+namespace lorgnette {
+
+// static
+std::unique_ptr<ImageReader> PipelinedImageReader::Create(
+    brillo::ErrorPtr* error,
+    const ScanParameters& params,
+    std::unique_ptr<ImageReader> encoder,
+    size_t max_buffer_size) {
+  if (!encoder) {
+    return nullptr;
+  }
+
+  std::unique_ptr<PipelinedImageReader> reader(
+      new PipelinedImageReader(params, std::move(encoder), max_buffer_size));
+
+  if (!reader->ValidateParams(error) ||
+      !reader->Initialize(error, std::nullopt)) {
+    return nullptr;
+  }
+
+  return reader;
+}
+
+PipelinedImageReader::~PipelinedImageReader() {
+  StopEncoder(nullptr, /*abort=*/true);
+}
+
+bool PipelinedImageReader::ReadRow(brillo::ErrorPtr* error, uint8_t* data) {
+  DCHECK(encoder_thread_);
+
+  const size_t row_size = params_.bytes_per_line;
+  size_t row;
+  {
+    base::AutoLock auto_lock(lock_);
+    while (!encoder_failed_ && rows_added_ - rows_encoded_ == ring_rows_) {
+      rows_encoded_cond_.Wait();
+    }
+    if (encoder_failed_) {
+      if (error && encoder_error_) {
+        *error = std::move(encoder_error_);
+      }
+      return false;
+    }
+    row = rows_added_;
+  }
+
+  // The slot of |row| is not used by the encoder until |rows_added_| is
+  // incremented.
+  memcpy(ring_.data() + (row % ring_rows_) * row_size, data, row_size);
+  {
+    base::AutoLock auto_lock(lock_);
+    ++rows_added_;
+  }
+  rows_added_cond_.Signal();
+
+  return true;
+}
+
+bool PipelinedImageReader::Finalize(brillo::ErrorPtr* error) {
+  DCHECK(encoder_thread_);
+
+  if (!StopEncoder(error, /*abort=*/false)) {
+    return false;
+  }
+
+  return encoder_->Finalize(error);
+}
+
+PipelinedImageReader::PipelinedImageReader(
+    const ScanParameters& params,
+    std::unique_ptr<ImageReader> encoder,
+    size_t max_buffer_size)
+    : ImageReader(params, base::ScopedFILE()),
+      encoder_(std::move(encoder)),
+      ring_rows_(max_buffer_size),
+      rows_added_cond_(&lock_),
+      rows_encoded_cond_(&lock_) {}
+
+bool PipelinedImageReader::Initialize(brillo::ErrorPtr* error,
+                                      const std::optional<int>& resolution) {
+  // |ring_rows_| holds the maximum size of the ring until the parameters are
+  // validated.
+  const size_t row_size = params_.bytes_per_line;
+  ring_rows_ = std::clamp<size_t>(ring_rows_ / row_size, 1, params_.lines);
+  ring_.resize(ring_rows_ * row_size);
+
+  encoder_thread_ =
+      std::make_unique<base::DelegateSimpleThread>(this, "ScanImageEncoder");
+  encoder_thread_->Start();
+  return true;
+}
+
+void PipelinedImageReader::Run() {
+  const size_t row_size = params_.bytes_per_line;
+  base::AutoLock auto_lock(lock_);
+  while (true) {
+    while (!aborted_ && !all_rows_added_ && rows_encoded_ == rows_added_) {
+      rows_added_cond_.Wait();
+    }
+    if (aborted_ || rows_encoded_ == rows_added_) {
+      return;
+    }
+
+    uint8_t* row = ring_.data() + (rows_encoded_ % ring_rows_) * row_size;
+    brillo::ErrorPtr error;
+    bool encoded;
+    {
+      base::AutoUnlock auto_unlock(lock_);
+      encoded = encoder_->ReadRow(&error, row);
+    }
+    if (!encoded) {
+      encoder_failed_ = true;
+      encoder_error_ = std::move(error);
+      rows_encoded_cond_.Signal();
+      return;
+    }
+    ++rows_encoded_;
+    rows_encoded_cond_.Signal();
+  }
+}
+
+bool PipelinedImageReader::StopEncoder(brillo::ErrorPtr* error, bool abort) {
+  if (!encoder_thread_) {
+    return true;
+  }
+
+  {
+    base::AutoLock auto_lock(lock_);
+    all_rows_added_ = true;
+    aborted_ = abort;
+  }
+  rows_added_cond_.Signal();
+  encoder_thread_->Join();
+  encoder_thread_.reset();
+
+  base::AutoLock auto_lock(lock_);
+  if (!encoder_failed_) {
+    return true;
+  }
+  if (error && encoder_error_) {
+    *error = std::move(encoder_error_);
+  } else {
+    brillo::Error::AddTo(error, FROM_HERE, kDbusDomain, kManagerServiceError,
+                         "Encoding the scanned image failed");
+  }
+  return false;
+}
+
+}  // namespace lorgnette
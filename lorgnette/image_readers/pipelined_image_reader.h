@@ -0,0 +1,96 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LORGNETTE_IMAGE_READERS_PIPELINED_IMAGE_READER_H_
+#define LORGNETTE_IMAGE_READERS_PIPELINED_IMAGE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <base/check.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/thread_annotations.h>
+#include <base/threading/simple_thread.h>
+
+#include "lorgnette/image_readers/image_reader.h"
+
+namespace lorgnette {
+
+// This class passes the rows of an image to another ImageReader, the encoder,
+// which runs on a separate thread. ReadRow() only copies the row to a bounded
+// ring of row buffers, so the caller can keep reading scan data from the
+// scanner while the previous rows are being encoded. ReadRow() blocks only when
+// the ring is full.
+class PipelinedImageReader final
+    : public ImageReader,
+      public base::DelegateSimpleThread::Delegate {
+ public:
+  // Maximum size of the ring of row buffers. About 1000 rows of a 600 DPI
+  // color A4 page.
+  static constexpr size_t kMaxBufferSize = 16 * 1024 * 1024;
+
+  // Returns nullptr if |encoder| is nullptr. |params| must be the parameters
+  // |encoder| was created with. The ring holds at least one row, even if the
+  // row is larger than |max_buffer_size|.
+  static std::unique_ptr<ImageReader> Create(
+      brillo::ErrorPtr* error,
+      const ScanParameters& params,
+      std::unique_ptr<ImageReader> encoder,
+      size_t max_buffer_size = kMaxBufferSize);
+  ~PipelinedImageReader();
+
+  // Returns false if the encoder failed to encode one of the previous rows.
+  // The error of the encoder is added to |error| then.
+  bool ReadRow(brillo::ErrorPtr* error, uint8_t* data) override;
+  // Waits until all rows are encoded and finalizes the image.
+  bool Finalize(brillo::ErrorPtr* error) override;
+
+ private:
+  PipelinedImageReader(const ScanParameters& params,
+                       std::unique_ptr<ImageReader> encoder,
+                       size_t max_buffer_size);
+  bool Initialize(brillo::ErrorPtr* error,
+                  const std::optional<int>& resolution) override;
+
+  // base::DelegateSimpleThread::Delegate:
+  // Encodes the rows added to the ring until all rows were added or the
+  // encoder fails.
+  void Run() override;
+
+  // Stops the encoder thread after the rows added so far are encoded, or
+  // immediately if |abort| is set. Returns false if the encoder failed and
+  // moves its error to |error|.
+  bool StopEncoder(brillo::ErrorPtr* error, bool abort);
+
+  std::unique_ptr<ImageReader> encoder_;
+  std::unique_ptr<base::DelegateSimpleThread> encoder_thread_;
+
+  // The ring of row buffers. Row |i| of the image is stored at index
+  // |i % ring_rows_|. The rows in [rows_encoded_, rows_added_) are owned by
+  // the encoder thread, the others by the thread calling ReadRow().
+  std::vector<uint8_t> ring_;
+  size_t ring_rows_;
+
+  base::Lock lock_;
+  // Signaled when a row is added or the encoder has to stop.
+  base::ConditionVariable rows_added_cond_;
+  // Signaled when the encoder encoded rows or failed.
+  base::ConditionVariable rows_encoded_cond_;
+  size_t rows_added_ GUARDED_BY(lock_) = 0;
+  size_t rows_encoded_ GUARDED_BY(lock_) = 0;
+  // Set when no more rows will be added.
+  bool all_rows_added_ GUARDED_BY(lock_) = false;
+  // Set when the encoder should stop as soon as possible.
+  bool aborted_ GUARDED_BY(lock_) = false;
+  bool encoder_failed_ GUARDED_BY(lock_) = false;
+  brillo::ErrorPtr encoder_error_ GUARDED_BY(lock_);
+};
+
+}  // namespace lorgnette
+
+#endif  // LORGNETTE_IMAGE_READERS_PIPELINED_IMAGE_READER_H_
@@ -0,0 +1,206 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "lorgnette/image_readers/pipelined_image_reader.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/files/scoped_temp_dir.h>
+#include <brillo/errors/error.h>
+#include <dbus/lorgnette/dbus-constants.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "lorgnette/constants.h"
+#include "lorgnette/image_readers/jpeg_reader.h"
+#include "lorgnette/sane_client.h"
+
+using ::testing::ContainsRegex;
+
+namespace lorgnette {
+
+namespace {
+
+constexpr int kBytesPerLine = 100;
+constexpr int kLines = 50;
+
+ScanParameters CreateScanParameters() {
+  ScanParameters parameters;
+  parameters.format = kGrayscale;
+  parameters.bytes_per_line = kBytesPerLine;
+  parameters.pixels_per_line = kBytesPerLine;
+  parameters.lines = kLines;
+  parameters.depth = 8;
+  return parameters;
+}
+
+std::vector<uint8_t> CreateRow(int line) {
+  std::vector<uint8_t> row(kBytesPerLine);
+  for (int i = 0; i < kBytesPerLine; i++) {
+    row[i] = (line * 7 + i) % 256;
+  }
+  return row;
+}
+
+// Records the rows it receives. Fails to encode row |fail_at_row|, if set.
+class FakeEncoder : public ImageReader {
+ public:
+  struct Result {
+    std::vector<std::vector<uint8_t>> rows;
+    bool finalized = false;
+  };
+
+  FakeEncoder(const ScanParameters& params,
+              Result* result,
+              std::optional<int> fail_at_row = std::nullopt)
+      : ImageReader(params, base::ScopedFILE()),
+        result_(result),
+        fail_at_row_(fail_at_row) {}
+
+  bool ReadRow(brillo::ErrorPtr* error, uint8_t* data) override {
+    if (fail_at_row_.has_value() &&
+        fail_at_row_.value() == static_cast<int>(result_->rows.size())) {
+      brillo::Error::AddTo(error, FROM_HERE, kDbusDomain, kManagerServiceError,
+                           "Fake encoder failed");
+      return false;
+    }
+    result_->rows.emplace_back(data, data + params_.bytes_per_line);
+    return true;
+  }
+
+  bool Finalize(brillo::ErrorPtr* error) override {
+    result_->finalized = true;
+    return true;
+  }
+
+ private:
+  bool Initialize(brillo::ErrorPtr* error,
+                  const std::optional<int>& resolution) override {
+    return true;
+  }
+
+  Result* result_;
+  std::optional<int> fail_at_row_;
+};
+
+}  // namespace
+
+TEST(PipelinedImageReaderTest, CreateWithoutEncoder) {
+  brillo::ErrorPtr error;
+  EXPECT_FALSE(
+      PipelinedImageReader::Create(&error, CreateScanParameters(), nullptr));
+}
+
+TEST(PipelinedImageReaderTest, EncodesAllRowsInOrder) {
+  const ScanParameters parameters = CreateScanParameters();
+  FakeEncoder::Result result;
+  brillo::ErrorPtr error;
+  // The ring holds 3 rows, so it wraps around many times.
+  std::unique_ptr<ImageReader> reader = PipelinedImageReader::Create(
+      &error, parameters, std::make_unique<FakeEncoder>(parameters, &result),
+      3 * kBytesPerLine);
+  ASSERT_TRUE(reader);
+
+  for (int line = 0; line < kLines; line++) {
+    std::vector<uint8_t> row = CreateRow(line);
+    ASSERT_TRUE(reader->ReadRow(&error, row.data()));
+  }
+  EXPECT_TRUE(reader->Finalize(&error));
+  EXPECT_FALSE(error);
+
+  ASSERT_EQ(result.rows.size(), kLines);
+  for (int line = 0; line < kLines; line++) {
+    EXPECT_EQ(result.rows[line], CreateRow(line)) << "line " << line;
+  }
+  EXPECT_TRUE(result.finalized);
+}
+
+TEST(PipelinedImageReaderTest, EncoderFailure) {
+  const ScanParameters parameters = CreateScanParameters();
+  FakeEncoder::Result result;
+  brillo::ErrorPtr error;
+  std::unique_ptr<ImageReader> reader = PipelinedImageReader::Create(
+      &error, parameters,
+      std::make_unique<FakeEncoder>(parameters, &result, /*fail_at_row=*/5),
+      2 * kBytesPerLine);
+  ASSERT_TRUE(reader);
+
+  // The failure is reported by ReadRow() at the latest when the ring is full.
+  int line = 0;
+  std::vector<uint8_t> row = CreateRow(0);
+  while (reader->ReadRow(&error, row.data())) {
+    line++;
+    ASSERT_LE(line, 5 + 2);
+  }
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->GetDomain(), kDbusDomain);
+  EXPECT_EQ(error->GetCode(), kManagerServiceError);
+  EXPECT_THAT(error->GetMessage(), ContainsRegex("Fake encoder failed"));
+  EXPECT_EQ(result.rows.size(), 5);
+}
+
+TEST(PipelinedImageReaderTest, DestroyWithoutFinalize) {
+  const ScanParameters parameters = CreateScanParameters();
+  FakeEncoder::Result result;
+  brillo::ErrorPtr error;
+  std::unique_ptr<ImageReader> reader = PipelinedImageReader::Create(
+      &error, parameters, std::make_unique<FakeEncoder>(parameters, &result));
+  ASSERT_TRUE(reader);
+
+  std::vector<uint8_t> row = CreateRow(0);
+  ASSERT_TRUE(reader->ReadRow(&error, row.data()));
+  reader.reset();
+
+  EXPECT_LE(result.rows.size(), 1);
+  EXPECT_FALSE(result.finalized);
+}
+
+TEST(PipelinedImageReaderTest, SameImageAsEncoder) {
+  const ScanParameters parameters = CreateScanParameters();
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath expected_path = temp_dir.GetPath().Append("expected");
+  const base::FilePath actual_path = temp_dir.GetPath().Append("actual");
+
+  brillo::ErrorPtr error;
+  std::unique_ptr<ImageReader> expected_reader = JpegReader::Create(
+      &error, parameters, 300,
+      base::ScopedFILE(base::OpenFile(expected_path, "wb")));
+  ASSERT_TRUE(expected_reader);
+  std::unique_ptr<ImageReader> actual_reader = PipelinedImageReader::Create(
+      &error, parameters,
+      JpegReader::Create(&error, parameters, 300,
+                         base::ScopedFILE(base::OpenFile(actual_path, "wb"))),
+      4 * kBytesPerLine);
+  ASSERT_TRUE(actual_reader);
+
+  for (int line = 0; line < kLines; line++) {
+    std::vector<uint8_t> row = CreateRow(line);
+    ASSERT_TRUE(expected_reader->ReadRow(&error, row.data()));
+    ASSERT_TRUE(actual_reader->ReadRow(&error, row.data()));
+  }
+  ASSERT_TRUE(expected_reader->Finalize(&error));
+  ASSERT_TRUE(actual_reader->Finalize(&error));
+  // Close the files.
+  expected_reader.reset();
+  actual_reader.reset();
+
+  std::string expected;
+  std::string actual;
+  ASSERT_TRUE(base::ReadFileToString(expected_path, &expected));
+  ASSERT_TRUE(base::ReadFileToString(actual_path, &actual));
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(actual, expected);
+}
+
+}  // namespace lorgnette
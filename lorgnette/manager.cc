@@ -34,6 +34,7 @@
 #include "lorgnette/guess_source.h"
 #include "lorgnette/image_readers/image_reader.h"
 #include "lorgnette/image_readers/jpeg_reader.h"
+#include "lorgnette/image_readers/pipelined_image_reader.h"
 #include "lorgnette/image_readers/png_reader.h"
 #include "lorgnette/ippusb_device.h"
 #include "permission_broker/dbus-proxies.h"
@@ -864,6 +865,15 @@ ScanState Manager::RunScanLoop(brillo::ErrorPtr* error,
     return SCAN_STATE_FAILED;
   }
 
+  // Encode the image on another thread, so that reading the scan data is not
+  // stalled while the rows read so far are being encoded. Otherwise, the
+  // scanner pauses in the middle of high resolution pages.
+  image_reader = PipelinedImageReader::Create(error, params.value(),
+                                              std::move(image_reader));
+  if (!image_reader) {
+    return SCAN_STATE_FAILED;
+  }
+
   base::TimeTicks last_progress_sent_time = base::TimeTicks::Now();
   uint32_t last_progress_value = 0;
   size_t rows_written = 0;
@@ -16,7 +16,9 @@
 #include <base/files/file_util.h>
 #include <base/files/scoped_file.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
 #include <base/time/time.h>
+#include <base/timer/elapsed_timer.h>
 #include <brillo/dbus/mock_dbus_method_response.h>
 #include <brillo/process/process.h>
 #include <chromeos/dbus/service_constants.h>
@@ -27,6 +29,8 @@
 #include <sane/sane.h>
 
 #include "lorgnette/enums.h"
+#include "lorgnette/image_readers/jpeg_reader.h"
+#include "lorgnette/image_readers/png_reader.h"
 #include "lorgnette/sane_client_fake.h"
 #include "lorgnette/test_util.h"
 
@@ -1010,6 +1014,84 @@ TEST_F(ManagerTest, GetNextImageTooLarge) {
   EXPECT_EQ(signals_[0].scan_failure_mode(), SCAN_FAILURE_MODE_UNKNOWN);
 }
 
+// Logs the time to scan a synthetic A4 600 DPI color page from a fake scanner
+// that needs 15 ms for every read, compared with the time to only read the scan
+// data and to only encode the image. Before the encoding was pipelined, the
+// scan took about as long as both of them together.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(ManagerTest, DISABLED_Benchmark) {
+  constexpr base::TimeDelta kReadDelay = base::Milliseconds(15);
+  constexpr size_t kReadSize = 1024 * 1024;
+  ScanParameters parameters;
+  parameters.format = kRGB;
+  parameters.pixels_per_line = 4960;
+  parameters.bytes_per_line = 4960 * 3;
+  parameters.lines = 7016;
+  parameters.depth = 8;
+  // Smooth gradients with some noise, which is roughly what a scanned page
+  // looks like to the encoders.
+  std::vector<uint8_t> page(static_cast<size_t>(parameters.bytes_per_line) *
+                            parameters.lines);
+  uint32_t noise = 1;
+  for (int y = 0; y < parameters.lines; y++) {
+    for (int x = 0; x < parameters.bytes_per_line; x++) {
+      noise = noise * 1103515245 + 12345;
+      page[static_cast<size_t>(y) * parameters.bytes_per_line + x] =
+          (x / 3 + y) / 48 + (x % 3) * 40 + (noise >> 28);
+    }
+  }
+  EXPECT_CALL(*metrics_library_, SendEnumToUMA(::testing::_, ::testing::_,
+                                               ::testing::_))
+      .Times(::testing::AnyNumber());
+
+  for (ImageFormat format : {IMAGE_FORMAT_PNG, IMAGE_FORMAT_JPEG}) {
+    brillo::ErrorPtr error;
+    SaneDeviceFake scanner;
+    scanner.SetScanData({page});
+    scanner.SetScanParameters(parameters);
+    scanner.SetReadScanDataDelay(kReadDelay);
+    ASSERT_EQ(scanner.StartScan(&error), SANE_STATUS_GOOD);
+    std::vector<uint8_t> buffer(kReadSize);
+    size_t read = 0;
+    base::ElapsedTimer read_timer;
+    while (scanner.ReadScanData(&error, buffer.data(), buffer.size(), &read) ==
+           SANE_STATUS_GOOD) {
+    }
+    const base::TimeDelta read_time = read_timer.Elapsed();
+
+    base::ScopedFILE out_file(
+        base::OpenFile(temp_dir_.GetPath().Append("encoded"), "wb"));
+    std::unique_ptr<ImageReader> encoder =
+        format == IMAGE_FORMAT_PNG
+            ? PngReader::Create(&error, parameters, 600, std::move(out_file))
+            : JpegReader::Create(&error, parameters, 600, std::move(out_file));
+    ASSERT_TRUE(encoder);
+    base::ElapsedTimer encode_timer;
+    for (int y = 0; y < parameters.lines; y++) {
+      ASSERT_TRUE(encoder->ReadRow(
+          &error, page.data() + static_cast<size_t>(y) *
+                                    parameters.bytes_per_line));
+    }
+    ASSERT_TRUE(encoder->Finalize(&error));
+    const base::TimeDelta encode_time = encode_timer.Elapsed();
+
+    auto device = std::make_unique<SaneDeviceFake>();
+    device->SetScanData({page});
+    device->SetScanParameters(parameters);
+    device->SetReadScanDataDelay(kReadDelay);
+    sane_client_->SetDeviceForName("TestDevice", std::move(device));
+    signals_.clear();
+    base::ElapsedTimer scan_timer;
+    RunScanSuccess("TestDevice", MODE_COLOR, format);
+    const base::TimeDelta scan_time = scan_timer.Elapsed();
+
+    LOG(INFO) << ImageFormat_Name(format) << ": reading "
+              << read_time.InMilliseconds() << " ms, encoding "
+              << encode_time.InMilliseconds() << " ms, scan "
+              << scan_time.InMilliseconds() << " ms";
+  }
+}
+
 TEST_F(ManagerTest, RemoveDupNoRepeats) {
   std::vector<ScannerInfo> scanners_empty, scanners_present, sane_scanners,
       expected_present;
@@ -9,6 +9,7 @@
 #include <optional>
 #include <utility>
 
+#include <base/threading/platform_thread.h>
 #include <chromeos/dbus/service_constants.h>
 
 #include "lorgnette/dbus_adaptors/org.chromium.lorgnette.Manager.h"
@@ -181,6 +182,10 @@ SANE_Status SaneDeviceFake::ReadScanData(brillo::ErrorPtr* error,
     return SANE_STATUS_EOF;
   }
 
+  if (read_scan_data_delay_.is_positive()) {
+    base::PlatformThread::Sleep(read_scan_data_delay_);
+  }
+
   size_t to_copy = std::min(count, page.size() - scan_data_offset_);
   memcpy(buf, page.data() + scan_data_offset_, to_copy);
   *read_out = to_copy;
@@ -223,4 +228,8 @@ void SaneDeviceFake::SetScanData(
   scan_data_ = scan_data;
 }
 
+void SaneDeviceFake::SetReadScanDataDelay(base::TimeDelta delay) {
+  read_scan_data_delay_ = delay;
+}
+
 }  // namespace lorgnette
@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 
+#include <base/time/time.h>
 #include <sane/sane.h>
 
 #include "lorgnette/sane_client.h"
@@ -89,6 +90,9 @@ class SaneDeviceFake : public SaneDevice {
   void SetScanParameters(const std::optional<ScanParameters>& params);
   void SetReadScanDataResult(SANE_Status result);
   void SetScanData(const std::vector<std::vector<uint8_t>>& scan_data);
+  // Sleeps for |delay| in every ReadScanData() call that returns data, to
+  // simulate the speed of a real scanner.
+  void SetReadScanDataDelay(base::TimeDelta delay);
 
  private:
   int resolution_;
@@ -97,6 +101,7 @@ class SaneDeviceFake : public SaneDevice {
   std::optional<ValidOptionValues> values_;
   SANE_Status start_scan_result_;
   SANE_Status read_scan_data_result_;
+  base::TimeDelta read_scan_data_delay_;
   bool scan_running_;
   bool cancelled_;
   std::optional<ScanParameters> params_;
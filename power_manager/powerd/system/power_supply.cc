@@ -67,30 +67,78 @@ constexpr base::TimeDelta
 constexpr base::TimeDelta kDefaultBatteryStabilizedAfterResumeDelay =
     base::Seconds(5);
 
+// Attributes read for every power supply directory in a single batch by
+// PowerSupply::UpdatePowerStatus().
+constexpr const char* kBatchedAttributes[] = {
+    "charge_full",
+    "charge_full_design",
+    "charge_now",
+    "current_max",
+    "current_now",
+    "cycle_count",
+    "energy_full",
+    "energy_full_design",
+    "energy_now",
+    "manufacturer",
+    "model_name",
+    "online",
+    "power_now",
+    "present",
+    "serial_number",
+    "status",
+    "technology",
+    "type",
+    "usb_type",
+    "vendor",
+    "voltage_max_design",
+    "voltage_min_design",
+    "voltage_now",
+};
+
+bool IsBatchedAttribute(const std::string& filename) {
+  for (const char* name : kBatchedAttributes) {
+    if (filename == name)
+      return true;
+  }
+  return false;
+}
+
 // Reads the contents of |filename| within |directory| into |out|, trimming
-// trailing whitespace.  Returns true on success.
-bool ReadAndTrimString(const base::FilePath& directory,
+// trailing whitespace.  Returns true on success. Batched attributes are taken
+// from |attributes|; a batched attribute missing from it couldn't be read.
+bool ReadAndTrimString(const SysfsFileContents& attributes,
+                       const base::FilePath& directory,
                        const std::string& filename,
                        std::string* out) {
-  return util::MaybeReadStringFile(directory.Append(filename), out);
+  const base::FilePath path = directory.Append(filename);
+  if (!IsBatchedAttribute(filename))
+    return util::MaybeReadStringFile(path, out);
+
+  const auto it = attributes.find(path);
+  if (it == attributes.end())
+    return false;
+  *out = it->second;
+  return true;
 }
 
 // Reads a 64-bit integer value from a file and returns true on success.
-bool ReadInt64(const base::FilePath& directory,
+bool ReadInt64(const SysfsFileContents& attributes,
+               const base::FilePath& directory,
                const std::string& filename,
                int64_t* out) {
   std::string buffer;
-  if (!ReadAndTrimString(directory, filename, &buffer))
+  if (!ReadAndTrimString(attributes, directory, filename, &buffer))
     return false;
   return base::StringToInt64(buffer, out);
 }
 
 // Reads an integer value and scales it to a double (see |kDoubleScaleFactor|.
 // Returns 0.0 on failure.
-double ReadScaledDouble(const base::FilePath& directory,
+double ReadScaledDouble(const SysfsFileContents& attributes,
+                        const base::FilePath& directory,
                         const std::string& filename) {
   int64_t value = 0;
-  if (!ReadInt64(directory, filename, &value))
+  if (!ReadInt64(attributes, directory, filename, &value))
     return 0.0;
 
   return kDoubleScaleFactor * static_cast<double>(value);
@@ -99,14 +147,15 @@ double ReadScaledDouble(const base::FilePath& directory,
 // Returns the string surrounded by brackets via the |out| parameter.
 // For example, returns "fun" given the string: "This format is not so [fun]"
 // The return value is a boolean indicating true on success or false on failure.
-bool ReadBracketSelectedString(const base::FilePath& directory,
+bool ReadBracketSelectedString(const SysfsFileContents& attributes,
+                               const base::FilePath& directory,
                                const std::string& filename,
                                std::string* out) {
   std::string buffer;
 
   DCHECK(out);
 
-  if (!ReadAndTrimString(directory, filename, &buffer))
+  if (!ReadAndTrimString(attributes, directory, filename, &buffer))
     return false;
   size_t start = buffer.find("[");
   if (start == std::string::npos)
@@ -134,9 +183,10 @@ bool IsPdDrpType(const std::string& type) {
 
 // Returns the type of connection for the power supply. If the type
 // cannot be read, kUnknownType is returned.
-std::string ReadPowerSupplyType(const base::FilePath& path) {
+std::string ReadPowerSupplyType(const SysfsFileContents& attributes,
+                                const base::FilePath& path) {
   std::string type;
-  if (!ReadAndTrimString(path, "type", &type))
+  if (!ReadAndTrimString(attributes, path, "type", &type))
     return PowerSupply::kUnknownType;
 
   if (type != PowerSupply::kUsbType)
@@ -147,7 +197,7 @@ std::string ReadPowerSupplyType(const base::FilePath& path) {
   // file, with the active value in brackets. For example:
   // "Unknown SDP DCP CDP C PD [PD_DRP] BrickID".
   std::string usb_type;
-  if (!ReadBracketSelectedString(path, "usb_type", &usb_type))
+  if (!ReadBracketSelectedString(attributes, path, "usb_type", &usb_type))
     return PowerSupply::kUsbType;
 
   // The exact type is unknown, but we still know it's USB.
@@ -164,16 +214,19 @@ std::string ReadPowerSupplyType(const base::FilePath& path) {
 }
 
 // Returns true if |path|, a sysfs directory, corresponds to an external
-// peripheral (e.g. a wireless mouse or keyboard).
-bool IsExternalPeripheral(const base::FilePath& path) {
-  std::string scope;
-  return ReadAndTrimString(path, "scope", &scope) && scope == "Device";
+// peripheral (e.g. a wireless mouse or keyboard). |scopes| holds the "scope"
+// attributes of the supply directories.
+bool IsExternalPeripheral(const SysfsFileContents& scopes,
+                          const base::FilePath& path) {
+  const auto it = scopes.find(path.Append("scope"));
+  return it != scopes.end() && it->second == "Device";
 }
 
 // Returns true if |path|, a sysfs directory, corresponds to a battery.
-bool IsBatteryPresent(const base::FilePath& path) {
+bool IsBatteryPresent(const SysfsFileContents& attributes,
+                      const base::FilePath& path) {
   int64_t present = 0;
-  return ReadInt64(path, "present", &present) && present != 0;
+  return ReadInt64(attributes, path, "present", &present) && present != 0;
 }
 
 // Returns a string describing |type|.
@@ -847,21 +900,38 @@ bool PowerSupply::UpdatePowerStatus(UpdatePolicy policy) {
 
   std::vector<base::FilePath> battery_paths;
 
-  // Iterate through sysfs's power supply information.
+  // Iterate through sysfs's power supply information. The scopes of all
+  // directories are read in a first batch, so that nothing else is read for
+  // external peripherals, and the commonly-used attributes of the remaining
+  // directories in a second one.
+  std::vector<base::FilePath> scope_paths;
   base::FileEnumerator file_enum(power_supply_path_, false,
                                  base::FileEnumerator::DIRECTORIES);
   for (base::FilePath path = file_enum.Next(); !path.empty();
        path = file_enum.Next()) {
-    if (IsExternalPeripheral(path))
+    if (IsSupplyIgnored(path.BaseName().value()))
       continue;
+    scope_paths.push_back(path.Append("scope"));
+  }
+  const SysfsFileContents scopes = sysfs_reader_.ReadFiles(scope_paths);
 
-    if (IsSupplyIgnored(path.BaseName().value()))
+  std::vector<base::FilePath> supply_paths;
+  std::vector<base::FilePath> attribute_paths;
+  for (const base::FilePath& scope_path : scope_paths) {
+    const base::FilePath path = scope_path.DirName();
+    if (IsExternalPeripheral(scopes, path))
       continue;
 
+    supply_paths.push_back(path);
+    for (const char* name : kBatchedAttributes)
+      attribute_paths.push_back(path.Append(name));
+  }
+  const SysfsFileContents attributes = sysfs_reader_.ReadFiles(attribute_paths);
+
+  for (const base::FilePath& path : supply_paths) {
     std::string type;
-    if (!base::ReadFileToString(path.Append("type"), &type))
+    if (!ReadAndTrimString(attributes, path, "type", &type))
       continue;
-    base::TrimWhitespaceASCII(type, base::TRIM_TRAILING, &type);
 
     saw_power_source = true;
 
@@ -870,12 +940,13 @@ bool PowerSupply::UpdatePowerStatus(UpdatePolicy policy) {
     if (type == kBatteryType)
       battery_paths.push_back(path);
     else
-      ReadLinePowerDirectory(path, &status);
+      ReadLinePowerDirectory(path, attributes, &status);
   }
 
   // If no battery was found, assume that the system is actually on AC power.
   if (!status.line_power_on &&
-      (battery_paths.empty() || !IsBatteryPresent(battery_paths[0]))) {
+      (battery_paths.empty() ||
+       !IsBatteryPresent(attributes, battery_paths[0]))) {
     if (saw_power_source) {
       // Batteryless Chromeboxes sometimes don't report any power sources. If we
       // saw at least one source but it wasn't online, the battery status might
@@ -907,11 +978,11 @@ bool PowerSupply::UpdatePowerStatus(UpdatePolicy policy) {
     battery_paths.resize(1);
   }
   if (battery_paths.size() == 1) {
-    if (!ReadBatteryDirectory(battery_paths[0], &status,
+    if (!ReadBatteryDirectory(battery_paths[0], attributes, &status,
                               false /* allow_empty */))
       return false;
   } else if (battery_paths.size() > 1) {
-    if (!ReadMultipleBatteryDirectories(battery_paths, &status))
+    if (!ReadMultipleBatteryDirectories(battery_paths, attributes, &status))
       return false;
   }
 
@@ -997,6 +1068,7 @@ bool PowerSupply::UpdatePowerStatus(UpdatePolicy policy) {
 }
 
 void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
+                                         const SysfsFileContents& attributes,
                                          PowerStatus* status) {
   // Add the port and fill in its details as we go.
   status->ports.emplace_back();
@@ -1008,13 +1080,13 @@ void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
 
   // Bidirectional/dual-role ports export a "status" field.
   std::string line_status;
-  ReadAndTrimString(path, "status", &line_status);
+  ReadAndTrimString(attributes, path, "status", &line_status);
   const bool dual_role_port = !line_status.empty();
   if (dual_role_port)
     status->supports_dual_role_devices = true;
 
   // An "Unknown" type indicates a sink-only device that can't supply power.
-  port->type = ReadPowerSupplyType(path);
+  port->type = ReadPowerSupplyType(attributes, path);
   if (port->type == kUnknownType)
     return;
 
@@ -1024,7 +1096,8 @@ void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
   // case a value of 0 indicates we're connected to a dual-role device but not
   // sinking power.
   int64_t online = 0;
-  if ((!ReadInt64(path, "online", &online) || !online) && !dual_role_connected)
+  if ((!ReadInt64(attributes, path, "online", &online) || !online) &&
+      !dual_role_connected)
     return;
 
   // If we've made it this far, there's a dedicated source or dual-role device
@@ -1038,11 +1111,12 @@ void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
   // additional discussion.
   port->active_by_default = !dual_role_port || !dual_role_connected;
 
-  ReadAndTrimString(path, "manufacturer", &port->manufacturer_id);
-  ReadAndTrimString(path, "model_name", &port->model_id);
+  ReadAndTrimString(attributes, path, "manufacturer", &port->manufacturer_id);
+  ReadAndTrimString(attributes, path, "model_name", &port->model_id);
 
-  const double max_voltage = ReadScaledDouble(path, "voltage_max_design");
-  const double max_current = ReadScaledDouble(path, "current_max");
+  const double max_voltage =
+      ReadScaledDouble(attributes, path, "voltage_max_design");
+  const double max_current = ReadScaledDouble(attributes, path, "current_max");
   port->max_power = max_voltage * max_current;  // watts
 
   VLOG(1) << "Added power source " << port->id << ":"
@@ -1081,20 +1155,23 @@ void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
   status->line_power_max_voltage = max_voltage;
   status->line_power_max_current = max_current;
   if (base::PathExists(path.Append("voltage_now"))) {
-    status->line_power_voltage = ReadScaledDouble(path, "voltage_now");
+    status->line_power_voltage =
+        ReadScaledDouble(attributes, path, "voltage_now");
     status->has_line_power_voltage = true;
   }
   if (base::PathExists(path.Append("current_now"))) {
-    status->line_power_current = ReadScaledDouble(path, "current_now");
+    status->line_power_current =
+        ReadScaledDouble(attributes, path, "current_now");
     status->has_line_power_current = true;
   }
   if (base::PathExists(path.Append("voltage_max_design"))) {
     status->line_power_max_voltage =
-        ReadScaledDouble(path, "voltage_max_design");
+        ReadScaledDouble(attributes, path, "voltage_max_design");
     status->has_line_power_max_voltage = true;
   }
   if (base::PathExists(path.Append("current_max"))) {
-    status->line_power_max_current = ReadScaledDouble(path, "current_max");
+    status->line_power_max_current =
+        ReadScaledDouble(attributes, path, "current_max");
     status->has_line_power_max_current = true;
   }
 
@@ -1122,34 +1199,40 @@ void PowerSupply::ReadLinePowerDirectory(const base::FilePath& path,
 }
 
 bool PowerSupply::ReadBatteryDirectory(const base::FilePath& path,
+                                       const SysfsFileContents& attributes,
                                        PowerStatus* status,
                                        bool allow_empty) {
   VLOG(1) << "Reading battery status from " << path.value();
   status->battery_path = path.value();
-  status->battery_is_present = IsBatteryPresent(path);
+  status->battery_is_present = IsBatteryPresent(attributes, path);
   if (!status->battery_is_present)
     return true;
 
-  ReadAndTrimString(path, "status", &status->battery_status_string);
+  ReadAndTrimString(attributes, path, "status",
+                    &status->battery_status_string);
 
   // POWER_SUPPLY_PROP_VENDOR does not seem to be a valid property
   // defined in <linux/power_supply.h>.
-  ReadAndTrimString(
-      path,
-      base::PathExists(path.Append("manufacturer")) ? "manufacturer" : "vendor",
-      &status->battery_vendor);
-  ReadAndTrimString(path, "model_name", &status->battery_model_name);
-  ReadAndTrimString(path, "technology", &status->battery_technology);
-
-  double voltage = ReadScaledDouble(path, "voltage_now");
+  ReadAndTrimString(attributes, path,
+                    base::PathExists(path.Append("manufacturer"))
+                        ? "manufacturer"
+                        : "vendor",
+                    &status->battery_vendor);
+  ReadAndTrimString(attributes, path, "model_name",
+                    &status->battery_model_name);
+  ReadAndTrimString(attributes, path, "technology",
+                    &status->battery_technology);
+
+  double voltage = ReadScaledDouble(attributes, path, "voltage_now");
   status->battery_voltage = voltage;
 
   int64_t cycle_count = 0;
-  if (ReadInt64(path, "cycle_count", &cycle_count)) {
+  if (ReadInt64(attributes, path, "cycle_count", &cycle_count)) {
     status->battery_cycle_count = cycle_count;
   }
 
-  ReadAndTrimString(path, "serial_number", &status->battery_serial_number);
+  ReadAndTrimString(attributes, path, "serial_number",
+                    &status->battery_serial_number);
 
   // Attempt to determine nominal voltage for time-remaining calculations. This
   // may or may not be the same as the instantaneous voltage |battery_voltage|,
@@ -1160,10 +1243,10 @@ bool PowerSupply::ReadBatteryDirectory(const base::FilePath& path,
   // TODO(khegde): https://crbug.com/980246
   if (base::PathExists(path.Append("voltage_min_design"))) {
     status->battery_voltage_min_design =
-        ReadScaledDouble(path, "voltage_min_design");
+        ReadScaledDouble(attributes, path, "voltage_min_design");
     nominal_voltage = status->battery_voltage_min_design;
   } else if (base::PathExists(path.Append("voltage_max_design"))) {
-    nominal_voltage = ReadScaledDouble(path, "voltage_max_design");
+    nominal_voltage = ReadScaledDouble(attributes, path, "voltage_max_design");
   }
 
   // Nominal voltage is not required to obtain the charge level; if it's
@@ -1204,19 +1287,22 @@ bool PowerSupply::ReadBatteryDirectory(const base::FilePath& path,
   double energy = 0;
 
   if (base::PathExists(path.Append("energy_now")))
-    energy = ReadScaledDouble(path, "energy_now");
+    energy = ReadScaledDouble(attributes, path, "energy_now");
 
   if (base::PathExists(path.Append("charge_full"))) {
-    charge_full = ReadScaledDouble(path, "charge_full");
-    charge_full_design = ReadScaledDouble(path, "charge_full_design");
-    charge = ReadScaledDouble(path, "charge_now");
+    charge_full = ReadScaledDouble(attributes, path, "charge_full");
+    charge_full_design =
+        ReadScaledDouble(attributes, path, "charge_full_design");
+    charge = ReadScaledDouble(attributes, path, "charge_now");
     if (energy <= 0.0)
       energy = charge * nominal_voltage;
   } else if (base::PathExists(path.Append("energy_full"))) {
     DCHECK_GT(nominal_voltage, 0);
-    charge_full = ReadScaledDouble(path, "energy_full") / nominal_voltage;
+    charge_full =
+        ReadScaledDouble(attributes, path, "energy_full") / nominal_voltage;
     charge_full_design =
-        ReadScaledDouble(path, "energy_full_design") / nominal_voltage;
+        ReadScaledDouble(attributes, path, "energy_full_design") /
+        nominal_voltage;
     charge = energy / nominal_voltage;
   } else {
     LOG(WARNING) << "Ignoring reading without battery charge/energy";
@@ -1239,9 +1325,10 @@ bool PowerSupply::ReadBatteryDirectory(const base::FilePath& path,
   // The current can be reported as negative on some systems but not on others,
   // so it can't be used to determine whether the battery is charging or
   // discharging.
-  double current = base::PathExists(path.Append("power_now"))
-                       ? fabs(ReadScaledDouble(path, "power_now")) / voltage
-                       : fabs(ReadScaledDouble(path, "current_now"));
+  double current =
+      base::PathExists(path.Append("power_now"))
+          ? fabs(ReadScaledDouble(attributes, path, "power_now")) / voltage
+          : fabs(ReadScaledDouble(attributes, path, "current_now"));
   status->battery_current = current;
   status->battery_energy_rate = current * voltage;
 
@@ -1296,12 +1383,15 @@ bool PowerSupply::UpdateBatteryPercentagesAndState(PowerStatus* status) {
 }
 
 bool PowerSupply::ReadMultipleBatteryDirectories(
-    const std::vector<base::FilePath>& paths, PowerStatus* status) {
+    const std::vector<base::FilePath>& paths,
+    const SysfsFileContents& attributes,
+    PowerStatus* status) {
   DCHECK_GE(paths.size(), 2);
   std::vector<PowerStatus> battery_statuses;
   for (const auto& path : paths) {
     PowerStatus battery_status(*status);
-    if (ReadBatteryDirectory(path, &battery_status, true /* allow_empty */))
+    if (ReadBatteryDirectory(path, attributes, &battery_status,
+                             true /* allow_empty */))
       battery_statuses.push_back(battery_status);
     else
       LOG(WARNING) << "Ignoring battery at " << path.value();
@@ -22,6 +22,7 @@
 
 #include "power_manager/powerd/system/power_supply_observer.h"
 #include "power_manager/powerd/system/rolling_average.h"
+#include "power_manager/powerd/system/sysfs_batch_reader.h"
 #include "power_manager/powerd/system/udev_subsystem_observer.h"
 #include "power_manager/proto_bindings/power_supply_properties.pb.h"
 
@@ -428,14 +429,18 @@ class PowerSupply : public PowerSupplyInterface, public UdevSubsystemObserver {
 
   // Helper method for UpdatePowerStatus() that reads |path|, a directory under
   // |power_supply_path_| corresponding to a line power source (e.g. anything
-  // that isn't a battery), and updates |status|.
-  void ReadLinePowerDirectory(const base::FilePath& path, PowerStatus* status);
+  // that isn't a battery), and updates |status|. |attributes| holds the
+  // commonly-used attributes that were batch-read from all directories.
+  void ReadLinePowerDirectory(const base::FilePath& path,
+                              const SysfsFileContents& attributes,
+                              PowerStatus* status);
 
   // Helper method for UpdatePowerStatus() that reads |path|, a directory under
   // |power_supply_path_| corresponding to a battery, and updates |status|.
   // Returns false if an error is encountered (including the charge being zero
   // when |allow_empty| is false).
   bool ReadBatteryDirectory(const base::FilePath& path,
+                            const SysfsFileContents& attributes,
                             PowerStatus* status,
                             bool allow_empty);
 
@@ -450,6 +455,7 @@ class PowerSupply : public PowerSupplyInterface, public UdevSubsystemObserver {
   // directories from sysfs using ReadBatteryDirectory() and merges the results
   // into |status|.
   bool ReadMultipleBatteryDirectories(const std::vector<base::FilePath>& paths,
+                                      const SysfsFileContents& attributes,
                                       PowerStatus* status);
 
   // Updates |status|'s time-to-full and time-to-empty estimates or returns
@@ -530,6 +536,9 @@ class PowerSupply : public PowerSupplyInterface, public UdevSubsystemObserver {
   // supplies.
   base::FilePath power_supply_path_;
 
+  // Reads attributes from the directories in |power_supply_path_|.
+  SysfsBatchReader sysfs_reader_;
+
   // Should multiple battery directories in sysfs be read and combined?
   bool allow_multiple_batteries_ = false;
 
@@ -2045,6 +2045,23 @@ TEST_F(PowerSupplyTest, NoNominalVoltage) {
   EXPECT_FALSE(UpdateStatus(&status));
 }
 
+TEST_F(PowerSupplyTest, UnreadableCurrentAndVoltage) {
+  // current_now and voltage_now are reported as long as they exist, even if
+  // they can't be read.
+  WriteDefaultValues(PowerSource::AC);
+  for (const char* name : {"current_now", "voltage_now"}) {
+    base::DeleteFile(ac_dir_.Append(name));
+    ASSERT_TRUE(base::CreateDirectory(ac_dir_.Append(name)));
+  }
+  Init();
+  PowerStatus status;
+  ASSERT_TRUE(UpdateStatus(&status));
+  EXPECT_TRUE(status.has_line_power_current);
+  EXPECT_DOUBLE_EQ(0.0, status.line_power_current);
+  EXPECT_TRUE(status.has_line_power_voltage);
+  EXPECT_DOUBLE_EQ(0.0, status.line_power_voltage);
+}
+
 TEST_F(PowerSupplyTest, NoCurrentOrVoltage) {
   WriteDefaultValues(PowerSource::AC);
   WriteDoubleValue(ac_dir_, "current_now", 2.0);
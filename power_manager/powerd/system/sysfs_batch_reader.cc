@@ -0,0 +1,416 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "power_manager/powerd/system/sysfs_batch_reader.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+#include <base/memory/ptr_util.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/string_util.h>
+
+namespace power_manager::system {
+
+namespace {
+
+// Number of submission queue entries. Each file takes two entries (read and
+// close) in the second batch.
+constexpr unsigned kRingEntries = 64;
+constexpr size_t kMaxFilesPerBatch = kRingEntries / 2;
+
+// sysfs attributes are at most a page long. Files that fill the whole buffer
+// are re-read directly in case they are longer.
+constexpr size_t kReadBufferSize = 4096;
+
+// Tags stored in the high bit of io_uring user data to tell reads from closes.
+constexpr uint64_t kCloseTag = 1ULL << 63;
+
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IoUringEnter(int fd,
+                 unsigned to_submit,
+                 unsigned min_complete,
+                 unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+int IoUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+bool ReadFileDirectly(const base::FilePath& path, std::string* out) {
+  if (!base::ReadFileToString(path, out))
+    return false;
+  base::TrimWhitespaceASCII(*out, base::TRIM_TRAILING, out);
+  return true;
+}
+
+}  // namespace
+
+// Minimal io_uring wrapper that supports the open/read/close sequence needed
+// by SysfsBatchReader.
+class SysfsBatchReader::Ring {
+ public:
+  // Returns null if io_uring or one of the needed operations is unavailable.
+  static std::unique_ptr<Ring> Create() {
+    auto ring = base::WrapUnique(new Ring());
+    if (!ring->Init())
+      return nullptr;
+    return ring;
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  ~Ring() {
+    if (sqes_)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_)
+      munmap(sq_ring_, sq_ring_size_);
+  }
+
+  // Makes the submission of the batch after |successful_batches| others fail
+  // once the kernel took part of it.
+  void FailSubmissionForTesting(int successful_batches) {
+    batches_before_failure_for_testing_ = successful_batches;
+  }
+
+  // Reads at most kMaxFilesPerBatch |paths| into |contents|. Returns false if
+  // the ring stopped working, in which case it must not be used again.
+  bool ReadFiles(const std::vector<base::FilePath>& paths,
+                 SysfsFileContents* contents) {
+    DCHECK_LE(paths.size(), kMaxFilesPerBatch);
+
+    // Open all files in one batch.
+    for (size_t i = 0; i < paths.size(); ++i) {
+      io_uring_sqe* sqe = NextSqe();
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uint64_t>(paths[i].value().c_str());
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe->user_data = i;
+    }
+    std::vector<int> fds(paths.size(), -1);
+    bool ok = SubmitAndWait(paths.size(), [&fds](uint64_t data, int32_t res) {
+      if (data < fds.size())
+        fds[data] = res;
+    });
+
+    std::vector<size_t> opened;
+    for (size_t i = 0; i < fds.size(); ++i) {
+      if (fds[i] >= 0)
+        opened.push_back(i);
+    }
+    if (!ok) {
+      // Opens still in flight may yet add files, which can't be closed.
+      LOG_IF(ERROR, in_flight_) << in_flight_ << " io_uring opens were lost";
+      for (size_t i : opened)
+        close(fds[i]);
+      return false;
+    }
+
+    // Read and close all opened files in a second batch. The close is
+    // hard-linked to the read so it runs even if the read fails.
+    for (size_t j = 0; j < opened.size(); ++j) {
+      size_t i = opened[j];
+      io_uring_sqe* sqe = NextSqe();
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fds[i];
+      sqe->addr = reinterpret_cast<uint64_t>(&buffer_[j * kReadBufferSize]);
+      sqe->len = kReadBufferSize;
+      sqe->off = 0;
+      sqe->flags = IOSQE_IO_HARDLINK;
+      sqe->user_data = j;
+
+      sqe = NextSqe();
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->fd = fds[i];
+      sqe->user_data = j | kCloseTag;
+    }
+    std::vector<int32_t> lengths(opened.size(), -1);
+    std::vector<bool> closed(opened.size(), false);
+    ok = SubmitAndWait(opened.size() * 2, [&lengths, &closed](uint64_t data,
+                                                              int32_t res) {
+      const uint64_t j = data & ~kCloseTag;
+      if (j >= lengths.size())
+        return;
+      if (data & kCloseTag)
+        closed[j] = true;
+      else
+        lengths[j] = res;
+    });
+    if (!ok) {
+      // The closes that never reached the kernel are done here. If some
+      // entries are still in flight, it is unknown which files they close, so
+      // the rest is leaked rather than risking closing a reused fd.
+      if (in_flight_) {
+        LOG(ERROR) << in_flight_ << " io_uring reads or closes were lost";
+        return false;
+      }
+      for (size_t j = 0; j < opened.size(); ++j) {
+        if (!closed[j])
+          close(fds[opened[j]]);
+      }
+      return false;
+    }
+
+    for (size_t j = 0; j < opened.size(); ++j) {
+      const base::FilePath& path = paths[opened[j]];
+      std::string value;
+      if (lengths[j] < 0)
+        continue;
+      if (static_cast<size_t>(lengths[j]) == kReadBufferSize) {
+        if (ReadFileDirectly(path, &value))
+          (*contents)[path] = std::move(value);
+        continue;
+      }
+      value.assign(&buffer_[j * kReadBufferSize], lengths[j]);
+      base::TrimWhitespaceASCII(value, base::TRIM_TRAILING, &value);
+      (*contents)[path] = std::move(value);
+    }
+    return true;
+  }
+
+ private:
+  Ring() = default;
+
+  bool Init() {
+    io_uring_params params = {};
+    ring_fd_.reset(IoUringSetup(kRingEntries, &params));
+    if (!ring_fd_.is_valid()) {
+      VPLOG(1) << "io_uring is unavailable";
+      return false;
+    }
+
+    // OPENAT, READ and CLOSE all arrived in Linux 5.6, as did probing.
+    const size_t probe_size =
+        sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<uint8_t> probe_buffer(probe_size);
+    auto* probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+    if (IoUringRegister(ring_fd_.get(), IORING_REGISTER_PROBE, probe, 256) <
+        0) {
+      VLOG(1) << "io_uring does not support probing";
+      return false;
+    }
+    for (int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}) {
+      if (op > probe->last_op ||
+          !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+        VLOG(1) << "io_uring does not support operation " << op;
+        return false;
+      }
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_)
+      return false;
+    cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!cq_ring_)
+      return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+    if (!sqes_)
+      return false;
+
+    uint8_t* sq = static_cast<uint8_t*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    uint8_t* cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    buffer_.resize(kMaxFilesPerBatch * kReadBufferSize);
+    return true;
+  }
+
+  void* Map(size_t size, off_t offset) {
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_.get(), offset);
+    if (addr == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to map io_uring";
+      return nullptr;
+    }
+    return addr;
+  }
+
+  // Returns a zeroed submission queue entry. The entry is published to the
+  // kernel by the next SubmitAndWait() call.
+  io_uring_sqe* NextSqe() {
+    unsigned index = pending_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    pending_tail_++;
+    return sqe;
+  }
+
+  // Submits |count| pending entries and waits for their completions, passing
+  // the user data and result of each to |on_complete|.
+  //
+  // On failure, the entries the kernel already took are still waited for, so
+  // that |on_complete| sees all of their results, and |in_flight_| is set to
+  // the number of them that could not be waited for. The entries it did not
+  // take are never run, since the ring must not be used again.
+  template <typename Callback>
+  bool SubmitAndWait(unsigned count, Callback on_complete) {
+    if (count == 0)
+      return true;
+
+    bool fail_for_testing = batches_before_failure_for_testing_ == 0;
+    if (batches_before_failure_for_testing_ >= 0)
+      --batches_before_failure_for_testing_;
+
+    __atomic_store_n(sq_tail_, pending_tail_, __ATOMIC_RELEASE);
+    unsigned to_submit = count;
+    unsigned completed = 0;
+    while (completed < count) {
+      int ret;
+      if (fail_for_testing && to_submit < count) {
+        errno = EIO;
+        ret = -1;
+      } else if (fail_for_testing) {
+        ret = IoUringEnter(ring_fd_.get(), (to_submit + 1) / 2, 0, 0);
+      } else {
+        ret = IoUringEnter(ring_fd_.get(), to_submit, count - completed,
+                           IORING_ENTER_GETEVENTS);
+      }
+      if (ret < 0 && errno != EINTR) {
+        PLOG(ERROR) << "io_uring_enter failed";
+        completed += ReapCompletions(on_complete);
+        in_flight_ = count - to_submit - completed;
+        while (in_flight_ > 0) {
+          ret = IoUringEnter(ring_fd_.get(), 0, in_flight_,
+                             IORING_ENTER_GETEVENTS);
+          if (ret < 0 && errno != EINTR) {
+            PLOG(ERROR) << "Failed to wait for io_uring completions";
+            break;
+          }
+          in_flight_ -= ReapCompletions(on_complete);
+        }
+        return false;
+      }
+      if (ret > 0)
+        to_submit -= std::min<unsigned>(ret, to_submit);
+
+      completed += ReapCompletions(on_complete);
+    }
+    return true;
+  }
+
+  // Passes the available completions to |on_complete| and returns their
+  // number.
+  template <typename Callback>
+  unsigned ReapCompletions(Callback on_complete) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned reaped = 0;
+    for (; head != tail; ++head, ++reaped) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      on_complete(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+  }
+
+  base::ScopedFD ring_fd_;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  // Submission queue tail including entries not yet handed to the kernel.
+  unsigned pending_tail_ = 0;
+
+  // Entries taken by the kernel whose completions were lost after a failure.
+  unsigned in_flight_ = 0;
+
+  int batches_before_failure_for_testing_ = -1;
+
+  // Destination of reads, kReadBufferSize bytes per file of a batch.
+  std::vector<char> buffer_;
+};
+
+SysfsBatchReader::SysfsBatchReader() : ring_(Ring::Create()) {}
+
+SysfsBatchReader::~SysfsBatchReader() = default;
+
+void SysfsBatchReader::DisableIoUringForTesting() {
+  ring_.reset();
+}
+
+void SysfsBatchReader::FailIoUringForTesting(int successful_batches) {
+  if (ring_)
+    ring_->FailSubmissionForTesting(successful_batches);
+}
+
+bool SysfsBatchReader::UsingIoUring() const {
+  return ring_ != nullptr;
+}
+
+SysfsFileContents SysfsBatchReader::ReadFiles(
+    const std::vector<base::FilePath>& paths) {
+  SysfsFileContents contents;
+  for (size_t start = 0; start < paths.size(); start += kMaxFilesPerBatch) {
+    std::vector<base::FilePath> batch(
+        paths.begin() + start,
+        paths.begin() + std::min(paths.size(), start + kMaxFilesPerBatch));
+    if (ring_ && !ring_->ReadFiles(batch, &contents)) {
+      // The ring may still hold entries of the failed batch, so it is never
+      // used again.
+      LOG(WARNING) << "Falling back to reading sysfs files directly";
+      ring_.reset();
+    }
+    if (!ring_)
+      ReadFilesDirectly(batch, &contents);
+  }
+  return contents;
+}
+
+void SysfsBatchReader::ReadFilesDirectly(
+    const std::vector<base::FilePath>& paths, SysfsFileContents* contents) {
+  for (const auto& path : paths) {
+    std::string value;
+    if (ReadFileDirectly(path, &value))
+      (*contents)[path] = std::move(value);
+  }
+}
+
+}  // namespace power_manager::system
@@ -0,0 +1,64 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef POWER_MANAGER_POWERD_SYSTEM_SYSFS_BATCH_READER_H_
+#define POWER_MANAGER_POWERD_SYSTEM_SYSFS_BATCH_READER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+
+namespace power_manager::system {
+
+// Contents of files read by SysfsBatchReader, keyed by path. Files that could
+// not be read are absent.
+using SysfsFileContents = std::map<base::FilePath, std::string>;
+
+// Reads many small sysfs attribute files at once.
+//
+// When the kernel supports it, all opens are submitted to an io_uring as one
+// batch and all reads and closes as a second one, so a refresh costs two
+// syscalls regardless of the number of attributes. Otherwise (io_uring may be
+// compiled out or disabled by policy) files are read one at a time.
+//
+// Reads are synchronous, so this is only suitable for attributes that don't
+// block on hardware, e.g. power supply properties cached by the kernel.
+class SysfsBatchReader {
+ public:
+  SysfsBatchReader();
+  SysfsBatchReader(const SysfsBatchReader&) = delete;
+  SysfsBatchReader& operator=(const SysfsBatchReader&) = delete;
+
+  ~SysfsBatchReader();
+
+  // Disables io_uring so tests can exercise the fallback path.
+  void DisableIoUringForTesting();
+
+  // Makes io_uring fail halfway through submitting the batch that follows
+  // |successful_batches| others, e.g. 1 for the reads of the first files.
+  void FailIoUringForTesting(int successful_batches);
+
+  // Returns true if reads are batched through io_uring.
+  bool UsingIoUring() const;
+
+  // Reads each of |paths|, trimming trailing whitespace from the contents.
+  SysfsFileContents ReadFiles(const std::vector<base::FilePath>& paths);
+
+ private:
+  class Ring;
+
+  // Reads |paths| one at a time, adding the results to |contents|.
+  void ReadFilesDirectly(const std::vector<base::FilePath>& paths,
+                         SysfsFileContents* contents);
+
+  // Null if io_uring is unavailable.
+  std::unique_ptr<Ring> ring_;
+};
+
+}  // namespace power_manager::system
+
+#endif  // POWER_MANAGER_POWERD_SYSTEM_SYSFS_BATCH_READER_H_
@@ -0,0 +1,158 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "power_manager/powerd/system/sysfs_batch_reader.h"
+
+#include <string>
+#include <vector>
+
+#include <base/check.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+namespace power_manager::system {
+
+namespace {
+
+void WriteValue(const base::FilePath& path, const std::string& value) {
+  CHECK(base::WriteFile(path, value.c_str(), value.length()));
+}
+
+int CountOpenFds() {
+  int count = 0;
+  base::FileEnumerator fds(base::FilePath("/proc/self/fd"), false,
+                           base::FileEnumerator::FILES |
+                               base::FileEnumerator::DIRECTORIES);
+  for (base::FilePath fd = fds.Next(); !fd.empty(); fd = fds.Next())
+    ++count;
+  return count;
+}
+
+}  // namespace
+
+class SysfsBatchReaderTest : public ::testing::TestWithParam<bool> {
+ public:
+  SysfsBatchReaderTest() {}
+  SysfsBatchReaderTest(const SysfsBatchReaderTest&) = delete;
+  SysfsBatchReaderTest& operator=(const SysfsBatchReaderTest&) = delete;
+
+  ~SysfsBatchReaderTest() override = default;
+
+  void SetUp() override {
+    CHECK(temp_dir_.CreateUniqueTempDir());
+    if (!GetParam())
+      reader_.DisableIoUringForTesting();
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  SysfsBatchReader reader_;
+};
+
+TEST_P(SysfsBatchReaderTest, ReadFiles) {
+  const base::FilePath kPresent = temp_dir_.GetPath().Append("present");
+  const base::FilePath kStatus = temp_dir_.GetPath().Append("status");
+  const base::FilePath kEmpty = temp_dir_.GetPath().Append("empty");
+  const base::FilePath kMissing = temp_dir_.GetPath().Append("missing");
+  WriteValue(kPresent, "1\n");
+  WriteValue(kStatus, "Charging  \n");
+  WriteValue(kEmpty, "");
+
+  SysfsFileContents contents =
+      reader_.ReadFiles({kPresent, kStatus, kEmpty, kMissing});
+  ASSERT_EQ(3, contents.size());
+  EXPECT_EQ("1", contents[kPresent]);
+  EXPECT_EQ("Charging", contents[kStatus]);
+  EXPECT_EQ("", contents[kEmpty]);
+  EXPECT_EQ(0, contents.count(kMissing));
+
+  // Files are re-read on every call.
+  WriteValue(kPresent, "0\n");
+  contents = reader_.ReadFiles({kPresent});
+  EXPECT_EQ("0", contents[kPresent]);
+
+  EXPECT_TRUE(reader_.ReadFiles({}).empty());
+}
+
+TEST_P(SysfsBatchReaderTest, LargeFile) {
+  // Files that don't fit in the per-file buffer are still read completely.
+  const base::FilePath kPath = temp_dir_.GetPath().Append("large");
+  const std::string kValue(10000, 'x');
+  WriteValue(kPath, kValue);
+  SysfsFileContents contents = reader_.ReadFiles({kPath});
+  EXPECT_EQ(kValue, contents[kPath]);
+}
+
+TEST_P(SysfsBatchReaderTest, ManyFiles) {
+  // Read more files than fit in a single batch.
+  std::vector<base::FilePath> paths;
+  for (int i = 0; i < 200; ++i) {
+    paths.push_back(temp_dir_.GetPath().Append(base::NumberToString(i)));
+    WriteValue(paths.back(), base::NumberToString(i) + "\n");
+  }
+  SysfsFileContents contents = reader_.ReadFiles(paths);
+  ASSERT_EQ(paths.size(), contents.size());
+  for (int i = 0; i < 200; ++i)
+    EXPECT_EQ(base::NumberToString(i), contents[paths[i]]);
+}
+
+TEST_P(SysfsBatchReaderTest, IoUringFailure) {
+  if (!reader_.UsingIoUring())
+    GTEST_SKIP() << "io_uring is unavailable";
+
+  std::vector<base::FilePath> paths;
+  for (int i = 0; i < 10; ++i) {
+    paths.push_back(temp_dir_.GetPath().Append(base::NumberToString(i)));
+    WriteValue(paths.back(), base::NumberToString(i) + "\n");
+  }
+
+  // Fail while opening the files, or while reading and closing them.
+  for (int successful_batches : {0, 1}) {
+    const int open_fds = CountOpenFds();
+    SysfsBatchReader reader;
+    reader.FailIoUringForTesting(successful_batches);
+    SysfsFileContents contents = reader.ReadFiles(paths);
+    EXPECT_FALSE(reader.UsingIoUring());
+    // All files are read directly instead, and none is left open. Neither is
+    // the ring.
+    EXPECT_EQ(open_fds, CountOpenFds());
+    ASSERT_EQ(paths.size(), contents.size());
+    for (int i = 0; i < 10; ++i)
+      EXPECT_EQ(base::NumberToString(i), contents[paths[i]]);
+  }
+}
+
+// Reports the cost of polling a power_supply tree similar to a laptop's. Run
+// with --gtest_also_run_disabled_tests to compare the two modes.
+TEST_P(SysfsBatchReaderTest, DISABLED_PollBenchmark) {
+  const int kNumAttributes = 24;
+  const int kIterations = 1000;
+  std::vector<base::FilePath> paths;
+  for (const char* supply : {"AC", "BAT0", "ucsi-source-psy-1",
+                             "ucsi-source-psy-2"}) {
+    const base::FilePath dir = temp_dir_.GetPath().Append(supply);
+    CHECK(base::CreateDirectory(dir));
+    for (int i = 0; i < kNumAttributes; ++i) {
+      paths.push_back(dir.Append("attr" + base::NumberToString(i)));
+      WriteValue(paths.back(), "12345678\n");
+    }
+  }
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; ++i)
+    CHECK_EQ(paths.size(), reader_.ReadFiles(paths).size());
+  const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  LOG(INFO) << (reader_.UsingIoUring() ? "io_uring" : "direct") << ": "
+            << elapsed.InMicrosecondsF() / kIterations << " us per poll of "
+            << paths.size() << " files";
+}
+
+INSTANTIATE_TEST_SUITE_P(IoUring, SysfsBatchReaderTest, ::testing::Bool());
+
+}  // namespace power_manager::system
@@ -0,0 +1,259 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "smbfs/buffered_file.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <base/check.h>
+#include <base/logging.h>
+#include <base/posix/safe_strerror.h>
+
+namespace smbfs {
+
+BufferedFile::BufferedFile(SambaInterface* samba_impl,
+                           SMBCFILE* file,
+                           std::shared_ptr<ChangeCounter> changes)
+    : samba_impl_(samba_impl), file_(file), changes_(std::move(changes)) {
+  DCHECK(samba_impl_);
+  DCHECK(file_);
+  DCHECK(changes_);
+}
+
+BufferedFile::~BufferedFile() {
+  LOG_IF(ERROR, !write_back_buffer_.empty())
+      << "Dropping " << write_back_buffer_.size() << " buffered bytes";
+  LOG_IF(ERROR, write_back_error_) << "Dropping write-back error: "
+                                   << base::safe_strerror(write_back_error_);
+}
+
+int BufferedFile::Read(off_t offset,
+                       size_t size,
+                       char* buf,
+                       size_t* out_bytes_read) {
+  DCHECK(buf);
+  DCHECK(out_bytes_read);
+
+  // Reads must see the data written before them. A failure is reported by
+  // the next Flush(), not to this read.
+  WriteBack();
+
+  // Another BufferedFile of the file may have changed the data read ahead.
+  if (read_ahead_changes_ != changes_->load()) {
+    DropReadAhead();
+  }
+
+  if (offset == next_read_offset_) {
+    ++sequential_reads_;
+  } else {
+    sequential_reads_ = 0;
+  }
+
+  const off_t read_ahead_end = ReadAheadEnd();
+  if (offset >= read_ahead_offset_ && offset < read_ahead_end &&
+      (offset + static_cast<off_t>(size) <= read_ahead_end ||
+       read_ahead_eof_)) {
+    const size_t start = offset - read_ahead_offset_;
+    const size_t count = std::min(size, read_ahead_buffer_.size() - start);
+    memcpy(buf, read_ahead_buffer_.data() + start, count);
+    *out_bytes_read = count;
+  } else {
+    int error = ReadFromServer(offset, size, buf, out_bytes_read);
+    if (error) {
+      return error;
+    }
+  }
+
+  next_read_offset_ = offset + *out_bytes_read;
+  return 0;
+}
+
+bool BufferedFile::ShouldReadAhead() const {
+  if (sequential_reads_ < kSequentialReadThreshold) {
+    return false;
+  }
+
+  const off_t read_ahead_end = ReadAheadEnd();
+  if (next_read_offset_ < read_ahead_offset_ ||
+      next_read_offset_ > read_ahead_end) {
+    // The buffer does not continue the last read.
+    return true;
+  }
+  return !read_ahead_eof_ && read_ahead_end - next_read_offset_ <
+                                 static_cast<off_t>(kReadAheadSize / 2);
+}
+
+void BufferedFile::ReadAhead() {
+  if (!ShouldReadAhead()) {
+    return;
+  }
+
+  off_t offset = ReadAheadEnd();
+  if (next_read_offset_ < read_ahead_offset_ || next_read_offset_ > offset) {
+    read_ahead_buffer_.clear();
+    offset = next_read_offset_;
+  } else {
+    // Keep the data that was not read yet.
+    read_ahead_buffer_.erase(
+        read_ahead_buffer_.begin(),
+        read_ahead_buffer_.begin() + (next_read_offset_ - read_ahead_offset_));
+  }
+  read_ahead_offset_ = next_read_offset_;
+  if (read_ahead_changes_ != changes_->load()) {
+    // The data kept may be stale, read it again.
+    offset = read_ahead_offset_;
+    read_ahead_buffer_.clear();
+  }
+  // Changes made while reading make the data stale, so the counter is read
+  // first.
+  read_ahead_changes_ = changes_->load();
+
+  const size_t buffered = read_ahead_buffer_.size();
+  read_ahead_buffer_.resize(buffered + kReadAheadSize);
+  size_t bytes_read = 0;
+  int error = ReadFromServer(offset, kReadAheadSize,
+                             read_ahead_buffer_.data() + buffered, &bytes_read);
+  if (error) {
+    VLOG(1) << "Read-ahead at offset: " << offset
+            << " failed: " << base::safe_strerror(error);
+    DropReadAhead();
+    return;
+  }
+  read_ahead_buffer_.resize(buffered + bytes_read);
+  read_ahead_eof_ = bytes_read < kReadAheadSize;
+}
+
+int BufferedFile::Write(off_t offset,
+                        const char* buf,
+                        size_t size,
+                        size_t* out_bytes_written) {
+  DCHECK(buf);
+  DCHECK(out_bytes_written);
+
+  // The read-ahead buffers of the file may contain the data being
+  // overwritten.
+  DropReadAhead();
+  ++*changes_;
+
+  const bool extends_buffer =
+      !write_back_buffer_.empty() &&
+      offset == write_back_offset_ +
+                    static_cast<off_t>(write_back_buffer_.size()) &&
+      write_back_buffer_.size() + size <= kWriteBackSize;
+  if (!extends_buffer) {
+    // A failure is reported by the next Flush(), not to this write.
+    WriteBack();
+  }
+
+  if (size > kWriteBackSize) {
+    int error = samba_impl_->SeekFile(file_, offset, SEEK_SET);
+    if (!error) {
+      error = samba_impl_->WriteFile(file_, buf, size, out_bytes_written);
+    }
+    ++*changes_;
+    return error;
+  }
+
+  if (write_back_buffer_.empty()) {
+    write_back_offset_ = offset;
+  }
+  write_back_buffer_.insert(write_back_buffer_.end(), buf, buf + size);
+  buffered_end_ = write_back_offset_ + write_back_buffer_.size();
+  *out_bytes_written = size;
+  return 0;
+}
+
+int BufferedFile::Flush() {
+  WriteBack();
+  const int error = write_back_error_;
+  write_back_error_ = 0;
+  return error;
+}
+
+void BufferedFile::WriteBack() {
+  if (write_back_buffer_.empty()) {
+    return;
+  }
+
+  int error = samba_impl_->SeekFile(file_, write_back_offset_, SEEK_SET);
+  size_t written = 0;
+  while (!error && written < write_back_buffer_.size()) {
+    size_t bytes_written = 0;
+    error = samba_impl_->WriteFile(file_, write_back_buffer_.data() + written,
+                                   write_back_buffer_.size() - written,
+                                   &bytes_written);
+    if (!error && !bytes_written) {
+      error = EIO;
+    }
+    written += bytes_written;
+  }
+  if (error) {
+    VLOG(1) << "Write-back of " << write_back_buffer_.size()
+            << " bytes at offset: " << write_back_offset_
+            << " failed: " << base::safe_strerror(error);
+    if (!write_back_error_) {
+      write_back_error_ = error;
+    }
+  }
+
+  write_back_buffer_.clear();
+  buffered_end_ = 0;
+  // Even a failed write-back may have changed part of the file.
+  ++*changes_;
+}
+
+int BufferedFile::Truncate(off_t size) {
+  // A failure is reported by the next Flush().
+  WriteBack();
+
+  DropReadAhead();
+  int error = samba_impl_->TruncateFile(file_, size);
+  ++*changes_;
+  return error;
+}
+
+int BufferedFile::ReadFromServer(off_t offset,
+                                 size_t size,
+                                 char* buf,
+                                 size_t* out_bytes_read) {
+  int error = samba_impl_->SeekFile(file_, offset, SEEK_SET);
+  if (error) {
+    return error;
+  }
+
+  size_t total = 0;
+  while (total < size) {
+    size_t bytes_read = 0;
+    error =
+        samba_impl_->ReadFile(file_, buf + total, size - total, &bytes_read);
+    if (error) {
+      return error;
+    }
+    if (!bytes_read) {
+      // EOF.
+      break;
+    }
+    total += bytes_read;
+  }
+  *out_bytes_read = total;
+  return 0;
+}
+
+off_t BufferedFile::ReadAheadEnd() const {
+  return read_ahead_offset_ + read_ahead_buffer_.size();
+}
+
+void BufferedFile::DropReadAhead() {
+  read_ahead_buffer_.clear();
+  read_ahead_buffer_.shrink_to_fit();
+  read_ahead_offset_ = 0;
+  read_ahead_eof_ = false;
+}
+
+}  // namespace smbfs
@@ -0,0 +1,152 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SMBFS_BUFFERED_FILE_H_
+#define SMBFS_BUFFERED_FILE_H_
+
+#include <libsmbclient.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "smbfs/samba_interface.h"
+
+namespace smbfs {
+
+// A regular file opened with libsmbclient, with read-ahead of sequential reads
+// and a bounded write-back buffer. FUSE splits reads and writes into requests
+// of at most 128KB, and each of them costs at least one round trip to the
+// server. libsmbclient keeps several SMB requests in flight for a large read
+// or write, so turning a stream of small FUSE requests into a few large calls
+// hides most of the network latency.
+//
+// Data buffered for writing is written back when it cannot be extended by the
+// next write, and by Flush(), Truncate() and Read(). The caller must call
+// Flush() before closing the file. Errors of write-backs not made by Flush()
+// are kept and reported by the next Flush(), like the kernel reports failed
+// write-backs of the page cache on fsync() and close().
+//
+// The BufferedFiles of the same file share a ChangeCounter, so that data read
+// ahead by one of them is dropped once another one changed the file.
+//
+// All methods must be called on the thread |samba_impl| is used on, unless
+// noted.
+class BufferedFile {
+ public:
+  // Size of the reads made to fill the read-ahead buffer.
+  static constexpr size_t kReadAheadSize = 1024 * 1024;
+  // Maximum amount of data buffered for writing.
+  static constexpr size_t kWriteBackSize = 1024 * 1024;
+  // Number of consecutive sequential reads after which reading ahead starts.
+  static constexpr int kSequentialReadThreshold = 2;
+
+  // Number of changes made to a file. Can be used from any thread.
+  using ChangeCounter = std::atomic<uint64_t>;
+
+  // |file| must have been opened with |samba_impl|, which must outlive this
+  // object. |changes| is shared with the other BufferedFiles of the same file,
+  // if there are any.
+  BufferedFile(SambaInterface* samba_impl,
+               SMBCFILE* file,
+               std::shared_ptr<ChangeCounter> changes =
+                   std::make_shared<ChangeCounter>(0));
+  ~BufferedFile();
+
+  BufferedFile(const BufferedFile&) = delete;
+  BufferedFile& operator=(const BufferedFile&) = delete;
+
+  SMBCFILE* file() const { return file_; }
+  const std::shared_ptr<ChangeCounter>& changes() const { return changes_; }
+
+  // Reads up to |size| bytes at |offset| into |buf|, from the read-ahead
+  // buffer if it holds them. On success, |out_bytes_read| contains the number
+  // of bytes read, which is less than |size| only at the end of the file.
+  // Returns 0 on success and errno on failure.
+  [[nodiscard]] int Read(off_t offset,
+                         size_t size,
+                         char* buf,
+                         size_t* out_bytes_read);
+
+  // Returns true if the last reads were sequential and the read-ahead buffer
+  // runs low. ReadAhead() should then be called once the current read was
+  // replied to.
+  bool ShouldReadAhead() const;
+
+  // Reads the next kReadAheadSize bytes after the last read into the
+  // read-ahead buffer, if ShouldReadAhead() is still true. Errors are only
+  // logged, the next reads then go to the server.
+  void ReadAhead();
+
+  // Writes |size| bytes from |buf| at |offset|. The data is buffered if it
+  // fits into the write-back buffer. On success, |out_bytes_written| contains
+  // the number of bytes written or buffered. Returns 0 on success and errno on
+  // failure.
+  [[nodiscard]] int Write(off_t offset,
+                          const char* buf,
+                          size_t size,
+                          size_t* out_bytes_written);
+
+  // Writes back any buffered data. Returns 0 on success and errno on failure,
+  // including failures of earlier write-backs since the last Flush(). The
+  // buffered data is dropped in both cases.
+  [[nodiscard]] int Flush();
+
+  // Writes back any buffered data, e.g. so that reads through other files
+  // see it. Failures are reported by the next Flush().
+  void WriteBack();
+
+  // Writes back any buffered data and truncates the file to |size| bytes.
+  // Returns 0 on success and errno on failure to truncate.
+  [[nodiscard]] int Truncate(off_t size);
+
+  // Returns the offset right after the data buffered for writing, or 0 if
+  // there is none. The size of the file on the server may not include that
+  // data yet. Can be called from any thread.
+  off_t GetBufferedEnd() const { return buffered_end_; }
+
+ private:
+  // Seeks to |offset| and reads until |size| bytes or the end of the file were
+  // read.
+  int ReadFromServer(off_t offset,
+                     size_t size,
+                     char* buf,
+                     size_t* out_bytes_read);
+
+  // Returns the offset right after the data in |read_ahead_buffer_|.
+  off_t ReadAheadEnd() const;
+
+  // Drops the data in |read_ahead_buffer_|, which may be stale after a write.
+  void DropReadAhead();
+
+  SambaInterface* const samba_impl_;
+  SMBCFILE* const file_;
+  const std::shared_ptr<ChangeCounter> changes_;
+
+  // Sequential read detection. |next_read_offset_| is the offset right after
+  // the last read.
+  off_t next_read_offset_ = 0;
+  int sequential_reads_ = 0;
+
+  // Data of the file at |read_ahead_offset_|. |read_ahead_eof_| is true if
+  // the data reaches the end of the file. |read_ahead_changes_| is the value
+  // of |changes_| before the data was read.
+  std::vector<char> read_ahead_buffer_;
+  off_t read_ahead_offset_ = 0;
+  bool read_ahead_eof_ = false;
+  uint64_t read_ahead_changes_ = 0;
+
+  // Data to write at |write_back_offset_|.
+  std::vector<char> write_back_buffer_;
+  off_t write_back_offset_ = 0;
+  std::atomic<off_t> buffered_end_{0};
+  // The first error of the write-backs since the last Flush().
+  int write_back_error_ = 0;
+};
+
+}  // namespace smbfs
+
+#endif  // SMBFS_BUFFERED_FILE_H_
@@ -0,0 +1,393 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "smbfs/buffered_file.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/threading/platform_thread.h>
+#include <base/time/time.h>
+#include <base/timer/elapsed_timer.h>
+#include <gtest/gtest.h>
+
+#include "smbfs/samba_interface_impl.h"
+
+namespace smbfs {
+namespace {
+
+constexpr size_t kFuseRequestSize = 128 * 1024;
+
+// A file kept in memory. Every call sleeps for |latency|, like a round trip
+// to an SMB server.
+class FakeSambaInterface : public SambaInterfaceImpl {
+ public:
+  explicit FakeSambaInterface(size_t size,
+                              base::TimeDelta latency = base::TimeDelta())
+      : contents_(size), latency_(latency) {
+    for (size_t i = 0; i < size; ++i) {
+      contents_[i] = static_cast<char>(i * 7 + i / 4096);
+    }
+  }
+
+  int SeekFile(SMBCFILE* file, off_t offset, int whence) override {
+    EXPECT_EQ(whence, SEEK_SET);
+    position_ = offset;
+    return 0;
+  }
+
+  int ReadFile(SMBCFILE* file,
+               void* buf,
+               size_t count,
+               size_t* out_bytes_read) override {
+    base::PlatformThread::Sleep(latency_);
+    ++read_calls_;
+    if (read_error_) {
+      return read_error_;
+    }
+    const size_t start = std::min(position_, contents_.size());
+    *out_bytes_read = std::min(count, contents_.size() - start);
+    std::copy_n(contents_.begin() + start, *out_bytes_read,
+                static_cast<char*>(buf));
+    position_ += *out_bytes_read;
+    return 0;
+  }
+
+  int WriteFile(SMBCFILE* file,
+                const void* buf,
+                size_t count,
+                size_t* out_bytes_written) override {
+    base::PlatformThread::Sleep(latency_);
+    ++write_calls_;
+    if (write_error_) {
+      return write_error_;
+    }
+    if (position_ + count > contents_.size()) {
+      contents_.resize(position_ + count);
+    }
+    memcpy(contents_.data() + position_, buf, count);
+    position_ += count;
+    *out_bytes_written = count;
+    return 0;
+  }
+
+  int TruncateFile(SMBCFILE* file, off_t size) override {
+    contents_.resize(size);
+    return 0;
+  }
+
+  const std::vector<char>& contents() const { return contents_; }
+  int read_calls() const { return read_calls_; }
+  int write_calls() const { return write_calls_; }
+  void set_read_error(int error) { read_error_ = error; }
+  void set_write_error(int error) { write_error_ = error; }
+
+ private:
+  std::vector<char> contents_;
+  const base::TimeDelta latency_;
+  size_t position_ = 0;
+  int read_calls_ = 0;
+  int write_calls_ = 0;
+  int read_error_ = 0;
+  int write_error_ = 0;
+};
+
+SMBCFILE* const kFile = reinterpret_cast<SMBCFILE*>(0x1234);
+
+// Reads the whole file in FUSE sized requests, reading ahead like
+// SmbFilesystem does.
+std::vector<char> ReadSequentially(BufferedFile* file) {
+  std::vector<char> data;
+  std::vector<char> buf(kFuseRequestSize);
+  while (true) {
+    size_t bytes_read = 0;
+    EXPECT_EQ(file->Read(data.size(), buf.size(), buf.data(), &bytes_read), 0);
+    data.insert(data.end(), buf.begin(), buf.begin() + bytes_read);
+    if (bytes_read < buf.size()) {
+      return data;
+    }
+    if (file->ShouldReadAhead()) {
+      file->ReadAhead();
+    }
+  }
+}
+
+}  // namespace
+
+TEST(BufferedFileTest, SequentialReadsAreReadAhead) {
+  const size_t kSize = 8 * 1024 * 1024 + 1000;
+  FakeSambaInterface samba_impl(kSize);
+  BufferedFile file(&samba_impl, kFile);
+
+  EXPECT_EQ(ReadSequentially(&file), samba_impl.contents());
+  // Apart from a few reads at the start and at the end of the file, the file
+  // is read in kReadAheadSize pieces.
+  EXPECT_LE(samba_impl.read_calls(),
+            static_cast<int>(kSize / BufferedFile::kReadAheadSize) + 5);
+}
+
+TEST(BufferedFileTest, RandomReadsAreNotReadAhead) {
+  FakeSambaInterface samba_impl(4 * 1024 * 1024);
+  BufferedFile file(&samba_impl, kFile);
+
+  std::vector<char> buf(kFuseRequestSize);
+  for (off_t offset : {3 * kFuseRequestSize, kFuseRequestSize,
+                       5 * kFuseRequestSize, 0 * kFuseRequestSize}) {
+    size_t bytes_read = 0;
+    ASSERT_EQ(file.Read(offset, buf.size(), buf.data(), &bytes_read), 0);
+    EXPECT_EQ(bytes_read, buf.size());
+    EXPECT_TRUE(std::equal(buf.begin(), buf.end(),
+                           samba_impl.contents().begin() + offset));
+    EXPECT_FALSE(file.ShouldReadAhead());
+  }
+  EXPECT_EQ(samba_impl.read_calls(), 4);
+}
+
+TEST(BufferedFileTest, ReadAheadStopsAtEndOfFile) {
+  const size_t kSize = BufferedFile::kReadAheadSize + 10;
+  FakeSambaInterface samba_impl(kSize);
+  BufferedFile file(&samba_impl, kFile);
+
+  EXPECT_EQ(ReadSequentially(&file), samba_impl.contents());
+  EXPECT_FALSE(file.ShouldReadAhead());
+  const int read_calls = samba_impl.read_calls();
+
+  // Reading at the end of the file is served from the read-ahead buffer.
+  std::vector<char> buf(kFuseRequestSize);
+  size_t bytes_read = 0;
+  EXPECT_EQ(file.Read(kSize - 5, buf.size(), buf.data(), &bytes_read), 0);
+  EXPECT_EQ(bytes_read, 5u);
+  EXPECT_EQ(samba_impl.read_calls(), read_calls);
+}
+
+TEST(BufferedFileTest, ReadAheadError) {
+  FakeSambaInterface samba_impl(4 * 1024 * 1024);
+  BufferedFile file(&samba_impl, kFile);
+
+  std::vector<char> buf(kFuseRequestSize);
+  size_t bytes_read = 0;
+  ASSERT_EQ(file.Read(0, buf.size(), buf.data(), &bytes_read), 0);
+  ASSERT_EQ(file.Read(buf.size(), buf.size(), buf.data(), &bytes_read), 0);
+  ASSERT_TRUE(file.ShouldReadAhead());
+  samba_impl.set_read_error(EIO);
+  file.ReadAhead();
+
+  // The failed read-ahead is dropped and the next read goes to the server.
+  EXPECT_EQ(file.Read(2 * buf.size(), buf.size(), buf.data(), &bytes_read),
+            EIO);
+  samba_impl.set_read_error(0);
+  EXPECT_EQ(file.Read(2 * buf.size(), buf.size(), buf.data(), &bytes_read), 0);
+  EXPECT_TRUE(std::equal(buf.begin(), buf.end(),
+                         samba_impl.contents().begin() + 2 * buf.size()));
+}
+
+TEST(BufferedFileTest, SequentialWritesAreBuffered) {
+  FakeSambaInterface samba_impl(0);
+  BufferedFile file(&samba_impl, kFile);
+
+  const size_t kWrites = 20;
+  std::vector<char> expected;
+  for (size_t i = 0; i < kWrites; ++i) {
+    std::vector<char> buf(kFuseRequestSize, static_cast<char>(i));
+    size_t bytes_written = 0;
+    ASSERT_EQ(file.Write(expected.size(), buf.data(), buf.size(),
+                         &bytes_written),
+              0);
+    EXPECT_EQ(bytes_written, buf.size());
+    expected.insert(expected.end(), buf.begin(), buf.end());
+    EXPECT_GT(file.GetBufferedEnd(),
+              static_cast<off_t>(samba_impl.contents().size()));
+    EXPECT_EQ(file.GetBufferedEnd(), static_cast<off_t>(expected.size()));
+  }
+  ASSERT_EQ(file.Flush(), 0);
+  EXPECT_EQ(file.GetBufferedEnd(), 0);
+  EXPECT_EQ(samba_impl.contents(), expected);
+  EXPECT_EQ(samba_impl.write_calls(),
+            static_cast<int>(kWrites * kFuseRequestSize /
+                             BufferedFile::kWriteBackSize) +
+                1);
+}
+
+TEST(BufferedFileTest, NonSequentialWriteWritesBack) {
+  FakeSambaInterface samba_impl(1024 * 1024);
+  BufferedFile file(&samba_impl, kFile);
+  std::vector<char> expected = samba_impl.contents();
+
+  const std::vector<char> buf(1000, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(file.Write(5000, buf.data(), buf.size(), &bytes_written), 0);
+  EXPECT_EQ(samba_impl.write_calls(), 0);
+  ASSERT_EQ(file.Write(100, buf.data(), buf.size(), &bytes_written), 0);
+  EXPECT_EQ(samba_impl.write_calls(), 1);
+  ASSERT_EQ(file.Flush(), 0);
+  EXPECT_EQ(samba_impl.write_calls(), 2);
+
+  std::fill_n(expected.begin() + 5000, buf.size(), 'x');
+  std::fill_n(expected.begin() + 100, buf.size(), 'x');
+  EXPECT_EQ(samba_impl.contents(), expected);
+}
+
+TEST(BufferedFileTest, ReadsSeeBufferedWrites) {
+  const size_t kSize = 4 * 1024 * 1024;
+  FakeSambaInterface samba_impl(kSize);
+  BufferedFile file(&samba_impl, kFile);
+
+  // Fill the read-ahead buffer.
+  std::vector<char> buf(kFuseRequestSize);
+  size_t bytes_read = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(file.Read(i * buf.size(), buf.size(), buf.data(), &bytes_read),
+              0);
+    file.ReadAhead();
+  }
+
+  const std::vector<char> data(100, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(file.Write(3 * buf.size(), data.data(), data.size(),
+                       &bytes_written),
+            0);
+  ASSERT_EQ(file.Read(3 * buf.size(), buf.size(), buf.data(), &bytes_read), 0);
+  EXPECT_EQ(bytes_read, buf.size());
+  EXPECT_TRUE(std::equal(data.begin(), data.end(), buf.begin()));
+  EXPECT_EQ(file.GetBufferedEnd(), 0);
+}
+
+TEST(BufferedFileTest, WriteBackError) {
+  FakeSambaInterface samba_impl(0);
+  BufferedFile file(&samba_impl, kFile);
+
+  const std::vector<char> buf(1000, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(file.Write(0, buf.data(), buf.size(), &bytes_written), 0);
+  samba_impl.set_write_error(ENOSPC);
+  EXPECT_EQ(file.Flush(), ENOSPC);
+  EXPECT_EQ(file.GetBufferedEnd(), 0);
+
+  // The data was dropped.
+  samba_impl.set_write_error(0);
+  EXPECT_EQ(file.Flush(), 0);
+  EXPECT_TRUE(samba_impl.contents().empty());
+}
+
+TEST(BufferedFileTest, DeferredWriteBackErrorIsReportedByFlush) {
+  FakeSambaInterface samba_impl(0);
+  BufferedFile file(&samba_impl, kFile);
+
+  const std::vector<char> buf(1000, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(file.Write(0, buf.data(), buf.size(), &bytes_written), 0);
+  samba_impl.set_write_error(ENOSPC);
+
+  // The write-back made for a read is not reported to the read.
+  std::vector<char> read_buf(buf.size());
+  size_t bytes_read = 0;
+  EXPECT_EQ(file.Read(0, read_buf.size(), read_buf.data(), &bytes_read), 0);
+  samba_impl.set_write_error(0);
+
+  // Nor to later writes.
+  ASSERT_EQ(file.Write(0, buf.data(), buf.size(), &bytes_written), 0);
+  EXPECT_EQ(file.Flush(), ENOSPC);
+  EXPECT_EQ(file.Flush(), 0);
+}
+
+TEST(BufferedFileTest, ChangesDropReadAheadOfOtherFiles) {
+  const size_t kSize = 4 * 1024 * 1024;
+  FakeSambaInterface samba_impl(kSize);
+  BufferedFile reader(&samba_impl, kFile);
+  BufferedFile writer(&samba_impl, kFile, reader.changes());
+
+  // Fill the read-ahead buffer of |reader|.
+  std::vector<char> buf(kFuseRequestSize);
+  size_t bytes_read = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(reader.Read(i * buf.size(), buf.size(), buf.data(), &bytes_read),
+              0);
+    reader.ReadAhead();
+  }
+
+  const std::vector<char> data(100, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(writer.Write(3 * buf.size(), data.data(), data.size(),
+                         &bytes_written),
+            0);
+  ASSERT_EQ(writer.Flush(), 0);
+  ASSERT_EQ(reader.Read(3 * buf.size(), buf.size(), buf.data(), &bytes_read),
+            0);
+  EXPECT_EQ(bytes_read, buf.size());
+  EXPECT_TRUE(std::equal(data.begin(), data.end(), buf.begin()));
+}
+
+TEST(BufferedFileTest, TruncateWritesBack) {
+  FakeSambaInterface samba_impl(0);
+  BufferedFile file(&samba_impl, kFile);
+
+  const std::vector<char> buf(1000, 'x');
+  size_t bytes_written = 0;
+  ASSERT_EQ(file.Write(0, buf.data(), buf.size(), &bytes_written), 0);
+  ASSERT_EQ(file.Truncate(10), 0);
+  EXPECT_EQ(samba_impl.contents(), std::vector<char>(10, 'x'));
+}
+
+// Logs the throughput of reading and writing a file in FUSE sized requests
+// to a server 2 ms away, with and without BufferedFile.
+// Run with --gtest_also_run_disabled_tests.
+TEST(BufferedFileTest, DISABLED_Benchmark) {
+  const size_t kSize = 32 * 1024 * 1024;
+  const base::TimeDelta kLatency = base::Milliseconds(2);
+  auto log = [&](const char* name, const base::ElapsedTimer& timer) {
+    LOG(INFO) << name << ": "
+              << kSize / 1024 / 1024 / timer.Elapsed().InSecondsF()
+              << " MB/s";
+  };
+  std::vector<char> buf(kFuseRequestSize);
+
+  {
+    FakeSambaInterface samba_impl(kSize, kLatency);
+    base::ElapsedTimer timer;
+    for (size_t offset = 0; offset < kSize; offset += buf.size()) {
+      size_t bytes_read = 0;
+      ASSERT_EQ(samba_impl.SeekFile(kFile, offset, SEEK_SET), 0);
+      ASSERT_EQ(samba_impl.ReadFile(kFile, buf.data(), buf.size(), &bytes_read),
+                0);
+    }
+    log("Unbuffered read", timer);
+  }
+  {
+    FakeSambaInterface samba_impl(kSize, kLatency);
+    BufferedFile file(&samba_impl, kFile);
+    base::ElapsedTimer timer;
+    ReadSequentially(&file);
+    log("Read with read-ahead", timer);
+  }
+  {
+    FakeSambaInterface samba_impl(0, kLatency);
+    base::ElapsedTimer timer;
+    for (size_t offset = 0; offset < kSize; offset += buf.size()) {
+      size_t bytes_written = 0;
+      ASSERT_EQ(samba_impl.SeekFile(kFile, offset, SEEK_SET), 0);
+      ASSERT_EQ(samba_impl.WriteFile(kFile, buf.data(), buf.size(),
+                                     &bytes_written),
+                0);
+    }
+    log("Unbuffered write", timer);
+  }
+  {
+    FakeSambaInterface samba_impl(0, kLatency);
+    BufferedFile file(&samba_impl, kFile);
+    base::ElapsedTimer timer;
+    for (size_t offset = 0; offset < kSize; offset += buf.size()) {
+      size_t bytes_written = 0;
+      ASSERT_EQ(file.Write(offset, buf.data(), buf.size(), &bytes_written), 0);
+    }
+    ASSERT_EQ(file.Flush(), 0);
+    log("Write with write-back", timer);
+  }
+}
+
+}  // namespace smbfs
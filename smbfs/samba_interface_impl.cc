@@ -22,6 +22,17 @@ namespace {
 // Default that is consistent with common filesystems (ie. ext3, ext4, NFTS).
 constexpr int kMaxShareFilenameLength = 255;
 
+// libsmbclient keeps global state shared by all contexts, which is only safe
+// to use from several threads once it is told to lock it. That must happen
+// before the first context is created.
+void InitThreadSafety() {
+  static const bool initialized = [] {
+    smbc_thread_posix();
+    return true;
+  }();
+  DCHECK(initialized);
+}
+
 void SambaLog(void* private_ptr, int level, const char* msg) {
   VLOG(level) << "libsmbclient: " << msg;
 }
@@ -48,7 +59,30 @@ void CopyPassword(const password_provider::Password& password,
 
 SambaInterfaceImpl::SambaInterfaceImpl(
     std::unique_ptr<SmbCredential> credentials, bool allow_ntlm)
-    : credentials_(std::move(credentials)) {
+    : credentials_(std::move(credentials)), allow_ntlm_(allow_ntlm) {
+  InitContext();
+}
+
+SambaInterfaceImpl::SambaInterfaceImpl(SambaInterfaceImpl* credentials_source)
+    : credentials_source_(credentials_source),
+      allow_ntlm_(credentials_source->allow_ntlm_) {
+  InitContext();
+}
+
+SambaInterfaceImpl::SambaInterfaceImpl() = default;
+
+SambaInterfaceImpl::~SambaInterfaceImpl() {
+  if (context_) {
+    smbc_free_context(context_, 1 /* shutdown_ctx */);
+  }
+}
+
+std::unique_ptr<SambaInterfaceImpl> SambaInterfaceImpl::CreateConnection() {
+  return base::WrapUnique(new SambaInterfaceImpl(this));
+}
+
+void SambaInterfaceImpl::InitContext() {
+  InitThreadSafety();
   context_ = smbc_new_context();
   CHECK(context_);
   CHECK(smbc_init_context(context_));
@@ -63,8 +97,9 @@ SambaInterfaceImpl::SambaInterfaceImpl(
   smbc_setOptionUseKerberos(context_, 1);
   // Allow fallback to NTLMv2 authentication if Kerberos fails. This does not
   // prevent fallback to anonymous auth if authentication fails.
-  smbc_setOptionFallbackAfterKerberos(context_, allow_ntlm);
-  LOG_IF(WARNING, !allow_ntlm) << "NTLM protocol is disabled";
+  smbc_setOptionFallbackAfterKerberos(context_, allow_ntlm_);
+  LOG_IF(WARNING, !allow_ntlm_ && credentials_source_ == this)
+      << "NTLM protocol is disabled";
   smbc_setFunctionAuthDataWithContext(context_,
                                       &SambaInterfaceImpl::GetUserAuth);
 
@@ -88,14 +123,6 @@ SambaInterfaceImpl::SambaInterfaceImpl(
   smbc_write_ctx_ = smbc_getFunctionWrite(context_);
 }
 
-SambaInterfaceImpl::SambaInterfaceImpl() = default;
-
-SambaInterfaceImpl::~SambaInterfaceImpl() {
-  if (context_) {
-    smbc_free_context(context_, 1 /* shutdown_ctx */);
-  }
-}
-
 void SambaInterfaceImpl::UpdateCredentials(
     std::unique_ptr<SmbCredential> credentials) {
   base::AutoLock l(lock_);
@@ -119,6 +146,7 @@ void SambaInterfaceImpl::GetUserAuth(SMBCCTX* context,
   SambaInterfaceImpl* samba_impl =
       static_cast<SambaInterfaceImpl*>(smbc_getOptionUserData(context));
   DCHECK(samba_impl);
+  samba_impl = samba_impl->credentials_source_;
 
   base::AutoLock l(samba_impl->lock_);
   // Credentials can be omitted during mounts manually initiated from the
@@ -30,6 +30,13 @@ class SambaInterfaceImpl : public SambaInterface {
   SambaInterfaceImpl(const SambaInterfaceImpl&) = delete;
   SambaInterfaceImpl& operator=(const SambaInterfaceImpl&) = delete;
 
+  // Creates another libsmbclient context, which authenticates with the
+  // credentials of this one, including the ones set later with
+  // UpdateCredentials(). Calls to the new context can be made on a different
+  // thread than the calls to this one. This object must outlive the returned
+  // one.
+  std::unique_ptr<SambaInterfaceImpl> CreateConnection();
+
   // SambaInterface overrides.
   WeakPtr AsWeakPtr() override;
 
@@ -77,6 +84,12 @@ class SambaInterfaceImpl : public SambaInterface {
   FRIEND_TEST(SambaInterfaceImplTest, MakeStatModeBitsFromDOSAttributes);
   FRIEND_TEST(SambaInterfaceImplTest, UpdateCredentials);
 
+  // Constructor for CreateConnection().
+  explicit SambaInterfaceImpl(SambaInterfaceImpl* credentials_source);
+
+  // Creates and initializes |context_|.
+  void InitContext();
+
   // Callback function for obtaining authentication credentials. Set by calling
   // smbc_setFunctionAuthDataWithContext() and called from libsmbclient.
   static void GetUserAuth(SMBCCTX* context,
@@ -94,6 +107,9 @@ class SambaInterfaceImpl : public SambaInterface {
 
   mutable base::Lock lock_;
   std::unique_ptr<SmbCredential> credentials_;
+  // The object whose |credentials_| are used for authentication.
+  SambaInterfaceImpl* const credentials_source_ = this;
+  const bool allow_ntlm_ = false;
 
   SMBCCTX* context_ = nullptr;
 
@@ -8,6 +8,7 @@
 #include <utility>
 #include <vector>
 
+#include <base/barrier_closure.h>
 #include <base/bind.h>
 #include <base/callback_helpers.h>
 #include <base/check.h>
@@ -27,6 +28,7 @@ namespace smbfs {
 namespace {
 
 constexpr char kSambaThreadName[] = "smbfs-libsmb";
+constexpr char kFileThreadNamePrefix[] = "smbfs-file-";
 constexpr char kUrlPrefix[] = "smb://";
 
 constexpr double kAttrTimeoutSeconds = 5.0;
@@ -37,6 +39,11 @@ constexpr mode_t kFileModeMask = kAllowedFileTypes | 0770;
 constexpr int kStatCacheSize = 1024;
 constexpr double kStatCacheTimeoutSeconds = kAttrTimeoutSeconds;
 
+// Number of libsmbclient contexts regular files are spread over, in addition
+// to the one used for metadata and directories. Each one has its own SMB
+// connection to the server.
+constexpr int kNumFileConnections = 4;
+
 bool IsAllowedFileMode(mode_t mode) {
   return mode & kAllowedFileTypes;
 }
@@ -51,6 +58,28 @@ SmbFilesystem::Options::Options(Options&&) = default;
 
 SmbFilesystem::Options& SmbFilesystem::Options::operator=(Options&&) = default;
 
+SmbFilesystem::Connection::Connection(
+    std::unique_ptr<SambaInterface> samba_impl, const std::string& thread_name)
+    : samba_impl(std::move(samba_impl)), thread(thread_name) {
+  CHECK(thread.Start());
+  task_runner = thread.task_runner();
+}
+
+SmbFilesystem::Connection::~Connection() {
+  // Stop the thread before destroying the context to avoid a UAF on the
+  // context.
+  thread.Stop();
+}
+
+SmbFilesystem::OpenFile::OpenFile() = default;
+
+SmbFilesystem::OpenFile::~OpenFile() = default;
+
+SmbFilesystem::OpenFile::OpenFile(OpenFile&&) = default;
+
+SmbFilesystem::OpenFile& SmbFilesystem::OpenFile::operator=(OpenFile&&) =
+    default;
+
 SmbFilesystem::SmbFilesystem(Delegate* delegate, Options options)
     : delegate_(delegate),
       share_path_(options.share_path),
@@ -68,8 +97,14 @@ SmbFilesystem::SmbFilesystem(Delegate* delegate, Options options)
   CHECK(!share_path_.empty());
   CHECK_NE(share_path_.back(), '/');
 
-  samba_impl_ = std::make_unique<SambaInterfaceImpl>(
+  auto samba_impl = std::make_unique<SambaInterfaceImpl>(
       std::move(options.credentials), options.allow_ntlm);
+  for (int i = 0; i < kNumFileConnections; ++i) {
+    connections_.push_back(std::make_unique<Connection>(
+        samba_impl->CreateConnection(),
+        kFileThreadNamePrefix + base::NumberToString(i)));
+  }
+  samba_impl_ = std::move(samba_impl);
 
   CHECK(samba_thread_.Start());
 }
@@ -83,6 +118,10 @@ SmbFilesystem::SmbFilesystem(Delegate* delegate, const std::string& share_path)
 }
 
 SmbFilesystem::~SmbFilesystem() {
+  // The connection threads post tasks to |samba_thread_|, stop them first.
+  for (auto& connection : connections_) {
+    connection->thread.Stop();
+  }
   if (samba_impl_) {
     // Stop the Samba processing thread before destroying the context to avoid a
     // UAF on the context.
@@ -228,29 +267,176 @@ std::string SmbFilesystem::ShareFilePathFromInode(ino_t inode) const {
   return MakeShareFilePath(file_path);
 }
 
+SmbFilesystem::Connection* SmbFilesystem::PickConnection() {
+  base::AutoLock l(open_files_lock_);
+  Connection* picked = nullptr;
+  for (const auto& connection : connections_) {
+    if (!picked || connection->open_files < picked->open_files) {
+      picked = connection.get();
+    }
+  }
+  if (picked) {
+    ++picked->open_files;
+  }
+  return picked;
+}
+
+void SmbFilesystem::ReleaseConnection(Connection* connection) {
+  if (!connection) {
+    return;
+  }
+  base::AutoLock l(open_files_lock_);
+  DCHECK_GT(connection->open_files, 0);
+  --connection->open_files;
+}
+
+SambaInterface* SmbFilesystem::GetSambaInterface(
+    Connection* connection) const {
+  return connection ? connection->samba_impl.get() : samba_impl_.get();
+}
+
+scoped_refptr<base::SingleThreadTaskRunner> SmbFilesystem::GetTaskRunner(
+    Connection* connection) {
+  return connection ? connection->task_runner : samba_thread_.task_runner();
+}
+
+scoped_refptr<base::SingleThreadTaskRunner> SmbFilesystem::GetFileTaskRunner(
+    uint64_t handle) {
+  Connection* connection = nullptr;
+  {
+    base::AutoLock l(open_files_lock_);
+    const auto it = open_files_.find(handle);
+    if (it != open_files_.end()) {
+      connection = it->second.connection;
+    }
+  }
+  return GetTaskRunner(connection);
+}
+
 uint64_t SmbFilesystem::AddOpenFile(SMBCFILE* file) {
+  OpenFile open_file;
+  open_file.file = file;
+
+  base::AutoLock l(open_files_lock_);
+  uint64_t handle = open_files_seq_++;
+  // Disallow wrap around.
+  CHECK(handle);
+  open_files_[handle] = std::move(open_file);
+  return handle;
+}
+
+uint64_t SmbFilesystem::AddOpenRegularFile(fuse_ino_t inode,
+                                           SMBCFILE* file,
+                                           Connection* connection,
+                                           const std::string& share_file_path) {
+  OpenFile open_file;
+  open_file.file = file;
+  open_file.inode = inode;
+  open_file.connection = connection;
+  open_file.share_file_path = share_file_path;
+
+  base::AutoLock l(open_files_lock_);
+  // The open files of the same inode share their change counter so that a
+  // change made through one of them drops the data read ahead by the others.
+  std::shared_ptr<BufferedFile::ChangeCounter> changes =
+      GetChangeCounter(inode);
+  if (!changes) {
+    changes = std::make_shared<BufferedFile::ChangeCounter>(0);
+  }
+  open_file.buffered_file = std::make_unique<BufferedFile>(
+      GetSambaInterface(connection), file, std::move(changes));
   uint64_t handle = open_files_seq_++;
   // Disallow wrap around.
   CHECK(handle);
-  open_files_[handle] = file;
+  open_files_[handle] = std::move(open_file);
   return handle;
 }
 
 void SmbFilesystem::RemoveOpenFile(uint64_t handle) {
+  base::AutoLock l(open_files_lock_);
   auto it = open_files_.find(handle);
   if (it == open_files_.end()) {
     NOTREACHED() << "File handle not found";
     return;
   }
+  if (it->second.connection) {
+    DCHECK_GT(it->second.connection->open_files, 0);
+    --it->second.connection->open_files;
+  }
   open_files_.erase(it);
 }
 
 SMBCFILE* SmbFilesystem::LookupOpenFile(uint64_t handle) const {
+  base::AutoLock l(open_files_lock_);
   const auto it = open_files_.find(handle);
   if (it == open_files_.end()) {
     return nullptr;
   }
-  return it->second;
+  return it->second.file;
+}
+
+SmbFilesystem::OpenFile* SmbFilesystem::LookupRegularFile(uint64_t handle) {
+  base::AutoLock l(open_files_lock_);
+  const auto it = open_files_.find(handle);
+  if (it == open_files_.end() || !it->second.buffered_file) {
+    return nullptr;
+  }
+  // Elements of |open_files_| do not move when other files are added.
+  return &it->second;
+}
+
+std::shared_ptr<BufferedFile::ChangeCounter> SmbFilesystem::GetChangeCounter(
+    fuse_ino_t inode) const {
+  open_files_lock_.AssertAcquired();
+  for (const auto& entry : open_files_) {
+    const OpenFile& open_file = entry.second;
+    if (open_file.inode == inode && open_file.buffered_file) {
+      return open_file.buffered_file->changes();
+    }
+  }
+  return nullptr;
+}
+
+void SmbFilesystem::NotifyFileChanged(fuse_ino_t inode) {
+  base::AutoLock l(open_files_lock_);
+  std::shared_ptr<BufferedFile::ChangeCounter> changes =
+      GetChangeCounter(inode);
+  if (changes) {
+    ++*changes;
+  }
+}
+
+void SmbFilesystem::WriteBackOpenFiles(fuse_ino_t inode,
+                                       uint64_t except_handle,
+                                       base::OnceClosure done) {
+  std::vector<uint64_t> handles;
+  {
+    base::AutoLock l(open_files_lock_);
+    for (const auto& entry : open_files_) {
+      const OpenFile& open_file = entry.second;
+      if (entry.first != except_handle && open_file.inode == inode &&
+          open_file.buffered_file &&
+          open_file.buffered_file->GetBufferedEnd() > 0) {
+        handles.push_back(entry.first);
+      }
+    }
+  }
+  if (handles.empty()) {
+    std::move(done).Run();
+    return;
+  }
+
+  // The files are only used on their own threads, so this waits for replies
+  // instead of blocking, which could deadlock with a read on another thread.
+  base::RepeatingClosure barrier =
+      base::BarrierClosure(handles.size(), std::move(done));
+  for (uint64_t handle : handles) {
+    GetFileTaskRunner(handle)->PostTaskAndReply(
+        FROM_HERE,
+        base::BindOnce(&SmbFilesystem::WriteBackInternal,
+                       base::Unretained(this), handle),
+        barrier);
+  }
 }
 
 void SmbFilesystem::MaybeUpdateCredentials(int error) {
@@ -356,6 +542,18 @@ void SmbFilesystem::LookupInternal(std::unique_ptr<EntryRequest> request,
           << " name: " << name << " -> path: " << share_file_path;
 
   ino_t inode = inode_map_.IncInodeRef(file_path);
+  // The size on the server must include the data written to open files.
+  WriteBackOpenFiles(
+      inode, 0,
+      base::BindOnce(&SmbFilesystem::OnLookupFilesWrittenBack,
+                     base::Unretained(this), std::move(request), inode,
+                     share_file_path));
+}
+
+void SmbFilesystem::OnLookupFilesWrittenBack(
+    std::unique_ptr<EntryRequest> request,
+    fuse_ino_t inode,
+    const std::string& share_file_path) {
   struct stat smb_stat = {0};
   if (!GetCachedInodeStat(inode, &smb_stat)) {
     int error = samba_impl_->Stat(share_file_path, &smb_stat);
@@ -415,6 +613,15 @@ void SmbFilesystem::GetAttrInternal(std::unique_ptr<AttrRequest> request,
     return;
   }
 
+  // The size on the server must include the data written to open files.
+  WriteBackOpenFiles(
+      inode, 0,
+      base::BindOnce(&SmbFilesystem::OnGetAttrFilesWrittenBack,
+                     base::Unretained(this), std::move(request), inode));
+}
+
+void SmbFilesystem::OnGetAttrFilesWrittenBack(
+    std::unique_ptr<AttrRequest> request, fuse_ino_t inode) {
   struct stat smb_stat = {0};
   const std::string share_file_path = ShareFilePathFromInode(inode);
   VLOG(2) << "GetAttrInternal inode: " << inode
@@ -501,18 +708,66 @@ void SmbFilesystem::SetAttrInternal(std::unique_ptr<AttrRequest> request,
   // SetAttrInternal supports changing multiple attributes simultaneously but
   // this is not atomic: all changes must succeed for the request to succeed but
   // a partial failure will not be unapplied.
+  if ((to_set & FUSE_SET_ATTR_SIZE) && file_handle) {
+    // An open file may have writes buffered on the connection it was opened
+    // on, so it is truncated there.
+    GetFileTaskRunner(*file_handle)
+        ->PostTaskAndReplyWithResult(
+            FROM_HERE,
+            base::BindOnce(&SmbFilesystem::TruncateFileInternal,
+                           base::Unretained(this), *file_handle, attr.st_size),
+            base::BindOnce(&SmbFilesystem::OnFileTruncated,
+                           base::Unretained(this), std::move(request), inode,
+                           share_file_path, attr, to_set, smb_stat,
+                           reply_stat));
+    return;
+  }
+
   if (to_set & FUSE_SET_ATTR_SIZE) {
-    error = SetFileSizeInternal(share_file_path, file_handle, attr.st_size,
-                                smb_stat, &reply_stat);
+    error = SetFileSizeInternal(share_file_path, attr.st_size, smb_stat,
+                                &reply_stat);
     if (error) {
       request->ReplyError(error);
       return;
     }
+    NotifyFileChanged(inode);
   }
 
+  SetAttrTimesInternal(std::move(request), inode, share_file_path, attr,
+                       to_set, smb_stat, reply_stat);
+}
+
+void SmbFilesystem::OnFileTruncated(std::unique_ptr<AttrRequest> request,
+                                    fuse_ino_t inode,
+                                    const std::string& share_file_path,
+                                    const struct stat& attr,
+                                    int to_set,
+                                    const struct stat& current_stat,
+                                    struct stat reply_stat,
+                                    int error) {
+  if (error) {
+    VLOG(1) << "TruncateFile path: " << share_file_path
+            << " size: " << attr.st_size
+            << " failed: " << base::safe_strerror(error);
+    request->ReplyError(error);
+    return;
+  }
+  reply_stat.st_size = attr.st_size;
+
+  SetAttrTimesInternal(std::move(request), inode, share_file_path, attr,
+                       to_set, current_stat, reply_stat);
+}
+
+void SmbFilesystem::SetAttrTimesInternal(std::unique_ptr<AttrRequest> request,
+                                         fuse_ino_t inode,
+                                         const std::string& share_file_path,
+                                         const struct stat& attr,
+                                         int to_set,
+                                         const struct stat& current_stat,
+                                         struct stat reply_stat) {
   if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) {
-    error = SetUtimesInternal(share_file_path, to_set, attr.st_atim,
-                              attr.st_mtim, smb_stat, &reply_stat);
+    int error = SetUtimesInternal(share_file_path, to_set, attr.st_atim,
+                                  attr.st_mtim, current_stat, &reply_stat);
     if (error) {
       request->ReplyError(error);
       return;
@@ -526,7 +781,6 @@ void SmbFilesystem::SetAttrInternal(std::unique_ptr<AttrRequest> request,
 }
 
 int SmbFilesystem::SetFileSizeInternal(const std::string& share_file_path,
-                                       std::optional<uint64_t> file_handle,
                                        off_t size,
                                        const struct stat& current_stat,
                                        struct stat* reply_stat) {
@@ -543,34 +797,24 @@ int SmbFilesystem::SetFileSizeInternal(const std::string& share_file_path,
   }
 
   SMBCFILE* file = nullptr;
-  int error = 0;
-  base::ScopedClosureRunner file_closer;
-  if (file_handle) {
-    file = LookupOpenFile(*file_handle);
-    if (!file) {
-      VLOG(1) << "Bad file handle";
-      return EBADF;
-    }
-  } else {
-    error = samba_impl_->OpenFile(share_file_path, O_WRONLY, 0, &file);
-    if (error) {
-      VLOG(1) << "OpenFile path: " << share_file_path
-              << " failed: " << base::safe_strerror(error);
-      return error;
-    }
-
-    file_closer.ReplaceClosure(base::BindOnce(
-        [](SambaInterface* samba_impl, SMBCFILE* file) {
-          int error = samba_impl->CloseFile(file);
-          if (error) {
-            LOG(ERROR)
-                << "CloseFile failed on temporary SetFileSizeInternal file: "
-                << base::safe_strerror(error);
-          }
-        },
-        samba_impl_.get(), file));
+  int error = samba_impl_->OpenFile(share_file_path, O_WRONLY, 0, &file);
+  if (error) {
+    VLOG(1) << "OpenFile path: " << share_file_path
+            << " failed: " << base::safe_strerror(error);
+    return error;
   }
 
+  base::ScopedClosureRunner file_closer(base::BindOnce(
+      [](SambaInterface* samba_impl, SMBCFILE* file) {
+        int error = samba_impl->CloseFile(file);
+        if (error) {
+          LOG(ERROR)
+              << "CloseFile failed on temporary SetFileSizeInternal file: "
+              << base::safe_strerror(error);
+        }
+      },
+      samba_impl_.get(), file));
+
   error = samba_impl_->TruncateFile(file, size);
   if (error) {
     VLOG(1) << "TruncateFile size: " << size
@@ -642,16 +886,38 @@ void SmbFilesystem::OpenInternal(std::unique_ptr<OpenRequest> request,
   const std::string share_file_path = ShareFilePathFromInode(inode);
   VLOG(2) << "OpenInternal inode: " << inode << " -> path: " << share_file_path;
 
+  Connection* connection = PickConnection();
+  GetTaskRunner(connection)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::OpenFileInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, share_file_path, flags, connection));
+}
+
+void SmbFilesystem::OpenFileInternal(std::unique_ptr<OpenRequest> request,
+                                     fuse_ino_t inode,
+                                     const std::string& share_file_path,
+                                     int flags,
+                                     Connection* connection) {
+  VLOG(2) << "OpenFileInternal path: " << share_file_path
+          << " flags: " << flags;
+
   SMBCFILE* file = nullptr;
-  int error = samba_impl_->OpenFile(share_file_path, flags, 0, &file);
+  int error =
+      GetSambaInterface(connection)->OpenFile(share_file_path, flags, 0, &file);
   if (error) {
     VLOG(1) << "OpenFile path " << share_file_path
             << " failed: " << base::safe_strerror(error);
+    ReleaseConnection(connection);
     request->ReplyError(error);
     return;
   }
 
-  request->ReplyOpen(AddOpenFile(file));
+  if (flags & O_TRUNC) {
+    NotifyFileChanged(inode);
+  }
+  request->ReplyOpen(
+      AddOpenRegularFile(inode, file, connection, share_file_path));
 }
 
 void SmbFilesystem::Create(std::unique_ptr<CreateRequest> request,
@@ -689,19 +955,56 @@ void SmbFilesystem::CreateInternal(std::unique_ptr<CreateRequest> request,
   VLOG(2) << "CreateInternal parent inode: " << parent_inode
           << " name: " << name << " -> path: " << share_file_path;
 
+  Connection* connection = PickConnection();
+  GetTaskRunner(connection)
+      ->PostTask(FROM_HERE, base::BindOnce(&SmbFilesystem::CreateFileInternal,
+                                           base::Unretained(this),
+                                           std::move(request), file_path,
+                                           share_file_path, mode, flags,
+                                           connection));
+}
+
+void SmbFilesystem::CreateFileInternal(std::unique_ptr<CreateRequest> request,
+                                       const base::FilePath& file_path,
+                                       const std::string& share_file_path,
+                                       mode_t mode,
+                                       int flags,
+                                       Connection* connection) {
+  VLOG(2) << "CreateFileInternal path: " << share_file_path
+          << " mode: " << mode << " flags: " << flags;
+
   // NOTE: |mode| appears to be ignored by libsmbclient.
   SMBCFILE* file = nullptr;
-  int error = samba_impl_->OpenFile(share_file_path, flags, mode, &file);
+  int error = GetSambaInterface(connection)
+                  ->OpenFile(share_file_path, flags, mode, &file);
   if (error) {
     VLOG(1) << "OpenFile path: " << share_file_path
             << " failed: " << base::safe_strerror(error);
+    ReleaseConnection(connection);
     request->ReplyError(error);
     return;
   }
 
-  uint64_t handle = AddOpenFile(file);
+  // The inode map is only used on |samba_thread_|.
+  samba_thread_.task_runner()->PostTask(
+      FROM_HERE,
+      base::BindOnce(&SmbFilesystem::OnFileCreated, base::Unretained(this),
+                     std::move(request), file_path, share_file_path, mode,
+                     connection, file));
+}
 
+void SmbFilesystem::OnFileCreated(std::unique_ptr<CreateRequest> request,
+                                  const base::FilePath& file_path,
+                                  const std::string& share_file_path,
+                                  mode_t mode,
+                                  Connection* connection,
+                                  SMBCFILE* file) {
   ino_t inode = inode_map_.IncInodeRef(file_path);
+  // The file may have existed, open, and been truncated.
+  NotifyFileChanged(inode);
+  uint64_t handle =
+      AddOpenRegularFile(inode, file, connection, share_file_path);
+
   struct stat entry_stat = MakeStat(inode, {0});
   entry_stat.st_mode = S_IFREG | mode;
   fuse_entry_param entry = {0};
@@ -722,10 +1025,11 @@ void SmbFilesystem::Read(std::unique_ptr<BufRequest> request,
                          off_t offset) {
   VLOG(2) << "Read inode: " << inode << " size: " << size
           << " offset: " << offset;
-  samba_thread_.task_runner()->PostTask(
-      FROM_HERE,
-      base::BindOnce(&SmbFilesystem::ReadInternal, base::Unretained(this),
-                     std::move(request), inode, file_handle, size, offset));
+  GetFileTaskRunner(file_handle)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::ReadInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, file_handle, size, offset));
 }
 
 void SmbFilesystem::ReadInternal(std::unique_ptr<BufRequest> request,
@@ -739,27 +1043,32 @@ void SmbFilesystem::ReadInternal(std::unique_ptr<BufRequest> request,
     return;
   }
 
-  SMBCFILE* file = LookupOpenFile(file_handle);
-  if (!file) {
+  // Reads must see the data written through other open files of the inode.
+  WriteBackOpenFiles(
+      inode, file_handle,
+      base::BindOnce(&SmbFilesystem::OnReadFilesWrittenBack,
+                     base::Unretained(this), std::move(request), inode,
+                     file_handle, size, offset));
+}
+
+void SmbFilesystem::OnReadFilesWrittenBack(std::unique_ptr<BufRequest> request,
+                                           fuse_ino_t inode,
+                                           uint64_t file_handle,
+                                           size_t size,
+                                           off_t offset) {
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
     VLOG(1) << "Bad file handle";
     request->ReplyError(EBADF);
     return;
   }
 
-  int error = samba_impl_->SeekFile(file, offset, SEEK_SET);
-  if (error) {
-    VLOG(1) << "SeekFile path: " << ShareFilePathFromInode(inode)
-            << ", offset: " << offset
-            << " failed: " << base::safe_strerror(error);
-    request->ReplyError(error);
-    return;
-  }
-
   std::vector<char> buf(size);
   size_t bytes_read = 0;
-  error = samba_impl_->ReadFile(file, buf.data(), size, &bytes_read);
+  int error =
+      open_file->buffered_file->Read(offset, size, buf.data(), &bytes_read);
   if (error) {
-    VLOG(1) << "ReadFile path: " << ShareFilePathFromInode(inode)
+    VLOG(1) << "ReadFile path: " << open_file->share_file_path
             << " offset: " << offset << ", size: " << size
             << " failed: " << base::safe_strerror(error);
     request->ReplyError(error);
@@ -767,6 +1076,36 @@ void SmbFilesystem::ReadInternal(std::unique_ptr<BufRequest> request,
   }
 
   request->ReplyBuf(buf.data(), bytes_read);
+
+  if (open_file->buffered_file->ShouldReadAhead()) {
+    // Read ahead while the kernel processes the reply, before the next read
+    // request arrives.
+    base::ThreadTaskRunnerHandle::Get()->PostTask(
+        FROM_HERE, base::BindOnce(&SmbFilesystem::ReadAheadInternal,
+                                  base::Unretained(this), file_handle));
+  }
+}
+
+void SmbFilesystem::ReadAheadInternal(uint64_t file_handle) {
+  VLOG(2) << "ReadAheadInternal file_handle: " << file_handle;
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
+    // The file was released in the meantime.
+    return;
+  }
+  open_file->buffered_file->ReadAhead();
+}
+
+void SmbFilesystem::WriteBackInternal(uint64_t file_handle) {
+  VLOG(2) << "WriteBackInternal file_handle: " << file_handle;
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
+    // The file was released in the meantime, which wrote it back.
+    return;
+  }
+  open_file->buffered_file->WriteBack();
+  // A stat cached since the write may be missing the data.
+  EraseCachedInodeStat(open_file->inode);
 }
 
 void SmbFilesystem::Write(std::unique_ptr<WriteRequest> request,
@@ -777,11 +1116,12 @@ void SmbFilesystem::Write(std::unique_ptr<WriteRequest> request,
                           off_t offset) {
   VLOG(2) << "Write inode: " << inode << "file_handle: " << file_handle
           << " size: " << size << " offset: " << offset;
-  samba_thread_.task_runner()->PostTask(
-      FROM_HERE,
-      base::BindOnce(&SmbFilesystem::WriteInternal, base::Unretained(this),
-                     std::move(request), inode, file_handle,
-                     std::vector<char>(buf, buf + size), offset));
+  GetFileTaskRunner(file_handle)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::WriteInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, file_handle,
+                                std::vector<char>(buf, buf + size), offset));
 }
 
 void SmbFilesystem::WriteInternal(std::unique_ptr<WriteRequest> request,
@@ -795,26 +1135,18 @@ void SmbFilesystem::WriteInternal(std::unique_ptr<WriteRequest> request,
     return;
   }
 
-  SMBCFILE* file = LookupOpenFile(file_handle);
-  if (!file) {
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
     VLOG(1) << "Bad file handle";
     request->ReplyError(EBADF);
     return;
   }
 
-  int error = samba_impl_->SeekFile(file, offset, SEEK_SET);
-  if (error) {
-    VLOG(1) << "SeekFile path: " << ShareFilePathFromInode(inode)
-            << ", offset: " << offset
-            << " failed: " << base::safe_strerror(error);
-    request->ReplyError(error);
-    return;
-  }
-
   size_t bytes_written = 0;
-  error = samba_impl_->WriteFile(file, buf.data(), buf.size(), &bytes_written);
+  int error = open_file->buffered_file->Write(offset, buf.data(), buf.size(),
+                                              &bytes_written);
   if (error) {
-    VLOG(1) << "WriteFile path: " << ShareFilePathFromInode(inode)
+    VLOG(1) << "WriteFile path: " << open_file->share_file_path
             << " offset: " << offset << ", size: " << buf.size()
             << " failed: " << base::safe_strerror(error);
     request->ReplyError(error);
@@ -827,14 +1159,68 @@ void SmbFilesystem::WriteInternal(std::unique_ptr<WriteRequest> request,
   request->ReplyWrite(bytes_written);
 }
 
+void SmbFilesystem::Flush(std::unique_ptr<SimpleRequest> request,
+                          fuse_ino_t inode,
+                          uint64_t file_handle) {
+  VLOG(2) << "Flush inode: " << inode << " file_handle: " << file_handle;
+  GetFileTaskRunner(file_handle)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::FlushInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, file_handle));
+}
+
+void SmbFilesystem::Fsync(std::unique_ptr<SimpleRequest> request,
+                          fuse_ino_t inode,
+                          uint64_t file_handle,
+                          bool datasync) {
+  VLOG(2) << "Fsync inode: " << inode << " file_handle: " << file_handle
+          << " datasync: " << datasync;
+  // libsmbclient has no way to ask the server to sync a file, so only the
+  // buffered data is written.
+  GetFileTaskRunner(file_handle)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::FlushInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, file_handle));
+}
+
+void SmbFilesystem::FlushInternal(std::unique_ptr<SimpleRequest> request,
+                                  fuse_ino_t inode,
+                                  uint64_t file_handle) {
+  VLOG(2) << "FlushInternal inode: " << inode
+          << " file_handle: " << file_handle;
+  if (request->IsInterrupted()) {
+    return;
+  }
+
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
+    VLOG(1) << "Bad file handle";
+    request->ReplyError(EBADF);
+    return;
+  }
+
+  int error = open_file->buffered_file->Flush();
+  // The size of the file on the server may have changed.
+  EraseCachedInodeStat(inode);
+  if (error) {
+    request->ReplyError(error);
+    return;
+  }
+
+  request->ReplyOk();
+}
+
 void SmbFilesystem::Release(std::unique_ptr<SimpleRequest> request,
                             fuse_ino_t inode,
                             uint64_t file_handle) {
   VLOG(2) << "Release inode: " << inode << " file_handle: " << file_handle;
-  samba_thread_.task_runner()->PostTask(
-      FROM_HERE,
-      base::BindOnce(&SmbFilesystem::ReleaseInternal, base::Unretained(this),
-                     std::move(request), inode, file_handle));
+  GetFileTaskRunner(file_handle)
+      ->PostTask(FROM_HERE,
+                 base::BindOnce(&SmbFilesystem::ReleaseInternal,
+                                base::Unretained(this), std::move(request),
+                                inode, file_handle));
 }
 
 void SmbFilesystem::ReleaseInternal(std::unique_ptr<SimpleRequest> request,
@@ -846,23 +1232,46 @@ void SmbFilesystem::ReleaseInternal(std::unique_ptr<SimpleRequest> request,
     return;
   }
 
-  SMBCFILE* file = LookupOpenFile(file_handle);
-  if (!file) {
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
     VLOG(1) << "Bad file handle";
     request->ReplyError(EBADF);
     return;
   }
 
-  int error = samba_impl_->CloseFile(file);
+  // The kernel sends a flush request on close(), so normally there is no
+  // buffered data left here.
+  int flush_error = open_file->buffered_file->Flush();
+  LOG_IF(WARNING, flush_error)
+      << "Write-back on release failed: " << base::safe_strerror(flush_error);
+  EraseCachedInodeStat(inode);
+
+  int error =
+      GetSambaInterface(open_file->connection)->CloseFile(open_file->file);
   if (error) {
     request->ReplyError(error);
     return;
   }
 
   RemoveOpenFile(file_handle);
+  if (flush_error) {
+    request->ReplyError(flush_error);
+    return;
+  }
   request->ReplyOk();
 }
 
+int SmbFilesystem::TruncateFileInternal(uint64_t file_handle, off_t size) {
+  VLOG(2) << "TruncateFileInternal file_handle: " << file_handle
+          << " size: " << size;
+  OpenFile* open_file = LookupRegularFile(file_handle);
+  if (!open_file) {
+    VLOG(1) << "Bad file handle";
+    return EBADF;
+  }
+  return open_file->buffered_file->Truncate(size);
+}
+
 void SmbFilesystem::Rename(std::unique_ptr<SimpleRequest> request,
                            fuse_ino_t old_parent_inode,
                            const std::string& old_name,
@@ -1305,10 +1714,12 @@ void SmbFilesystem::AddCachedInodeStat(const struct stat& inode_stat) {
   item.inode_stat = inode_stat;
   item.expires_at = base::Time::Now() + base::Seconds(kStatCacheTimeoutSeconds);
 
+  base::AutoLock l(stat_cache_lock_);
   stat_cache_.Put(inode_stat.st_ino, item);
 }
 
 void SmbFilesystem::EraseCachedInodeStat(ino_t inode) {
+  base::AutoLock l(stat_cache_lock_);
   auto iter = stat_cache_.Peek(inode);
   if (iter != stat_cache_.end()) {
     stat_cache_.Erase(iter);
@@ -1317,6 +1728,7 @@ void SmbFilesystem::EraseCachedInodeStat(ino_t inode) {
 
 bool SmbFilesystem::GetCachedInodeStat(ino_t inode, struct stat* out_stat) {
   DCHECK(out_stat);
+  base::AutoLock l(stat_cache_lock_);
   auto iter = stat_cache_.Get(inode);
   if (iter == stat_cache_.end()) {
     return false;
@@ -26,6 +26,7 @@
 #include <base/threading/thread_task_runner_handle.h>
 #include <gtest/gtest_prod.h>
 
+#include "smbfs/buffered_file.h"
 #include "smbfs/filesystem.h"
 #include "smbfs/inode_map.h"
 #include "smbfs/recursive_delete_operation.h"
@@ -132,6 +133,13 @@ class SmbFilesystem : public Filesystem {
              const char* buf,
              size_t size,
              off_t offset) override;
+  void Flush(std::unique_ptr<SimpleRequest> request,
+             fuse_ino_t inode,
+             uint64_t file_handle) override;
+  void Fsync(std::unique_ptr<SimpleRequest> request,
+             fuse_ino_t inode,
+             uint64_t file_handle,
+             bool datasync) override;
   void Release(std::unique_ptr<SimpleRequest> request,
                fuse_ino_t inode,
                uint64_t file_handle) override;
@@ -193,20 +201,78 @@ class SmbFilesystem : public Filesystem {
     base::Time expires_at;
   };
 
+  // A libsmbclient context used for regular files, and the thread all calls
+  // to it are made on. Each file is read and written on the connection it was
+  // opened on, so requests on different files run concurrently.
+  struct Connection {
+    Connection(std::unique_ptr<SambaInterface> samba_impl,
+               const std::string& thread_name);
+    ~Connection();
+
+    std::unique_ptr<SambaInterface> samba_impl;
+    base::Thread thread;
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+    // Number of files open on the connection. Guarded by |open_files_lock_|.
+    int open_files = 0;
+  };
+
+  // An open file or directory. Directories, and regular files when there are
+  // no |connections_| (ie. in unit tests), use |samba_thread_|.
+  struct OpenFile {
+    OpenFile();
+    ~OpenFile();
+
+    OpenFile(OpenFile&&);
+    OpenFile& operator=(OpenFile&&);
+
+    SMBCFILE* file = nullptr;
+    fuse_ino_t inode = 0;
+    // For regular files only.
+    Connection* connection = nullptr;
+    std::unique_ptr<BufferedFile> buffered_file;
+    // Path of the file when it was opened, for logging.
+    std::string share_file_path;
+  };
+
   // Filesystem implementations that execute on |samba_thread_|.
   void StatFsInternal(std::unique_ptr<StatFsRequest> request, fuse_ino_t inode);
   void LookupInternal(std::unique_ptr<EntryRequest> request,
                       fuse_ino_t parent_inode,
                       const std::string& name);
+  // Continues LookupInternal() once the open files of |inode| were written
+  // back.
+  void OnLookupFilesWrittenBack(std::unique_ptr<EntryRequest> request,
+                                fuse_ino_t inode,
+                                const std::string& share_file_path);
   void ForgetInternal(fuse_ino_t inode, uint64_t count);
   void GetAttrInternal(std::unique_ptr<AttrRequest> request, fuse_ino_t inode);
+  // Continues GetAttrInternal() once the open files of |inode| were written
+  // back.
+  void OnGetAttrFilesWrittenBack(std::unique_ptr<AttrRequest> request,
+                                 fuse_ino_t inode);
   void SetAttrInternal(std::unique_ptr<AttrRequest> request,
                        fuse_ino_t inode,
                        std::optional<uint64_t> file_handle,
                        const struct stat& attr,
                        int to_set);
+  // Continues SetAttrInternal() once the size of the file was set.
+  void OnFileTruncated(std::unique_ptr<AttrRequest> request,
+                       fuse_ino_t inode,
+                       const std::string& share_file_path,
+                       const struct stat& attr,
+                       int to_set,
+                       const struct stat& current_stat,
+                       struct stat reply_stat,
+                       int error);
+  // Sets the times of the file, if requested, and replies to |request|.
+  void SetAttrTimesInternal(std::unique_ptr<AttrRequest> request,
+                            fuse_ino_t inode,
+                            const std::string& share_file_path,
+                            const struct stat& attr,
+                            int to_set,
+                            const struct stat& current_stat,
+                            struct stat reply_stat);
   int SetFileSizeInternal(const std::string& share_file_path,
-                          std::optional<uint64_t> file_handle,
                           off_t size,
                           const struct stat& current_stat,
                           struct stat* reply_stat);
@@ -224,19 +290,13 @@ class SmbFilesystem : public Filesystem {
                       const std::string& name,
                       mode_t mode,
                       int flags);
-  void ReadInternal(std::unique_ptr<BufRequest> request,
-                    fuse_ino_t inode,
-                    uint64_t file_handle,
-                    size_t size,
-                    off_t offset);
-  void WriteInternal(std::unique_ptr<WriteRequest> request,
-                     fuse_ino_t inode,
-                     uint64_t file_handle,
-                     const std::vector<char>& buf,
-                     off_t offset);
-  void ReleaseInternal(std::unique_ptr<SimpleRequest> request,
-                       fuse_ino_t inode,
-                       uint64_t file_handle);
+  // Called with the file opened by CreateFileInternal().
+  void OnFileCreated(std::unique_ptr<CreateRequest> request,
+                     const base::FilePath& file_path,
+                     const std::string& share_file_path,
+                     mode_t mode,
+                     Connection* connection,
+                     SMBCFILE* file);
   void RenameInternal(std::unique_ptr<SimpleRequest> request,
                       fuse_ino_t old_parent_inode,
                       const std::string& old_name,
@@ -263,6 +323,48 @@ class SmbFilesystem : public Filesystem {
                      fuse_ino_t parent_inode,
                      const std::string& name);
 
+  // Filesystem implementations that execute on the thread of |connection|.
+  void OpenFileInternal(std::unique_ptr<OpenRequest> request,
+                        fuse_ino_t inode,
+                        const std::string& share_file_path,
+                        int flags,
+                        Connection* connection);
+  void CreateFileInternal(std::unique_ptr<CreateRequest> request,
+                          const base::FilePath& file_path,
+                          const std::string& share_file_path,
+                          mode_t mode,
+                          int flags,
+                          Connection* connection);
+
+  // Filesystem implementations that execute on the thread of the connection
+  // the file was opened on, see GetFileTaskRunner().
+  void ReadInternal(std::unique_ptr<BufRequest> request,
+                    fuse_ino_t inode,
+                    uint64_t file_handle,
+                    size_t size,
+                    off_t offset);
+  // Continues ReadInternal() once the other open files of |inode| were
+  // written back.
+  void OnReadFilesWrittenBack(std::unique_ptr<BufRequest> request,
+                              fuse_ino_t inode,
+                              uint64_t file_handle,
+                              size_t size,
+                              off_t offset);
+  void ReadAheadInternal(uint64_t file_handle);
+  void WriteBackInternal(uint64_t file_handle);
+  void WriteInternal(std::unique_ptr<WriteRequest> request,
+                     fuse_ino_t inode,
+                     uint64_t file_handle,
+                     const std::vector<char>& buf,
+                     off_t offset);
+  void FlushInternal(std::unique_ptr<SimpleRequest> request,
+                     fuse_ino_t inode,
+                     uint64_t file_handle);
+  void ReleaseInternal(std::unique_ptr<SimpleRequest> request,
+                       fuse_ino_t inode,
+                       uint64_t file_handle);
+  int TruncateFileInternal(uint64_t file_handle, off_t size);
+
   // mojom::SmbFs helpers that execute on |samba_thread_|.
   void DeleteRecursivelyInternal(
       const base::FilePath& path,
@@ -287,10 +389,36 @@ class SmbFilesystem : public Filesystem {
   // number.
   std::string ShareFilePathFromInode(ino_t inode) const;
 
-  // Registers an open file and returns a handle to that file. Always returns a
-  // non-zero handle.
+  // Returns the connection with the fewest open files, and counts a file as
+  // open on it. Returns nullptr if there are no |connections_|.
+  Connection* PickConnection();
+
+  // Stops counting a file as open on |connection|, which was returned by
+  // PickConnection(), after the file failed to open.
+  void ReleaseConnection(Connection* connection);
+
+  // Returns the libsmbclient context and the task runner of |connection|, or
+  // of |samba_thread_| if |connection| is nullptr.
+  SambaInterface* GetSambaInterface(Connection* connection) const;
+  scoped_refptr<base::SingleThreadTaskRunner> GetTaskRunner(
+      Connection* connection);
+
+  // Returns the task runner of the connection regular file |handle| was opened
+  // on. Directories and unknown handles use |samba_thread_|.
+  scoped_refptr<base::SingleThreadTaskRunner> GetFileTaskRunner(
+      uint64_t handle);
+
+  // Registers an open directory and returns a handle to that directory. Always
+  // returns a non-zero handle.
   uint64_t AddOpenFile(SMBCFILE* file);
 
+  // Registers regular file |inode| opened on |connection| and returns a handle
+  // to that file. Always returns a non-zero handle.
+  uint64_t AddOpenRegularFile(fuse_ino_t inode,
+                              SMBCFILE* file,
+                              Connection* connection,
+                              const std::string& share_file_path);
+
   // Removes |handle| from the open file table.
   void RemoveOpenFile(uint64_t handle);
 
@@ -298,6 +426,28 @@ class SmbFilesystem : public Filesystem {
   // does not exist.
   SMBCFILE* LookupOpenFile(uint64_t handle) const;
 
+  // Returns the open regular file referred to by |handle|. Returns nullptr if
+  // |handle| does not exist or is a directory. Must be called on the thread
+  // returned by GetFileTaskRunner(), the only one removing the file.
+  OpenFile* LookupRegularFile(uint64_t handle);
+
+  // Returns the change counter shared by the open files of |inode|, or
+  // nullptr if there is none. |open_files_lock_| must be held.
+  std::shared_ptr<BufferedFile::ChangeCounter> GetChangeCounter(
+      fuse_ino_t inode) const;
+
+  // Drops the data read ahead by the open files of |inode|, after it was
+  // changed without going through them.
+  void NotifyFileChanged(fuse_ino_t inode);
+
+  // Writes back the data buffered for writing to the open files of |inode|,
+  // except |except_handle|, on their threads, so that reads and stats see it.
+  // Then runs |done| on the current thread, right away if there is no such
+  // data.
+  void WriteBackOpenFiles(fuse_ino_t inode,
+                          uint64_t except_handle,
+                          base::OnceClosure done);
+
   // Request credentials, if |error| is an auth failure, and the share has not
   // previously connected successfully.
   void MaybeUpdateCredentials(int error);
@@ -331,7 +481,10 @@ class SmbFilesystem : public Filesystem {
   scoped_refptr<base::SingleThreadTaskRunner> main_task_runner_ =
       base::ThreadTaskRunnerHandle::Get();
 
-  std::unordered_map<uint64_t, SMBCFILE*> open_files_;
+  // Regular files are added and removed on their connection's thread, so the
+  // open file table is guarded by |open_files_lock_|.
+  mutable base::Lock open_files_lock_;
+  std::unordered_map<uint64_t, OpenFile> open_files_;
   uint64_t open_files_seq_ = 1;
 
   mutable base::Lock lock_;
@@ -340,7 +493,14 @@ class SmbFilesystem : public Filesystem {
   // Interface to libsmbclient.
   std::unique_ptr<SambaInterface> samba_impl_;
 
+  // Additional libsmbclient contexts for regular files. Must be destroyed
+  // before |samba_impl_|, whose credentials they use.
+  std::vector<std::unique_ptr<Connection>> connections_;
+
   // Cache stat information during ReadDir() to speed up subsequent access.
+  // Writes invalidate it on the connection threads, so it is guarded by
+  // |stat_cache_lock_|.
+  base::Lock stat_cache_lock_;
   base::HashingLRUCache<ino_t, StatCacheItem> stat_cache_;
 
   // Whether a successful connection to the SMB server has been made. Used to
@@ -24,6 +24,20 @@ void AssignAndSignal(std::string* destination,
   event->Signal();
 }
 
+// How long a command of each priority may wait before it is forwarded ahead of
+// commands sent later with a more urgent priority.
+base::TimeDelta GetLatencyTarget(trunks::CommandPriority priority) {
+  switch (priority) {
+    case trunks::PRIORITY_INTERACTIVE:
+      return base::TimeDelta();
+    case trunks::PRIORITY_BACKGROUND:
+      return base::Seconds(5);
+    case trunks::PRIORITY_NORMAL:
+    default:
+      return base::Milliseconds(500);
+  }
+}
+
 // A callback which posts another |callback| to a given |task_runner|.
 void PostCallbackToTaskRunner(
     trunks::CommandTransceiver::ResponseCallback callback,
@@ -48,16 +62,18 @@ BackgroundCommandTransceiver::~BackgroundCommandTransceiver() {}
 
 void BackgroundCommandTransceiver::SendCommand(const std::string& command,
                                                ResponseCallback callback) {
+  SendCommandWithPriority(command, PRIORITY_NORMAL, std::move(callback));
+}
+
+void BackgroundCommandTransceiver::SendCommandWithPriority(
+    const std::string& command,
+    CommandPriority priority,
+    ResponseCallback callback) {
   if (task_runner_.get()) {
     ResponseCallback background_callback =
         base::BindOnce(PostCallbackToTaskRunner, std::move(callback),
                        base::ThreadTaskRunnerHandle::Get());
-    // Use SendCommandTask instead of binding to next_transceiver_ directly to
-    // leverage weak pointer semantics.
-    base::OnceClosure task =
-        base::BindOnce(&BackgroundCommandTransceiver::SendCommandTask,
-                       GetWeakPtr(), command, std::move(background_callback));
-    task_runner_->PostNonNestableTask(FROM_HERE, std::move(task));
+    EnqueueCommand(command, priority, std::move(background_callback));
   } else {
     next_transceiver_->SendCommand(command, std::move(callback));
   }
@@ -72,12 +88,7 @@ std::string BackgroundCommandTransceiver::SendCommandAndWait(
         base::WaitableEvent::InitialState::NOT_SIGNALED);
     ResponseCallback callback =
         base::BindOnce(&AssignAndSignal, &response, &response_ready);
-    // Use SendCommandTask instead of binding to next_transceiver_ directly to
-    // leverage weak pointer semantics.
-    base::OnceClosure task =
-        base::BindOnce(&BackgroundCommandTransceiver::SendCommandTask,
-                       GetWeakPtr(), command, std::move(callback));
-    task_runner_->PostNonNestableTask(FROM_HERE, std::move(task));
+    EnqueueCommand(command, PRIORITY_NORMAL, std::move(callback));
     response_ready.Wait();
     return response;
   } else {
@@ -85,9 +96,37 @@ std::string BackgroundCommandTransceiver::SendCommandAndWait(
   }
 }
 
-void BackgroundCommandTransceiver::SendCommandTask(const std::string& command,
-                                                   ResponseCallback callback) {
-  next_transceiver_->SendCommand(command, std::move(callback));
+void BackgroundCommandTransceiver::EnqueueCommand(const std::string& command,
+                                                  CommandPriority priority,
+                                                  ResponseCallback callback) {
+  {
+    base::AutoLock lock(queue_lock_);
+    const base::TimeTicks now = base::TimeTicks::Now();
+    QueueKey key(now + GetLatencyTarget(priority), next_sequence_number_++);
+    queue_.emplace(key, PendingCommand{command, std::move(callback), now});
+  }
+  // Each task forwards whichever command is most urgent when it runs, rather
+  // than the one it was posted for. Use SendNextCommandTask instead of binding
+  // to next_transceiver_ directly to leverage weak pointer semantics.
+  base::OnceClosure task = base::BindOnce(
+      &BackgroundCommandTransceiver::SendNextCommandTask, GetWeakPtr());
+  task_runner_->PostNonNestableTask(FROM_HERE, std::move(task));
+}
+
+void BackgroundCommandTransceiver::SendNextCommandTask() {
+  PendingCommand pending;
+  {
+    base::AutoLock lock(queue_lock_);
+    if (queue_.empty())
+      return;
+    auto it = queue_.begin();
+    pending = std::move(it->second);
+    queue_.erase(it);
+  }
+  if (stats_) {
+    stats_->RecordQueueWait(base::TimeTicks::Now() - pending.enqueue_time);
+  }
+  next_transceiver_->SendCommand(pending.command, std::move(pending.callback));
 }
 
 }  // namespace trunks
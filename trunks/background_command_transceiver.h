@@ -7,18 +7,31 @@
 
 #include "trunks/command_transceiver.h"
 
+#include <cstdint>
+#include <map>
 #include <string>
+#include <utility>
 
 #include <base/memory/ref_counted.h>
 #include <base/memory/weak_ptr.h>
+#include <base/synchronization/lock.h>
 #include <base/task/sequenced_task_runner.h>
+#include <base/time/time.h>
 
+#include "trunks/tpm_command_stats.h"
 #include "trunks/trunks_export.h"
+#include "trunks/trunks_interface.pb.h"
 
 namespace trunks {
 
 // Sends commands to another CommandTransceiver on a background thread. Response
 // callbacks are called on the original calling thread.
+//
+// Commands waiting for the background thread are forwarded in order of a
+// deadline: the time they were sent plus the latency target of their
+// CommandPriority. Interactive commands thus overtake queued background work,
+// while background commands that have waited long enough are not starved. A
+// command that has already been forwarded is never preempted.
 // Example:
 //   base::Thread background_thread("my thread");
 //   ...
@@ -49,10 +62,34 @@ class TRUNKS_EXPORT BackgroundCommandTransceiver : public CommandTransceiver {
                    ResponseCallback callback) override;
   std::string SendCommandAndWait(const std::string& command) override;
 
+  // Like SendCommand(), but schedules |command| according to |priority|.
+  // SendCommand() and SendCommandAndWait() use PRIORITY_NORMAL.
+  void SendCommandWithPriority(const std::string& command,
+                               CommandPriority priority,
+                               ResponseCallback callback);
+
+  // If set, the time each command spends queued is recorded in |stats|. This
+  // class does not take ownership of |stats|.
+  void set_command_stats(TpmCommandStats* stats) { stats_ = stats; }
+
  private:
-  // Sends a |command| to the |next_transceiver_| and invokes a |callback| with
-  // the command response.
-  void SendCommandTask(const std::string& command, ResponseCallback callback);
+  struct PendingCommand {
+    std::string command;
+    ResponseCallback callback;
+    base::TimeTicks enqueue_time;
+  };
+  // Queued commands are ordered by deadline, then by arrival.
+  using QueueKey = std::pair<base::TimeTicks, uint64_t>;
+
+  // Adds |command| to |queue_| and posts a task to forward the most urgent
+  // queued command.
+  void EnqueueCommand(const std::string& command,
+                      CommandPriority priority,
+                      ResponseCallback callback);
+
+  // Sends the most urgent queued command to the |next_transceiver_| and
+  // invokes its callback with the command response.
+  void SendNextCommandTask();
 
   base::WeakPtr<BackgroundCommandTransceiver> GetWeakPtr() {
     return weak_factory_.GetWeakPtr();
@@ -61,6 +98,13 @@ class TRUNKS_EXPORT BackgroundCommandTransceiver : public CommandTransceiver {
   CommandTransceiver* next_transceiver_;
   scoped_refptr<base::SequencedTaskRunner> task_runner_;
 
+  // Commands sent from any thread and not yet forwarded on |task_runner_|.
+  base::Lock queue_lock_;
+  std::map<QueueKey, PendingCommand> queue_;
+  uint64_t next_sequence_number_ = 0;
+
+  TpmCommandStats* stats_ = nullptr;
+
   // Declared last so weak pointers are invalidated first on destruction.
   base::WeakPtrFactory<BackgroundCommandTransceiver> weak_factory_;
 };
@@ -4,15 +4,24 @@
 
 #include "trunks/background_command_transceiver.h"
 
+#include <algorithm>
+#include <map>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <base/bind.h>
+#include <base/callback_helpers.h>
 #include <base/check.h>
 #include <base/logging.h>
 #include <base/run_loop.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/synchronization/lock.h>
+#include <base/synchronization/waitable_event.h>
 #include <base/test/task_environment.h>
 #include <base/threading/platform_thread.h>
 #include <base/threading/thread.h>
+#include <base/time/time.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -98,4 +107,96 @@ TEST_F(BackgroundTransceiverTest, Synchronous) {
   test_thread_.Stop();
 }
 
+TEST_F(BackgroundTransceiverTest, Priority) {
+  trunks::BackgroundCommandTransceiver background_transceiver(
+      &next_transceiver_, test_thread_.task_runner());
+  std::vector<std::string> forwarded;
+  EXPECT_CALL(next_transceiver_, SendCommand(_, _))
+      .WillRepeatedly(
+          Invoke([&forwarded](const std::string& command,
+                              CommandTransceiver::ResponseCallback callback) {
+            forwarded.push_back(command);
+            std::move(callback).Run(command);
+          }));
+  // Keep the background thread busy while commands are queued.
+  base::WaitableEvent release(base::WaitableEvent::ResetPolicy::MANUAL,
+                              base::WaitableEvent::InitialState::NOT_SIGNALED);
+  test_thread_.task_runner()->PostTask(
+      FROM_HERE, base::BindOnce(&base::WaitableEvent::Wait,
+                                base::Unretained(&release)));
+  background_transceiver.SendCommandWithPriority(
+      "background1", PRIORITY_BACKGROUND, base::DoNothing());
+  background_transceiver.SendCommandWithPriority(
+      "background2", PRIORITY_BACKGROUND, base::DoNothing());
+  background_transceiver.SendCommand("normal", base::DoNothing());
+  background_transceiver.SendCommandWithPriority(
+      "interactive", PRIORITY_INTERACTIVE, base::DoNothing());
+  release.Signal();
+  test_thread_.Stop();
+  EXPECT_EQ(std::vector<std::string>(
+                {"interactive", "normal", "background1", "background2"}),
+            forwarded);
+  base::RunLoop().RunUntilIdle();
+}
+
+// Reports the latency of interactive commands sent while background commands
+// keep the TPM busy. Run with --gtest_also_run_disabled_tests.
+TEST_F(BackgroundTransceiverTest, DISABLED_InteractiveLatencyBenchmark) {
+  const int kRounds = 100;
+  const base::TimeDelta kBackgroundCost = base::Milliseconds(20);
+  const base::TimeDelta kInteractiveCost = base::Milliseconds(2);
+  const base::TimeDelta kInterval = base::Milliseconds(25);
+
+  for (bool use_priority : {false, true}) {
+    base::Thread tpm_thread("tpm_thread");
+    ASSERT_TRUE(tpm_thread.Start());
+    trunks::BackgroundCommandTransceiver background_transceiver(
+        &next_transceiver_, tpm_thread.task_runner());
+    base::Lock lock;
+    std::map<std::string, base::TimeTicks> sent;
+    std::vector<base::TimeDelta> latencies;
+    EXPECT_CALL(next_transceiver_, SendCommand(_, _))
+        .WillRepeatedly(Invoke(
+            [&](const std::string& command,
+                CommandTransceiver::ResponseCallback callback) {
+              const bool interactive = command[0] == 'i';
+              base::PlatformThread::Sleep(interactive ? kInteractiveCost
+                                                      : kBackgroundCost);
+              if (interactive) {
+                base::AutoLock auto_lock(lock);
+                latencies.push_back(base::TimeTicks::Now() - sent[command]);
+              }
+              std::move(callback).Run(command);
+            }));
+
+    for (int i = 0; i < kRounds; ++i) {
+      const std::string id = base::NumberToString(i);
+      // Two background commands per interval oversubscribe the TPM.
+      for (const char* prefix : {"b1-", "b2-"}) {
+        background_transceiver.SendCommandWithPriority(
+            prefix + id,
+            use_priority ? PRIORITY_BACKGROUND : PRIORITY_NORMAL,
+            base::DoNothing());
+      }
+      {
+        base::AutoLock auto_lock(lock);
+        sent["i-" + id] = base::TimeTicks::Now();
+      }
+      background_transceiver.SendCommandWithPriority(
+          "i-" + id, use_priority ? PRIORITY_INTERACTIVE : PRIORITY_NORMAL,
+          base::DoNothing());
+      base::PlatformThread::Sleep(kInterval);
+    }
+    tpm_thread.Stop();
+    base::RunLoop().RunUntilIdle();
+
+    ASSERT_EQ(kRounds, latencies.size());
+    std::sort(latencies.begin(), latencies.end());
+    LOG(INFO) << (use_priority ? "With" : "Without")
+              << " priorities: interactive p50 "
+              << latencies[kRounds / 2].InMillisecondsF() << " ms, p99 "
+              << latencies[kRounds * 99 / 100].InMillisecondsF() << " ms";
+  }
+}
+
 }  // namespace trunks
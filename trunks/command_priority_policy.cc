@@ -0,0 +1,77 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "trunks/command_priority_policy.h"
+
+#include <utility>
+
+#include <base/logging.h>
+
+namespace trunks {
+
+namespace {
+
+// Bounds the memory spent on clients that have come and gone.
+constexpr size_t kMaxCachedSenders = 256;
+
+// Higher is more urgent.
+int GetUrgency(CommandPriority priority) {
+  switch (priority) {
+    case PRIORITY_INTERACTIVE:
+      return 2;
+    case PRIORITY_BACKGROUND:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+}  // namespace
+
+CommandPriorityPolicy::CommandPriorityPolicy(UidResolver uid_resolver)
+    : uid_resolver_(std::move(uid_resolver)) {}
+
+CommandPriorityPolicy::~CommandPriorityPolicy() = default;
+
+void CommandPriorityPolicy::SetUserPriority(uid_t uid,
+                                            CommandPriority priority) {
+  user_priorities_[uid] = priority;
+  sender_priorities_.clear();
+}
+
+CommandPriority CommandPriorityPolicy::GetPriority(
+    const std::string& sender, const SendCommandRequest& request) {
+  CommandPriority priority = GetSenderPriority(sender);
+  if (request.has_priority() &&
+      GetUrgency(request.priority()) < GetUrgency(priority)) {
+    priority = request.priority();
+  }
+  return priority;
+}
+
+CommandPriority CommandPriorityPolicy::GetSenderPriority(
+    const std::string& sender) {
+  auto iter = sender_priorities_.find(sender);
+  if (iter != sender_priorities_.end()) {
+    return iter->second;
+  }
+  CommandPriority priority = PRIORITY_NORMAL;
+  uid_t uid;
+  if (!uid_resolver_.Run(sender, &uid)) {
+    // Don't cache the failure; the next command may resolve.
+    LOG(WARNING) << "Failed to look up the user of " << sender;
+    return priority;
+  }
+  auto user_iter = user_priorities_.find(uid);
+  if (user_iter != user_priorities_.end()) {
+    priority = user_iter->second;
+  }
+  if (sender_priorities_.size() >= kMaxCachedSenders) {
+    sender_priorities_.clear();
+  }
+  sender_priorities_[sender] = priority;
+  return priority;
+}
+
+}  // namespace trunks
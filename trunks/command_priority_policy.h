@@ -0,0 +1,59 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TRUNKS_COMMAND_PRIORITY_POLICY_H_
+#define TRUNKS_COMMAND_PRIORITY_POLICY_H_
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+#include <base/callback.h>
+
+#include "trunks/trunks_export.h"
+#include "trunks/trunks_interface.pb.h"
+
+namespace trunks {
+
+// Decides the scheduling class of the commands sent by each D-Bus client from
+// the user the client runs as, so a client cannot declare itself interactive.
+// A client may still ask for a less urgent class than its own, e.g. for work
+// nobody is waiting on.
+class TRUNKS_EXPORT CommandPriorityPolicy {
+ public:
+  // Looks up the uid of the D-Bus connection |sender| into |uid|. Returns
+  // false if the connection is unknown.
+  using UidResolver =
+      base::RepeatingCallback<bool(const std::string& sender, uid_t* uid)>;
+
+  explicit CommandPriorityPolicy(UidResolver uid_resolver);
+  CommandPriorityPolicy(const CommandPriorityPolicy&) = delete;
+  CommandPriorityPolicy& operator=(const CommandPriorityPolicy&) = delete;
+
+  ~CommandPriorityPolicy();
+
+  // Commands from clients running as |uid| are scheduled as |priority|.
+  // Clients of any other user get PRIORITY_NORMAL.
+  void SetUserPriority(uid_t uid, CommandPriority priority);
+
+  // Returns the class of a command from |sender|. |request| is honored only
+  // if it is less urgent than the class of |sender|.
+  CommandPriority GetPriority(const std::string& sender,
+                              const SendCommandRequest& request);
+
+ private:
+  CommandPriority GetSenderPriority(const std::string& sender);
+
+  UidResolver uid_resolver_;
+  std::map<uid_t, CommandPriority> user_priorities_;
+  // Classes of the connections seen so far. Unique connection names are never
+  // reused by the bus, so a stale entry is harmless; the cache is only
+  // dropped when it grows too large.
+  std::map<std::string, CommandPriority> sender_priorities_;
+};
+
+}  // namespace trunks
+
+#endif  // TRUNKS_COMMAND_PRIORITY_POLICY_H_
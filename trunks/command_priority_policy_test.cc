@@ -0,0 +1,101 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "trunks/command_priority_policy.h"
+
+#include <map>
+#include <string>
+
+#include <base/bind.h>
+#include <gtest/gtest.h>
+
+namespace trunks {
+
+namespace {
+
+constexpr uid_t kInteractiveUid = 1000;
+constexpr uid_t kBackgroundUid = 1001;
+constexpr uid_t kOtherUid = 1002;
+
+}  // namespace
+
+class CommandPriorityPolicyTest : public testing::Test {
+ public:
+  CommandPriorityPolicyTest()
+      : policy_(base::BindRepeating(&CommandPriorityPolicyTest::ResolveUid,
+                                    base::Unretained(this))) {
+    policy_.SetUserPriority(kInteractiveUid, PRIORITY_INTERACTIVE);
+    policy_.SetUserPriority(kBackgroundUid, PRIORITY_BACKGROUND);
+    senders_[":1.1"] = kInteractiveUid;
+    senders_[":1.2"] = kBackgroundUid;
+    senders_[":1.3"] = kOtherUid;
+  }
+
+ protected:
+  bool ResolveUid(const std::string& sender, uid_t* uid) {
+    ++lookups_;
+    auto iter = senders_.find(sender);
+    if (iter == senders_.end()) {
+      return false;
+    }
+    *uid = iter->second;
+    return true;
+  }
+
+  SendCommandRequest MakeRequest() {
+    SendCommandRequest request;
+    request.set_command("command");
+    return request;
+  }
+
+  SendCommandRequest MakeRequest(CommandPriority priority) {
+    SendCommandRequest request = MakeRequest();
+    request.set_priority(priority);
+    return request;
+  }
+
+  std::map<std::string, uid_t> senders_;
+  int lookups_ = 0;
+  CommandPriorityPolicy policy_;
+};
+
+TEST_F(CommandPriorityPolicyTest, ClassFromUser) {
+  EXPECT_EQ(PRIORITY_INTERACTIVE, policy_.GetPriority(":1.1", MakeRequest()));
+  EXPECT_EQ(PRIORITY_BACKGROUND, policy_.GetPriority(":1.2", MakeRequest()));
+  EXPECT_EQ(PRIORITY_NORMAL, policy_.GetPriority(":1.3", MakeRequest()));
+}
+
+TEST_F(CommandPriorityPolicyTest, UnknownSender) {
+  EXPECT_EQ(PRIORITY_NORMAL, policy_.GetPriority(":1.9", MakeRequest()));
+  // Failures are retried.
+  senders_[":1.9"] = kInteractiveUid;
+  EXPECT_EQ(PRIORITY_INTERACTIVE, policy_.GetPriority(":1.9", MakeRequest()));
+}
+
+TEST_F(CommandPriorityPolicyTest, RequestCannotRaisePriority) {
+  EXPECT_EQ(PRIORITY_NORMAL,
+            policy_.GetPriority(":1.3", MakeRequest(PRIORITY_INTERACTIVE)));
+  EXPECT_EQ(PRIORITY_BACKGROUND,
+            policy_.GetPriority(":1.2", MakeRequest(PRIORITY_INTERACTIVE)));
+  EXPECT_EQ(PRIORITY_BACKGROUND,
+            policy_.GetPriority(":1.2", MakeRequest(PRIORITY_NORMAL)));
+}
+
+TEST_F(CommandPriorityPolicyTest, RequestCanLowerPriority) {
+  EXPECT_EQ(PRIORITY_NORMAL,
+            policy_.GetPriority(":1.1", MakeRequest(PRIORITY_NORMAL)));
+  EXPECT_EQ(PRIORITY_BACKGROUND,
+            policy_.GetPriority(":1.1", MakeRequest(PRIORITY_BACKGROUND)));
+  EXPECT_EQ(PRIORITY_BACKGROUND,
+            policy_.GetPriority(":1.3", MakeRequest(PRIORITY_BACKGROUND)));
+}
+
+TEST_F(CommandPriorityPolicyTest, SenderCached) {
+  policy_.GetPriority(":1.1", MakeRequest());
+  policy_.GetPriority(":1.1", MakeRequest());
+  policy_.GetPriority(":1.2", MakeRequest());
+  EXPECT_EQ(2, lookups_);
+}
+
+}  // namespace trunks
@@ -13,6 +13,7 @@ constexpr char kTrunksServiceName[] = "org.chromium.Trunks";
 
 // Methods exported by trunks.
 constexpr char kSendCommand[] = "SendCommand";
+constexpr char kGetCommandStats[] = "GetCommandStats";
 
 };  // namespace trunks
 
@@ -17,6 +17,7 @@
 #include <base/check_op.h>
 #include <base/logging.h>
 
+#include "trunks/command_codes.h"
 #include "trunks/error_codes.h"
 
 #define IS_TPM_CC_VENDOR_CMD(c)            \
@@ -107,6 +108,21 @@ void ResourceManager::SendCommand(const std::string& command,
 }
 
 std::string ResourceManager::SendCommandAndWait(const std::string& command) {
+  if (!stats_) {
+    return ProcessCommand(command);
+  }
+  const base::TimeTicks start = base::TimeTicks::Now();
+  tpm_latency_ = base::TimeDelta();
+  std::string response = ProcessCommand(command);
+  TPM_CC command_code;
+  if (GetCommandCode(command, command_code) == TPM_RC_SUCCESS) {
+    stats_->RecordCommand(command_code, base::TimeTicks::Now() - start,
+                          tpm_latency_);
+  }
+  return response;
+}
+
+std::string ResourceManager::ProcessCommand(const std::string& command) {
   // Sanitize the |command|. If this succeeds consistency of the command header
   // and the size of all other sections can be assumed.
   MessageInfo command_info;
@@ -205,7 +221,7 @@ std::string ResourceManager::SendCommandAndWait(const std::string& command) {
   MessageInfo response_info;
   int attempts = 0;
   while (attempts++ < kMaxCommandAttempts) {
-    response = next_transceiver_->SendCommandAndWait(updated_command);
+    response = SendToTpm(updated_command);
     result = ParseResponse(command_info, response, &response_info);
     if (result != TPM_RC_SUCCESS) {
       return CreateErrorResponse(result);
@@ -608,8 +624,12 @@ TPM_RC ResourceManager::LoadContext(const MessageInfo& command_info,
   TPM_RC result = TPM_RC_SUCCESS;
   int attempts = 0;
   while (attempts++ < kMaxCommandAttempts) {
+    const base::TimeTicks start = base::TimeTicks::Now();
     result = factory_.GetTpm()->ContextLoadSync(
         handle_info->context, &handle_info->tpm_handle, nullptr);
+    if (stats_) {
+      stats_->RecordContextLoad(base::TimeTicks::Now() - start);
+    }
     if (!FixWarnings(command_info, result)) {
       break;
     }
@@ -898,7 +918,7 @@ std::string ResourceManager::ProcessFlushContext(
       command.substr(0, kMessageHeaderSize) + handle_blob;
   // No need to loop and fix warnings, there are no actionable warnings on when
   // flushing context.
-  std::string response = next_transceiver_->SendCommandAndWait(updated_command);
+  std::string response = SendToTpm(updated_command);
   MessageInfo response_info;
   TPM_RC result = ParseResponse(command_info, response, &response_info);
   if (result != TPM_RC_SUCCESS) {
@@ -993,6 +1013,16 @@ std::string ResourceManager::ReplaceHandles(
                                  handles_blob);
 }
 
+std::string ResourceManager::SendToTpm(const std::string& command) {
+  if (!stats_) {
+    return next_transceiver_->SendCommandAndWait(command);
+  }
+  const base::TimeTicks start = base::TimeTicks::Now();
+  std::string response = next_transceiver_->SendCommandAndWait(command);
+  tpm_latency_ += base::TimeTicks::Now() - start;
+  return response;
+}
+
 TPM_RC ResourceManager::SaveContext(const MessageInfo& command_info,
                                     HandleInfo* handle_info) {
   if (!handle_info->is_loaded) {
@@ -1004,9 +1034,13 @@ TPM_RC ResourceManager::SaveContext(const MessageInfo& command_info,
   while (attempts++ < kMaxCommandAttempts) {
     std::string tpm_handle_name;
     Serialize_TPM_HANDLE(handle_info->tpm_handle, &tpm_handle_name);
+    const base::TimeTicks start = base::TimeTicks::Now();
     result = factory_.GetTpm()->ContextSaveSync(handle_info->tpm_handle,
                                                 tpm_handle_name,
                                                 &handle_info->context, nullptr);
+    if (stats_) {
+      stats_->RecordContextSave(base::TimeTicks::Now() - start);
+    }
     if (!FixWarnings(command_info, result)) {
       break;
     }
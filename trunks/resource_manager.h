@@ -15,6 +15,7 @@
 #include <base/location.h>
 #include <base/time/time.h>
 
+#include "trunks/tpm_command_stats.h"
 #include "trunks/tpm_generated.h"
 #include "trunks/trunks_factory.h"
 
@@ -68,6 +69,10 @@ class ResourceManager : public CommandTransceiver {
     max_suspend_duration_ = max_suspend_duration;
   }
 
+  // If set, the latency of each command and of the context swaps done to run
+  // it is recorded in |stats|. This class does not take ownership of |stats|.
+  void set_command_stats(TpmCommandStats* stats) { stats_ = stats; }
+
  private:
   struct MessageInfo {
     bool has_sessions = false;
@@ -239,6 +244,13 @@ class ResourceManager : public CommandTransceiver {
   std::string ReplaceHandles(const std::string& message,
                              const std::vector<TPM_HANDLE>& new_handles);
 
+  // Does the work of SendCommandAndWait().
+  std::string ProcessCommand(const std::string& command);
+
+  // Forwards |command| to |next_transceiver_|, accumulating the time spent in
+  // |tpm_latency_| when statistics are enabled.
+  std::string SendToTpm(const std::string& command);
+
   // Saves the context for a session or object handle. On success returns
   // TPM_RC_SUCCESS and ensures |handle_info| holds valid context data.
   TPM_RC SaveContext(const MessageInfo& command_info, HandleInfo* handle_info);
@@ -250,6 +262,9 @@ class ResourceManager : public CommandTransceiver {
 
   const TrunksFactory& factory_;
   CommandTransceiver* next_transceiver_ = nullptr;
+  TpmCommandStats* stats_ = nullptr;
+  // Time the command being processed has spent in |next_transceiver_|.
+  base::TimeDelta tpm_latency_;
   TPM_HANDLE next_virtual_handle_ = TRANSIENT_FIRST;
 
   // A mapping of known unloaded virtual handles to corresponding HandleInfo.
@@ -0,0 +1,74 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "trunks/tpm_command_stats.h"
+
+#include <algorithm>
+
+namespace trunks {
+
+TpmCommandStats::TpmCommandStats() = default;
+
+TpmCommandStats::~TpmCommandStats() = default;
+
+void TpmCommandStats::RecordCommand(TPM_CC command_code,
+                                    base::TimeDelta latency,
+                                    base::TimeDelta tpm_latency) {
+  base::AutoLock lock(lock_);
+  CommandHistograms& histograms = commands_[command_code];
+  histograms.latency.Add(latency);
+  histograms.tpm_latency.Add(tpm_latency);
+}
+
+void TpmCommandStats::RecordQueueWait(base::TimeDelta wait) {
+  base::AutoLock lock(lock_);
+  queue_wait_.Add(wait);
+}
+
+void TpmCommandStats::RecordContextSave(base::TimeDelta latency) {
+  base::AutoLock lock(lock_);
+  context_saves_.Add(latency);
+}
+
+void TpmCommandStats::RecordContextLoad(base::TimeDelta latency) {
+  base::AutoLock lock(lock_);
+  context_loads_.Add(latency);
+}
+
+void TpmCommandStats::GetStats(GetCommandStatsResponse* response) const {
+  response->Clear();
+  base::AutoLock lock(lock_);
+  for (const auto& entry : commands_) {
+    CommandStats* command = response->add_commands();
+    command->set_command_code(entry.first);
+    entry.second.latency.ToProto(command->mutable_latency());
+    entry.second.tpm_latency.ToProto(command->mutable_tpm_latency());
+  }
+  queue_wait_.ToProto(response->mutable_queue_wait());
+  context_saves_.ToProto(response->mutable_context_saves());
+  context_loads_.ToProto(response->mutable_context_loads());
+}
+
+void TpmCommandStats::Histogram::Add(base::TimeDelta sample) {
+  const uint64_t us = std::max<int64_t>(sample.InMicroseconds(), 0);
+  int bucket = 0;
+  while (bucket < kNumBuckets - 1 && (us >> bucket) != 0) {
+    ++bucket;
+  }
+  ++count;
+  total_us += us;
+  max_us = std::max(max_us, us);
+  ++buckets[bucket];
+}
+
+void TpmCommandStats::Histogram::ToProto(LatencyHistogram* proto) const {
+  proto->set_count(count);
+  proto->set_total_us(total_us);
+  proto->set_max_us(max_us);
+  for (uint64_t bucket : buckets) {
+    proto->add_buckets(bucket);
+  }
+}
+
+}  // namespace trunks
@@ -0,0 +1,75 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TRUNKS_TPM_COMMAND_STATS_H_
+#define TRUNKS_TPM_COMMAND_STATS_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+#include "trunks/tpm_generated.h"
+#include "trunks/trunks_export.h"
+#include "trunks/trunks_interface.pb.h"
+
+namespace trunks {
+
+// Accumulates latency statistics for the commands trunksd sends to the TPM, so
+// slow commands and context swapping can be diagnosed on a live device. All
+// methods are thread-safe.
+class TRUNKS_EXPORT TpmCommandStats {
+ public:
+  TpmCommandStats();
+  TpmCommandStats(const TpmCommandStats&) = delete;
+  TpmCommandStats& operator=(const TpmCommandStats&) = delete;
+
+  ~TpmCommandStats();
+
+  // Records that the resource manager took |latency| to process a command with
+  // |command_code|, of which |tpm_latency| was spent waiting for the TPM.
+  void RecordCommand(TPM_CC command_code,
+                     base::TimeDelta latency,
+                     base::TimeDelta tpm_latency);
+
+  // Records that a command waited |wait| to be picked up from the queue.
+  void RecordQueueWait(base::TimeDelta wait);
+
+  // Record a context save or load issued by the resource manager itself.
+  void RecordContextSave(base::TimeDelta latency);
+  void RecordContextLoad(base::TimeDelta latency);
+
+  // Fills |response| with a snapshot of the statistics.
+  void GetStats(GetCommandStatsResponse* response) const;
+
+ private:
+  static constexpr int kNumBuckets = 24;
+
+  struct Histogram {
+    void Add(base::TimeDelta sample);
+    void ToProto(LatencyHistogram* proto) const;
+
+    uint64_t count = 0;
+    uint64_t total_us = 0;
+    uint64_t max_us = 0;
+    std::array<uint64_t, kNumBuckets> buckets = {};
+  };
+
+  struct CommandHistograms {
+    Histogram latency;
+    Histogram tpm_latency;
+  };
+
+  mutable base::Lock lock_;
+  std::map<TPM_CC, CommandHistograms> commands_;
+  Histogram queue_wait_;
+  Histogram context_saves_;
+  Histogram context_loads_;
+};
+
+}  // namespace trunks
+
+#endif  // TRUNKS_TPM_COMMAND_STATS_H_
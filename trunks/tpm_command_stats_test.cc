@@ -0,0 +1,88 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "trunks/tpm_command_stats.h"
+
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "trunks/trunks_interface.pb.h"
+
+namespace trunks {
+
+TEST(TpmCommandStatsTest, Empty) {
+  TpmCommandStats stats;
+  GetCommandStatsResponse response;
+  stats.GetStats(&response);
+  EXPECT_EQ(0, response.commands_size());
+  EXPECT_EQ(0, response.queue_wait().count());
+  EXPECT_EQ(0, response.context_saves().count());
+  EXPECT_EQ(0, response.context_loads().count());
+}
+
+TEST(TpmCommandStatsTest, RecordCommand) {
+  TpmCommandStats stats;
+  stats.RecordCommand(TPM_CC_Sign, base::Microseconds(300),
+                      base::Microseconds(200));
+  stats.RecordCommand(TPM_CC_Sign, base::Microseconds(100),
+                      base::Microseconds(100));
+  stats.RecordCommand(TPM_CC_GetRandom, base::Microseconds(0),
+                      base::Microseconds(0));
+
+  GetCommandStatsResponse response;
+  stats.GetStats(&response);
+  ASSERT_EQ(2, response.commands_size());
+  // Commands are reported in order of command code.
+  const CommandStats& sign = response.commands(0);
+  const CommandStats& get_random = response.commands(1);
+  EXPECT_EQ(TPM_CC_GetRandom, get_random.command_code());
+  EXPECT_EQ(1, get_random.latency().count());
+  EXPECT_EQ(1, get_random.latency().buckets(0));
+
+  EXPECT_EQ(TPM_CC_Sign, sign.command_code());
+  EXPECT_EQ(2, sign.latency().count());
+  EXPECT_EQ(400, sign.latency().total_us());
+  EXPECT_EQ(300, sign.latency().max_us());
+  EXPECT_EQ(300, sign.tpm_latency().total_us());
+  EXPECT_EQ(200, sign.tpm_latency().max_us());
+}
+
+TEST(TpmCommandStatsTest, Buckets) {
+  TpmCommandStats stats;
+  // Bucket i holds samples in [2^(i-1), 2^i) microseconds.
+  stats.RecordQueueWait(base::Microseconds(1));
+  stats.RecordQueueWait(base::Microseconds(3));
+  stats.RecordQueueWait(base::Microseconds(4));
+  stats.RecordQueueWait(base::Microseconds(7));
+  // Samples that don't fit are counted in the last bucket.
+  stats.RecordQueueWait(base::Hours(1));
+
+  GetCommandStatsResponse response;
+  stats.GetStats(&response);
+  const LatencyHistogram& queue_wait = response.queue_wait();
+  ASSERT_LT(3, queue_wait.buckets_size());
+  EXPECT_EQ(5, queue_wait.count());
+  EXPECT_EQ(0, queue_wait.buckets(0));
+  EXPECT_EQ(1, queue_wait.buckets(1));
+  EXPECT_EQ(1, queue_wait.buckets(2));
+  EXPECT_EQ(2, queue_wait.buckets(3));
+  EXPECT_EQ(1, queue_wait.buckets(queue_wait.buckets_size() - 1));
+  EXPECT_EQ(base::Hours(1).InMicroseconds(), queue_wait.max_us());
+}
+
+TEST(TpmCommandStatsTest, ContextSwaps) {
+  TpmCommandStats stats;
+  stats.RecordContextSave(base::Milliseconds(2));
+  stats.RecordContextLoad(base::Milliseconds(1));
+  stats.RecordContextLoad(base::Milliseconds(3));
+
+  GetCommandStatsResponse response;
+  stats.GetStats(&response);
+  EXPECT_EQ(1, response.context_saves().count());
+  EXPECT_EQ(2000, response.context_saves().total_us());
+  EXPECT_EQ(2, response.context_loads().count());
+  EXPECT_EQ(4000, response.context_loads().total_us());
+}
+
+}  // namespace trunks
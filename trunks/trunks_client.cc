@@ -24,6 +24,7 @@
 #include <crypto/scoped_openssl_types.h>
 #include <openssl/sha.h>
 
+#include "trunks/command_codes.h"
 #include "trunks/error_codes.h"
 #include "trunks/hmac_session.h"
 #include "trunks/password_authorization_delegate.h"
@@ -137,6 +138,7 @@ void PrintUsage() {
   puts("  --test_sign_verify - Perform a closed-loop sign and verify test");
   puts("  --test_certify_simple");
   puts("     - Perform certifying key and partially verify the output-");
+  puts("  --command_stats - Prints trunksd command latency statistics.");
   puts("D-Bus options:");
   puts("  --vtpm");
   puts("      - Send the TPM command to vtpm instead of trunks.");
@@ -532,6 +534,47 @@ int TransientKeys(const TrunksFactory& factory) {
   return 0;
 }
 
+void PrintLatencyHistogram(const char* name,
+                           const trunks::LatencyHistogram& histogram) {
+  if (histogram.count() == 0) {
+    return;
+  }
+  printf("  %s: count=%" PRIu64 " avg=%" PRIu64 "us max=%" PRIu64 "us\n", name,
+         histogram.count(), histogram.total_us() / histogram.count(),
+         histogram.max_us());
+  for (int i = 0; i < histogram.buckets_size(); ++i) {
+    if (histogram.buckets(i) == 0) {
+      continue;
+    }
+    if (i == 0) {
+      printf("    <1us: %" PRIu64 "\n", histogram.buckets(i));
+    } else {
+      printf("    >=%" PRIu64 "us: %" PRIu64 "\n", uint64_t{1} << (i - 1),
+             histogram.buckets(i));
+    }
+  }
+}
+
+int PrintCommandStats(TrunksDBusProxy* proxy) {
+  trunks::GetCommandStatsResponse stats;
+  if (!proxy->GetCommandStats(&stats)) {
+    LOG(ERROR) << "Failed to get command stats.";
+    return -1;
+  }
+  for (const trunks::CommandStats& command : stats.commands()) {
+    printf("%s (%#x):\n",
+           trunks::GetCommandString(command.command_code()).c_str(),
+           command.command_code());
+    PrintLatencyHistogram("latency", command.latency());
+    PrintLatencyHistogram("tpm_latency", command.tpm_latency());
+  }
+  puts("trunksd:");
+  PrintLatencyHistogram("queue_wait", stats.queue_wait());
+  PrintLatencyHistogram("context_saves", stats.context_saves());
+  PrintLatencyHistogram("context_loads", stats.context_loads());
+  return 0;
+}
+
 void PrintEccPoint(const char* name, const trunks::TPM2B_ECC_POINT& point) {
   printf("%s point: [%u]", name, point.size);
   printf("  X=[%u] %s, ", point.point.x.size, HexEncode(point.point.x).c_str());
@@ -1115,6 +1158,9 @@ int main(int argc, char** argv) {
                             : CreateTrunksDBusProxyToTrunks();
 
   CHECK(dbus_proxy->Init()) << "Failed to initialize D-Bus proxy.";
+  if (cl->HasSwitch("command_stats")) {
+    return PrintCommandStats(dbus_proxy.get());
+  }
 
   TrunksFactoryImpl factory(dbus_proxy.get());
   CHECK(factory.Initialize()) << "Failed to initialize trunks factory.";
@@ -127,6 +127,9 @@ void TrunksDBusProxy::SendCommandInternal(const std::string& command,
       base::SplitOnceCallback(std::move(callback));
   SendCommandRequest tpm_command_proto;
   tpm_command_proto.set_command(command);
+  if (priority_) {
+    tpm_command_proto.set_priority(*priority_);
+  }
   auto on_success = base::BindOnce(
       [](ResponseCallback callback, const SendCommandResponse& response) {
         std::move(callback).Run(response.response());
@@ -165,6 +168,9 @@ std::string TrunksDBusProxy::SendCommandAndWaitInternal(
   }
   SendCommandRequest tpm_command_proto;
   tpm_command_proto.set_command(command);
+  if (priority_) {
+    tpm_command_proto.set_priority(*priority_);
+  }
   brillo::ErrorPtr error;
   std::unique_ptr<dbus::Response> dbus_response =
       brillo::dbus_utils::CallMethodAndBlockWithTimeout(
@@ -190,6 +196,30 @@ std::string TrunksDBusProxy::SendCommandAndWaitInternal(
   }
 }
 
+bool TrunksDBusProxy::GetCommandStats(GetCommandStatsResponse* stats) {
+  if (origin_thread_id_ != base::PlatformThread::CurrentId()) {
+    LOG(ERROR) << "Error TrunksDBusProxy cannot be shared by multiple threads.";
+    return false;
+  }
+  if (!IsServiceReady(false /* force_check */)) {
+    LOG(ERROR) << "Error TrunksDBusProxy cannot connect to trunksd.";
+    return false;
+  }
+  brillo::ErrorPtr error;
+  std::unique_ptr<dbus::Response> dbus_response =
+      brillo::dbus_utils::CallMethodAndBlock(object_proxy_, dbus_interface_,
+                                             trunks::kGetCommandStats, &error,
+                                             GetCommandStatsRequest());
+  if (!dbus_response ||
+      !brillo::dbus_utils::ExtractMethodCallResults(dbus_response.get(),
+                                                    &error, stats)) {
+    LOG(ERROR) << "TrunksProxy could not get command stats: "
+               << (error ? error->GetMessage() : "no response");
+    return false;
+  }
+  return true;
+}
+
 void TrunksDBusProxy::ReportMetrics(const std::string& command,
                                     const std::string& response) {
   TPM_CC cc;
@@ -6,6 +6,7 @@
 #define TRUNKS_TRUNKS_DBUS_PROXY_H_
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -18,6 +19,7 @@
 
 #include "trunks/command_transceiver.h"
 #include "trunks/trunks_export.h"
+#include "trunks/trunks_interface.pb.h"
 
 namespace trunks {
 
@@ -50,6 +52,15 @@ class TRUNKS_EXPORT TrunksDBusProxy : public CommandTransceiver {
   // the flag is not set or |force_check| is passed.
   bool IsServiceReady(bool force_check);
 
+  // Fetches trunksd's command latency statistics into |stats|. Blocks until
+  // trunksd responds. Returns true on success.
+  bool GetCommandStats(GetCommandStatsResponse* stats);
+
+  // Asks trunksd to schedule this client's commands as |priority|. trunksd
+  // derives the class from the user the client runs as and only honors
+  // |priority| if it is less urgent than that.
+  void set_command_priority(CommandPriority priority) { priority_ = priority; }
+
   void set_init_timeout(base::TimeDelta init_timeout) {
     init_timeout_ = init_timeout;
   }
@@ -100,6 +111,7 @@ class TRUNKS_EXPORT TrunksDBusProxy : public CommandTransceiver {
   const std::string dbus_interface_;
 
   bool service_ready_ = false;
+  std::optional<CommandPriority> priority_;
   // Timeout waiting for trunksd service readiness on dbus when initializing.
   base::TimeDelta init_timeout_ = base::Seconds(30);
   // Delay between subsequent checks if trunksd is ready on dbus.
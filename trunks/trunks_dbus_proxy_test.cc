@@ -62,6 +62,8 @@ class FakeObjectProxy : public dbus::ObjectProxy {
     trunks::SendCommandRequest command_proto;
     brillo::dbus_utils::PopValueFromReader(&reader, &command_proto);
     last_command_ = command_proto.command();
+    has_priority_ = command_proto.has_priority();
+    last_priority_ = command_proto.priority();
     if (next_response_.empty()) {
       return std::unique_ptr<dbus::Response>();
     }
@@ -76,6 +78,8 @@ class FakeObjectProxy : public dbus::ObjectProxy {
 
   std::string next_response_;
   std::string last_command_;
+  bool has_priority_ = false;
+  trunks::CommandPriority last_priority_ = trunks::PRIORITY_NORMAL;
 };
 
 }  // namespace
@@ -175,6 +179,25 @@ TEST_F(TrunksDBusProxyTest, SendCommandAndWaitSuccess) {
   EXPECT_EQ(command, last_command());
 }
 
+TEST_F(TrunksDBusProxyTest, SendCommandPriority) {
+  std::string command = CreateCommand(TPM_CC_FIRST);
+  std::string tpm_response = CreateErrorResponse(TPM_RC_SUCCESS);
+  TpmErrorData error_data{TPM_CC_FIRST, TPM_RC_SUCCESS};
+  EXPECT_CALL(*uma_reporter_, ReportTpm2CommandAndResponse(error_data))
+      .Times(2)
+      .WillRepeatedly(Return(true));
+
+  EXPECT_TRUE(proxy_.Init());
+  set_next_response(tpm_response);
+  EXPECT_EQ(tpm_response, proxy_.SendCommandAndWait(command));
+  // By default trunksd picks the class.
+  EXPECT_FALSE(object_proxy_->has_priority_);
+  proxy_.set_command_priority(PRIORITY_BACKGROUND);
+  EXPECT_EQ(tpm_response, proxy_.SendCommandAndWait(command));
+  EXPECT_TRUE(object_proxy_->has_priority_);
+  EXPECT_EQ(PRIORITY_BACKGROUND, object_proxy_->last_priority_);
+}
+
 TEST_F(TrunksDBusProxyTest, SendCommandFailureInit) {
   std::string command = CreateCommand(TPM_CC_FIRST);
   TpmErrorData error_data{TPM_CC_FIRST, SAPI_RC_NO_CONNECTION};
@@ -8,6 +8,8 @@
 
 #include <base/bind.h>
 #include <base/logging.h>
+#include <dbus/message.h>
+#include <dbus/object_proxy.h>
 
 #include "trunks/dbus_interface.h"
 #include "trunks/error_codes.h"
@@ -18,8 +20,19 @@ namespace trunks {
 using brillo::dbus_utils::AsyncEventSequencer;
 using brillo::dbus_utils::DBusMethodResponse;
 
+namespace {
+
+constexpr char kDBusServiceName[] = "org.freedesktop.DBus";
+constexpr char kDBusServicePath[] = "/org/freedesktop/DBus";
+constexpr char kDBusInterface[] = "org.freedesktop.DBus";
+constexpr char kGetConnectionUnixUser[] = "GetConnectionUnixUser";
+
+}  // namespace
+
 TrunksDBusService::TrunksDBusService()
-    : brillo::DBusServiceDaemon(trunks::kTrunksServiceName) {}
+    : brillo::DBusServiceDaemon(trunks::kTrunksServiceName),
+      priority_policy_(base::BindRepeating(&TrunksDBusService::GetSenderUid,
+                                           base::Unretained(this))) {}
 
 void TrunksDBusService::RegisterDBusObjectsAsync(
     AsyncEventSequencer* sequencer) {
@@ -27,8 +40,12 @@ void TrunksDBusService::RegisterDBusObjectsAsync(
       nullptr, bus_, dbus::ObjectPath(kTrunksServicePath)));
   brillo::dbus_utils::DBusInterface* dbus_interface =
       trunks_dbus_object_->AddOrGetInterface(kTrunksInterface);
-  dbus_interface->AddMethodHandler(kSendCommand, base::Unretained(this),
-                                   &TrunksDBusService::HandleSendCommand);
+  dbus_interface->AddMethodHandlerWithMessage(
+      kSendCommand, base::Unretained(this),
+      &TrunksDBusService::HandleSendCommand);
+  dbus_interface->AddSimpleMethodHandler(
+      kGetCommandStats, base::Unretained(this),
+      &TrunksDBusService::HandleGetCommandStats);
   trunks_dbus_object_->RegisterAsync(
       sequencer->GetHandler("Failed to register D-Bus object.", true));
   if (power_manager_) {
@@ -46,6 +63,7 @@ void TrunksDBusService::OnShutdown(int* exit_code) {
 void TrunksDBusService::HandleSendCommand(
     std::unique_ptr<DBusMethodResponse<const SendCommandResponse&>>
         response_sender,
+    dbus::Message* message,
     const SendCommandRequest& request) {
   // Convert |response_sender| to a shared_ptr so |transceiver_| can safely
   // copy the callback.
@@ -64,10 +82,40 @@ void TrunksDBusService::HandleSendCommand(
              CreateErrorResponse(SAPI_RC_BAD_PARAMETER));
     return;
   }
-  transceiver_->SendCommand(
+  transceiver_->SendCommandWithPriority(
       request.command(),
+      priority_policy_.GetPriority(message->GetSender(), request),
       base::BindOnce(callback,
                      SharedResponsePointer(std::move(response_sender))));
 }
 
+bool TrunksDBusService::GetSenderUid(const std::string& sender, uid_t* uid) {
+  dbus::ObjectProxy* proxy = bus_->GetObjectProxy(
+      kDBusServiceName, dbus::ObjectPath(kDBusServicePath));
+  dbus::MethodCall method_call(kDBusInterface, kGetConnectionUnixUser);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendString(sender);
+  std::unique_ptr<dbus::Response> response = proxy->CallMethodAndBlock(
+      &method_call, dbus::ObjectProxy::TIMEOUT_USE_DEFAULT);
+  if (!response) {
+    return false;
+  }
+  dbus::MessageReader reader(response.get());
+  uint32_t value;
+  if (!reader.PopUint32(&value)) {
+    return false;
+  }
+  *uid = value;
+  return true;
+}
+
+GetCommandStatsResponse TrunksDBusService::HandleGetCommandStats(
+    const GetCommandStatsRequest& request) {
+  GetCommandStatsResponse response;
+  if (stats_) {
+    stats_->GetStats(&response);
+  }
+  return response;
+}
+
 }  // namespace trunks
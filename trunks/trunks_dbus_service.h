@@ -13,8 +13,10 @@
 #include <brillo/dbus/dbus_method_response.h>
 #include <brillo/dbus/dbus_object.h>
 
-#include "trunks/command_transceiver.h"
+#include "trunks/background_command_transceiver.h"
+#include "trunks/command_priority_policy.h"
 #include "trunks/power_manager.h"
+#include "trunks/tpm_command_stats.h"
 #include "trunks/trunks_interface.pb.h"
 
 namespace trunks {
@@ -35,9 +37,10 @@ class TrunksDBusService : public brillo::DBusServiceDaemon {
 
   ~TrunksDBusService() override = default;
 
-  // The |transceiver| will be the target of all incoming TPM commands. This
-  // class does not take ownership of |transceiver|.
-  void set_transceiver(CommandTransceiver* transceiver) {
+  // The |transceiver| will be the target of all incoming TPM commands, which
+  // it schedules according to their requested priority. This class does not
+  // take ownership of |transceiver|.
+  void set_transceiver(BackgroundCommandTransceiver* transceiver) {
     transceiver_ = transceiver;
   }
 
@@ -47,6 +50,13 @@ class TrunksDBusService : public brillo::DBusServiceDaemon {
     power_manager_ = power_manager;
   }
 
+  // The |stats| will be reported by the 'GetCommandStats' method. This class
+  // does not take ownership of |stats|.
+  void set_command_stats(TpmCommandStats* stats) { stats_ = stats; }
+
+  // Decides the priority of incoming commands from their sender.
+  CommandPriorityPolicy* priority_policy() { return &priority_policy_; }
+
  protected:
   // Exports D-Bus methods.
   void RegisterDBusObjectsAsync(
@@ -59,15 +69,26 @@ class TrunksDBusService : public brillo::DBusServiceDaemon {
   // Handles calls to the 'SendCommand' method.
   void HandleSendCommand(std::unique_ptr<brillo::dbus_utils::DBusMethodResponse<
                              const SendCommandResponse&>> response_sender,
+                         dbus::Message* message,
                          const SendCommandRequest& request);
 
+  // Asks the bus for the uid of the connection |sender|. Blocks until the bus
+  // replies.
+  bool GetSenderUid(const std::string& sender, uid_t* uid);
+
+  // Handles calls to the 'GetCommandStats' method.
+  GetCommandStatsResponse HandleGetCommandStats(
+      const GetCommandStatsRequest& request);
+
   base::WeakPtr<TrunksDBusService> GetWeakPtr() {
     return weak_factory_.GetWeakPtr();
   }
 
   std::unique_ptr<brillo::dbus_utils::DBusObject> trunks_dbus_object_;
-  CommandTransceiver* transceiver_ = nullptr;
+  BackgroundCommandTransceiver* transceiver_ = nullptr;
   PowerManager* power_manager_ = nullptr;
+  TpmCommandStats* stats_ = nullptr;
+  CommandPriorityPolicy priority_policy_;
 
   // Declared last so weak pointers are invalidated first on destruction.
   base::WeakPtrFactory<TrunksDBusService> weak_factory_{this};
@@ -19,8 +19,10 @@
 #include <scoped_minijail.h>
 
 #include "trunks/background_command_transceiver.h"
+#include "trunks/command_priority_policy.h"
 #include "trunks/power_manager.h"
 #include "trunks/resource_manager.h"
+#include "trunks/tpm_command_stats.h"
 #include "trunks/tpm_handle.h"
 #include "trunks/trunks_dbus_service.h"
 #include "trunks/trunks_factory_impl.h"
@@ -42,6 +44,30 @@ const char kTrunksGroup[] = "trunks";
 const char kTrunksSeccompPath[] = "/usr/share/policy/trunksd-seccomp.policy";
 const char kBackgroundThreadName[] = "trunksd_background_thread";
 
+// Clients whose commands a user is waiting on, e.g. to sign in or to touch a
+// security key, and clients whose commands nobody is waiting on.
+const char* const kInteractiveUsers[] = {"cryptohome", "u2f"};
+const char* const kBackgroundUsers[] = {"attestation"};
+
+void SetUserPriorities(trunks::CommandPriorityPolicy* policy) {
+  auto set_priority = [policy](const char* user,
+                               trunks::CommandPriority priority) {
+    uid_t uid;
+    gid_t gid;
+    if (!brillo::userdb::GetUserInfo(user, &uid, &gid)) {
+      LOG(WARNING) << "No user " << user << " to prioritize.";
+      return;
+    }
+    policy->SetUserPriority(uid, priority);
+  };
+  for (const char* user : kInteractiveUsers) {
+    set_priority(user, trunks::PRIORITY_INTERACTIVE);
+  }
+  for (const char* user : kBackgroundUsers) {
+    set_priority(user, trunks::PRIORITY_BACKGROUND);
+  }
+}
+
 void InitMinijailSandbox() {
   uid_t trunks_uid;
   gid_t trunks_gid;
@@ -112,6 +138,8 @@ int main(int argc, char** argv) {
 
   // Create a service instance so objects like AtExitManager exist.
   trunks::TrunksDBusService service;
+  // Look up the users while /etc/passwd is still reachable.
+  SetUserPriorities(service.priority_policy());
 
   // This needs to be *after* opening the TPM handle and *before* starting the
   // background thread.
@@ -124,13 +152,17 @@ int main(int argc, char** argv) {
   CHECK(background_thread.Start()) << "Failed to start background thread.";
   trunks::TrunksFactoryImpl factory(low_level_transceiver);
   CHECK(factory.Initialize()) << "Failed to initialize trunks factory.";
+  trunks::TpmCommandStats command_stats;
   trunks::ResourceManager resource_manager(factory, low_level_transceiver);
+  resource_manager.set_command_stats(&command_stats);
   background_thread.task_runner()->PostNonNestableTask(
       FROM_HERE, base::BindOnce(&trunks::ResourceManager::Initialize,
                                 base::Unretained(&resource_manager)));
   trunks::BackgroundCommandTransceiver background_transceiver(
       &resource_manager, background_thread.task_runner());
+  background_transceiver.set_command_stats(&command_stats);
   service.set_transceiver(&background_transceiver);
+  service.set_command_stats(&command_stats);
   trunks::PowerManager power_manager(&resource_manager,
                                      background_thread.task_runner());
   service.set_power_manager(&power_manager);
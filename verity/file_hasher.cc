@@ -14,6 +14,8 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,7 @@
 #include <base/logging.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_util.h>
+#include <base/threading/simple_thread.h>
 
 #include "verity/file_hasher.h"
 
@@ -43,6 +46,65 @@ int64_t GetFileSize(base::File* file) {
   }
   return file->GetLength();
 }
+
+// Size of the reads of each thread when hashing in parallel.
+constexpr int kParallelReadSize = 1024 * 1024;
+
+// Hashes the blocks [|begin|, |end|) of |source| into the leaves of |tree|.
+// Block 0 is at |offset| in |source|.
+class LeafHasher : public base::DelegateSimpleThread::Delegate {
+ public:
+  LeafHasher(base::File* source,
+             int64_t offset,
+             struct dm_bht* tree,
+             unsigned int begin,
+             unsigned int end)
+      : source_(source), offset_(offset), tree_(tree), begin_(begin),
+        end_(end) {}
+  LeafHasher(const LeafHasher&) = delete;
+  LeafHasher& operator=(const LeafHasher&) = delete;
+
+  // base::DelegateSimpleThread::Delegate:
+  void Run() override {
+    std::vector<uint8_t> data(kParallelReadSize);
+    unsigned int block = begin_;
+    while (block < end_) {
+      const unsigned int count =
+          std::min<unsigned int>(end_ - block, kParallelReadSize / PAGE_SIZE);
+      const int size = count * PAGE_SIZE;
+      const int read =
+          source_->Read(offset_ + int64_t{block} * PAGE_SIZE,
+                        reinterpret_cast<char*>(data.data()), size);
+      if (read < 0) {
+        PLOG(ERROR) << "Failed to read for block: " << block;
+        return;
+      }
+      if (read != size) {
+        LOG(ERROR) << "Short read for block: " << block;
+        return;
+      }
+      for (unsigned int i = 0; i < count; ++i) {
+        if (dm_bht_store_block(tree_, block + i,
+                               data.data() + i * PAGE_SIZE)) {
+          LOG(ERROR) << "Failed to store block " << block + i;
+          return;
+        }
+      }
+      block += count;
+    }
+    success_ = true;
+  }
+
+  bool success() const { return success_; }
+
+ private:
+  base::File* source_;
+  const int64_t offset_;
+  struct dm_bht* tree_;
+  const unsigned int begin_;
+  const unsigned int end_;
+  bool success_ = false;
+};
 }  // namespace
 
 FileHasher::~FileHasher() {
@@ -100,6 +162,9 @@ bool FileHasher::Store() {
 }
 
 bool FileHasher::Hash() {
+  if (threads_ > 1)
+    return HashParallel();
+
   // TODO(wad) abstract size when dm-bht needs to do break from PAGE_SIZE
   uint8_t block_data[PAGE_SIZE];
   uint32_t block = 0;
@@ -119,6 +184,53 @@ bool FileHasher::Hash() {
   return !dm_bht_compute(&tree_);
 }
 
+bool FileHasher::HashParallel() {
+  // Like the single-threaded path, read from the current position.
+  const int64_t offset = source_->Seek(base::File::FROM_CURRENT, 0);
+  if (offset < 0) {
+    PLOG(ERROR) << "Failed to get the source position";
+    return false;
+  }
+
+  // dm_bht_store_block() only writes the leaf of its block, so the threads
+  // can store blocks concurrently. Each thread takes whole pages of leaves
+  // so that no two of them write to the same page.
+  const uint64_t leaves_per_page = tree_.node_count;
+  const uint64_t pages = (block_limit_ + leaves_per_page - 1) / leaves_per_page;
+  const uint64_t threads = std::max<uint64_t>(1, std::min<uint64_t>(threads_,
+                                                                   pages));
+
+  std::vector<std::unique_ptr<LeafHasher>> hashers;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> workers;
+  for (uint64_t i = 0; i < threads; ++i) {
+    const unsigned int begin = static_cast<unsigned int>(std::min<uint64_t>(
+        block_limit_, pages * i / threads * leaves_per_page));
+    const unsigned int end = static_cast<unsigned int>(std::min<uint64_t>(
+        block_limit_, pages * (i + 1) / threads * leaves_per_page));
+    hashers.push_back(std::make_unique<LeafHasher>(source_.get(), offset,
+                                                   &tree_, begin, end));
+    workers.push_back(std::make_unique<base::DelegateSimpleThread>(
+        hashers.back().get(), "FileHasher"));
+    workers.back()->Start();
+  }
+
+  bool success = true;
+  for (uint64_t i = 0; i < threads; ++i) {
+    workers[i]->Join();
+    success &= hashers[i]->success();
+  }
+  if (!success)
+    return false;
+
+  // Leave the source where the single-threaded path would.
+  if (source_->Seek(base::File::FROM_BEGIN,
+                    offset + int64_t{block_limit_} * PAGE_SIZE) < 0) {
+    PLOG(ERROR) << "Failed to seek the source";
+    return false;
+  }
+  return !dm_bht_compute(&tree_);
+}
+
 void FileHasher::set_salt(const char* salt) {
   if (!strcmp(salt, "random"))
     salt = RandomSalt();
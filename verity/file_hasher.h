@@ -21,7 +21,9 @@ namespace verity {
 // FileHasher takes a |base::File| object and reads in |block_size|
 // bytes creating SHA-256 hashes as it goes.
 // TODO(wad) allow any hashing format supported by openssl (and the kernel).
-// This class may not be used by multiple threads at once.
+// This class may not be used by multiple threads at once, but Hash() can
+// spread the hashing of the blocks over several threads of its own. See
+// set_threads().
 class BRILLO_EXPORT FileHasher {
  public:
   FileHasher(std::unique_ptr<base::File> source,
@@ -32,6 +34,7 @@ class BRILLO_EXPORT FileHasher {
         destination_(std::move(destination)),
         block_limit_(blocks),
         alg_(alg),
+        threads_(1),
         initialized_(false) {}
   virtual ~FileHasher();
 
@@ -47,11 +50,22 @@ class BRILLO_EXPORT FileHasher {
   virtual void set_salt(const char* salt);
   virtual const char* salt(void) { return salt_; }
 
+  // Sets the number of threads hashing the blocks in Hash(). With more than
+  // one thread, each of them hashes a range of blocks read with large
+  // positional reads, then the upper levels of the tree are computed on the
+  // calling thread. The hash tree is the same as with a single thread.
+  virtual void set_threads(unsigned int threads) { threads_ = threads; }
+  virtual unsigned int threads() const { return threads_; }
+
  private:
+  // Hashes the blocks on |threads_| threads.
+  bool HashParallel();
+
   std::unique_ptr<base::File> source_;
   std::unique_ptr<base::File> destination_;
   unsigned int block_limit_;
   const char* alg_;
+  unsigned int threads_;
   const char* salt_;
   char random_salt_[DM_BHT_SALT_SIZE * 2 + 1];
   std::vector<char> hash_data_;
@@ -4,10 +4,16 @@
 //
 // Tests for verity::FileHasher
 
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/system/sys_info.h>
+#include <base/timer/elapsed_timer.h>
 #include <gtest/gtest.h>
 
 #include "verity/file_hasher.h"
@@ -18,6 +24,49 @@ namespace {
 // Just 32 byte salt. (There is no meaning to this pattern.)
 constexpr char kSalt[] =
     "abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789";
+
+// Writes |blocks| blocks of pseudo-random data to |path|.
+bool WriteImage(const base::FilePath& path, unsigned int blocks) {
+  base::File file(path,
+                  base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file.IsValid())
+    return false;
+
+  std::vector<uint32_t> data(PAGE_SIZE / sizeof(uint32_t));
+  uint32_t seed = 1;
+  for (unsigned int block = 0; block < blocks; ++block) {
+    for (uint32_t& word : data) {
+      seed = seed * 1103515245 + 12345;
+      word = seed;
+    }
+    if (file.WriteAtCurrentPos(reinterpret_cast<char*>(data.data()),
+                               PAGE_SIZE) != PAGE_SIZE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Hashes the image at |image| with |threads| threads. Returns the table and
+// sets |hash_tree| to the stored hash tree.
+std::string HashImage(const base::FilePath& image,
+                      const base::FilePath& hash_path,
+                      unsigned int threads,
+                      std::string* hash_tree) {
+  verity::FileHasher hasher(
+      std::make_unique<base::File>(
+          image, base::File::FLAG_OPEN | base::File::FLAG_READ),
+      std::make_unique<base::File>(
+          hash_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE),
+      0, kSha256HashName);
+  EXPECT_TRUE(hasher.Initialize());
+  hasher.set_salt(reinterpret_cast<const char*>(kSalt));
+  hasher.set_threads(threads);
+  EXPECT_TRUE(hasher.Hash());
+  EXPECT_TRUE(hasher.Store());
+  EXPECT_TRUE(base::ReadFileToString(hash_path, hash_tree));
+  return hasher.GetTable(true);
+}
 }  // namespace
 
 class FileHasherTest : public ::testing::Test {
@@ -63,6 +112,79 @@ TEST_F(FileHasherTest, EndToEnd) {
             "23456789abcdef0123456789abcdef0123456789");
 }
 
+TEST_F(FileHasherTest, EndToEndParallel) {
+  verity::FileHasher hasher(std::move(small_file_), std::move(target_file_), 0,
+                            kSha256HashName);
+  EXPECT_TRUE(hasher.Initialize());
+  hasher.set_salt(reinterpret_cast<const char*>(kSalt));
+  hasher.set_threads(4);
+  EXPECT_TRUE(hasher.Hash());
+  EXPECT_TRUE(hasher.Store());
+
+  EXPECT_EQ(hasher.GetTable(true),
+            "0 16 verity payload=ROOT_DEV hashtree=HASH_DEV hashstart=16 "
+            "alg=sha256 root_hexdigest=21f0268f4a293d8110074c678a651c638d"
+            "56a610dd2662975a35d451d3258018 salt=abcdef0123456789abcdef01"
+            "23456789abcdef0123456789abcdef0123456789");
+}
+
+TEST_F(FileHasherTest, ParallelMatchesSingleThread) {
+  // Enough blocks for several pages of leaves, the last one partial.
+  const base::FilePath image = temp_dir_.GetPath().Append("image.bin");
+  ASSERT_TRUE(WriteImage(image, 1000));
+  const base::FilePath hash_path = temp_dir_.GetPath().Append("hash.bin");
+
+  std::string expected_tree;
+  const std::string expected_table =
+      HashImage(image, hash_path, 1, &expected_tree);
+  for (unsigned int threads : {2u, 3u, 7u, 16u}) {
+    std::string tree;
+    EXPECT_EQ(expected_table, HashImage(image, hash_path, threads, &tree))
+        << threads << " threads";
+    EXPECT_EQ(expected_tree, tree) << threads << " threads";
+  }
+}
+
+TEST_F(FileHasherTest, ParallelShortSource) {
+  const base::FilePath image = temp_dir_.GetPath().Append("image.bin");
+  ASSERT_TRUE(WriteImage(image, 1000));
+  verity::FileHasher hasher(
+      std::make_unique<base::File>(
+          image, base::File::FLAG_OPEN | base::File::FLAG_READ),
+      std::move(target_file_), 0, kSha256HashName);
+  ASSERT_TRUE(hasher.Initialize());
+  hasher.set_threads(4);
+
+  // The source shrinks after the hasher got its size.
+  ASSERT_TRUE(base::WriteFile(image, "", 0));
+  EXPECT_FALSE(hasher.Hash());
+}
+
+// Hashes a 2GiB image with an increasing number of threads. The image is
+// likely in the page cache: this measures the hashing more than the reads.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(FileHasherTest, DISABLED_Benchmark) {
+  constexpr unsigned int kBlocks = 512 * 1024;
+  const base::FilePath image = temp_dir_.GetPath().Append("image.bin");
+  ASSERT_TRUE(WriteImage(image, kBlocks));
+  const base::FilePath hash_path = temp_dir_.GetPath().Append("hash.bin");
+
+  std::string expected_tree;
+  const unsigned int cpus = base::SysInfo::NumberOfProcessors();
+  for (unsigned int threads = 1; threads <= cpus; threads *= 2) {
+    std::string tree;
+    base::ElapsedTimer timer;
+    HashImage(image, hash_path, threads, &tree);
+    const base::TimeDelta elapsed = timer.Elapsed();
+    LOG(INFO) << threads << " threads: "
+              << kBlocks / 256 / elapsed.InSecondsF() << " MB/s";
+
+    if (expected_tree.empty())
+      expected_tree = tree;
+    EXPECT_EQ(expected_tree, tree);
+  }
+}
+
 TEST_F(FileHasherTest, BadSourceFile) {
   verity::FileHasher hasher(nullptr, std::move(target_file_), 0,
                             kSha256HashName);
@@ -31,6 +31,7 @@ void print_usage(const char* name) {
       "  hashtree          Path to a hash tree to create or read from\n"
       "  root_hexdigest    Digest of the root node (in hex) for verification\n"
       "  salt              Salt (in hex)\n"
+      "  threads           Number of threads hashing the image (default 1)\n"
       "\n",
       name);
 }
@@ -46,7 +47,8 @@ static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt);
+                         const char* salt,
+                         unsigned int threads);
 
 void splitarg(char* arg, char** key, char** val) {
   char* sp = NULL;
@@ -61,6 +63,7 @@ int main(int argc, char** argv) {
   const char* hashtree = NULL;
   const char* salt = NULL;
   unsigned int payload_blocks = 0;
+  unsigned int threads = 1;
   int i;
   char *key, *val;
 
@@ -87,6 +90,8 @@ int main(int argc, char** argv) {
       // Silently drop the mode for now...
     } else if (!strcmp(key, "salt")) {
       salt = val;
+    } else if (!strcmp(key, "threads")) {
+      threads = (unsigned int)strtoul(val, NULL, 0);
     } else {
       fprintf(stderr, "bogus key: '%s'\n", key);
       print_usage(argv[0]);
@@ -102,7 +107,8 @@ int main(int argc, char** argv) {
   }
 
   if (mode == VERITY_CREATE) {
-    return verity_create(alg, payload, payload_blocks, hashtree, salt);
+    return verity_create(alg, payload, payload_blocks, hashtree, salt,
+                         threads);
   } else {
     LOG(FATAL) << "Verification not done yet";
   }
@@ -113,7 +119,8 @@ static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt) {
+                         const char* salt,
+                         unsigned int threads) {
   auto source = std::make_unique<base::File>(
       base::FilePath(image_path),
       base::File::FLAG_OPEN | base::File::FLAG_READ);
@@ -131,6 +138,7 @@ static int verity_create(const char* alg,
   LOG_IF(FATAL, !hasher.Initialize()) << "Failed to initialize hasher";
   if (salt)
     hasher.set_salt(salt);
+  hasher.set_threads(threads);
   LOG_IF(FATAL, !hasher.Hash()) << "Failed to hash hasher";
   LOG_IF(FATAL, !hasher.Store()) << "Failed to store hasher";
   hasher.PrintTable(true);
@@ -717,7 +717,8 @@ int ExportDiskImage(dbus::ObjectProxy* proxy,
                     string cryptohome_id,
                     string vm_name,
                     string export_name,
-                    string removable_media) {
+                    string removable_media,
+                    bool use_zstd) {
   if (cryptohome_id.empty()) {
     LOG(ERROR) << "Cryptohome id cannot be empty";
     return -1;
@@ -767,6 +768,7 @@ int ExportDiskImage(dbus::ObjectProxy* proxy,
   vm_tools::concierge::ExportDiskImageRequest request;
   request.set_cryptohome_id(std::move(cryptohome_id));
   request.set_vm_name(std::move(vm_name));
+  request.set_use_zstd(use_zstd);
 
   if (!writer.AppendProtoAsArrayOfBytes(request)) {
     LOG(ERROR) << "Failed to encode ExportDiskImageRequest protobuf";
@@ -1789,6 +1791,8 @@ int main(int argc, char** argv) {
   DEFINE_string(rootfs, "", "Path to the VM rootfs");
   DEFINE_string(name, "", "Name to assign to the VM");
   DEFINE_string(export_name, "", "Name to give the exported disk image");
+  DEFINE_bool(export_zstd, false,
+              "Export the disk image as a zstd-compressed tarball");
   DEFINE_string(import_name, "", "Name of the VM image to import");
   DEFINE_string(extra_disks, "",
                 "Additional disk images to be mounted inside the VM");
@@ -1919,7 +1923,7 @@ int main(int argc, char** argv) {
   } else if (FLAGS_export_disk) {
     return ExportDiskImage(proxy, std::move(FLAGS_cryptohome_id),
                            std::move(FLAGS_name), std::move(FLAGS_export_name),
-                           std::move(FLAGS_removable_media));
+                           std::move(FLAGS_removable_media), FLAGS_export_zstd);
   } else if (FLAGS_import_disk) {
     return ImportDiskImage(proxy, std::move(FLAGS_cryptohome_id),
                            std::move(FLAGS_name), std::move(FLAGS_import_name),
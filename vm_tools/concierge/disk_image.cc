@@ -20,6 +20,7 @@
 #include <base/stl_util.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/stringprintf.h>
+#include <base/system/sys_info.h>
 
 #include "vm_tools/concierge/disk_image.h"
 #include "vm_tools/concierge/plugin_vm_config.h"
@@ -31,6 +32,10 @@ namespace {
 
 constexpr gid_t kPluginVmGid = 20128;
 
+// Size of the block of zeroes used to pass holes of sparse files to the
+// archive writer.
+constexpr size_t kZeroBlockSize = 1024 * 1024;
+
 }  // namespace
 
 namespace vm_tools {
@@ -219,6 +224,8 @@ VmExportOperation::VmExportOperation(const VmId vm_id,
       out_fd_(std::move(out_fd)),
       out_digest_fd_(std::move(out_digest_fd)),
       copying_data_(false),
+      entry_size_(0),
+      entry_offset_(0),
       out_fmt_(std::move(out_fmt)),
       sha256_(crypto::SecureHash::Create(crypto::SecureHash::SHA256)) {
   base::File::Info info;
@@ -289,18 +296,44 @@ bool VmExportOperation::PrepareOutput() {
             strerror(archive_errno(out_.get()))));
         return false;
       }
-
-      ret = archive_write_set_format_pax_restricted(out_.get());
+      break;
+    case ArchiveFormat::TAR_ZSTD:
+      ret = archive_write_add_filter_zstd(out_.get());
       if (ret != ARCHIVE_OK) {
         set_failure_reason(base::StringPrintf(
-            "libarchive: failed to initialize pax format: %s, %s",
+            "libarchive: failed to initialize zstd filter: %s, %s",
             archive_error_string(out_.get()),
             strerror(archive_errno(out_.get()))));
         return false;
       }
+
+      // Spread compression across all cores. Versions of libarchive without
+      // multithreaded zstd support reject the option, in which case we carry
+      // on with single-threaded compression.
+      ret = archive_write_set_filter_option(
+          out_.get(), "zstd", "threads",
+          base::NumberToString(base::SysInfo::NumberOfProcessors()).c_str());
+      if (ret != ARCHIVE_OK) {
+        LOG(WARNING) << "libarchive: multithreaded zstd is not available: "
+                     << archive_error_string(out_.get());
+      }
       break;
   }
 
+  if (out_fmt_ == ArchiveFormat::TAR_GZ ||
+      out_fmt_ == ArchiveFormat::TAR_ZSTD) {
+    // The pax writer stores holes of sparse entries in the extended header
+    // and skips over them rather than passing zeroes to the compressor.
+    ret = archive_write_set_format_pax_restricted(out_.get());
+    if (ret != ARCHIVE_OK) {
+      set_failure_reason(base::StringPrintf(
+          "libarchive: failed to initialize pax format: %s, %s",
+          archive_error_string(out_.get()),
+          strerror(archive_errno(out_.get()))));
+      return false;
+    }
+  }
+
   ret = archive_write_open(out_.get(), reinterpret_cast<void*>(this),
                            OutputFileOpenCallback, OutputFileWriteCallback,
                            OutputFileCloseCallback);
@@ -413,7 +446,9 @@ bool VmExportOperation::ExecuteIo(uint64_t io_limit) {
         break;
       }
 
-      copying_data_ = archive_entry_size(entry) > 0;
+      entry_size_ = archive_entry_size(entry);
+      entry_offset_ = 0;
+      copying_data_ = entry_size_ > 0;
     }
 
     if (copying_data_) {
@@ -435,35 +470,68 @@ bool VmExportOperation::ExecuteIo(uint64_t io_limit) {
   return false;
 }
 
+// Unlike archive_read_data(), archive_read_data_block() hands out libarchive's
+// own buffers and reports holes of sparse files as gaps between blocks instead
+// of synthesizing zeroes, so large mostly-empty images are cheap to walk.
 uint64_t VmExportOperation::CopyEntry(uint64_t io_limit) {
   uint64_t bytes_read = 0;
 
   do {
-    uint8_t buf[16384];
-    int count = archive_read_data(in_.get(), buf, sizeof(buf));
-    if (count == 0) {
-      // No more data
+    const void* buff;
+    size_t size;
+    la_int64_t offset;
+    int ret = archive_read_data_block(in_.get(), &buff, &size, &offset);
+    if (ret == ARCHIVE_EOF) {
+      // The file may end with a hole.
+      if (entry_offset_ < entry_size_ &&
+          !WriteHole(entry_size_ - entry_offset_)) {
+        break;
+      }
       copying_data_ = false;
       break;
     }
 
-    if (count < 0) {
+    if (ret != ARCHIVE_OK) {
       MarkFailed("failed to read data block", in_.get());
       break;
     }
 
-    bytes_read += count;
+    if (offset > entry_offset_ && !WriteHole(offset - entry_offset_)) {
+      break;
+    }
 
-    int ret = archive_write_data(out_.get(), buf, count);
-    if (ret < ARCHIVE_OK) {
+    bytes_read += size;
+
+    if (size > 0 && archive_write_data(out_.get(), buff, size) < ARCHIVE_OK) {
       MarkFailed("failed to write data block", out_.get());
       break;
     }
+    entry_offset_ = offset + size;
   } while (bytes_read < io_limit);
 
   return bytes_read;
 }
 
+bool VmExportOperation::WriteHole(uint64_t length) {
+  if (zero_block_.empty())
+    zero_block_.resize(kZeroBlockSize);
+
+  while (length > 0) {
+    size_t count = std::min<uint64_t>(length, zero_block_.size());
+    if (archive_write_data(out_.get(), zero_block_.data(), count) <
+        ARCHIVE_OK) {
+      MarkFailed("failed to write hole", out_.get());
+      return false;
+    }
+    length -= count;
+    entry_offset_ += count;
+    // Holes take no I/O, so they only count towards progress.
+    AccumulateProcessedSize(count);
+  }
+
+  return true;
+}
+
 void VmExportOperation::Finalize() {
   archive_read_close(in_.get());
   // Free the input archive.
@@ -526,6 +594,7 @@ PluginVmImportOperation::PluginVmImportOperation(
       dest_image_path_(std::move(disk_path)),
       bus_(std::move(bus)),
       vmplugin_service_proxy_(vmplugin_service_proxy),
+      image_gid_(kPluginVmGid),
       in_fd_(std::move(in_fd)),
       copying_data_(false) {
   set_source_size(source_size);
@@ -551,6 +620,13 @@ bool PluginVmImportOperation::PrepareInput() {
     return false;
   }
 
+  // Images exported with ArchiveFormat::TAR_ZSTD.
+  ret = archive_read_support_format_tar(in_.get());
+  if (ret != ARCHIVE_OK) {
+    set_failure_reason("libarchive: failed to initialize tar format");
+    return false;
+  }
+
   ret = archive_read_support_filter_all(in_.get());
   if (ret != ARCHIVE_OK) {
     set_failure_reason("libarchive: failed to initialize filter");
@@ -670,7 +746,7 @@ bool PluginVmImportOperation::ExecuteIo(uint64_t io_limit) {
       archive_entry_set_pathname(entry, dest_path.value().c_str());
 
       archive_entry_set_uid(entry, getuid());
-      archive_entry_set_gid(entry, kPluginVmGid);
+      archive_entry_set_gid(entry, image_gid_);
 
       mode_t mode = archive_entry_filetype(entry);
       switch (mode) {
@@ -713,7 +789,8 @@ bool PluginVmImportOperation::ExecuteIo(uint64_t io_limit) {
 // Note that this is extremely similar to VmExportOperation::CopyEntry()
 // implementation. The difference is the disk writer supports
 // archive_write_data_block() API that handles sparse files, whereas generic
-// writer does not, so we have to use separate implementations.
+// writer does not and needs holes passed to it explicitly, so we have to use
+// separate implementations.
 uint64_t PluginVmImportOperation::CopyEntry(uint64_t io_limit) {
   uint64_t bytes_read_begin = archive_filter_bytes(in_.get(), -1);
   uint64_t bytes_read = 0;
@@ -760,7 +837,7 @@ void PluginVmImportOperation::Finalize() {
   // Free the output archive structures.
   out_.reset();
   // Make sure resulting image is accessible by the dispatcher process.
-  if (chown(output_dir_.GetPath().value().c_str(), -1, kPluginVmGid) < 0) {
+  if (chown(output_dir_.GetPath().value().c_str(), -1, image_gid_) < 0) {
     MarkFailed("failed to change group of the destination directory", NULL);
     return;
   }
@@ -6,6 +6,7 @@
 #define VM_TOOLS_CONCIERGE_DISK_IMAGE_H_
 
 #include <archive.h>
+#include <sys/types.h>
 
 #include <memory>
 #include <string>
@@ -136,6 +137,8 @@ using ArchiveWriter = std::unique_ptr<struct archive, ArchiveWriteDeleter>;
 enum class ArchiveFormat {
   ZIP,
   TAR_GZ,
+  // Tarball compressed with multithreaded zstd.
+  TAR_ZSTD,
 };
 
 class VmExportOperation : public DiskImageOperation {
@@ -174,10 +177,15 @@ class VmExportOperation : public DiskImageOperation {
 
   void MarkFailed(const char* msg, struct archive* a);
 
-  // Copies up to |io_limit| bytes of one file of the image.
+  // Copies up to |io_limit| bytes of one file of the image. Holes in sparse
+  // files are not read from disk and do not count against |io_limit|.
   // Returns number of bytes read.
   uint64_t CopyEntry(uint64_t io_limit);
 
+  // Feeds |length| bytes of zeroes representing a hole in the current entry
+  // into the output archive. Returns false on failure.
+  bool WriteHole(uint64_t length);
+
   // Path to the directory containing source image.
   const base::FilePath src_image_path_;
 
@@ -192,6 +200,15 @@ class VmExportOperation : public DiskImageOperation {
   // entry.
   bool copying_data_;
 
+  // Logical size of the entry being copied and the offset up to which its
+  // contents have been passed to the output archive.
+  int64_t entry_size_;
+  int64_t entry_offset_;
+
+  // Block of zeroes used to fill holes of sparse entries. Allocated on first
+  // use.
+  std::vector<uint8_t> zero_block_;
+
   // If true, disk image is a directory potentially containing multiple files.
   // If false, disk image is a single file.
   bool image_is_directory_;
@@ -221,6 +238,10 @@ class PluginVmImportOperation : public DiskImageOperation {
 
   ~PluginVmImportOperation() override;
 
+  // Sets the group owning the imported files, instead of the pluginvm group,
+  // so that tests can run without privileges.
+  void set_image_gid_for_testing(gid_t gid) { image_gid_ = gid; }
+
  protected:
   bool ExecuteIo(uint64_t io_limit) override;
   void Finalize() override;
@@ -253,6 +274,9 @@ class PluginVmImportOperation : public DiskImageOperation {
   // Proxy to the dispatcher service.  Not owned.
   dbus::ObjectProxy* vmplugin_service_proxy_;
 
+  // Group owning the imported files.
+  gid_t image_gid_;
+
   // File descriptor from which to fetch the source image.
   base::ScopedFD in_fd_;
 
@@ -0,0 +1,250 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "vm_tools/concierge/disk_image.h"
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/posix/eintr_wrapper.h>
+#include <chromeos/dbus/service_constants.h>
+#include <dbus/message.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <dbus/object_path.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <vm_plugin_dispatcher/proto_bindings/vm_plugin_dispatcher.pb.h>
+
+namespace vm_tools {
+namespace concierge {
+namespace {
+
+using testing::_;
+using testing::Invoke;
+
+constexpr char kOwnerId[] = "owner";
+constexpr char kVmName[] = "vm";
+constexpr char kImageName[] = "dGVzdA==.img";
+constexpr int64_t kImageSize = 64 * 1024 * 1024;
+constexpr uint64_t kIoLimit = 1024 * 1024;
+constexpr char kImportedImageName[] = "dGVzdA==.pvm";
+constexpr int64_t kImportedDiskSize = 16 * 1024 * 1024;
+
+class VmExportOperationTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    image_path_ = temp_dir_.GetPath().Append(kImageName);
+    export_path_ = temp_dir_.GetPath().Append("export");
+
+    // Sparse image with data at the start, in the middle and at the end.
+    base::File image(image_path_,
+                     base::File::FLAG_CREATE | base::File::FLAG_WRITE);
+    ASSERT_TRUE(image.IsValid());
+    ASSERT_TRUE(image.SetLength(kImageSize));
+    ASSERT_TRUE(WriteAt(&image, 0, "head"));
+    ASSERT_TRUE(WriteAt(&image, kImageSize / 2, "middle"));
+    ASSERT_TRUE(WriteAt(&image, kImageSize - 4, "tail"));
+  }
+
+  static bool WriteAt(base::File* file, int64_t offset, const std::string& s) {
+    return file->Write(offset, s.data(), s.size()) ==
+           static_cast<int>(s.size());
+  }
+
+  // Runs an export of the test image to |export_path_| in the given format.
+  void Export(ArchiveFormat fmt) {
+    base::ScopedFD out_fd(HANDLE_EINTR(
+        open(export_path_.value().c_str(), O_CREAT | O_RDWR, 0600)));
+    ASSERT_TRUE(out_fd.is_valid());
+
+    auto op = VmExportOperation::Create(VmId(kOwnerId, kVmName), image_path_,
+                                        std::move(out_fd), base::ScopedFD(),
+                                        fmt);
+    ASSERT_EQ(op->status(), DISK_STATUS_IN_PROGRESS) << op->failure_reason();
+    while (op->status() == DISK_STATUS_IN_PROGRESS)
+      op->Run(kIoLimit);
+    ASSERT_EQ(op->status(), DISK_STATUS_CREATED) << op->failure_reason();
+    EXPECT_EQ(op->GetProgress(), 100);
+  }
+
+  // Extracts the single image file from the exported archive.
+  std::string ReadExportedImage() {
+    struct archive* a = archive_read_new();
+    archive_read_support_format_all(a);
+    archive_read_support_filter_all(a);
+    EXPECT_EQ(archive_read_open_filename(a, export_path_.value().c_str(),
+                                         102400),
+              ARCHIVE_OK);
+
+    std::string contents;
+    struct archive_entry* entry;
+    EXPECT_EQ(archive_read_next_header(a, &entry), ARCHIVE_OK);
+    EXPECT_STREQ(archive_entry_pathname(entry), kImageName);
+    contents.resize(archive_entry_size(entry));
+
+    const void* buff;
+    size_t size;
+    la_int64_t offset;
+    while (archive_read_data_block(a, &buff, &size, &offset) == ARCHIVE_OK)
+      contents.replace(offset, size, static_cast<const char*>(buff), size);
+
+    EXPECT_EQ(archive_read_next_header(a, &entry), ARCHIVE_EOF);
+    archive_read_free(a);
+    return contents;
+  }
+
+  std::string ReadSourceImage() {
+    std::string contents;
+    EXPECT_TRUE(base::ReadFileToString(image_path_, &contents));
+    return contents;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath image_path_;
+  base::FilePath export_path_;
+};
+
+TEST_F(VmExportOperationTest, TarGzRoundTrip) {
+  Export(ArchiveFormat::TAR_GZ);
+  EXPECT_EQ(ReadExportedImage(), ReadSourceImage());
+}
+
+TEST_F(VmExportOperationTest, TarZstdRoundTrip) {
+  Export(ArchiveFormat::TAR_ZSTD);
+  EXPECT_EQ(ReadExportedImage(), ReadSourceImage());
+}
+
+TEST_F(VmExportOperationTest, ZipRoundTrip) {
+  Export(ArchiveFormat::ZIP);
+  EXPECT_EQ(ReadExportedImage(), ReadSourceImage());
+}
+
+class PluginVmImportOperationTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    archive_path_ = temp_dir_.GetPath().Append("import.tar.zst");
+    image_path_ = temp_dir_.GetPath().Append(kImportedImageName);
+
+    mock_bus_ = new dbus::MockBus(dbus::Bus::Options());
+    mock_proxy_ = new dbus::MockObjectProxy(
+        mock_bus_.get(), plugin_dispatcher::kVmPluginDispatcherServiceName,
+        dbus::ObjectPath(plugin_dispatcher::kVmPluginDispatcherServicePath));
+  }
+
+  // Writes a zstd-compressed tar to |archive_path_|, with a config file and a
+  // sparse disk with data at the start and in the middle, and a hole at the
+  // end. Both are under a top level .pvm directory, as in exported images.
+  void WriteArchive() {
+    struct archive* a = archive_write_new();
+    ASSERT_EQ(archive_write_add_filter_zstd(a), ARCHIVE_OK);
+    ASSERT_EQ(archive_write_set_format_pax_restricted(a), ARCHIVE_OK);
+    ASSERT_EQ(archive_write_open_filename(a, archive_path_.value().c_str()),
+              ARCHIVE_OK);
+
+    struct archive_entry* entry = archive_entry_new();
+    archive_entry_set_pathname(entry, "vm.pvm/config.pvs");
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_entry_set_size(entry, config_.size());
+    ASSERT_EQ(archive_write_header(a, entry), ARCHIVE_OK);
+    ASSERT_EQ(archive_write_data(a, config_.data(), config_.size()),
+              static_cast<la_ssize_t>(config_.size()));
+
+    disk_.assign(kImportedDiskSize, '\0');
+    disk_.replace(0, 4, "head");
+    disk_.replace(kImportedDiskSize / 2, 6, "middle");
+    archive_entry_clear(entry);
+    archive_entry_set_pathname(entry, "vm.pvm/disk.hdd");
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_entry_set_size(entry, disk_.size());
+    archive_entry_sparse_add_entry(entry, 0, 4096);
+    archive_entry_sparse_add_entry(entry, kImportedDiskSize / 2, 4096);
+    ASSERT_EQ(archive_write_header(a, entry), ARCHIVE_OK);
+    // The pax writer drops the holes from the data.
+    ASSERT_EQ(archive_write_data(a, disk_.data(), disk_.size()),
+              static_cast<la_ssize_t>(disk_.size()));
+
+    archive_entry_free(entry);
+    ASSERT_EQ(archive_write_close(a), ARCHIVE_OK);
+    archive_write_free(a);
+  }
+
+  // Replies to the RegisterVm call made once the image is imported.
+  static std::unique_ptr<dbus::Response> RegisterVm(
+      dbus::MethodCall* method_call, int timeout_ms) {
+    EXPECT_EQ(method_call->GetMember(), plugin_dispatcher::kRegisterVmMethod);
+    std::unique_ptr<dbus::Response> response = dbus::Response::CreateEmpty();
+    plugin_dispatcher::RegisterVmResponse reply;
+    reply.set_error(plugin_dispatcher::VM_SUCCESS);
+    EXPECT_TRUE(
+        dbus::MessageWriter(response.get()).AppendProtoAsArrayOfBytes(reply));
+    return response;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath archive_path_;
+  base::FilePath image_path_;
+  std::string config_ = "config";
+  std::string disk_;
+
+  scoped_refptr<dbus::MockBus> mock_bus_;
+  scoped_refptr<dbus::MockObjectProxy> mock_proxy_;
+};
+
+TEST_F(PluginVmImportOperationTest, TarZstdImport) {
+  WriteArchive();
+  int64_t archive_size;
+  ASSERT_TRUE(base::GetFileSize(archive_path_, &archive_size));
+  base::ScopedFD in_fd(
+      HANDLE_EINTR(open(archive_path_.value().c_str(), O_RDONLY)));
+  ASSERT_TRUE(in_fd.is_valid());
+
+  EXPECT_CALL(*mock_proxy_, CallMethodAndBlock(_, _))
+      .WillOnce(Invoke(&PluginVmImportOperationTest::RegisterVm));
+
+  auto op = PluginVmImportOperation::Create(
+      std::move(in_fd), image_path_, archive_size, VmId(kOwnerId, kVmName),
+      mock_bus_, mock_proxy_.get());
+  ASSERT_EQ(op->status(), DISK_STATUS_IN_PROGRESS) << op->failure_reason();
+  op->set_image_gid_for_testing(getgid());
+  while (op->status() == DISK_STATUS_IN_PROGRESS)
+    op->Run(kIoLimit);
+  ASSERT_EQ(op->status(), DISK_STATUS_CREATED) << op->failure_reason();
+
+  // The top level .pvm directory is dropped.
+  std::string config;
+  EXPECT_TRUE(
+      base::ReadFileToString(image_path_.Append("config.pvs"), &config));
+  EXPECT_EQ(config, config_);
+
+  const base::FilePath disk_path = image_path_.Append("disk.hdd");
+  std::string disk;
+  EXPECT_TRUE(base::ReadFileToString(disk_path, &disk));
+  EXPECT_EQ(disk, disk_);
+
+  // The holes are not written out.
+  struct stat st;
+  ASSERT_EQ(stat(disk_path.value().c_str(), &st), 0);
+  EXPECT_EQ(st.st_size, kImportedDiskSize);
+  EXPECT_LT(st.st_blocks * 512, kImportedDiskSize / 2);
+}
+
+}  // namespace
+}  // namespace concierge
+}  // namespace vm_tools
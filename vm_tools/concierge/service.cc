@@ -3541,10 +3541,11 @@ std::unique_ptr<dbus::Response> Service::ExportDiskImage(
   ArchiveFormat fmt;
   switch (location) {
     case STORAGE_CRYPTOHOME_ROOT:
-      fmt = ArchiveFormat::TAR_GZ;
+      fmt =
+          request.use_zstd() ? ArchiveFormat::TAR_ZSTD : ArchiveFormat::TAR_GZ;
       break;
     case STORAGE_CRYPTOHOME_PLUGINVM:
-      fmt = ArchiveFormat::ZIP;
+      fmt = request.use_zstd() ? ArchiveFormat::TAR_ZSTD : ArchiveFormat::ZIP;
       break;
     default:
       LOG(ERROR) << "Unsupported location for source image";
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include "sommelier.h"            // NOLINT(build/include_directory)
+#include "sommelier-copy.h"       // NOLINT(build/include_directory)
 #include "sommelier-timing.h"     // NOLINT(build/include_directory)
 #include "sommelier-tracing.h"    // NOLINT(build/include_directory)
 #include "sommelier-transform.h"  // NOLINT(build/include_directory)
@@ -542,13 +543,32 @@ static void sl_host_surface_frame(struct wl_client* client,
                            host_callback);
 }
 
+// Adds |n| damage rectangles to |damage| after applying scale and offset.
+static void add_damage_rects(pixman_region32_t* damage,
+                             pixman_box32_t* rect,
+                             int n,
+                             double scale_x,
+                             double scale_y,
+                             double offset_x,
+                             double offset_y) {
+  while (n--) {
+    // Enclosing rect after applying scale and offset.
+    int32_t x1 = rect->x1 * scale_x + offset_x;
+    int32_t y1 = rect->y1 * scale_y + offset_y;
+    int32_t x2 = rect->x2 * scale_x + offset_x + 0.5;
+    int32_t y2 = rect->y2 * scale_y + offset_y + 0.5;
+
+    if (x1 < x2 && y1 < y2)
+      pixman_region32_union_rect(damage, damage, x1, y1, x2 - x1, y2 - y1);
+    ++rect;
+  }
+}
+
+// Copies |rect|, in buffer coordinates and clipped to the contents, from the
+// client's buffer to the current output buffer.
 static void copy_damaged_rect(sl_host_surface* host,
                               pixman_box32_t* rect,
-                              bool shaped,
-                              double scale_x,
-                              double scale_y,
-                              double offset_x,
-                              double offset_y) {
+                              bool shaped) {
   uint8_t* src_addr = static_cast<uint8_t*>(host->contents_shm_mmap->addr);
   uint8_t* dst_addr = static_cast<uint8_t*>(host->current_buffer->mmap->addr);
   size_t* src_offset = host->contents_shm_mmap->offset;
@@ -558,7 +578,6 @@ static void copy_damaged_rect(sl_host_surface* host,
   size_t* y_ss = host->contents_shm_mmap->y_ss;
   size_t bpp = host->contents_shm_mmap->bpp;
   size_t num_planes = host->contents_shm_mmap->num_planes;
-  int32_t x1, y1, x2, y2;
   size_t null_set[3] = {0, 0, 0};
   size_t shape_stride[3] = {0, 0, 0};
 
@@ -575,35 +594,16 @@ static void copy_damaged_rect(sl_host_surface* host,
         pixman_image_get_stride(host->current_buffer->shape_image);
   }
 
-  // Enclosing rect after applying scale and offset.
-  x1 = rect->x1 * scale_x + offset_x;
-  y1 = rect->y1 * scale_y + offset_y;
-  x2 = rect->x2 * scale_x + offset_x + 0.5;
-  y2 = rect->y2 * scale_y + offset_y + 0.5;
-
-  x1 = MAX(0, x1);
-  y1 = MAX(0, y1);
-  x2 = MIN(static_cast<int32_t>(host->contents_width), x2);
-  y2 = MIN(static_cast<int32_t>(host->contents_height), y2);
-
-  if (x1 < x2 && y1 < y2) {
-    size_t i;
-
-    for (i = 0; i < num_planes; ++i) {
-      uint8_t* src_base = src_addr + src_offset[i];
-      uint8_t* dst_base = dst_addr + dst_offset[i];
-      uint8_t* src = src_base + y1 * src_stride[i] + x1 * bpp;
-      uint8_t* dst = dst_base + y1 * dst_stride[i] + x1 * bpp;
-      int32_t width = x2 - x1;
-      int32_t height = (y2 - y1) / y_ss[i];
-      size_t bytes = width * bpp;
-
-      while (height--) {
-        memcpy(dst, src, bytes);
-        dst += dst_stride[i];
-        src += src_stride[i];
-      }
-    }
+  for (size_t i = 0; i < num_planes; ++i) {
+    uint8_t* src_base = src_addr + src_offset[i];
+    uint8_t* dst_base = dst_addr + dst_offset[i];
+    uint8_t* src = src_base + rect->y1 * src_stride[i] + rect->x1 * bpp;
+    uint8_t* dst = dst_base + rect->y1 * dst_stride[i] + rect->x1 * bpp;
+    int32_t width = rect->x2 - rect->x1;
+    int32_t height = (rect->y2 - rect->y1) / y_ss[i];
+
+    sl_copy_plane(host->ctx->copy_engine, dst, dst_stride[i], src,
+                  src_stride[i], width * bpp, height);
   }
 }
 
@@ -676,34 +676,31 @@ static void sl_host_surface_commit(struct wl_client* client,
       host->current_buffer->mmap->begin_write(host->current_buffer->mmap->fd,
                                               host->ctx);
 
-    // Copy damaged regions (surface-relative coordinates).
+    // Transform surface damage to buffer coordinates and merge it with the
+    // buffer damage, so that overlapping and adjacent rectangles are
+    // coalesced and no pixel is copied twice.
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
     int n;
     pixman_box32_t* rect =
         pixman_region32_rectangles(&host->current_buffer->surface_damage, &n);
-    while (n--) {
-      TRACE_EVENT("surface",
-                  "sl_host_surface_commit: memcpy_loop (surface damage)");
-      copy_damaged_rect(host, rect, host->contents_shaped, contents_scale_x,
-                        contents_scale_y, wl_fixed_to_double(contents_offset_x),
-                        wl_fixed_to_double(contents_offset_y));
-      ++rect;
-    }
-
-    // Copy damaged regions (buffer-relative coordinates).
-    //
-    // In theory, if we've accumulated both surface damage and buffer damage,
-    // it might be more efficient to first transform and union the regions, so
-    // that we won't ever copy the same pixel twice.
-    // In practice, wl_surface::damage_buffer obsoletes wl_surface::damage, and
-    // it doesn't seem worthwhile to optimize for the edge case in which an app
-    // uses both in the same frame.
+    add_damage_rects(&damage, rect, n, contents_scale_x, contents_scale_y,
+                     wl_fixed_to_double(contents_offset_x),
+                     wl_fixed_to_double(contents_offset_y));
     rect = pixman_region32_rectangles(&host->current_buffer->buffer_damage, &n);
+    add_damage_rects(&damage, rect, n, 1.0, 1.0, 0.0, 0.0);
+    pixman_region32_intersect_rect(&damage, &damage, 0, 0,
+                                   host->contents_width,
+                                   host->contents_height);
+
+    // Copy damaged regions.
+    rect = pixman_region32_rectangles(&damage, &n);
     while (n--) {
-      TRACE_EVENT("surface",
-                  "sl_host_surface_commit: memcpy_loop (buffer damage)");
-      copy_damaged_rect(host, rect, host->contents_shaped, 1.0, 1.0, 0.0, 0.0);
+      TRACE_EVENT("surface", "sl_host_surface_commit: memcpy_loop");
+      copy_damaged_rect(host, rect, host->contents_shaped);
       ++rect;
     }
+    pixman_region32_fini(&damage);
 
     if (host->current_buffer->mmap->end_write)
       host->current_buffer->mmap->end_write(host->current_buffer->mmap->fd,
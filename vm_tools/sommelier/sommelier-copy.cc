@@ -0,0 +1,207 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sommelier-copy.h"  // NOLINT(build/include_directory)
+
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Copies at least this large bypass the cache on the destination side.
+constexpr size_t kNonTemporalThreshold = 256 * 1024;
+
+// Copies at least this large are split across the worker threads, in parts
+// of at least kMinBytesPerPart.
+constexpr size_t kParallelThreshold = 1024 * 1024;
+constexpr size_t kMinBytesPerPart = 256 * 1024;
+
+struct sl_copy_part {
+  uint8_t* dst;
+  size_t dst_stride;
+  const uint8_t* src;
+  size_t src_stride;
+  size_t row_bytes;
+  size_t rows;
+  bool non_temporal;
+};
+
+void sl_copy_span_non_temporal(uint8_t* dst, const uint8_t* src, size_t bytes) {
+#if defined(__SSE2__)
+  // Streaming stores need a 16-byte aligned destination.
+  size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+  head = std::min(head, bytes);
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  bytes -= head;
+
+  while (bytes >= 64) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+    dst += 64;
+    src += 64;
+    bytes -= 64;
+  }
+  while (bytes >= 16) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst),
+                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    dst += 16;
+    src += 16;
+    bytes -= 16;
+  }
+#endif
+  memcpy(dst, src, bytes);
+}
+
+void sl_copy_part_run(const sl_copy_part& part) {
+  uint8_t* dst = part.dst;
+  const uint8_t* src = part.src;
+  size_t row_bytes = part.row_bytes;
+  size_t rows = part.rows;
+
+  // Rows without padding in between are copied as one span.
+  if (part.dst_stride == row_bytes && part.src_stride == row_bytes) {
+    row_bytes *= rows;
+    rows = 1;
+  }
+
+  while (rows--) {
+    if (part.non_temporal)
+      sl_copy_span_non_temporal(dst, src, row_bytes);
+    else
+      memcpy(dst, src, row_bytes);
+    dst += part.dst_stride;
+    src += part.src_stride;
+  }
+
+#if defined(__SSE2__)
+  // Make the streaming stores visible before the copy is reported as done.
+  if (part.non_temporal)
+    _mm_sfence();
+#endif
+}
+
+}  // namespace
+
+struct sl_copy_engine {
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  // Signalled when parts are queued or the engine shuts down.
+  std::condition_variable work_cv;
+  // Signalled when the last outstanding part completes.
+  std::condition_variable done_cv;
+  std::vector<sl_copy_part> queue;
+  size_t outstanding = 0;
+  bool quit = false;
+};
+
+static void sl_copy_engine_worker(struct sl_copy_engine* engine) {
+  std::unique_lock<std::mutex> lock(engine->mutex);
+  for (;;) {
+    engine->work_cv.wait(
+        lock, [engine] { return engine->quit || !engine->queue.empty(); });
+    if (engine->quit)
+      return;
+
+    sl_copy_part part = engine->queue.back();
+    engine->queue.pop_back();
+    lock.unlock();
+    sl_copy_part_run(part);
+    lock.lock();
+
+    if (--engine->outstanding == 0)
+      engine->done_cv.notify_one();
+  }
+}
+
+struct sl_copy_engine* sl_copy_engine_create(int num_threads) {
+  if (num_threads <= 0)
+    return NULL;
+
+  struct sl_copy_engine* engine = new sl_copy_engine();
+  for (int i = 0; i < num_threads; ++i)
+    engine->threads.emplace_back(sl_copy_engine_worker, engine);
+  return engine;
+}
+
+void sl_copy_engine_destroy(struct sl_copy_engine* engine) {
+  if (!engine)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(engine->mutex);
+    engine->quit = true;
+  }
+  engine->work_cv.notify_all();
+  for (auto& thread : engine->threads)
+    thread.join();
+  delete engine;
+}
+
+void sl_copy_plane(struct sl_copy_engine* engine,
+                   uint8_t* dst,
+                   size_t dst_stride,
+                   const uint8_t* src,
+                   size_t src_stride,
+                   size_t row_bytes,
+                   size_t rows) {
+  size_t total = row_bytes * rows;
+  sl_copy_part part;
+  part.dst = dst;
+  part.dst_stride = dst_stride;
+  part.src = src;
+  part.src_stride = src_stride;
+  part.row_bytes = row_bytes;
+  part.rows = rows;
+  part.non_temporal = total >= kNonTemporalThreshold;
+
+  size_t num_parts = 1;
+  if (engine && total >= kParallelThreshold) {
+    num_parts = std::min({engine->threads.size() + 1, rows,
+                          total / kMinBytesPerPart});
+  }
+  if (num_parts <= 1) {
+    sl_copy_part_run(part);
+    return;
+  }
+
+  // Hand all but the first part to the workers, and copy the first part on
+  // the calling thread while they run.
+  size_t rows_per_part = (rows + num_parts - 1) / num_parts;
+  {
+    std::lock_guard<std::mutex> lock(engine->mutex);
+    for (size_t first_row = rows_per_part; first_row < rows;
+         first_row += rows_per_part) {
+      sl_copy_part worker_part = part;
+      worker_part.dst = dst + first_row * dst_stride;
+      worker_part.src = src + first_row * src_stride;
+      worker_part.rows = std::min(rows_per_part, rows - first_row);
+      engine->queue.push_back(worker_part);
+      ++engine->outstanding;
+    }
+  }
+  engine->work_cv.notify_all();
+
+  part.rows = rows_per_part;
+  sl_copy_part_run(part);
+
+  std::unique_lock<std::mutex> lock(engine->mutex);
+  engine->done_cv.wait(lock, [engine] { return engine->outstanding == 0; });
+}
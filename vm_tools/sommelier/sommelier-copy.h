@@ -0,0 +1,35 @@
+// Copyright 2022 The ChromiumOS Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef VM_TOOLS_SOMMELIER_SOMMELIER_COPY_H_
+#define VM_TOOLS_SOMMELIER_SOMMELIER_COPY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pool of worker threads used to split large damage copies. Copies that are
+// too small to benefit from splitting are always done on the calling thread.
+struct sl_copy_engine;
+
+// Creates a copy engine with |num_threads| worker threads in addition to the
+// calling thread. Returns NULL if |num_threads| is not positive, in which case
+// copies are done on the calling thread only.
+struct sl_copy_engine* sl_copy_engine_create(int num_threads);
+void sl_copy_engine_destroy(struct sl_copy_engine* engine);
+
+// Copies |rows| rows of |row_bytes| bytes each from |src| to |dst|.
+//
+// Rows that are laid out contiguously in both buffers are copied as a single
+// span. Large copies use non-temporal stores where available, as the
+// destination is handed to the host compositor and not read back by us, and
+// are split across the worker threads of |engine| (which may be NULL).
+void sl_copy_plane(struct sl_copy_engine* engine,
+                   uint8_t* dst,
+                   size_t dst_stride,
+                   const uint8_t* src,
+                   size_t src_stride,
+                   size_t row_bytes,
+                   size_t rows);
+
+#endif  // VM_TOOLS_SOMMELIER_SOMMELIER_COPY_H_
@@ -180,6 +180,7 @@ void sl_context_init_default(struct sl_context* ctx) {
     ctx->atoms[i].name = name;
   }
   ctx->timing = NULL;
+  ctx->copy_engine = NULL;
   ctx->trace_filename = NULL;
   ctx->enable_xshape = false;
   ctx->trace_system = false;
@@ -182,6 +182,8 @@ struct sl_context {
   xcb_visualid_t visual_ids[256];
   xcb_colormap_t colormaps[256];
   Timing* timing;
+  // Worker pool for damage copies, or NULL to copy on the main thread only.
+  struct sl_copy_engine* copy_engine;
   const char* trace_filename;
   bool enable_xshape;
   bool trace_system;
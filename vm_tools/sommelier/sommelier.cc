@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include "sommelier.h"            // NOLINT(build/include_directory)
+#include "sommelier-copy.h"       // NOLINT(build/include_directory)
 #include "sommelier-tracing.h"    // NOLINT(build/include_directory)
 #include "sommelier-transform.h"  // NOLINT(build/include_directory)
 #include "sommelier-xshape.h"     // NOLINT(build/include_directory)
@@ -3240,6 +3241,15 @@ static void sl_client_destroy_notify(struct wl_listener* listener, void* data) {
   exit(0);
 }
 
+// Copy engine of the context. Sommelier only shuts down by exiting, so the
+// engine is destroyed at exit to join its worker threads.
+static struct sl_copy_engine* sl_exit_copy_engine = NULL;
+
+static void sl_destroy_copy_engine_at_exit() {
+  sl_copy_engine_destroy(sl_exit_copy_engine);
+  sl_exit_copy_engine = NULL;
+}
+
 // Break |str| into a sequence of zero or more nonempty arguments. No more
 // than |argc| arguments will be added to |argv|. Returns the total number of
 // argments found in |str|.
@@ -3316,6 +3326,7 @@ static void sl_print_usage() {
       "  --force-drm-device=DEVICE\tDRM device to use\n"
       "  --glamor\t\t\tUse glamor to accelerate X11 clients\n"
       "  --timing-filename=PATH\tPath to timing output log\n"
+      "  --copy-threads=N\t\tWorker threads for copying large damage\n"
       "  --direct-scale\t\tEnable direct scaling mode\n"
 #ifdef PERFETTO_TRACING
       "  --trace-filename=PATH\t\tPath to Perfetto trace filename\n"
@@ -3534,7 +3545,8 @@ int sl_run_parent(int argc,
             strstr(arg, "--accelerators") == arg ||
             strstr(arg, "--windowed-accelerators") == arg ||
             strstr(arg, "--drm-device") == arg ||
-            strstr(arg, "--support-damage-buffer") == arg) {
+            strstr(arg, "--support-damage-buffer") == arg ||
+            strstr(arg, "--copy-threads") == arg) {
           args[i++] = arg;
         }
       }
@@ -3668,6 +3680,7 @@ int real_main(int argc, char** argv) {
   const char* xfont_path = getenv("SOMMELIER_XFONT_PATH");
   const char* socket_name = "wayland-0";
   bool noop_driver = false;
+  int copy_threads = 0;
   struct wl_event_loop* event_loop;
   struct wl_listener client_destroy_listener = {};
   client_destroy_listener.notify = sl_client_destroy_notify;
@@ -3757,6 +3770,8 @@ int real_main(int argc, char** argv) {
       xfont_path = sl_arg_value(arg);
     } else if (strstr(arg, "--timing-filename") == arg) {
       ctx.timing = new Timing(sl_arg_value(arg));
+    } else if (strstr(arg, "--copy-threads") == arg) {
+      copy_threads = atoi(sl_arg_value(arg));
     } else if (strstr(arg, "--explicit-fence") == arg) {
       ctx.use_explicit_fence = true;
     } else if (strstr(arg, "--enable-xshape") == arg) {
@@ -3805,6 +3820,12 @@ int real_main(int argc, char** argv) {
     }
   }
 
+  ctx.copy_engine = sl_copy_engine_create(copy_threads);
+  if (ctx.copy_engine) {
+    sl_exit_copy_engine = ctx.copy_engine;
+    atexit(sl_destroy_copy_engine_at_exit);
+  }
+
   if (ctx.xwayland) {
     assert(client_fd == -1);
 